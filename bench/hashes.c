@@ -0,0 +1,78 @@
+/* Compare the raw speed of the hash families on URL-like inputs. This doesn't
+ * need redis, and can be built and run from this directory with:
+ *
+ *     gcc -O3 -I../pyreBloom -o hashes hashes.c && ./hashes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "murmur.c"
+#include "murmur_simd.c"
+#include "xxh3.c"
+#include "wyhash.c"
+
+#define NUM_URLS   100000
+#define NUM_ROUNDS 50
+#define NUM_SEEDS  7
+
+static char * urls[NUM_URLS];
+static uint32_t lengths[NUM_URLS];
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Something that looks like a crawled url: a host and a few path components */
+static void make_urls() {
+    const char * alphabet = "abcdefghijklmnopqrstuvwxyz0123456789";
+    uint32_t i, j, length;
+    srand(1);
+    for (i = 0; i < NUM_URLS; ++i) {
+        urls[i] = (char *)(malloc(128));
+        length = snprintf(urls[i], 128, "http://www%i.example%i.com/",
+            rand() % 10, rand() % 1000);
+        for (j = 0; j < (uint32_t)(10 + rand() % 60); ++j) {
+            urls[i][length++] = (j % 9 == 8) ? '/' : alphabet[rand() % 36];
+        }
+        urls[i][length] = '\0';
+        lengths[i] = length;
+    }
+}
+
+int main(int argc, char ** argv) {
+    uint32_t seeds[NUM_SEEDS] = { 1, 2, 3, 4, 5, 6, 7 };
+    uint64_t out[NUM_SEEDS];
+    volatile uint64_t sink = 0;
+    uint32_t i, j, round;
+    double start, total = (double)(NUM_URLS) * NUM_ROUNDS;
+
+    make_urls();
+    printf("Hashing %i urls %i times with %i seeds\n",
+        NUM_URLS, NUM_ROUNDS, NUM_SEEDS);
+
+#define BENCH(name, expr)                                                     \
+    start = -now();                                                           \
+    for (round = 0; round < NUM_ROUNDS; ++round) {                            \
+        for (i = 0; i < NUM_URLS; ++i) {                                      \
+            expr;                                                             \
+            for (j = 0; j < NUM_SEEDS; ++j) { sink += out[j]; }               \
+        }                                                                     \
+    }                                                                         \
+    start += now();                                                           \
+    printf("%-16s: %fs (%f urls / second)\n", name, start, total / start);
+
+    BENCH("murmur64a", for (j = 0; j < NUM_SEEDS; ++j) {
+        out[j] = MurmurHash64A(urls[i], lengths[i], seeds[j]); });
+    BENCH("murmur64a lanes", MurmurHash64A_seeds(
+        urls[i], lengths[i], seeds, NUM_SEEDS, out));
+    BENCH("xxh3", for (j = 0; j < NUM_SEEDS; ++j) {
+        out[j] = XXH3_64bits_withSeed(urls[i], lengths[i], seeds[j]); });
+    BENCH("wyhash", for (j = 0; j < NUM_SEEDS; ++j) {
+        out[j] = wyhash(urls[i], lengths[i], seeds[j]); });
+
+    return 0;
+}
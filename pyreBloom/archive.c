@@ -0,0 +1,716 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "archive.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const uint32_t archive_page_bytes = 4096;
+const uint32_t archive_max_page_bytes = 1 << 16;
+
+/* About how many bytes of a segment are read or written at a time */
+static const uint32_t archive_run_bytes = 1 << 20;
+
+/* How many decompressed pages are kept for reading archived filters */
+static const uint32_t archive_slots = 64;
+
+/* Each page is either kept as it is, or as the gaps between its set bits
+ * (the first from the start of the page), each written as a Rice code: the
+ * gap shifted down by `k` in unary (that many ones and then a zero), and
+ * then its low `k` bits. Codes are written least significant bit first.
+ *
+ *     'r' <page>
+ *     'g' <k> <set bits, 4 bytes little-endian> <codes>
+ *
+ * A page's bits run from the most significant bit of its first byte, as they
+ * do in redis. */
+static const uint32_t archive_header_bytes = 6;
+
+/* Start archiving a filter, unless it already is, by clearing out anything
+ * left behind by an archive that never finished. The filter is recorded as
+ * being archived, in a new epoch, so that any client that adds to it from
+ * then on finds out and cancels the archive. It must still be in the epoch
+ * we last saw it in, or we'd be archiving segments it no longer has.
+ *
+ *     KEYS = { metadata key, archive key }
+ *     ARGV = { epoch }
+ *
+ * It replies with the new epoch, or if the filter is already archived, with
+ * the size of its pages and of its archive, and its epoch. */
+static const char * archive_begin_script =
+    "if redis.call('HGET', KEYS[1], 'state') == 'archived' then\n"
+    "    return redis.call('HMGET', KEYS[1], 'page_bytes', 'archive_bytes',\n"
+    "        'epoch')\n"
+    "end\n"
+    "if (redis.call('HGET', KEYS[1], 'epoch') or '0') ~= ARGV[1] then\n"
+    "    return redis.error_reply(KEYS[1] ..\n"
+    "        ' changed while it was being archived; try again')\n"
+    "end\n"
+    "redis.call('DEL', KEYS[2])\n"
+    "redis.call('HSET', KEYS[1], 'state', 'archiving')\n"
+    "return redis.call('HINCRBY', KEYS[1], 'epoch', 1)";
+
+/* Record that a filter is archived, moving it on to a new epoch, and delete
+ * its segments, unless another client finished archiving it first. If
+ * anything was added since the archive began, it was cancelled, and what's
+ * been written of it is thrown away, unless another archive has since begun.
+ *
+ *     KEYS = { metadata key, archive key, segment keys... }
+ *     ARGV = { page bytes, archive bytes, epoch the archive began in }
+ *
+ * It replies with the size of the pages and of the archive, and the epoch,
+ * as recorded. */
+static const char * archive_finish_script =
+    "local state = redis.call('HGET', KEYS[1], 'state')\n"
+    "if state ~= 'archived' then\n"
+    "    if state ~= 'archiving' or\n"
+    "        redis.call('HGET', KEYS[1], 'epoch') ~= ARGV[3] then\n"
+    "        if state ~= 'archiving' then\n"
+    "            redis.call('DEL', KEYS[2])\n"
+    "        end\n"
+    "        return redis.error_reply(KEYS[1] ..\n"
+    "            ' changed while it was being archived; try again')\n"
+    "    end\n"
+    "    redis.call('HSET', KEYS[1], 'state', 'archived', 'page_bytes',\n"
+    "        ARGV[1], 'archive_bytes', ARGV[2])\n"
+    "    redis.call('HINCRBY', KEYS[1], 'epoch', 1)\n"
+    "    for i = 3, #KEYS do\n"
+    "        redis.call('DEL', KEYS[i])\n"
+    "    end\n"
+    "end\n"
+    "return redis.call('HMGET', KEYS[1], 'page_bytes', 'archive_bytes',\n"
+    "    'epoch')";
+
+/* Cancel an archive that's under way, along with whatever it's written so
+ * far, since it may already have read the bits we're about to set
+ *
+ *     KEYS = { metadata key, archive key }
+ *
+ * It replies with the filter's state, the size of its pages and its epoch,
+ * which say whether it had already been archived. */
+static const char * archive_cancel_script =
+    "if redis.call('HGET', KEYS[1], 'state') == 'archiving' then\n"
+    "    redis.call('HDEL', KEYS[1], 'state')\n"
+    "    redis.call('HINCRBY', KEYS[1], 'epoch', 1)\n"
+    "    redis.call('DEL', KEYS[2])\n"
+    "end\n"
+    "return redis.call('HMGET', KEYS[1], 'state', 'page_bytes', 'epoch')";
+
+/* Write a run of decompressed pages back into a segment, as long as the
+ * filter is still archived. Once it isn't, whoever rehydrated it has already
+ * written every page, and bits set since then mustn't be overwritten.
+ *
+ *     KEYS = { metadata key, segment key }
+ *     ARGV = { offset, page, offset, page, ... }
+ *
+ * It replies with whether the pages were written. */
+static const char * rehydrate_script =
+    "if redis.call('HGET', KEYS[1], 'state') ~= 'archived' then\n"
+    "    return 0\n"
+    "end\n"
+    "for i = 1, #ARGV, 2 do\n"
+    "    redis.call('SETRANGE', KEYS[2], ARGV[i], ARGV[i + 1])\n"
+    "end\n"
+    "return 1";
+
+/* Once every page is back in its segment, it's an ordinary filter again, in
+ * a new epoch, which it replies with
+ *
+ *     KEYS = { metadata key, archive key } */
+static const char * rehydrate_finish_script =
+    "if redis.call('HGET', KEYS[1], 'state') == 'archived' then\n"
+    "    redis.call('HDEL', KEYS[1], 'state', 'page_bytes', 'archive_bytes')\n"
+    "    redis.call('HINCRBY', KEYS[1], 'epoch', 1)\n"
+    "    redis.call('DEL', KEYS[2])\n"
+    "end\n"
+    "return redis.call('HGET', KEYS[1], 'epoch')";
+
+static int archive_error(pyrebloomctxt * ctxt, const char * message) {
+    if (message != ctxt->ctxt->errstr) {
+        strncpy(ctxt->ctxt->errstr, message, errstr_size);
+    }
+    return PYREBLOOM_ERROR;
+}
+
+/* Make sure that there was a reply and that it isn't an error, recording
+ * why not otherwise */
+static redisReply * archive_reply(pyrebloomctxt * ctxt, redisReply * reply) {
+    if (reply == NULL) {
+        archive_error(ctxt, ctxt->ctxt->errstr);
+        return NULL;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        archive_error(ctxt, reply->str);
+        freeReplyObject(reply);
+        return NULL;
+    }
+    return reply;
+}
+
+/* Our own change moved the filter on to `epoch`, which we can take as ours
+ * only if nothing else has changed it since we last read its metadata.
+ * Otherwise the next fence finds us stale. */
+static void archive_epoch(pyrebloomctxt * ctxt, uint64_t epoch) {
+    if (epoch == ctxt->epoch + 1) {
+        ctxt->epoch = epoch;
+    }
+}
+
+/* Take the size of the pages and of the archive, and the epoch, from the
+ * metadata */
+static int archive_recorded(pyrebloomctxt * ctxt, redisReply * reply,
+    uint64_t * size) {
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 3 ||
+        reply->element[0]->type != REDIS_REPLY_STRING ||
+        reply->element[1]->type != REDIS_REPLY_STRING) {
+        return archive_error(ctxt, "Malformed archive metadata");
+    }
+    ctxt->archived   = 1;
+    ctxt->page_bytes = (uint32_t)(strtoul(reply->element[0]->str, NULL, 10));
+    *size            = strtoull(reply->element[1]->str, NULL, 10);
+    if (reply->element[2]->type == REDIS_REPLY_STRING) {
+        archive_epoch(ctxt, strtoull(reply->element[2]->str, NULL, 10));
+    }
+    return PYREBLOOM_OK;
+}
+
+/* How many bytes the p-th page of the i-th key has, the last being short */
+static uint32_t page_length(pyrebloomctxt * ctxt, uint32_t i, uint64_t p) {
+    uint64_t bytes = (key_bits(ctxt, i) + 7) / 8 - p * ctxt->page_bytes;
+    return (bytes < ctxt->page_bytes) ? (uint32_t)(bytes) : ctxt->page_bytes;
+}
+
+/* The bits of a Rice coding of `count` gaps with parameter k */
+static uint64_t rice_bits(const uint32_t * gaps, uint32_t count, uint32_t k) {
+    uint64_t bits = (uint64_t)(count) * (k + 1);
+    uint32_t i;
+    for (i = 0; i < count; ++i) {
+        bits += gaps[i] >> k;
+    }
+    return bits;
+}
+
+/* Compress a page with at least one bit set into `out`, which has room for
+ * archive_header_bytes more than the page, returning how long it is. `gaps`
+ * has room for one for every bit of the page. */
+static size_t encode_page(const unsigned char * page, uint32_t bytes,
+    uint32_t * gaps, unsigned char * out) {
+    uint32_t i, j, q, count = 0, last = 0, k, mean = 0, best = 0;
+    uint64_t size, least = 0, total = 0, at = 0;
+
+    for (i = 0; i < bytes; ++i) {
+        for (j = 0; page[i] && j < 8; ++j) {
+            if (page[i] & (0x80 >> j)) {
+                gaps[count] = i * 8 + j - last;
+                total += gaps[count++];
+                last = i * 8 + j + 1;
+            }
+        }
+    }
+    /* The best k is close to log2 of the mean gap, so try either side of it */
+    while (((uint64_t)(2) << mean) * count <= total) {
+        ++mean;
+    }
+    for (k = (mean > 0) ? mean - 1 : 0; k <= mean + 1; ++k) {
+        size = rice_bits(gaps, count, k);
+        if (least == 0 || size < least) {
+            least = size;
+            best  = k;
+        }
+    }
+    if (archive_header_bytes + (least + 7) / 8 >= 1 + (uint64_t)(bytes)) {
+        out[0] = 'r';
+        memcpy(out + 1, page, bytes);
+        return 1 + bytes;
+    }
+
+    out[0] = 'g';
+    out[1] = (unsigned char)(best);
+    for (i = 0; i < 4; ++i) {
+        out[2 + i] = (unsigned char)(count >> (8 * i));
+    }
+    out += archive_header_bytes;
+    memset(out, 0, (least + 7) / 8);
+    for (i = 0; i < count; ++i) {
+        for (q = gaps[i] >> best; q > 0; --q, ++at) {
+            out[at >> 3] |= 1 << (at & 7);
+        }
+        /* The zero that ends the unary part */
+        ++at;
+        for (j = 0; j < best; ++j, ++at) {
+            out[at >> 3] |= ((gaps[i] >> j) & 1) << (at & 7);
+        }
+    }
+    return archive_header_bytes + (least + 7) / 8;
+}
+
+/* Decompress a page of `bytes` bytes */
+static int decode_page(const unsigned char * in, size_t length,
+    unsigned char * page, uint32_t bytes) {
+    uint64_t at = 0, total, bit = 0, gap;
+    uint32_t i, j, k, count = 0;
+
+    memset(page, 0, bytes);
+    if (length >= 1 && in[0] == 'r') {
+        memcpy(page, in + 1, (length - 1 < bytes) ? length - 1 : bytes);
+        return PYREBLOOM_OK;
+    }
+    if (length < archive_header_bytes || in[0] != 'g' || in[1] > 32) {
+        return PYREBLOOM_ERROR;
+    }
+    k = in[1];
+    for (i = 0; i < 4; ++i) {
+        count |= (uint32_t)(in[2 + i]) << (8 * i);
+    }
+    total = (uint64_t)(length - archive_header_bytes) * 8;
+    in += archive_header_bytes;
+    for (i = 0; i < count; ++i) {
+        for (gap = 0; at < total && ((in[at >> 3] >> (at & 7)) & 1); ++at) {
+            ++gap;
+        }
+        if (at + 1 + k > total) {
+            return PYREBLOOM_ERROR;
+        }
+        gap <<= k;
+        for (++at, j = 0; j < k; ++j, ++at) {
+            gap |= (uint64_t)((in[at >> 3] >> (at & 7)) & 1) << j;
+        }
+        bit += gap;
+        if (bit >= (uint64_t)(bytes) * 8) {
+            return PYREBLOOM_ERROR;
+        }
+        page[bit >> 3] |= 0x80 >> (bit & 7);
+        ++bit;
+    }
+    return PYREBLOOM_OK;
+}
+
+int archive(pyrebloomctxt * ctxt, uint32_t page_bytes, uint64_t * size) {
+    redisReply * reply = NULL;
+    unsigned char * raw = NULL, * encoded = NULL, * out = NULL;
+    uint32_t * gaps = NULL;
+    char * fields = NULL, * field = NULL;
+    const char ** argv = NULL;
+    size_t * argvlen = NULL;
+    uint64_t bytes, pages, page, start, end;
+    uint32_t i, j, k, count, argc, length, run, most;
+    uint64_t begun;
+    char args[4][24];
+    int failed = 0;
+
+    *size = 0;
+    if (ctxt->layout == PYREBLOOM_LAYOUT_SPARSE) {
+        return archive_error(ctxt, "Sparse filters are already compact");
+    }
+    if (page_bytes == 0 || page_bytes > archive_max_page_bytes) {
+        return archive_error(ctxt,
+            "Archived pages must be between 1 byte and 64KB");
+    }
+    reply = archive_reply(ctxt, redisCommand(ctxt->ctxt,
+        "EVAL %s 2 %s %s %lu", archive_begin_script, ctxt->meta_key,
+        ctxt->archive_key, ctxt->epoch));
+    if (reply == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ARRAY) {
+        failed = (archive_recorded(ctxt, reply, size) == PYREBLOOM_ERROR);
+        freeReplyObject(reply);
+        return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+    }
+    begun = (uint64_t)(reply->integer);
+    archive_epoch(ctxt, begun);
+    freeReplyObject(reply);
+
+    ctxt->page_bytes = page_bytes;
+    run     = archive_run_bytes / page_bytes;
+    raw     = (unsigned char *)(malloc((size_t)(run) * page_bytes));
+    encoded = (unsigned char *)(malloc(
+        (size_t)(run) * (page_bytes + archive_header_bytes)));
+    gaps    = (uint32_t *)(malloc((size_t)(page_bytes) * 8 * sizeof(uint32_t)));
+    fields  = (char *)(malloc((size_t)(run) * 32));
+    most    = (2 + 2 * run > 8 + ctxt->num_keys) ?
+        2 + 2 * run : 8 + ctxt->num_keys;
+    argv    = (const char **)(malloc(most * sizeof(char *)));
+    argvlen = (size_t *)(malloc(most * sizeof(size_t)));
+
+    /* Every page that has any bits set is compressed and written to the
+     * archive, a run of them at a time */
+    argv[0]    = "HSET";
+    argv[1]    = ctxt->archive_key;
+    argvlen[0] = strlen(argv[0]);
+    argvlen[1] = strlen(argv[1]);
+    for (i = 0; i < ctxt->num_keys && !failed; ++i) {
+        bytes = (key_bits(ctxt, i) + 7) / 8;
+        pages = (bytes + page_bytes - 1) / page_bytes;
+        for (page = 0; page < pages; page += count) {
+            count = (pages - page < run) ? (uint32_t)(pages - page) : run;
+            start = page * page_bytes;
+            end   = start + (uint64_t)(count) * page_bytes;
+            end   = (end < bytes) ? end : bytes;
+            reply = archive_reply(ctxt, redisCommand(ctxt->ctxt,
+                "GETRANGE %s %lu %lu", ctxt->keys[i], start, end - 1));
+            if (reply == NULL) {
+                failed = 1;
+                break;
+            }
+            /* Segments stop at their last byte that's been set */
+            memset(raw, 0, end - start);
+            if (reply->type == REDIS_REPLY_STRING) {
+                memcpy(raw, reply->str, (reply->len < end - start) ?
+                    reply->len : end - start);
+            }
+            freeReplyObject(reply);
+
+            for (j = 0, argc = 2; j < count; ++j) {
+                length = page_length(ctxt, i, page + j);
+                for (k = 0; k < length && !raw[j * page_bytes + k]; ++k);
+                if (k == length) {
+                    continue;
+                }
+                field = fields + 32 * j;
+                out   = encoded + j * (page_bytes + archive_header_bytes);
+                snprintf(field, 32, "%u:%lu", i, page + j);
+                argv[argc]      = field;
+                argvlen[argc++] = strlen(field);
+                argv[argc]      = (const char *)(out);
+                argvlen[argc++] = encode_page(raw + j * page_bytes, length,
+                    gaps, out);
+                *size += argvlen[argc - 1];
+            }
+            if (argc > 2) {
+                reply = archive_reply(ctxt, redisCommandArgv(ctxt->ctxt, argc,
+                    argv, argvlen));
+                if (reply == NULL) {
+                    failed = 1;
+                    break;
+                }
+                freeReplyObject(reply);
+            }
+        }
+    }
+
+    /* And only then are the segments deleted, if nothing was added since */
+    if (!failed) {
+        snprintf(args[0], 24, "%u", ctxt->num_keys + 2);
+        snprintf(args[1], 24, "%u", page_bytes);
+        snprintf(args[2], 24, "%lu", *size);
+        snprintf(args[3], 24, "%lu", begun);
+        argc = 0;
+        argv[argc++] = "EVAL";
+        argv[argc++] = archive_finish_script;
+        argv[argc++] = args[0];
+        argv[argc++] = ctxt->meta_key;
+        argv[argc++] = ctxt->archive_key;
+        for (i = 0; i < ctxt->num_keys; ++i) {
+            argv[argc++] = ctxt->keys[i];
+        }
+        argv[argc++] = args[1];
+        argv[argc++] = args[2];
+        argv[argc++] = args[3];
+        for (i = 0; i < argc; ++i) {
+            argvlen[i] = strlen(argv[i]);
+        }
+        reply = archive_reply(ctxt, redisCommandArgv(ctxt->ctxt, argc, argv,
+            argvlen));
+        if (reply == NULL) {
+            failed = 1;
+        } else {
+            failed = (archive_recorded(ctxt, reply, size) == PYREBLOOM_ERROR);
+            freeReplyObject(reply);
+        }
+    }
+
+    free(raw);
+    free(encoded);
+    free(gaps);
+    free(fields);
+    free(argv);
+    free(argvlen);
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+/* Cancel the archive another client has under way. If it has just finished,
+ * the filter is archived after all, and needs rehydrating. */
+static int archive_cancel(pyrebloomctxt * ctxt) {
+    redisReply * reply = archive_reply(ctxt, redisCommand(ctxt->ctxt,
+        "EVAL %s 2 %s %s", archive_cancel_script, ctxt->meta_key,
+        ctxt->archive_key));
+    if (reply == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 3) {
+        freeReplyObject(reply);
+        return archive_error(ctxt, "Malformed archive metadata");
+    }
+    ctxt->archiving = 0;
+    if (reply->element[0]->type == REDIS_REPLY_STRING &&
+        strcmp(reply->element[0]->str, "archived") == 0 &&
+        reply->element[1]->type == REDIS_REPLY_STRING) {
+        ctxt->archived   = 1;
+        ctxt->page_bytes = (uint32_t)(
+            strtoul(reply->element[1]->str, NULL, 10));
+    }
+    if (reply->element[2]->type == REDIS_REPLY_STRING) {
+        archive_epoch(ctxt, strtoull(reply->element[2]->str, NULL, 10));
+    }
+    freeReplyObject(reply);
+    return PYREBLOOM_OK;
+}
+
+int rehydrate(pyrebloomctxt * ctxt) {
+    redisReply * reply = NULL, * element = NULL;
+    unsigned char * raw = NULL, * out = NULL;
+    char * fields = NULL;
+    const char ** argv = NULL;
+    size_t * argvlen = NULL;
+    uint64_t pages, page;
+    uint32_t i, j, count, argc, length, run, page_bytes;
+    int failed = 0, done = 0;
+
+    if (ctxt->archiving && archive_cancel(ctxt) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (!ctxt->archived) {
+        return PYREBLOOM_OK;
+    }
+    page_bytes = ctxt->page_bytes;
+    if (page_bytes == 0 || page_bytes > archive_max_page_bytes) {
+        return archive_error(ctxt, "Malformed archive metadata");
+    }
+    run     = archive_run_bytes / page_bytes;
+    raw     = (unsigned char *)(malloc((size_t)(run) * page_bytes));
+    fields  = (char *)(malloc((size_t)(run) * 32));
+    argv    = (const char **)(malloc((5 + 2 * run) * sizeof(char *)));
+    argvlen = (size_t *)(malloc((5 + 2 * run) * sizeof(size_t)));
+
+    for (i = 0; i < ctxt->num_keys && !failed && !done; ++i) {
+        pages = ((key_bits(ctxt, i) + 7) / 8 + page_bytes - 1) / page_bytes;
+        for (page = 0; page < pages && !done; page += count) {
+            count = (pages - page < run) ? (uint32_t)(pages - page) : run;
+            argv[0] = "HMGET";
+            argv[1] = ctxt->archive_key;
+            for (j = 0; j < count; ++j) {
+                snprintf(fields + 32 * j, 32, "%u:%lu", i, page + j);
+                argv[2 + j] = fields + 32 * j;
+            }
+            for (j = 0; j < 2 + count; ++j) {
+                argvlen[j] = strlen(argv[j]);
+            }
+            reply = archive_reply(ctxt, redisCommandArgv(ctxt->ctxt,
+                2 + count, argv, argvlen));
+            if (reply == NULL || reply->type != REDIS_REPLY_ARRAY ||
+                reply->elements != count) {
+                if (reply != NULL) {
+                    archive_error(ctxt, "Malformed archive");
+                    freeReplyObject(reply);
+                }
+                failed = 1;
+                break;
+            }
+
+            /* Pages that aren't in the archive had no bits set */
+            argv[0] = "EVAL";
+            argv[1] = rehydrate_script;
+            argv[2] = "2";
+            argv[3] = ctxt->meta_key;
+            argv[4] = ctxt->keys[i];
+            for (j = 0, argc = 5; j < count; ++j) {
+                element = reply->element[j];
+                if (element->type != REDIS_REPLY_STRING) {
+                    continue;
+                }
+                length = page_length(ctxt, i, page + j);
+                out    = raw + j * page_bytes;
+                if (decode_page((const unsigned char *)(element->str),
+                    element->len, out, length) == PYREBLOOM_ERROR) {
+                    archive_error(ctxt, "Malformed archived page");
+                    failed = 1;
+                    break;
+                }
+                /* Nor does the segment need any zeros past its last bit */
+                while (length > 0 && out[length - 1] == 0) {
+                    --length;
+                }
+                snprintf(fields + 32 * j, 32, "%lu", (page + j) * page_bytes);
+                argv[argc]      = fields + 32 * j;
+                argvlen[argc++] = strlen(fields + 32 * j);
+                argv[argc]      = (const char *)(out);
+                argvlen[argc++] = length;
+            }
+            freeReplyObject(reply);
+            if (failed) {
+                break;
+            }
+            if (argc > 5) {
+                for (j = 0; j < 5; ++j) {
+                    argvlen[j] = strlen(argv[j]);
+                }
+                reply = archive_reply(ctxt, redisCommandArgv(ctxt->ctxt, argc,
+                    argv, argvlen));
+                if (reply == NULL) {
+                    failed = 1;
+                    break;
+                }
+                /* Someone else has already rehydrated it */
+                done = (reply->integer == 0);
+                freeReplyObject(reply);
+            }
+        }
+    }
+
+    if (!failed) {
+        reply = archive_reply(ctxt, redisCommand(ctxt->ctxt,
+            "EVAL %s 2 %s %s", rehydrate_finish_script, ctxt->meta_key,
+            ctxt->archive_key));
+        failed = (reply == NULL);
+        if (!failed && reply->type == REDIS_REPLY_STRING) {
+            archive_epoch(ctxt, strtoull(reply->str, NULL, 10));
+        }
+        freeReplyObject(reply);
+    }
+    if (!failed) {
+        ctxt->archived = 0;
+        free(ctxt->pages);
+        free(ctxt->page_ids);
+        ctxt->pages    = NULL;
+        ctxt->page_ids = NULL;
+    }
+
+    free(raw);
+    free(fields);
+    free(argv);
+    free(argvlen);
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+/* Which key, and which bit of it, an item's i-th offset falls on */
+static void archive_locate(pyrebloomctxt * ctxt, uint32_t i, uint32_t * key,
+    uint64_t * bit) {
+    uint64_t d = ctxt->offsets[i];
+    *key = (uint32_t)(d / ctxt->segment_bits);
+    *bit = d % ctxt->segment_bits;
+    if (ctxt->layout == PYREBLOOM_LAYOUT_PARTITIONED) {
+        *key += i * ctxt->slice_segments;
+    }
+}
+
+/* The slot a page is kept in, once it's been decompressed */
+static uint32_t archive_slot(uint64_t id) {
+    return (uint32_t)(((id * 0x9E3779B97F4A7C15ULL) >> 32) % archive_slots);
+}
+
+static int archive_bit(pyrebloomctxt * ctxt, uint32_t slot, uint64_t bit) {
+    unsigned char byte = ctxt->pages[(uint64_t)(slot) * ctxt->page_bytes +
+        (bit / 8) % ctxt->page_bytes];
+    return (byte >> (7 - bit % 8)) & 1;
+}
+
+int archive_check(pyrebloomctxt * ctxt, const char * data, uint32_t len) {
+    redisReply * reply = NULL, * element = NULL;
+    const char ** argv = NULL;
+    size_t * argvlen = NULL;
+    uint32_t * pending = NULL;
+    char * fields = NULL;
+    uint64_t id, bit;
+    uint32_t i, j, key, slot, missing = 0;
+    int result = 1;
+
+    if (ctxt->pages == NULL) {
+        ctxt->pages    = (unsigned char *)(
+            malloc((size_t)(archive_slots) * ctxt->page_bytes));
+        ctxt->page_ids = (uint64_t *)(
+            malloc(archive_slots * sizeof(uint64_t)));
+        for (slot = 0; slot < archive_slots; ++slot) {
+            ctxt->page_ids[slot] = UINT64_MAX;
+        }
+    }
+
+    /* Any bit in a page we already have can rule the item out */
+    hash_offsets(ctxt, data, len);
+    pending = (uint32_t *)(malloc(ctxt->hashes * sizeof(uint32_t)));
+    for (i = 0; i < ctxt->hashes && result == 1; ++i) {
+        archive_locate(ctxt, i, &key, &bit);
+        id   = ((uint64_t)(key) << 32) | (bit / 8 / ctxt->page_bytes);
+        slot = archive_slot(id);
+        if (ctxt->page_ids[slot] == id) {
+            result = archive_bit(ctxt, slot, bit);
+        } else {
+            pending[missing++] = i;
+        }
+    }
+
+    /* And the rest are fetched all at once */
+    if (result == 1 && missing > 0) {
+        fields  = (char *)(malloc(missing * 32));
+        argv    = (const char **)(malloc((2 + missing) * sizeof(char *)));
+        argvlen = (size_t *)(malloc((2 + missing) * sizeof(size_t)));
+        argv[0] = "HMGET";
+        argv[1] = ctxt->archive_key;
+        for (j = 0; j < missing; ++j) {
+            archive_locate(ctxt, pending[j], &key, &bit);
+            snprintf(fields + 32 * j, 32, "%u:%lu", key,
+                bit / 8 / ctxt->page_bytes);
+            argv[2 + j] = fields + 32 * j;
+        }
+        for (j = 0; j < 2 + missing; ++j) {
+            argvlen[j] = strlen(argv[j]);
+        }
+        reply = archive_reply(ctxt, redisCommandArgv(ctxt->ctxt, 2 + missing,
+            argv, argvlen));
+        if (reply == NULL) {
+            result = PYREBLOOM_ERROR;
+        } else if (reply->type != REDIS_REPLY_ARRAY ||
+            reply->elements != missing) {
+            result = archive_error(ctxt, "Malformed archive");
+        }
+        for (j = 0; j < missing && result == 1; ++j) {
+            archive_locate(ctxt, pending[j], &key, &bit);
+            id      = ((uint64_t)(key) << 32) | (bit / 8 / ctxt->page_bytes);
+            slot    = archive_slot(id);
+            element = reply->element[j];
+            /* Pages that aren't in the archive had no bits set */
+            if (element->type != REDIS_REPLY_STRING) {
+                memset(ctxt->pages + (uint64_t)(slot) * ctxt->page_bytes, 0,
+                    ctxt->page_bytes);
+            } else if (decode_page((const unsigned char *)(element->str),
+                element->len,
+                ctxt->pages + (uint64_t)(slot) * ctxt->page_bytes,
+                page_length(ctxt, key, bit / 8 / ctxt->page_bytes)) ==
+                PYREBLOOM_ERROR) {
+                ctxt->page_ids[slot] = UINT64_MAX;
+                result = archive_error(ctxt, "Malformed archived page");
+                break;
+            }
+            ctxt->page_ids[slot] = id;
+            result = archive_bit(ctxt, slot, bit);
+        }
+        freeReplyObject(reply);
+        free(fields);
+        free(argv);
+        free(argvlen);
+    }
+    free(pending);
+    return result;
+}
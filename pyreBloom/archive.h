@@ -0,0 +1,75 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+
+#ifndef PYRE_ARCHIVE_H
+#define PYRE_ARCHIVE_H
+
+#include "bloom.h"
+
+/* Filters that have gone cold can be archived: each segment is read a page
+ * at a time, compressed, and written to a hash at `<key>.archive` (with a
+ * field `<segment>:<page>` for every page that has any bits set), and then
+ * the segments are deleted and the metadata records the filter's state as
+ * archived, along with the size of its pages and of the archive.
+ *
+ * Bloom filters that are anywhere near full are close to random, and so
+ * compress poorly; it's the ones that never filled up that shrink the most.
+ * Pages are compressed as the gaps between their set bits, which is close to
+ * as small as random bits of that fill can get, and pages that wouldn't get
+ * any smaller are kept as they are.
+ *
+ * An archived filter can be rehydrated, its pages written back into its
+ * segments, after which it's an ordinary filter again. It can also be read
+ * where it is, by fetching and decompressing only the pages an item's bits
+ * fall in. Archiving and rehydrating both move the filter on to a new epoch,
+ * so clients that already have it open find out from the fence behind their
+ * next batch of adds or checks.
+ *
+ * While a filter is being archived, its metadata records it as archiving,
+ * and any client that adds to it cancels the archive before it does, since
+ * the archive may already have read the bits it's about to set. Archiving
+ * then fails rather than deleting the segments, and can be tried again. */
+
+/* The size of the pages filters are archived in, by default and at most */
+extern const uint32_t archive_page_bytes;
+extern const uint32_t archive_max_page_bytes;
+
+/* Archive a filter, reporting how many bytes its archive takes. Archiving a
+ * filter that's already archived does nothing. */
+int archive(pyrebloomctxt * ctxt, uint32_t page_bytes, uint64_t * size);
+
+/* Write an archived filter's pages back into its segments, and mark it as
+ * an ordinary filter again. If another client gets there first, whatever's
+ * left is left to them. A filter that another client is archiving has its
+ * archive cancelled instead. */
+int rehydrate(pyrebloomctxt * ctxt);
+
+/* Check whether an item is in an archived filter, without rehydrating it.
+ * Pages are kept decompressed in a few slots, so items whose bits fall in
+ * the pages of earlier ones don't go to redis at all. */
+int archive_check(pyrebloomctxt * ctxt, const char * data, uint32_t len);
+
+#endif
@@ -25,36 +25,353 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <time.h>
 
 const uint32_t max_bits_per_key = 0xFFFFFFFF;
 
+/* Sharded filters have one segment for about every 128KB */
+const uint32_t shard_bits = 1 << 20;
+
+/* From murmur_simd.c */
+void MurmurHash64A_seeds(const void * key, uint32_t len,
+    const uint32_t * seeds, uint32_t count, uint64_t * out);
+
+/* From xxh3.c and wyhash.c */
+uint64_t XXH3_64bits_withSeed(const void * key, uint32_t len, uint64_t seed);
+uint64_t wyhash(const void * key, uint32_t len, uint64_t seed);
+
+/* The version of the metadata layout kept in the `<key>.meta` hash */
+const uint32_t metadata_version = 2;
+
+/* Load the description of a filter, or record it if this is the first client
+ * to create it. Whatever is recorded wins over what the client asked for, so
+ * every client agrees on the bits, hashes, segments and hash family. Filters
+ * that predate the metadata (their first segment exists but there's no
+ * metadata) were necessarily built with MurmurHash64A, the standard layout
+ * and the original sizing, whatever else the client asked for, and filters
+ * whose metadata records only their hash were built with that hash and the
+ * original sizing. A capacity of 0 means the caller expects the filter to
+ * already exist. Other structures keep their metadata in the same place, so
+ * we make sure this one is a bloom.
+ *
+ *     KEYS = { metadata key, first segment key }
+ *     ARGV = { capacity, error, bits, hashes, segment bits, hash family,
+ *              layout, metadata version, and the original sizing's bits,
+ *              hashes and segment bits }
+ *
+ * It replies with those same fields, as recorded, and for a filter that
+ * already existed, its state, the size of its pages if it's archived and its
+ * epoch. */
+static const char * metadata_script =
+    "local fields = {'capacity', 'error', 'bits', 'hashes', 'segment_bits',\n"
+    "    'hash', 'layout', 'version'}\n"
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind and kind ~= 'bloom' then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' .. kind)\n"
+    "end\n"
+    "local meta = redis.call('HMGET', KEYS[1], unpack(fields))\n"
+    "if meta[3] then\n"
+    "    meta[9] = redis.call('HGET', KEYS[1], 'state')\n"
+    "    meta[10] = redis.call('HGET', KEYS[1], 'page_bytes')\n"
+    "    meta[11] = redis.call('HGET', KEYS[1], 'epoch')\n"
+    "    return meta\n"
+    "end\n"
+    "if ARGV[1] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; capacity and error are required')\n"
+    "end\n"
+    "local legacy = meta[6] or redis.call('EXISTS', KEYS[2]) == 1\n"
+    "if legacy then\n"
+    "    ARGV[3], ARGV[4], ARGV[5] = ARGV[9], ARGV[10], ARGV[11]\n"
+    "    ARGV[6] = meta[6] or '0'\n"
+    "    ARGV[7] = '0'\n"
+    "end\n"
+    "redis.call('HSET', KEYS[1], 'type', 'bloom')\n"
+    "for i, field in ipairs(fields) do\n"
+    "    redis.call('HSET', KEYS[1], field, ARGV[i])\n"
+    "end\n"
+    "return {unpack(ARGV, 1, 8)}";
+
+/* Fold a standard filter in half, ORing the upper half of its bits into the
+ * lower half. A filter of several segments folds its upper segments into its
+ * lower ones; a filter of one segment has its halves copied out and ORed back
+ * into it. Either way the segments keep their size and names, and the
+ * filter moves on to a new epoch, which it replies with. It must still be in
+ * the epoch we last saw it in, and not be archived or being archived.
+ *
+ *     KEYS = { metadata key, two scratch keys, segment keys... }
+ *     ARGV = { bits as read, bits once folded, epoch } */
+static const char * fold_script =
+    "if redis.call('HGET', KEYS[1], 'bits') ~= ARGV[1] or\n"
+    "    (redis.call('HGET', KEYS[1], 'epoch') or '0') ~= ARGV[3] or\n"
+    "    redis.call('HEXISTS', KEYS[1], 'state') == 1 then\n"
+    "    return redis.error_reply(KEYS[1] ..\n"
+    "        ' changed while it was being folded; try again')\n"
+    "end\n"
+    "local n = #KEYS - 3\n"
+    "if n > 1 then\n"
+    "    for i = 4, 3 + n / 2 do\n"
+    "        redis.call('BITOP', 'OR', KEYS[i], KEYS[i], KEYS[i + n / 2])\n"
+    "        redis.call('DEL', KEYS[i + n / 2])\n"
+    "    end\n"
+    "else\n"
+    "    local half = tonumber(ARGV[2]) / 8\n"
+    "    redis.call('SET', KEYS[2], redis.call('GETRANGE', KEYS[4], 0,\n"
+    "        half - 1))\n"
+    "    redis.call('SET', KEYS[3], redis.call('GETRANGE', KEYS[4], half,\n"
+    "        2 * half - 1))\n"
+    "    redis.call('BITOP', 'OR', KEYS[4], KEYS[2], KEYS[3])\n"
+    "    redis.call('DEL', KEYS[2], KEYS[3])\n"
+    "end\n"
+    "redis.call('HSET', KEYS[1], 'bits', ARGV[2])\n"
+    "return redis.call('HINCRBY', KEYS[1], 'epoch', 1)";
+
+/* Cut a segment back to its length, dropping any bits that a stale client
+ * set past the end of a filter that had since been folded
+ *
+ *     KEYS = { segment key }
+ *     ARGV = { bytes } */
+static const char * trim_script =
+    "if redis.call('STRLEN', KEYS[1]) > tonumber(ARGV[1]) then\n"
+    "    redis.call('SET', KEYS[1],\n"
+    "        redis.call('GETRANGE', KEYS[1], 0, ARGV[1] - 1))\n"
+    "end\n"
+    "return redis.status_reply('OK')";
+
+/* A sparse filter keeps the offsets of its bits in a set, which redis packs
+ * into a sorted array of integers while it's small, and only becomes a
+ * bitmap once it's no longer smaller than one. Every client goes through
+ * this script until then, and adds and checks go to whichever is there. When
+ * it converts, the filter is recorded as a standard one, so that clients that
+ * open it afterwards skip the script altogether.
+ *
+ *     KEYS = { metadata key, sparse key, first segment key }
+ *     ARGV = { 'add' or 'check', the most offsets to keep sparse, offsets... }
+ *
+ * Adding replies with how many of the item's bits were already set, and
+ * checking with whether they all were. */
+static const char * sparse_script =
+    "local hits, n = 0, #ARGV - 2\n"
+    "local adding = (ARGV[1] == 'add')\n"
+    "if redis.call('EXISTS', KEYS[3]) == 1 then\n"
+    "    for i = 3, #ARGV do\n"
+    "        if adding then\n"
+    "            hits = hits + redis.call('SETBIT', KEYS[3], ARGV[i], 1)\n"
+    "        else\n"
+    "            hits = hits + redis.call('GETBIT', KEYS[3], ARGV[i])\n"
+    "        end\n"
+    "    end\n"
+    "elseif adding then\n"
+    "    hits = n - redis.call('SADD', KEYS[2], unpack(ARGV, 3))\n"
+    "    if redis.call('SCARD', KEYS[2]) > tonumber(ARGV[2]) then\n"
+    "        for _, offset in ipairs(redis.call('SMEMBERS', KEYS[2])) do\n"
+    "            redis.call('SETBIT', KEYS[3], offset, 1)\n"
+    "        end\n"
+    "        redis.call('DEL', KEYS[2])\n"
+    "        redis.call('HSET', KEYS[1], 'layout', 0)\n"
+    "    end\n"
+    "else\n"
+    "    for i = 3, #ARGV do\n"
+    "        hits = hits + redis.call('SISMEMBER', KEYS[2], ARGV[i])\n"
+    "    end\n"
+    "end\n"
+    "if adding then return hits end\n"
+    "return (hits == n) and 1 or 0";
+
+/* Add to the running count of new items in a filter's metadata, unless the
+ * filter has been deleted, so that a client that's behind can't bring back
+ * metadata that describes nothing.
+ *
+ *     KEYS = { metadata key }
+ *     ARGV = { new items } */
+static const char * count_script =
+    "if redis.call('EXISTS', KEYS[1]) == 0 then return 0 end\n"
+    "return redis.call('HINCRBY', KEYS[1], 'items', ARGV[1])";
+
+/* Echoed ahead of the last count when a filter is freed, to find where the
+ * replies to anything still pending end */
+static const char * drain_marker = "pyrebloom-drain";
+
+/* Give a new filter the same description as an existing one, so that the
+ * bits of the two can be combined. A key that's already described is left
+ * as it is.
+ *
+ *     KEYS = { metadata key, new metadata key } */
+static const char * describe_script =
+    "if redis.call('EXISTS', KEYS[2]) == 0 then\n"
+    "    redis.call('HMSET', KEYS[2],\n"
+    "        unpack(redis.call('HGETALL', KEYS[1])))\n"
+    "end\n"
+    "return redis.status_reply('OK')";
+
+/* The most offsets a sparse filter holds before it becomes a bitmap. Redis
+ * packs sets of up to 512 integers (by default) at 4 bytes apiece, so it
+ * becomes a bitmap at 512 of them, or once the bitmap would be smaller. */
+static const uint32_t sparse_entries = 512;
+
 /* The size of the context error string */
 const size_t errstr_size = 128;
 
-int init_pyrebloom(
-    pyrebloomctxt * ctxt, char * key, uint32_t capacity, double error,
-    char* host, uint32_t port, char* password, uint32_t db) {
-    // Counter
+/* Connect, and queue up authentication (or a PING). Its reply is left pending
+ * so that callers can pipeline more commands behind it and pay for only one
+ * round trip; finish_handshake reads it. Selecting a database can fail (it
+ * may be out of range), and whatever was pipelined behind a failed SELECT
+ * would go to db 0 instead, so any other database is selected (along with
+ * authenticating) before anything else is sent, for one more round trip. */
+int begin_handshake(redisContext ** ctxt, char * host, uint32_t port,
+    char * password, uint32_t db) {
+    redisReply * reply = NULL;
+    uint32_t pending = 1;
+    struct timeval timeout = { 1, 500000 };
+    *ctxt = redisConnectWithTimeout(host, port, timeout);
+    if ((*ctxt)->err != 0) {
+        return PYREBLOOM_ERROR;
+    }
+
+    if (db != 0) {
+        if (strlen(password) != 0) {
+            redisAppendCommand(*ctxt, "AUTH %s", password);
+            pending += 1;
+        }
+        redisAppendCommand(*ctxt, "SELECT %u", db);
+        if (finish_handshake(*ctxt, pending, &reply) == PYREBLOOM_ERROR) {
+            return PYREBLOOM_ERROR;
+        }
+        freeReplyObject(reply);
+        /* There's always the one reply left for finish_handshake */
+        redisAppendCommand(*ctxt, "PING");
+    } else if (strlen(password) != 0) {
+        redisAppendCommand(*ctxt, "AUTH %s", password);
+    } else {
+        /* Make sure that we can ping the host */
+        redisAppendCommand(*ctxt, "PING");
+    }
+    return PYREBLOOM_OK;
+}
+
+/* Read `count` pending replies, the first being from begin_handshake.
+ * The first error encountered is copied into the context's error string. On
+ * success, the last reply is handed back in `last` for the caller to free. */
+int finish_handshake(
+    redisContext * ctxt, uint32_t count, redisReply ** last) {
+    uint32_t i;
+    int result = PYREBLOOM_OK;
+    redisReply * reply = NULL;
+    *last = NULL;
+    for (i = 0; i < count; ++i) {
+        if (redisGetReply(ctxt, (void**)(&reply)) == REDIS_ERR) {
+            return PYREBLOOM_ERROR;
+        }
+        if (reply->type == REDIS_REPLY_ERROR && result == PYREBLOOM_OK) {
+            strncpy(ctxt->errstr, reply->str, errstr_size);
+            result = PYREBLOOM_ERROR;
+        }
+        if (i + 1 == count && result == PYREBLOOM_OK) {
+            *last = reply;
+        } else {
+            freeReplyObject(reply);
+        }
+    }
+    return result;
+}
+
+/* The number of bits and hashes that give `error` at `capacity` */
+static void size_pyrebloom(uint64_t capacity, double error,
+    uint64_t * bits, uint32_t * hashes) {
+    *bits   = (uint64_t)(-(log(error) * capacity) / (log(2) * log(2)));
+    *hashes = (uint32_t)(ceil(log(2) * (*bits) / capacity));
+}
+
+/* The most hashes considered when planning for cost */
+const uint32_t plan_max_hashes = 32;
+
+uint64_t bits_for_hashes(uint64_t capacity, double error, uint32_t hashes) {
+    uint64_t bits;
+    uint32_t optimal;
+    if (hashes == 0) {
+        size_pyrebloom(capacity, error, &bits, &optimal);
+        return bits;
+    }
+    /* With k hashes, (1 - e^(-kn/m))^k = error */
+    return (uint64_t)(ceil(-(double)(hashes) * capacity /
+        log(1 - pow(error, 1.0 / hashes))));
+}
+
+double plan_cost(uint64_t capacity, double error, uint32_t hashes,
+    double probe_cost) {
+    return (double)(bits_for_hashes(capacity, error, hashes)) /
+        bits_for_hashes(capacity, error, 0) + probe_cost * hashes;
+}
+
+uint32_t plan_hashes(uint64_t capacity, double error, double probe_cost,
+    uint64_t max_bits) {
+    uint32_t hashes, best = 0;
+    double cost, least = 0;
+    for (hashes = 1; hashes <= plan_max_hashes; ++hashes) {
+        if (max_bits != 0 &&
+            bits_for_hashes(capacity, error, hashes) > max_bits) {
+            continue;
+        }
+        cost = plan_cost(capacity, error, hashes, probe_cost);
+        if (best == 0 || cost < least) {
+            best  = hashes;
+            least = cost;
+        }
+    }
+    return best;
+}
+
+/* Once the shape of a filter is known, allocate its seeds, offsets and the
+ * names of its segments */
+static void prepare_pyrebloom(pyrebloomctxt * ctxt) {
     uint32_t i;
 
-    ctxt->capacity = capacity;
-    ctxt->bits     = (uint64_t)(-(log(error) * capacity) / (log(2) * log(2)));
-    ctxt->hashes   = (uint32_t)(ceil(log(2) * ctxt->bits / capacity));
-    ctxt->error    = error;
-    ctxt->key      = (char *)(malloc(strlen(key)));
-    strncpy(ctxt->key, key, strlen(key));
     ctxt->seeds    = (uint32_t *)(malloc(ctxt->hashes * sizeof(uint32_t)));
-    ctxt->password = (char *)(malloc(strlen(password)));
-    strncpy(ctxt->password, password, strlen(password));
+    ctxt->offsets  = (uint64_t *)(malloc(ctxt->hashes * sizeof(uint64_t)));
 
     /* We'll need a certain number of strings here */
-    ctxt->num_keys = (uint32_t)(
-        ceil((float)(ctxt->bits) / max_bits_per_key));
-    ctxt->keys = (char**)(malloc(ctxt->num_keys * sizeof(char*)));
-    for (i = 0; i < ctxt->num_keys; ++i) {
-        size_t length = strlen(key) + 10;
-        ctxt->keys[i] = (char*)(malloc(length));
-        snprintf(ctxt->keys[i], length, "%s.%i", key, i);
+    if (ctxt->layout == PYREBLOOM_LAYOUT_PARTITIONED) {
+        /* Each slice is named `<key>.slice<i>`, unless it's too big for one
+         * segment, in which case they're `<key>.slice<i>.<j>` */
+        ctxt->slice_bits = (ctxt->bits + ctxt->hashes - 1) / ctxt->hashes;
+        ctxt->slice_segments = (uint32_t)(
+            (ctxt->slice_bits + ctxt->segment_bits - 1) / ctxt->segment_bits);
+        ctxt->num_keys = ctxt->hashes * ctxt->slice_segments;
+        ctxt->keys = (char**)(malloc(ctxt->num_keys * sizeof(char*)));
+        for (i = 0; i < ctxt->num_keys; ++i) {
+            size_t length = strlen(ctxt->key) + 32;
+            ctxt->keys[i] = (char*)(malloc(length));
+            if (ctxt->slice_segments == 1) {
+                snprintf(ctxt->keys[i], length, "%s.slice%u", ctxt->key, i);
+            } else {
+                snprintf(ctxt->keys[i], length, "%s.slice%u.%u", ctxt->key,
+                    i / ctxt->slice_segments, i % ctxt->slice_segments);
+            }
+        }
+    } else {
+        /* In integers, since a double can't count every bit of a big filter */
+        ctxt->num_keys = (uint32_t)(
+            (ctxt->bits + ctxt->segment_bits - 1) / ctxt->segment_bits);
+        if (ctxt->layout == PYREBLOOM_LAYOUT_SPARSE) {
+            size_t length = strlen(ctxt->key) + 8;
+            ctxt->sparse_key = (char *)(malloc(length));
+            snprintf(ctxt->sparse_key, length, "%s.sparse", ctxt->key);
+        }
+        if (ctxt->layout == PYREBLOOM_LAYOUT_SHARDED ||
+            ctxt->layout == PYREBLOOM_LAYOUT_BLOCKED ||
+            ctxt->layout == PYREBLOOM_LAYOUT_SPARSE) {
+            ctxt->args    = (char *)(malloc((ctxt->hashes + 1) * 24));
+            ctxt->argv    = (const char **)(
+                malloc((8 + 4 * ctxt->hashes) * sizeof(char *)));
+            ctxt->argvlen = (size_t *)(
+                malloc((8 + 4 * ctxt->hashes) * sizeof(size_t)));
+        }
+        ctxt->keys = (char**)(malloc(ctxt->num_keys * sizeof(char*)));
+        for (i = 0; i < ctxt->num_keys; ++i) {
+            size_t length = strlen(ctxt->key) + 12;
+            ctxt->keys[i] = (char*)(malloc(length));
+            snprintf(ctxt->keys[i], length, "%s.%u", ctxt->key, i);
+        }
     }
 
     /* The implementation here used to rely on srand(1) and then repeated
@@ -76,81 +393,671 @@ int init_pyrebloom(
         ctxt->seeds[i] = x;
         x = a * x + c;
     }
+}
 
-    // Now for the redis context
-    struct timeval timeout = { 1, 500000 };
-    ctxt->ctxt = redisConnectWithTimeout(host, port, timeout);
-    if (ctxt->ctxt->err != 0) {
+/* Load the sparse script, again if redis has forgotten it */
+static int sparse_reload(pyrebloomctxt * ctxt) {
+    redisReply * reply = redisCommand(
+        ctxt->ctxt, "SCRIPT LOAD %s", sparse_script);
+    ctxt->reload = 0;
+    if (reply == NULL) {
         return PYREBLOOM_ERROR;
     }
-
-    /* And now if a password was provided, then */
-    if (strlen(password) != 0) {
-        redisReply * reply = NULL;
-        reply = redisCommand(ctxt->ctxt, "AUTH %s", password);
+    if (reply->type != REDIS_REPLY_STRING) {
         if (reply->type == REDIS_REPLY_ERROR) {
-            /* We'll copy the error into the context's error string */
             strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        }
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    snprintf(ctxt->sparse_sha, sizeof(ctxt->sparse_sha), "%s", reply->str);
+    freeReplyObject(reply);
+    return PYREBLOOM_OK;
+}
+
+/* Take the description of a filter from the metadata script's reply, which
+ * is freed */
+static int metadata_read(pyrebloomctxt * ctxt, redisReply * reply) {
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements < 8) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->archived  = 0;
+    ctxt->archiving = (reply->elements >= 9 &&
+        reply->element[8]->type == REDIS_REPLY_STRING &&
+        strcmp(reply->element[8]->str, "archiving") == 0);
+    if (reply->elements >= 10 &&
+        reply->element[8]->type == REDIS_REPLY_STRING &&
+        strcmp(reply->element[8]->str, "archived") == 0 &&
+        reply->element[9]->type == REDIS_REPLY_STRING) {
+        ctxt->archived   = 1;
+        ctxt->page_bytes = (uint32_t)(
+            strtoul(reply->element[9]->str, NULL, 10));
+    }
+    /* Filters that have never changed have no epoch recorded */
+    ctxt->epoch = 0;
+    if (reply->elements >= 11 &&
+        reply->element[10]->type == REDIS_REPLY_STRING) {
+        ctxt->epoch = strtoull(reply->element[10]->str, NULL, 10);
+    }
+    ctxt->capacity     = strtoull(reply->element[0]->str, NULL, 10);
+    ctxt->error        = strtod(reply->element[1]->str, NULL);
+    ctxt->bits         = strtoull(reply->element[2]->str, NULL, 10);
+    ctxt->hashes       = (uint32_t)(strtoul(reply->element[3]->str, NULL, 10));
+    ctxt->segment_bits = strtoull(reply->element[4]->str, NULL, 10);
+    ctxt->hash_family  = (uint32_t)(strtoul(reply->element[5]->str, NULL, 10));
+    ctxt->layout       = (uint32_t)(strtoul(reply->element[6]->str, NULL, 10));
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT ||
+        ctxt->layout >= PYREBLOOM_LAYOUT_COUNT ||
+        ctxt->bits == 0 || ctxt->hashes == 0 || ctxt->segment_bits == 0) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+
+    /* Sparse filters become a single segment */
+    if (ctxt->layout == PYREBLOOM_LAYOUT_SPARSE &&
+        ctxt->bits > ctxt->segment_bits) {
+        strncpy(ctxt->ctxt->errstr,
+            "Sparse filters must fit in a single segment", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    return PYREBLOOM_OK;
+}
+
+int init_pyrebloom(
+    pyrebloomctxt * ctxt, char * key, uint64_t capacity, double error,
+    char* host, uint32_t port, char* password, uint32_t db,
+    uint32_t hash_family, uint32_t layout, uint32_t power_of_two,
+    uint32_t hashes) {
+    redisReply * reply = NULL;
+    uint64_t segment_bits = max_bits_per_key, shards, legacy_bits = 0;
+    uint32_t legacy_hashes = 0;
+    char args[11][32];
+
+    /* There's no connection yet to hold an error string, so callers are
+     * expected to have rejected this themselves */
+    if (power_of_two && layout != PYREBLOOM_LAYOUT_STANDARD) {
+        return PYREBLOOM_ERROR;
+    }
+
+    ctxt->key      = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+    ctxt->password = (char *)(malloc(strlen(password) + 1));
+    strcpy(ctxt->password, password);
+    ctxt->archive_key = (char *)(malloc(strlen(key) + 9));
+    snprintf(ctxt->archive_key, strlen(key) + 9, "%s.archive", key);
+    ctxt->uncounted = 0;
+    ctxt->counting  = 0;
+    ctxt->archived  = 0;
+    ctxt->archiving = 0;
+    ctxt->fencing   = 0;
+    ctxt->stale     = 0;
+    ctxt->count_sha[0] = '\0';
+
+    /* What we'd like this filter to look like, if it doesn't exist yet */
+    if (capacity != 0) {
+        /* Which is also what a filter from before the metadata looks like */
+        size_pyrebloom(capacity, error, &legacy_bits, &legacy_hashes);
+        size_pyrebloom(capacity, error, &ctxt->bits, &ctxt->hashes);
+        if (hashes != 0) {
+            ctxt->bits   = bits_for_hashes(capacity, error, hashes);
+            ctxt->hashes = hashes;
+        }
+        /* Shards are all the same size, and so there may be a few extra bits */
+        if (layout == PYREBLOOM_LAYOUT_SHARDED) {
+            shards       = (ctxt->bits + shard_bits - 1) / shard_bits;
+            segment_bits = (ctxt->bits + shards - 1) / shards;
+            ctxt->bits   = shards * segment_bits;
+        } else if (layout == PYREBLOOM_LAYOUT_BLOCKED) {
+            /* Words mustn't straddle two segments */
+            segment_bits = max_bits_per_key & ~63;
+            ctxt->bits   = (ctxt->bits + 63) & ~63;
+        } else if (power_of_two) {
+            /* So that it can be folded in half again and again. Segments are
+             * powers of two too, so that folding pairs them up exactly. */
+            uint64_t bits = 128;
+            while (bits < ctxt->bits) {
+                bits <<= 1;
+            }
+            ctxt->bits   = bits;
+            segment_bits = (bits < (1ULL << 31)) ? bits : (1ULL << 31);
+        }
+    } else {
+        ctxt->bits   = 0;
+        ctxt->hashes = 0;
+    }
+    snprintf(args[0], 32, "%lu", capacity);
+    snprintf(args[1], 32, "%.17g", error);
+    snprintf(args[2], 32, "%lu", ctxt->bits);
+    snprintf(args[3], 32, "%u", ctxt->hashes);
+    snprintf(args[4], 32, "%lu", segment_bits);
+    snprintf(args[5], 32, "%u", hash_family);
+    snprintf(args[6], 32, "%u", layout);
+    snprintf(args[7], 32, "%u", metadata_version);
+    snprintf(args[8], 32, "%lu", legacy_bits);
+    snprintf(args[9], 32, "%u", legacy_hashes);
+    snprintf(args[10], 32, "%u", max_bits_per_key);
+
+    /* Connecting and agreeing on the description of this filter with any
+     * other clients happen in one round trip (after selecting the db, if it's
+     * not db 0) */
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    /* The first segment is always named `<key>.0` */
+    redisAppendCommand(ctxt->ctxt,
+        "EVAL %s 2 %s %s.0 %s %s %s %s %s %s %s %s %s %s %s", metadata_script,
+        ctxt->meta_key, key, args[0], args[1], args[2], args[3], args[4],
+        args[5], args[6], args[7], args[8], args[9], args[10]);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR ||
+        metadata_read(ctxt, reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (ctxt->layout == PYREBLOOM_LAYOUT_SPARSE &&
+        sparse_reload(ctxt) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+
+    prepare_pyrebloom(ctxt);
+
+    /* If we've made it this far, we're ok. */
+    return PYREBLOOM_OK;
+}
+
+int attach_pyrebloom(pyrebloomctxt * ctxt, redisContext * redis,
+    const char * key, uint64_t capacity, double error, uint32_t hash_family,
+    uint64_t segment_bits) {
+    uint64_t bits;
+    uint32_t hashes;
+    size_pyrebloom(capacity, error, &bits, &hashes);
+    attach_shaped(ctxt, redis, key, bits, hashes, hash_family, segment_bits);
+    ctxt->capacity     = capacity;
+    ctxt->error        = error;
+    return PYREBLOOM_OK;
+}
+
+int attach_shaped(pyrebloomctxt * ctxt, redisContext * redis,
+    const char * key, uint64_t bits, uint32_t hashes, uint32_t hash_family,
+    uint64_t segment_bits) {
+    ctxt->ctxt         = redis;
+    ctxt->key          = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->bits         = bits;
+    ctxt->hashes       = hashes;
+    ctxt->hash_family  = hash_family;
+    ctxt->layout       = PYREBLOOM_LAYOUT_STANDARD;
+    ctxt->segment_bits = segment_bits;
+    ctxt->uncounted    = 0;
+    ctxt->counting     = 0;
+    ctxt->archived     = 0;
+    ctxt->archiving    = 0;
+    ctxt->fencing      = 0;
+    ctxt->stale        = 0;
+    prepare_pyrebloom(ctxt);
+    return PYREBLOOM_OK;
+}
+
+/* Free everything prepare_pyrebloom allocated for a filter's shape, along
+ * with anything sized by it since */
+static void forget_shape(pyrebloomctxt * ctxt) {
+    uint32_t i;
+    free(ctxt->seeds);
+    free(ctxt->offsets);
+    free(ctxt->batch);
+    free(ctxt->hits);
+    free(ctxt->args);
+    free(ctxt->argv);
+    free(ctxt->argvlen);
+    free(ctxt->sparse_key);
+    free(ctxt->pages);
+    free(ctxt->page_ids);
+    if (ctxt->keys) {
+        for (i = 0; i < ctxt->num_keys; ++i) {
+            free(ctxt->keys[i]);
+        }
+        free(ctxt->keys);
+    }
+    ctxt->seeds      = NULL;
+    ctxt->offsets    = NULL;
+    ctxt->batch      = NULL;
+    ctxt->hits       = NULL;
+    ctxt->args       = NULL;
+    ctxt->argv       = NULL;
+    ctxt->argvlen    = NULL;
+    ctxt->sparse_key = NULL;
+    ctxt->pages      = NULL;
+    ctxt->page_ids   = NULL;
+    ctxt->keys       = NULL;
+    ctxt->batched = ctxt->next_batched = ctxt->batch_size = 0;
+}
+
+int free_pyrebloom(pyrebloomctxt * ctxt) {
+    redisReply * reply = NULL;
+    int drained = 0;
+    /* Our last batch of new items still needs counting. A batch that was
+     * abandoned part way may have left replies unread ahead of the count's,
+     * so everything up to a marker sent before it is read and thrown away. */
+    if (ctxt->ctxt != NULL && ctxt->meta_key != NULL && ctxt->uncounted > 0) {
+        redisAppendCommand(ctxt->ctxt, "ECHO %s", drain_marker);
+        redisAppendCommand(ctxt->ctxt, "EVAL %s 1 %s %lu", count_script,
+            ctxt->meta_key, ctxt->uncounted);
+        while (!drained &&
+            redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_OK) {
+            drained = (reply->type == REDIS_REPLY_STRING &&
+                strcmp(reply->str, drain_marker) == 0);
             freeReplyObject(reply);
-            return PYREBLOOM_ERROR;
-        } else {
+        }
+        if (drained &&
+            redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_OK) {
             freeReplyObject(reply);
-            return PYREBLOOM_OK;
+        }
+    }
+    forget_shape(ctxt);
+    free(ctxt->archive_key);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    free(ctxt->password);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+/* From murmur.c */
+uint64_t MurmurHash64A(const void * key, uint32_t len, uint64_t seed);
+
+uint64_t hash_item(uint32_t hash_family, const char * data, uint32_t len,
+    uint64_t seed) {
+    switch (hash_family) {
+    case PYREBLOOM_HASH_XXH3:
+        return XXH3_64bits_withSeed(data, len, seed);
+    case PYREBLOOM_HASH_WYHASH:
+        return wyhash(data, len, seed);
+    default:
+        return MurmurHash64A(data, len, seed);
+    }
+}
+
+/* For MurmurHash64A all seeds are hashed together by the multi-lane kernel */
+void hash_offsets(pyrebloomctxt * ctxt, const char * data, uint32_t len) {
+    uint32_t i;
+    if (ctxt->hash_family == PYREBLOOM_HASH_MURMUR64A) {
+        MurmurHash64A_seeds(
+            data, len, ctxt->seeds, ctxt->hashes, ctxt->offsets);
+    } else {
+        for (i = 0; i < ctxt->hashes; ++i) {
+            ctxt->offsets[i] = hash_item(
+                ctxt->hash_family, data, len, ctxt->seeds[i]);
+        }
+    }
+    if (ctxt->layout == PYREBLOOM_LAYOUT_PARTITIONED) {
+        for (i = 0; i < ctxt->hashes; ++i) {
+            ctxt->offsets[i] %= ctxt->slice_bits;
+        }
+    } else if (ctxt->layout == PYREBLOOM_LAYOUT_SHARDED) {
+        /* The top of the first hash picks the shard, and the rest of each
+         * hash picks a bit within it */
+        uint64_t shard = ((ctxt->offsets[0] >> 32) * ctxt->num_keys) >> 32;
+        for (i = 0; i < ctxt->hashes; ++i) {
+            ctxt->offsets[i] = shard * ctxt->segment_bits +
+                ctxt->offsets[i] % ctxt->segment_bits;
+        }
+    } else if (ctxt->layout == PYREBLOOM_LAYOUT_BLOCKED) {
+        /* The top of the first hash picks the word, and the bottom six bits
+         * of each hash pick a bit within it. Past 2^32 words the product no
+         * longer fits in 64 bits, so those filters use all of the hash. */
+        uint64_t word, words = ctxt->bits >> 6;
+        if (words < (1ULL << 32)) {
+            word = ((ctxt->offsets[0] >> 32) * words) >> 32;
+        } else {
+            word = (uint64_t)(((__uint128_t)(ctxt->offsets[0]) * words) >> 64);
+        }
+        for (i = 0; i < ctxt->hashes; ++i) {
+            ctxt->offsets[i] = (word << 6) | (ctxt->offsets[i] & 63);
         }
     } else {
-        /* Make sure that we can ping the host */
-        redisReply * reply = NULL;
-        reply = redisCommand(ctxt->ctxt, "PING");
-        if (reply->type == REDIS_REPLY_ERROR) {
-            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
-            freeReplyObject(reply);
-            return PYREBLOOM_ERROR;
+        for (i = 0; i < ctxt->hashes; ++i) {
+            ctxt->offsets[i] %= ctxt->bits;
+        }
+    }
+}
+
+/* Read or write all of an item's bits in its shard with a single BITFIELD */
+static void shard_command(pyrebloomctxt * ctxt, const char * op,
+    const char * data, uint32_t len) {
+    uint32_t i, argc = 2, setting = (op[0] == 'S');
+    hash_offsets(ctxt, data, len);
+    ctxt->argv[0] = "BITFIELD";
+    ctxt->argv[1] = ctxt->keys[ctxt->offsets[0] / ctxt->segment_bits];
+    for (i = 0; i < ctxt->hashes; ++i) {
+        char * slot = ctxt->args + 24 * i;
+        snprintf(slot, 24, "%lu", ctxt->offsets[i] % ctxt->segment_bits);
+        ctxt->argv[argc++] = op;
+        ctxt->argv[argc++] = "u1";
+        ctxt->argv[argc++] = slot;
+        if (setting) {
+            ctxt->argv[argc++] = "1";
         }
-        /* And now, finally free this reply object */
-        freeReplyObject(reply);
     }
+    for (i = 0; i < argc; ++i) {
+        ctxt->argvlen[i] = strlen(ctxt->argv[i]);
+    }
+    redisAppendCommandArgv(ctxt->ctxt, argc, ctxt->argv, ctxt->argvlen);
+}
+
+/* Add or check an item with a single run of the sparse script */
+static void sparse_command(pyrebloomctxt * ctxt, const char * op,
+    const char * data, uint32_t len) {
+    uint32_t i, argc = 0;
+    uint64_t most = ctxt->bits / 32;
+    char * entries = ctxt->args + 24 * ctxt->hashes;
+    hash_offsets(ctxt, data, len);
+    snprintf(entries, 24, "%lu", (most < sparse_entries) ? most : sparse_entries);
+    ctxt->argv[argc++] = "EVALSHA";
+    ctxt->argv[argc++] = ctxt->sparse_sha;
+    ctxt->argv[argc++] = "3";
+    ctxt->argv[argc++] = ctxt->meta_key;
+    ctxt->argv[argc++] = ctxt->sparse_key;
+    ctxt->argv[argc++] = ctxt->keys[0];
+    ctxt->argv[argc++] = op;
+    ctxt->argv[argc++] = entries;
+    for (i = 0; i < ctxt->hashes; ++i) {
+        char * offset = ctxt->args + 24 * i;
+        snprintf(offset, 24, "%lu", ctxt->offsets[i]);
+        ctxt->argv[argc++] = offset;
+    }
+    for (i = 0; i < argc; ++i) {
+        ctxt->argvlen[i] = strlen(ctxt->argv[i]);
+    }
+    redisAppendCommandArgv(ctxt->ctxt, argc, ctxt->argv, ctxt->argvlen);
+    ++ctxt->batched;
+}
+
+/* Read an item's whole word with a single BITFIELD, remembering which of its
+ * bits must be set for check_next to compare against. BITFIELD reads the
+ * first bit of a word as its most significant one. */
+static void word_command(
+    pyrebloomctxt * ctxt, const char * data, uint32_t len) {
+    uint32_t i;
+    uint64_t mask = 0, d;
+    if (ctxt->batched == ctxt->batch_size) {
+        ctxt->batch_size = ctxt->batch_size ? ctxt->batch_size * 2 : 64;
+        ctxt->batch = (uint64_t *)(realloc(ctxt->batch,
+            ctxt->batch_size * sizeof(uint64_t)));
+    }
+    hash_offsets(ctxt, data, len);
+    for (i = 0; i < ctxt->hashes; ++i) {
+        mask |= (uint64_t)(1) << (63 - (ctxt->offsets[i] & 63));
+    }
+    ctxt->batch[ctxt->batched++] = mask;
+    /* Unsigned fields top out at 63 bits, so the word is read as signed */
+    d = ctxt->offsets[0];
+    redisAppendCommand(ctxt->ctxt, "BITFIELD %s GET i64 #%lu",
+        ctxt->keys[d / ctxt->segment_bits], (d % ctxt->segment_bits) >> 6);
+}
+
+/* The most bits read or written by any one command of a partitioned batch */
+static const uint32_t batch_ops = 1024;
 
-    /* Select the appropriate DB */
+/* Queue up an item's offsets to be sent with the rest of a partitioned batch */
+static void batch_offsets(
+    pyrebloomctxt * ctxt, const char * data, uint32_t len) {
+    if (ctxt->batched == ctxt->batch_size) {
+        ctxt->batch_size = ctxt->batch_size ? ctxt->batch_size * 2 : 64;
+        ctxt->batch = (uint64_t *)(realloc(ctxt->batch,
+            (uint64_t)(ctxt->batch_size) * ctxt->hashes * sizeof(uint64_t)));
+        ctxt->hits = (uint32_t *)(realloc(ctxt->hits,
+            ctxt->batch_size * sizeof(uint32_t)));
+    }
+    hash_offsets(ctxt, data, len);
+    memcpy(ctxt->batch + (uint64_t)(ctxt->batched) * ctxt->hashes,
+        ctxt->offsets, ctxt->hashes * sizeof(uint64_t));
+    ctxt->hits[ctxt->batched++] = 0;
+}
+
+/* Either send a command of a partitioned batch, or read its reply and count
+ * the bits that were set against the items they belong to */
+static int batch_command(pyrebloomctxt * ctxt, int reading, uint32_t argc,
+    const char ** argv, const size_t * argvlen, const uint32_t * owners,
+    uint32_t ops, int * failed) {
     redisReply * reply = NULL;
-    reply = redisCommand(ctxt->ctxt, "SELECT %i", db);
+    uint32_t i;
+    if (!reading) {
+        redisAppendCommandArgv(ctxt->ctxt, argc, argv, argvlen);
+        return PYREBLOOM_OK;
+    }
+
+    if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+        strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
     if (reply->type == REDIS_REPLY_ERROR) {
+        *failed = 1;
         strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
-        freeReplyObject(reply);
-        /* Shut it down. */
-        free_pyrebloom(ctxt);
-        return PYREBLOOM_ERROR;
+    } else if (reply->type == REDIS_REPLY_ARRAY && reply->elements == ops) {
+        for (i = 0; i < ops; ++i) {
+            ctxt->hits[owners[i]] += (uint32_t)(reply->element[i]->integer);
+        }
     }
     freeReplyObject(reply);
+    return PYREBLOOM_OK;
+}
 
-    /* If we've made it this far, we're ok. */
+/* Send the count of new items from earlier adds along with this batch. The
+ * first count loads the script as well, and the rest only name it. */
+static void count_queue(pyrebloomctxt * ctxt) {
+    ctxt->counting = 0;
+    if (ctxt->meta_key == NULL || ctxt->uncounted == 0) {
+        return;
+    }
+    if (ctxt->count_sha[0] == '\0') {
+        redisAppendCommand(ctxt->ctxt, "EVAL %s 1 %s %lu", count_script,
+            ctxt->meta_key, ctxt->uncounted);
+        redisAppendCommand(ctxt->ctxt, "SCRIPT LOAD %s", count_script);
+        ctxt->counting = 2;
+    } else {
+        redisAppendCommand(ctxt->ctxt, "EVALSHA %s 1 %s %lu", ctxt->count_sha,
+            ctxt->meta_key, ctxt->uncounted);
+        ctxt->counting = 1;
+    }
+    ctxt->counted   = ctxt->uncounted;
+    ctxt->uncounted = 0;
+}
+
+/* Read the replies to the count, if one was sent. It's only an estimate, and
+ * so an error isn't worth failing the adds over, but if redis has forgotten
+ * the script then the count goes out again, with the script, next time. */
+static int count_read(pyrebloomctxt * ctxt) {
+    redisReply * reply = NULL;
+    int i, counting = ctxt->counting;
+    ctxt->counting = 0;
+    for (i = 0; i < counting; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+        if (i == 0 && reply->type == REDIS_REPLY_ERROR &&
+            strncmp(reply->str, "NOSCRIPT", 8) == 0) {
+            ctxt->uncounted   += ctxt->counted;
+            ctxt->count_sha[0] = '\0';
+        } else if (i == 1 && reply->type == REDIS_REPLY_STRING) {
+            snprintf(ctxt->count_sha, sizeof(ctxt->count_sha), "%s",
+                reply->str);
+        }
+        freeReplyObject(reply);
+    }
     return PYREBLOOM_OK;
 }
 
-int free_pyrebloom(pyrebloomctxt * ctxt) {
-    if (ctxt->seeds) {
-        free(ctxt->seeds);
+/* Read the filter's epoch behind a batch, to find out whether it was folded,
+ * archived or rehydrated while the batch was on its way */
+static void fence_queue(pyrebloomctxt * ctxt) {
+    if (ctxt->meta_key == NULL) {
+        return;
     }
-    redisFree(ctxt->ctxt);
+    redisAppendCommand(ctxt->ctxt, "HGET %s epoch", ctxt->meta_key);
+    ctxt->fencing = 1;
+}
+
+/* Read the fence, if one was sent. A filter with no epoch has either never
+ * changed or been deleted since, and neither makes us stale. */
+static int fence_read(pyrebloomctxt * ctxt) {
+    redisReply * reply = NULL;
+    if (!ctxt->fencing) {
+        return PYREBLOOM_OK;
+    }
+    ctxt->fencing = 0;
+    if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+        strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_STRING &&
+        strtoull(reply->str, NULL, 10) != ctxt->epoch) {
+        ctxt->stale = 1;
+    }
+    freeReplyObject(reply);
     return PYREBLOOM_OK;
 }
 
+/* Send every queued item's bits in slice i to that slice's keys in a single
+ * BITFIELD (or a few, for big batches), with the fence behind them, and then
+ * read them all back. Setting bits replies with what they were before, so
+ * either way `hits` ends up with how many of each item's bits were already
+ * set. */
+static int batch_flush(pyrebloomctxt * ctxt, int setting) {
+    uint32_t per_op = setting ? 4 : 3, reading, slice, segment, item, ops;
+    uint32_t * owners = (uint32_t *)(malloc(batch_ops * sizeof(uint32_t)));
+    const char ** argv = (const char **)(
+        malloc((2 + per_op * batch_ops) * sizeof(char *)));
+    size_t * argvlen = (size_t *)(
+        malloc((2 + per_op * batch_ops) * sizeof(size_t)));
+    char * slots = (char *)(malloc(batch_ops * 24));
+    int result = PYREBLOOM_OK, failed = 0;
+
+    for (reading = 0; reading < 2 && result == PYREBLOOM_OK; ++reading) {
+        /* The count was sent ahead of the batch */
+        if (reading && count_read(ctxt) == PYREBLOOM_ERROR) {
+            result = PYREBLOOM_ERROR;
+        }
+        for (slice = 0; slice < ctxt->hashes; ++slice) {
+            for (segment = 0; segment < ctxt->slice_segments; ++segment) {
+                char * key = ctxt->keys[slice * ctxt->slice_segments + segment];
+                argv[0] = "BITFIELD";
+                argv[1] = key;
+                argvlen[0] = 8;
+                argvlen[1] = strlen(key);
+                for (item = 0, ops = 0; item < ctxt->batched; ++item) {
+                    uint64_t d = ctxt->batch[
+                        (uint64_t)(item) * ctxt->hashes + slice];
+                    const char ** op = argv + 2 + per_op * ops;
+                    size_t * oplen = argvlen + 2 + per_op * ops;
+                    if (d / ctxt->segment_bits != segment) {
+                        continue;
+                    }
+                    owners[ops] = item;
+                    if (!reading) {
+                        snprintf(slots + 24 * ops, 24, "%lu",
+                            d % ctxt->segment_bits);
+                        op[0] = setting ? "SET" : "GET";
+                        op[1] = "u1";
+                        op[2] = slots + 24 * ops;
+                        oplen[0] = 3;
+                        oplen[1] = 2;
+                        oplen[2] = strlen(op[2]);
+                        if (setting) {
+                            op[3] = "1";
+                            oplen[3] = 1;
+                        }
+                    }
+                    if (++ops == batch_ops) {
+                        if (batch_command(ctxt, reading, 2 + per_op * ops,
+                            argv, argvlen, owners, ops, &failed) ==
+                            PYREBLOOM_ERROR) {
+                            result = PYREBLOOM_ERROR;
+                        }
+                        ops = 0;
+                    }
+                }
+                if (ops > 0 && batch_command(ctxt, reading,
+                    2 + per_op * ops, argv, argvlen, owners, ops, &failed) ==
+                    PYREBLOOM_ERROR) {
+                    result = PYREBLOOM_ERROR;
+                }
+            }
+        }
+        if (!reading) {
+            fence_queue(ctxt);
+        } else if (fence_read(ctxt) == PYREBLOOM_ERROR) {
+            result = PYREBLOOM_ERROR;
+        }
+    }
+
+    free(owners);
+    free(argv);
+    free(argvlen);
+    free(slots);
+    return failed ? PYREBLOOM_ERROR : result;
+}
+
 int add(pyrebloomctxt * ctxt, const char * data, uint32_t len) {
     uint32_t i;
+    if (ctxt->layout == PYREBLOOM_LAYOUT_PARTITIONED) {
+        batch_offsets(ctxt, data, len);
+        return PYREBLOOM_OK;
+    } else if (ctxt->layout == PYREBLOOM_LAYOUT_SHARDED ||
+        ctxt->layout == PYREBLOOM_LAYOUT_BLOCKED) {
+        shard_command(ctxt, "SET", data, len);
+        return PYREBLOOM_OK;
+    } else if (ctxt->layout == PYREBLOOM_LAYOUT_SPARSE) {
+        sparse_command(ctxt, "add", data, len);
+        return PYREBLOOM_OK;
+    }
+    hash_offsets(ctxt, data, len);
     for (i = 0; i < ctxt->hashes; ++i) {
-        uint64_t d = hash(data, len, ctxt->seeds[i], ctxt->bits);
+        uint64_t d = ctxt->offsets[i];
         redisAppendCommand(ctxt->ctxt, "SETBIT %s %lu 1",
-            ctxt->keys[d / max_bits_per_key], d % max_bits_per_key);
+            ctxt->keys[d / ctxt->segment_bits], d % ctxt->segment_bits);
     }
     return PYREBLOOM_OK;
 }
 
-int add_complete(pyrebloomctxt * ctxt, uint32_t count) {
-    uint32_t i, j, ct = 0, total = 0;
+int64_t add_complete(pyrebloomctxt * ctxt, uint64_t count) {
+    uint64_t i, total = 0;
+    uint32_t j, k, ct = 0;
+    uint32_t replies = (ctxt->layout == PYREBLOOM_LAYOUT_SHARDED ||
+        ctxt->layout == PYREBLOOM_LAYOUT_BLOCKED ||
+        ctxt->layout == PYREBLOOM_LAYOUT_SPARSE) ? 1 : ctxt->hashes;
+    int failed = 0;
     redisReply * reply = NULL;
 
     ctxt->ctxt->err = PYREBLOOM_OK;
+    count_queue(ctxt);
+    if (ctxt->layout == PYREBLOOM_LAYOUT_PARTITIONED) {
+        failed = (batch_flush(ctxt, 1) == PYREBLOOM_ERROR);
+        for (i = 0; i < ctxt->batched; ++i) {
+            if (ctxt->hits[i] == ctxt->hashes) {
+                total += 1;
+            }
+        }
+        count = ctxt->batched;
+        ctxt->batched = 0;
+        if (failed) {
+            return PYREBLOOM_ERROR;
+        }
+        /* A stale batch is sent again, and counted then */
+        if (!ctxt->stale) {
+            ctxt->uncounted += count - total;
+        }
+        return (int64_t)(count - total);
+    }
+    fence_queue(ctxt);
     for (i = 0; i < count; ++i) {
-        for (j = 0, ct = 0; j < ctxt->hashes; ++j) {
+        for (j = 0, ct = 0; j < replies; ++j) {
             /* Make sure that we were able to read a reply. Otherwise, provide
              * an error response */
             if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
@@ -159,10 +1066,19 @@ int add_complete(pyrebloomctxt * ctxt, uint32_t count) {
                 return PYREBLOOM_ERROR;
             }
 
-            /* Consume and read the response */
+            /* Consume and read the response. An error here mustn't be
+             * recorded in the context, or hiredis would refuse to read the
+             * replies that follow it. */
             if (reply->type == REDIS_REPLY_ERROR) {
-                ctxt->ctxt->err = PYREBLOOM_ERROR;
+                failed = 1;
                 strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+                if (strncmp(reply->str, "NOSCRIPT", 8) == 0) {
+                    ctxt->reload = 1;
+                }
+            } else if (reply->type == REDIS_REPLY_ARRAY) {
+                for (k = 0; k < reply->elements; ++k) {
+                    ct += reply->element[k]->integer;
+                }
             } else {
                 ct += reply->integer;
             }
@@ -172,30 +1088,77 @@ int add_complete(pyrebloomctxt * ctxt, uint32_t count) {
             total += 1;
         }
     }
+    failed = (count_read(ctxt) == PYREBLOOM_ERROR) || failed;
+    failed = (fence_read(ctxt) == PYREBLOOM_ERROR) || failed;
 
-    if (ctxt->ctxt->err == PYREBLOOM_ERROR) {
+    if (ctxt->layout == PYREBLOOM_LAYOUT_SPARSE) {
+        ctxt->batched = 0;
+        if (ctxt->reload) {
+            sparse_reload(ctxt);
+        }
+    }
+    if (failed) {
         return PYREBLOOM_ERROR;
     } else {
-        return count - total;
+        if (!ctxt->stale) {
+            ctxt->uncounted += count - total;
+        }
+        return (int64_t)(count - total);
     }
 }
 
 int check(pyrebloomctxt * ctxt, const char * data, uint32_t len) {
     uint32_t i;
+    if (ctxt->layout == PYREBLOOM_LAYOUT_PARTITIONED) {
+        batch_offsets(ctxt, data, len);
+        return PYREBLOOM_OK;
+    } else if (ctxt->layout == PYREBLOOM_LAYOUT_SHARDED) {
+        shard_command(ctxt, "GET", data, len);
+        return PYREBLOOM_OK;
+    } else if (ctxt->layout == PYREBLOOM_LAYOUT_BLOCKED) {
+        word_command(ctxt, data, len);
+        return PYREBLOOM_OK;
+    } else if (ctxt->layout == PYREBLOOM_LAYOUT_SPARSE) {
+        sparse_command(ctxt, "check", data, len);
+        return PYREBLOOM_OK;
+    }
+    hash_offsets(ctxt, data, len);
     for (i = 0; i < ctxt->hashes; ++i) {
-        uint64_t d = hash(data, len, ctxt->seeds[i], ctxt->bits);
+        uint64_t d = ctxt->offsets[i];
         redisAppendCommand(ctxt->ctxt, "GETBIT %s %lu",
-            ctxt->keys[d / max_bits_per_key], d % max_bits_per_key);
+            ctxt->keys[d / ctxt->segment_bits], d % ctxt->segment_bits);
     }
     return PYREBLOOM_OK;
 }
 
 int check_next(pyrebloomctxt * ctxt) {
-    uint32_t i;
-    int result = 1;
+    uint32_t i, j, replies = (ctxt->layout == PYREBLOOM_LAYOUT_SHARDED ||
+        ctxt->layout == PYREBLOOM_LAYOUT_BLOCKED ||
+        ctxt->layout == PYREBLOOM_LAYOUT_SPARSE) ? 1 : ctxt->hashes;
+    uint64_t mask = 0;
+    int result = 1, failed = 0;
     redisReply * reply = NULL;
     ctxt->ctxt->err = PYREBLOOM_OK;
-    for (i = 0; i < ctxt->hashes; ++i) {
+
+    /* The whole batch is checked when the first result is asked for */
+    if (ctxt->layout == PYREBLOOM_LAYOUT_PARTITIONED) {
+        if (ctxt->next_batched == 0) {
+            ctxt->batch_result = batch_flush(ctxt, 0);
+        }
+        result = (ctxt->hits[ctxt->next_batched++] == ctxt->hashes);
+        if (ctxt->next_batched == ctxt->batched) {
+            ctxt->batched = ctxt->next_batched = 0;
+        }
+        return (ctxt->batch_result == PYREBLOOM_ERROR) ?
+            PYREBLOOM_ERROR : result;
+    } else if (ctxt->layout == PYREBLOOM_LAYOUT_BLOCKED) {
+        mask = ctxt->batch[ctxt->next_batched++];
+        if (ctxt->next_batched == ctxt->batched) {
+            ctxt->batched = ctxt->next_batched = 0;
+        }
+    }
+
+    for (i = 0; i < replies; ++i) {
         if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
             strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
             ctxt->ctxt->err = PYREBLOOM_ERROR;
@@ -203,31 +1166,579 @@ int check_next(pyrebloomctxt * ctxt) {
         }
 
         if (reply->type == REDIS_REPLY_ERROR) {
-            ctxt->ctxt->err = PYREBLOOM_ERROR;
+            failed = 1;
             strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+            if (strncmp(reply->str, "NOSCRIPT", 8) == 0) {
+                ctxt->reload = 1;
+            }
+        } else if (mask && reply->type == REDIS_REPLY_ARRAY &&
+            reply->elements == 1) {
+            /* The whole word is checked at once */
+            uint64_t word = (uint64_t)(reply->element[0]->integer);
+            result = ((word & mask) == mask);
+        } else if (reply->type == REDIS_REPLY_ARRAY) {
+            for (j = 0; j < reply->elements; ++j) {
+                result = result && reply->element[j]->integer;
+            }
+        } else {
+            result = result && reply->integer;
         }
-        result = result && reply->integer;
         freeReplyObject(reply);
     }
-    if (ctxt->ctxt->err == PYREBLOOM_ERROR) {
+    /* The script can only be loaded again once every check that was sent
+     * with it has been read, and the fence behind them too */
+    if (ctxt->layout == PYREBLOOM_LAYOUT_SPARSE && --ctxt->batched == 0 &&
+        ctxt->reload && !ctxt->fencing) {
+        sparse_reload(ctxt);
+    }
+    if (failed) {
         return PYREBLOOM_ERROR;
     }
     return result;
 }
 
+void check_fence(pyrebloomctxt * ctxt) {
+    /* A partitioned batch sends its own when it's flushed, unless it was
+     * read from the archive */
+    if (ctxt->layout != PYREBLOOM_LAYOUT_PARTITIONED || ctxt->archived) {
+        fence_queue(ctxt);
+    }
+}
+
+int check_complete(pyrebloomctxt * ctxt) {
+    int result = fence_read(ctxt);
+    if (ctxt->layout == PYREBLOOM_LAYOUT_SPARSE && ctxt->batched == 0 &&
+        ctxt->reload) {
+        sparse_reload(ctxt);
+    }
+    return result;
+}
+
+int refresh(pyrebloomctxt * ctxt) {
+    pyrebloomctxt old = *ctxt;
+    redisReply * reply = NULL;
+    uint32_t i;
+
+    /* With a capacity of 0, the script only reads what's recorded */
+    reply = redisCommand(ctxt->ctxt,
+        "EVAL %s 2 %s %s.0 0 0 0 0 0 0 0 %u 0 0 0", metadata_script,
+        ctxt->meta_key, ctxt->key, metadata_version);
+    if (reply == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    if (metadata_read(ctxt, reply) == PYREBLOOM_ERROR) {
+        *ctxt = old;
+        return PYREBLOOM_ERROR;
+    }
+    forget_shape(ctxt);
+    prepare_pyrebloom(ctxt);
+    ctxt->stale = 0;
+
+    /* Adds sent before we knew the filter had been folded may have set bits
+     * past its end, in segments it no longer has */
+    if (!ctxt->archived && ctxt->layout == PYREBLOOM_LAYOUT_STANDARD &&
+        ctxt->bits < old.bits) {
+        for (i = ctxt->num_keys; i < old.num_keys; ++i) {
+            freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s.%u", ctxt->key,
+                i));
+        }
+        i = ctxt->num_keys - 1;
+        freeReplyObject(redisCommand(ctxt->ctxt, "EVAL %s 1 %s %lu",
+            trim_script, ctxt->keys[i], (key_bits(ctxt, i) + 7) / 8));
+    }
+    return PYREBLOOM_OK;
+}
+
 int delete(pyrebloomctxt * ctxt) {
-    uint32_t num_keys = (uint32_t)(
-        ceil((float)(ctxt->bits) / max_bits_per_key));
     uint32_t i = 0;
-    for (; i < num_keys; ++i) {
+    for (; i < ctxt->num_keys; ++i) {
         freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->keys[i]));
     }
+    if (ctxt->sparse_key) {
+        freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->sparse_key));
+    }
+    if (ctxt->archive_key) {
+        freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s",
+            ctxt->archive_key));
+    }
+    if (ctxt->meta_key) {
+        freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->meta_key));
+    }
+    ctxt->uncounted = 0;
+    ctxt->archived  = 0;
 
     return PYREBLOOM_OK;
 }
 
-/* From murmur.c */
-uint64_t MurmurHash64A(const void * key, uint32_t len, uint64_t seed);
+int delete_recorded(redisContext * redis, const char * key) {
+    pyrebloomctxt old;
+    redisReply * reply = NULL;
+    size_t length = strlen(key) + 9;
+    int result = PYREBLOOM_OK;
+
+    memset(&old, 0, sizeof(old));
+    old.ctxt        = redis;
+    old.key         = (char *)(malloc(strlen(key) + 1));
+    strcpy(old.key, key);
+    old.meta_key    = (char *)(malloc(length));
+    snprintf(old.meta_key, length, "%s.meta", key);
+    old.archive_key = (char *)(malloc(length));
+    snprintf(old.archive_key, length, "%s.archive", key);
+
+    /* The fields metadata_read expects, with the type where it would find
+     * the version, which it doesn't use */
+    reply = redisCommand(redis,
+        "HMGET %s capacity error bits hashes segment_bits hash layout type",
+        old.meta_key);
+    if (reply == NULL) {
+        result = PYREBLOOM_ERROR;
+    } else if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(redis->errstr, reply->str, errstr_size);
+        freeReplyObject(reply);
+        result = PYREBLOOM_ERROR;
+    } else if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 8) {
+        strncpy(redis->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        result = PYREBLOOM_ERROR;
+    } else if (reply->element[7]->type == REDIS_REPLY_STRING &&
+        strcmp(reply->element[7]->str, "bloom") != 0) {
+        snprintf(redis->errstr, errstr_size, "%s describes a %s",
+            old.meta_key, reply->element[7]->str);
+        freeReplyObject(reply);
+        result = PYREBLOOM_ERROR;
+    } else if (reply->element[2]->type != REDIS_REPLY_STRING) {
+        /* There's no filter recorded here */
+        freeReplyObject(reply);
+    } else if (reply->element[0]->type != REDIS_REPLY_STRING ||
+        reply->element[1]->type != REDIS_REPLY_STRING ||
+        reply->element[3]->type != REDIS_REPLY_STRING ||
+        reply->element[4]->type != REDIS_REPLY_STRING ||
+        reply->element[5]->type != REDIS_REPLY_STRING ||
+        reply->element[6]->type != REDIS_REPLY_STRING) {
+        strncpy(redis->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        result = PYREBLOOM_ERROR;
+    } else if (metadata_read(&old, reply) == PYREBLOOM_ERROR) {
+        result = PYREBLOOM_ERROR;
+    } else {
+        prepare_pyrebloom(&old);
+        delete(&old);
+    }
+
+    forget_shape(&old);
+    free(old.archive_key);
+    free(old.meta_key);
+    free(old.key);
+    return result;
+}
+
+int bits_set(pyrebloomctxt * ctxt, uint64_t * count) {
+    redisReply * reply = NULL;
+    uint32_t i, replies = ctxt->num_keys;
+    int failed = 0;
+    *count = 0;
+    for (i = 0; i < ctxt->num_keys; ++i) {
+        redisAppendCommand(ctxt->ctxt, "BITCOUNT %s", ctxt->keys[i]);
+    }
+    /* A sparse filter has one member for every bit that's set */
+    if (ctxt->sparse_key) {
+        redisAppendCommand(ctxt->ctxt, "SCARD %s", ctxt->sparse_key);
+        ++replies;
+    }
+    for (i = 0; i < replies; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+        if (reply->type == REDIS_REPLY_ERROR) {
+            failed = 1;
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        } else {
+            *count += (uint64_t)(reply->integer);
+        }
+        freeReplyObject(reply);
+    }
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+double estimate_items(uint64_t set, uint64_t bits, uint32_t hashes) {
+    if (set >= bits) {
+        return INFINITY;
+    }
+    return -((double)(bits) / hashes) * log(1 - (double)(set) / bits);
+}
+
+int items_added(pyrebloomctxt * ctxt, uint64_t * count) {
+    redisReply * reply = NULL;
+    if (ctxt->uncounted > 0) {
+        reply = redisCommand(ctxt->ctxt, "EVAL %s 1 %s %lu", count_script,
+            ctxt->meta_key, ctxt->uncounted);
+    } else {
+        reply = redisCommand(ctxt->ctxt, "HGET %s items", ctxt->meta_key);
+    }
+    if (reply == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    *count = 0;
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    } else if (reply->type == REDIS_REPLY_INTEGER) {
+        *count = (uint64_t)(reply->integer);
+        ctxt->uncounted = 0;
+    } else if (reply->type == REDIS_REPLY_STRING) {
+        *count = strtoull(reply->str, NULL, 10);
+    }
+    freeReplyObject(reply);
+    return PYREBLOOM_OK;
+}
+
+uint64_t key_bits(pyrebloomctxt * ctxt, uint32_t i) {
+    uint64_t total = ctxt->bits, first = (uint64_t)(i) * ctxt->segment_bits;
+    if (ctxt->layout == PYREBLOOM_LAYOUT_PARTITIONED) {
+        total = ctxt->slice_bits;
+        first = (uint64_t)(i % ctxt->slice_segments) * ctxt->segment_bits;
+    }
+    return (total - first < ctxt->segment_bits) ?
+        total - first : ctxt->segment_bits;
+}
+
+/* A xorshift generator for picking samples, which needn't be reproducible */
+static uint64_t sample_random(uint64_t * state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+int sample_fill(pyrebloomctxt * ctxt, uint32_t samples, uint32_t range_bytes,
+    double * fill) {
+    static uint64_t calls = 0;
+    uint64_t state = ((uint64_t)(time(NULL)) << 24) ^ (++calls << 8) ^
+        (uint64_t)(uintptr_t)(ctxt) ^ 0x9E3779B97F4A7C15ULL;
+    uint64_t total = 0, offset, bytes, start, range, sampled = 0, set = 0;
+    uint64_t sparse = 0;
+    uint32_t i, key, replies = samples;
+    redisReply * reply = NULL;
+    int failed = 0;
+
+    if (samples == 0 || range_bytes == 0) {
+        strncpy(ctxt->ctxt->errstr, "Samples must be at least one byte",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    for (key = 0; key < ctxt->num_keys; ++key) {
+        total += key_bits(ctxt, key);
+    }
+    for (i = 0; i < samples; ++i) {
+        /* A random bit, the key it's in, and a range of bytes around it that
+         * stays inside that key */
+        offset = sample_random(&state) % total;
+        for (key = 0; offset >= key_bits(ctxt, key); ++key) {
+            offset -= key_bits(ctxt, key);
+        }
+        bytes = (key_bits(ctxt, key) + 7) / 8;
+        range = (range_bytes < bytes) ? range_bytes : bytes;
+        start = offset / 8;
+        if (start + range > bytes) {
+            start = bytes - range;
+        }
+        redisAppendCommand(ctxt->ctxt, "BITCOUNT %s %lu %lu", ctxt->keys[key],
+            start, start + range - 1);
+        /* The last byte of a key may be only partly used */
+        sampled += 8 * range;
+        if (start + range == bytes) {
+            sampled -= 8 * bytes - key_bits(ctxt, key);
+        }
+    }
+    /* A sparse filter's bits may all still be in its set */
+    if (ctxt->sparse_key) {
+        redisAppendCommand(ctxt->ctxt, "SCARD %s", ctxt->sparse_key);
+        ++replies;
+    }
+    for (i = 0; i < replies; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+        if (reply->type == REDIS_REPLY_ERROR) {
+            failed = 1;
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        } else if (i < samples) {
+            set += (uint64_t)(reply->integer);
+        } else {
+            sparse = (uint64_t)(reply->integer);
+        }
+        freeReplyObject(reply);
+    }
+    *fill = (double)(set) / sampled + (double)(sparse) / ctxt->bits;
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+int foldable(pyrebloomctxt * ctxt) {
+    if (ctxt->layout != PYREBLOOM_LAYOUT_STANDARD || ctxt->bits < 128) {
+        return 0;
+    } else if (ctxt->num_keys == 1) {
+        /* The halves are copied out a byte at a time */
+        return ctxt->bits % 16 == 0;
+    }
+    /* Each upper segment is folded onto a whole lower one */
+    return ctxt->num_keys % 2 == 0 &&
+        ctxt->bits == ctxt->num_keys * ctxt->segment_bits;
+}
+
+int fold(pyrebloomctxt * ctxt) {
+    uint32_t i, argc = 0, keep = ctxt->num_keys / 2;
+    size_t length = strlen(ctxt->key) + 16;
+    char * scratch = (char *)(malloc(2 * length));
+    char args[4][24];
+    const char ** argv;
+    redisReply * reply = NULL;
+
+    if (!foldable(ctxt)) {
+        strncpy(ctxt->ctxt->errstr, "Filter can't be folded any further",
+            errstr_size);
+        free(scratch);
+        return PYREBLOOM_ERROR;
+    }
+    argv = (const char **)(malloc((9 + ctxt->num_keys) * sizeof(char *)));
+    snprintf(scratch, length, "%s.fold.low", ctxt->key);
+    snprintf(scratch + length, length, "%s.fold.high", ctxt->key);
+    snprintf(args[0], 24, "%u", 3 + ctxt->num_keys);
+    snprintf(args[1], 24, "%lu", ctxt->bits);
+    snprintf(args[2], 24, "%lu", ctxt->bits / 2);
+    snprintf(args[3], 24, "%lu", ctxt->epoch);
+    argv[argc++] = "EVAL";
+    argv[argc++] = fold_script;
+    argv[argc++] = args[0];
+    argv[argc++] = ctxt->meta_key;
+    argv[argc++] = scratch;
+    argv[argc++] = scratch + length;
+    for (i = 0; i < ctxt->num_keys; ++i) {
+        argv[argc++] = ctxt->keys[i];
+    }
+    argv[argc++] = args[1];
+    argv[argc++] = args[2];
+    argv[argc++] = args[3];
+    reply = redisCommandArgv(ctxt->ctxt, argc, argv, NULL);
+    free(argv);
+    free(scratch);
+    if (reply == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->epoch = (uint64_t)(reply->integer);
+    freeReplyObject(reply);
+
+    /* The upper segments are gone, and the rest keep their names */
+    ctxt->bits /= 2;
+    if (ctxt->num_keys > 1) {
+        for (i = keep; i < ctxt->num_keys; ++i) {
+            free(ctxt->keys[i]);
+        }
+        ctxt->num_keys = keep;
+    }
+    return PYREBLOOM_OK;
+}
+
+/* The name of another filter's segment that holds the same bits as our i-th
+ * segment, for a filter of the same shape at `key` */
+static char * combine_segment(pyrebloomctxt * ctxt, const char * key,
+    uint32_t i) {
+    const char * suffix = ctxt->keys[i] + strlen(ctxt->key);
+    size_t length = strlen(key) + strlen(suffix) + 1;
+    char * name = (char *)(malloc(length));
+    snprintf(name, length, "%s%s", key, suffix);
+    return name;
+}
+
+/* Make sure that each of the filters at `keys` has the same bits, hashes,
+ * segments, hash family and layout as this one, so that their bits line up */
+static int combine_check(pyrebloomctxt * ctxt, const char ** keys,
+    uint32_t count) {
+    redisReply * reply = NULL;
+    uint32_t i;
+    int failed = 0;
+    if (ctxt->layout == PYREBLOOM_LAYOUT_SPARSE) {
+        strncpy(ctxt->ctxt->errstr, "Sparse filters can't be combined",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    for (i = 0; i < count; ++i) {
+        redisAppendCommand(ctxt->ctxt,
+            "HMGET %s.meta type bits hashes segment_bits hash layout state",
+            keys[i]);
+    }
+    for (i = 0; i < count; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            return PYREBLOOM_ERROR;
+        }
+        if (failed) {
+            freeReplyObject(reply);
+            continue;
+        }
+        if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 7 ||
+            reply->element[0]->type != REDIS_REPLY_STRING ||
+            strcmp(reply->element[0]->str, "bloom") != 0) {
+            snprintf(ctxt->ctxt->errstr, errstr_size,
+                "%s.meta doesn't describe a bloom filter", keys[i]);
+            failed = 1;
+        } else if (reply->element[1]->type != REDIS_REPLY_STRING ||
+            reply->element[2]->type != REDIS_REPLY_STRING ||
+            reply->element[3]->type != REDIS_REPLY_STRING ||
+            reply->element[4]->type != REDIS_REPLY_STRING ||
+            reply->element[5]->type != REDIS_REPLY_STRING ||
+            strtoull(reply->element[1]->str, NULL, 10) != ctxt->bits ||
+            strtoul(reply->element[2]->str, NULL, 10) != ctxt->hashes ||
+            strtoull(reply->element[3]->str, NULL, 10) != ctxt->segment_bits ||
+            strtoul(reply->element[4]->str, NULL, 10) != ctxt->hash_family ||
+            strtoul(reply->element[5]->str, NULL, 10) != ctxt->layout) {
+            strncpy(ctxt->ctxt->errstr,
+                "Only filters of the same shape can be combined", errstr_size);
+            failed = 1;
+        } else if (reply->element[6]->type == REDIS_REPLY_STRING &&
+            strcmp(reply->element[6]->str, "archived") == 0) {
+            snprintf(ctxt->ctxt->errstr, errstr_size,
+                "%s is archived, and must be rehydrated first", keys[i]);
+            failed = 1;
+        }
+        freeReplyObject(reply);
+    }
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+/* Queue up a BITOP of our i-th segment and the same segment of each of the
+ * filters at `keys`, stored in `dest` */
+static void combine_segment_op(pyrebloomctxt * ctxt, const char * dest,
+    const char ** keys, uint32_t count, uint32_t intersect, uint32_t i) {
+    const char ** argv = (const char **)(malloc((count + 4) *
+        sizeof(char *)));
+    uint32_t j, argc = 0;
+    argv[argc++] = "BITOP";
+    argv[argc++] = intersect ? "AND" : "OR";
+    argv[argc++] = dest;
+    argv[argc++] = ctxt->keys[i];
+    for (j = 0; j < count; ++j) {
+        argv[argc++] = combine_segment(ctxt, keys[j], i);
+    }
+    redisAppendCommandArgv(ctxt->ctxt, argc, argv, NULL);
+    for (j = 4; j < argc; ++j) {
+        free((char *)(argv[j]));
+    }
+    free(argv);
+}
+
+/* Read `count` replies, adding up the integers among every `stride` of them
+ * starting at `first` */
+static int combine_replies(pyrebloomctxt * ctxt, uint32_t count,
+    uint32_t first, uint32_t stride, uint64_t * total) {
+    redisReply * reply = NULL;
+    uint32_t i;
+    int failed = 0;
+    for (i = 0; i < count; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+        if (reply->type == REDIS_REPLY_ERROR) {
+            failed = 1;
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        } else if (total != NULL && i % stride == first) {
+            *total += (uint64_t)(reply->integer);
+        }
+        freeReplyObject(reply);
+    }
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+int combine(pyrebloomctxt * ctxt, const char * into, const char ** keys,
+    uint32_t count, uint32_t intersect) {
+    redisReply * reply = NULL;
+    uint64_t set = 0;
+    double items;
+    uint32_t i;
+    char * dest;
+
+    if (into != NULL) {
+        reply = redisCommand(ctxt->ctxt, "EVAL %s 2 %s %s.meta",
+            describe_script, ctxt->meta_key, into);
+        if (reply == NULL) {
+            return PYREBLOOM_ERROR;
+        }
+        freeReplyObject(reply);
+        if (combine_check(ctxt, &into, 1) == PYREBLOOM_ERROR) {
+            return PYREBLOOM_ERROR;
+        }
+    }
+    if (combine_check(ctxt, keys, count) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    for (i = 0; i < ctxt->num_keys; ++i) {
+        dest = (into != NULL) ?
+            combine_segment(ctxt, into, i) : ctxt->keys[i];
+        combine_segment_op(ctxt, dest, keys, count, intersect, i);
+        redisAppendCommand(ctxt->ctxt, "BITCOUNT %s", dest);
+        if (into != NULL) {
+            free(dest);
+        }
+    }
+    if (combine_replies(ctxt, 2 * ctxt->num_keys, 1, 2, &set) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+
+    /* Nobody knows how many items went into the result, so its running count
+     * starts over from an estimate */
+    items = estimate_items(set, ctxt->bits, ctxt->hashes);
+    if (items > (double)(ctxt->bits)) {
+        items = (double)(ctxt->bits);
+    }
+    if (into != NULL) {
+        reply = redisCommand(ctxt->ctxt, "HSET %s.meta items %lu", into,
+            (uint64_t)(items));
+    } else {
+        reply = redisCommand(ctxt->ctxt, "HSET %s items %lu", ctxt->meta_key,
+            (uint64_t)(items));
+        ctxt->uncounted = 0;
+    }
+    freeReplyObject(reply);
+    return PYREBLOOM_OK;
+}
+
+int combined_bits(pyrebloomctxt * ctxt, const char ** keys, uint32_t count,
+    uint32_t intersect, uint64_t * set) {
+    size_t length = strlen(ctxt->key) + 16;
+    char * scratch = (char *)(malloc(length));
+    uint32_t i;
+    int result;
+
+    *set = 0;
+    if (combine_check(ctxt, keys, count) == PYREBLOOM_ERROR) {
+        free(scratch);
+        return PYREBLOOM_ERROR;
+    }
+    /* Only one segment's worth of scratch space is ever used */
+    snprintf(scratch, length, "%s.combine", ctxt->key);
+    for (i = 0; i < ctxt->num_keys; ++i) {
+        combine_segment_op(ctxt, scratch, keys, count, intersect, i);
+        redisAppendCommand(ctxt->ctxt, "BITCOUNT %s", scratch);
+    }
+    redisAppendCommand(ctxt->ctxt, "DEL %s", scratch);
+    free(scratch);
+    result = combine_replies(ctxt, 2 * ctxt->num_keys, 1, 2, set);
+    return (combine_replies(ctxt, 1, 0, 1, NULL) == PYREBLOOM_ERROR) ?
+        PYREBLOOM_ERROR : result;
+}
 
 uint64_t hash(const char* data, uint32_t len, uint64_t seed, uint64_t bits) {
     return MurmurHash64A(data, len, seed) % bits;
@@ -236,3 +1747,6 @@ uint64_t hash(const char* data, uint32_t len, uint64_t seed, uint64_t bits) {
 /* It's a little tricky to get cython to include and build this file separately
  * but it's just copy-and-pasted code for the implementation of murmurhash */
 #include "murmur.c"
+#include "murmur_simd.c"
+#include "xxh3.c"
+#include "wyhash.c"
@@ -33,31 +33,237 @@ enum {
     PYREBLOOM_ERROR = -1
 };
 
+/* The hash functions a filter can be built with. These are recorded in each
+ * filter's metadata, so they must never be renumbered. */
+enum {
+    PYREBLOOM_HASH_MURMUR64A = 0,
+    PYREBLOOM_HASH_XXH3      = 1,
+    PYREBLOOM_HASH_WYHASH    = 2,
+    PYREBLOOM_HASH_COUNT
+};
+
+/* How a filter's bits are laid out across its segments. Also recorded in each
+ * filter's metadata. */
+enum {
+    PYREBLOOM_LAYOUT_STANDARD    = 0,
+    /* Hash i only ever sets bits in slice i, which has keys of its own */
+    PYREBLOOM_LAYOUT_PARTITIONED = 1,
+    /* Each item's bits all go in one of many small segments */
+    PYREBLOOM_LAYOUT_SHARDED     = 2,
+    /* Each item's bits all go in one 64-bit word */
+    PYREBLOOM_LAYOUT_BLOCKED     = 3,
+    /* Bits are kept as a set of offsets until there are enough of them to
+     * be worth a bitmap, and then it's a standard filter */
+    PYREBLOOM_LAYOUT_SPARSE      = 4,
+    PYREBLOOM_LAYOUT_COUNT
+};
+
 // And now for some redis stuff
 typedef struct {
-	uint32_t        capacity;
+	uint64_t        capacity;
     uint32_t        hashes;
     uint32_t        num_keys;
+    uint32_t        hash_family;
+    uint32_t        layout;
 	uint64_t        bits;
+    uint64_t        segment_bits;
 	double          error;
 	uint32_t      * seeds;
+    uint64_t      * offsets;
 	char          * key;
+    char          * meta_key;
     char          * password;
 	redisContext  * ctxt;
     char         ** keys;
+    /* For the partitioned layout, the bits in each slice and the number of
+     * segments each slice is split into. The keys of slice i are keys
+     * [i * slice_segments, (i + 1) * slice_segments). */
+    uint64_t        slice_bits;
+    uint32_t        slice_segments;
+    /* Items added or checked with the partitioned layout are queued up here,
+     * and then sent as a batch of reads or writes for each slice. `hits` is
+     * how many of each item's bits were already set. The blocked layout
+     * queues the mask of each item checked here instead, and the sparse
+     * layout just counts the scripts whose replies haven't been read. */
+    uint64_t      * batch;
+    uint32_t      * hits;
+    uint32_t        batched;
+    uint32_t        next_batched;
+    uint32_t        batch_size;
+    int             batch_result;
+    /* Scratch space for the BITFIELD commands of the sharded and blocked
+     * layouts, and the scripts of the sparse layout */
+    char          * args;
+    const char   ** argv;
+    size_t        * argvlen;
+    /* For the sparse layout, the set that holds the offsets of its bits for
+     * as long as it's sparse, and the script that reads and writes them */
+    char          * sparse_key;
+    char            sparse_sha[48];
+    int             reload;
+    /* New items that haven't yet been added to the running count in the
+     * metadata, which goes out behind the next batch of adds, how many were
+     * sent with it and how many replies to that are still to be read, and
+     * the script that does the counting once it's loaded */
+    uint64_t        uncounted;
+    uint64_t        counted;
+    int             counting;
+    char            count_sha[48];
+    /* Whether the filter's bits have been archived, compressed a page of
+     * `page_bytes` at a time into the hash at `archive_key` with its segments
+     * deleted, or are being archived by another client, and the pages of it
+     * that have been read and decompressed locally, along with which page
+     * each of those slots holds */
+    char          * archive_key;
+    int             archived;
+    int             archiving;
+    uint32_t        page_bytes;
+    unsigned char * pages;
+    uint64_t      * page_ids;
+    /* The filter's epoch, which goes up whenever it's folded, archived or
+     * rehydrated, as of when we last read its metadata. Each batch of adds or checks reads it again
+     * behind the batch, and if it has moved on, the batch went to a shape
+     * that's no longer current and the filter is `stale` until refreshed. */
+    uint64_t        epoch;
+    int             fencing;
+    int             stale;
 } pyrebloomctxt;
 
-int init_pyrebloom(pyrebloomctxt * ctxt, char * key, uint32_t capacity, double error, char* host, uint32_t port, char* password, uint32_t db);
+/* The size of the context error string */
+extern const size_t errstr_size;
+
+/* The most bits we'll put in one segment, the size of the segments of the
+ * sharded layout, and the version of the metadata recorded at `<key>.meta` */
+extern const uint32_t max_bits_per_key;
+extern const uint32_t shard_bits;
+extern const uint32_t metadata_version;
+
+/* With `power_of_two`, a standard filter's bits are rounded up to a power of
+ * two, so that it can be folded as many times as it's underfilled. A filter
+ * is given the fewest bits for its error rate, unless it asks for a number of
+ * `hashes`, when it's given however many bits that takes. */
+int init_pyrebloom(pyrebloomctxt * ctxt, char * key, uint64_t capacity, double error, char* host, uint32_t port, char* password, uint32_t db, uint32_t hash_family, uint32_t layout, uint32_t power_of_two, uint32_t hashes);
+
+/* The bits a filter needs to hold `capacity` items at `error` with a given
+ * number of hashes, or with 0, with however many need the fewest bits */
+uint64_t bits_for_hashes(uint64_t capacity, double error, uint32_t hashes);
+
+/* The relative cost of each operation on a filter with a number of hashes:
+ * its memory as a multiple of the fewest bits it could have, plus
+ * `probe_cost` for every bit that's read or written. */
+double plan_cost(uint64_t capacity, double error, uint32_t hashes,
+    double probe_cost);
+
+/* The number of hashes (up to plan_max_hashes) with the least plan_cost whose
+ * filter fits in `max_bits` (or any number, given 0), or 0 if none fits */
+extern const uint32_t plan_max_hashes;
+uint32_t plan_hashes(uint64_t capacity, double error, double probe_cost,
+    uint64_t max_bits);
 int free_pyrebloom(pyrebloomctxt * ctxt);
 
+/* Describe a filter that lives on an existing connection, without consulting
+ * or recording any metadata. The caller owns the connection, and should clear
+ * ctxt->ctxt before calling free_pyrebloom. Structures that store something
+ * other than single bits can use `segment_bits` to say how many of their
+ * cells fit in each segment. */
+int attach_pyrebloom(pyrebloomctxt * ctxt, redisContext * redis,
+    const char * key, uint64_t capacity, double error, uint32_t hash_family,
+    uint64_t segment_bits);
+
+/* Like attach_pyrebloom, but with exactly `bits` and `hashes` rather than
+ * however many are needed for a capacity and error rate */
+int attach_shaped(pyrebloomctxt * ctxt, redisContext * redis,
+    const char * key, uint64_t bits, uint32_t hashes, uint32_t hash_family,
+    uint64_t segment_bits);
+
+/* Connect, selecting the database before anything else is sent, and queueing
+ * up AUTH (or PING), and then read that reply along with any commands
+ * pipelined behind it */
+int begin_handshake(redisContext ** ctxt, char * host, uint32_t port,
+    char * password, uint32_t db);
+int finish_handshake(redisContext * ctxt, uint32_t count, redisReply ** last);
+
+/* Hash an item with MurmurHash64A once for each seed, with the named kernel
+ * rather than the fastest one this CPU has, for testing */
+int MurmurHash64A_seeds_kernel(const char * kernel, const void * key,
+    uint32_t len, const uint32_t * seeds, uint32_t count, uint64_t * out);
+
+/* Hash an item with one of the hash families */
+uint64_t hash_item(uint32_t hash_family, const char * data, uint32_t len,
+    uint64_t seed);
+
+/* Compute the offsets of an item for every one of the filter's hashes into
+ * ctxt->offsets */
+void hash_offsets(pyrebloomctxt * ctxt, const char * data, uint32_t len);
+
 int add(pyrebloomctxt * ctxt, const char * data, uint32_t len);
-int add_complete(pyrebloomctxt * ctxt, uint32_t count);
+
+/* Read the replies for `count` adds, and return how many of those items were
+ * new to the filter */
+int64_t add_complete(pyrebloomctxt * ctxt, uint64_t count);
 
 int check(pyrebloomctxt * ctxt, const char * data, uint32_t len);
 int check_next(pyrebloomctxt * ctxt);
 
+/* Send the fence behind a batch of checks, before the first check_next (or
+ * after the last archive_check), and read it once they've all been read.
+ * Adds send and read their own. */
+void check_fence(pyrebloomctxt * ctxt);
+int check_complete(pyrebloomctxt * ctxt);
+
+/* Read a stale filter's shape from its metadata again, tidying up after any
+ * adds that went to the bits it no longer has */
+int refresh(pyrebloomctxt * ctxt);
+
 int delete(pyrebloomctxt * ctxt);
 
+/* Delete every key of the bloom filter whose metadata is at `key`, whatever
+ * its shape, on an existing connection. It's an error if the metadata there
+ * describes something else, and nothing if there isn't any. */
+int delete_recorded(redisContext * redis, const char * key);
+
+/* How many of the filter's bits are set, summed over its segments */
+int bits_set(pyrebloomctxt * ctxt, uint64_t * count);
+
+/* How many distinct items a filter with `set` of its bits set holds */
+double estimate_items(uint64_t set, uint64_t bits, uint32_t hashes);
+
+/* Every client keeps a running count of the new items it's added in the
+ * filter's metadata, and this reads it, along with any of ours that haven't
+ * been sent yet */
+int items_added(pyrebloomctxt * ctxt, uint64_t * count);
+
+/* How many of the filter's bits the i-th key holds */
+uint64_t key_bits(pyrebloomctxt * ctxt, uint32_t i);
+
+/* Estimate the fraction of the filter's bits that are set without reading
+ * them all, from BITCOUNTs of `samples` random ranges of `range_bytes` */
+int sample_fill(pyrebloomctxt * ctxt, uint32_t samples, uint32_t range_bytes,
+    double * fill);
+
+/* Halve a standard filter by ORing the upper half of its bits into the lower
+ * half, freeing that much memory in redis. Items keep their bits, since an
+ * offset modulo half the bits is the offset modulo all of them, folded. The
+ * false positive rate goes up to what it would have been had it been that
+ * size all along. A filter can be folded while it has an even number of
+ * bits, and every time if it was sized to a power of two. Clients that
+ * already have it open find out from the fence behind their next batch. */
+int foldable(pyrebloomctxt * ctxt);
+int fold(pyrebloomctxt * ctxt);
+
+/* OR (or with `intersect`, AND) the bits of the filters at `keys` into this
+ * one, or, given `into`, this one's bits and theirs into a filter at `into`
+ * that's described like this one if it's new. They must all be the same
+ * shape: the same bits, hashes, segments, hash family and layout. It's one
+ * BITOP for each segment, all pipelined, and nothing is read back. */
+int combine(pyrebloomctxt * ctxt, const char * into, const char ** keys,
+    uint32_t count, uint32_t intersect);
+
+/* How many bits are set in the union (or intersection) of this filter and
+ * the filters at `keys`, without storing it anywhere but a scratch key */
+int combined_bits(pyrebloomctxt * ctxt, const char ** keys, uint32_t count,
+    uint32_t intersect, uint64_t * set);
+
 uint64_t hash(const char* data, uint32_t len, uint64_t seed, uint64_t bits);
 
 #endif
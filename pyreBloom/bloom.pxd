@@ -21,7 +21,20 @@
 
 cdef extern from "bloom.h":
     ctypedef unsigned int uint32_t
-    ctypedef unsigned long int uint64_t
+    ctypedef unsigned long long uint64_t
+    ctypedef long long int64_t
+
+    enum:
+        PYREBLOOM_HASH_MURMUR64A
+        PYREBLOOM_HASH_XXH3
+        PYREBLOOM_HASH_WYHASH
+
+    enum:
+        PYREBLOOM_LAYOUT_STANDARD
+        PYREBLOOM_LAYOUT_PARTITIONED
+        PYREBLOOM_LAYOUT_SHARDED
+        PYREBLOOM_LAYOUT_BLOCKED
+        PYREBLOOM_LAYOUT_SPARSE
 
     ctypedef struct redisContext:
         int err
@@ -31,28 +44,412 @@ cdef extern from "bloom.h":
         char *obuf
     
     ctypedef struct pyrebloomctxt:
-        uint32_t        capacity
+        uint64_t        capacity
         uint32_t        hashes
         uint32_t        num_keys
+        uint32_t        hash_family
+        uint32_t        layout
         uint64_t        bits
+        uint64_t        segment_bits
         double          error
         uint32_t      * seeds
+        uint64_t      * offsets
         char          * key
+        char          * meta_key
         char          * password
         redisContext  * ctxt
         char         ** keys
+        char          * sparse_key
+        char          * archive_key
+        int             archived
+        int             archiving
+        uint32_t        page_bytes
+        int             stale
 
-    bint init_pyrebloom(pyrebloomctxt * ctxt, unsigned char * key,
-        uint32_t capacity, float error, char* host, uint32_t port,
-        char* password, uint32_t db)
+    bint init_pyrebloom(pyrebloomctxt * ctxt, char * key,
+        uint64_t capacity, double error, char* host, uint32_t port,
+        char* password, uint32_t db, uint32_t hash_family, uint32_t layout,
+        uint32_t power_of_two, uint32_t hashes)
     bint free_pyrebloom(pyrebloomctxt * ctxt)
+
+    uint32_t plan_max_hashes
+    uint64_t bits_for_hashes(uint64_t capacity, double error, uint32_t hashes)
+    double plan_cost(uint64_t capacity, double error, uint32_t hashes,
+        double probe_cost)
+    uint32_t plan_hashes(uint64_t capacity, double error, double probe_cost,
+        uint64_t max_bits)
     
     bint add(pyrebloomctxt * ctxt, char * data, uint32_t len)
-    int add_complete(pyrebloomctxt * ctxt, uint32_t count)
+    int64_t add_complete(pyrebloomctxt * ctxt, uint64_t count)
     
     bint check(pyrebloomctxt * ctxt, char * data, uint32_t len)
     int check_next(pyrebloomctxt * ctxt)
+    void check_fence(pyrebloomctxt * ctxt)
+    int check_complete(pyrebloomctxt * ctxt)
+    int refresh(pyrebloomctxt * ctxt)
     
     bint delete(pyrebloomctxt * ctxt)
     
+    int bits_set(pyrebloomctxt * ctxt, uint64_t * count)
+    double estimate_items(uint64_t set, uint64_t bits, uint32_t hashes)
+    uint64_t hash_item(uint32_t hash_family, const char * data, uint32_t len,
+        uint64_t seed)
+    int MurmurHash64A_seeds_kernel(const char * kernel, const void * key,
+        uint32_t len, const uint32_t * seeds, uint32_t count, uint64_t * out)
+    int items_added(pyrebloomctxt * ctxt, uint64_t * count)
+    int sample_fill(pyrebloomctxt * ctxt, uint32_t samples,
+        uint32_t range_bytes, double * fill)
+    bint foldable(pyrebloomctxt * ctxt)
+    int fold(pyrebloomctxt * ctxt)
+
+    int combine(pyrebloomctxt * ctxt, const char * into, const char ** keys,
+        uint32_t count, uint32_t intersect)
+    int combined_bits(pyrebloomctxt * ctxt, const char ** keys,
+        uint32_t count, uint32_t intersect, uint64_t * set)
+    
     uint64_t hash(unsigned char * data, uint32_t len, uint64_t hash, uint64_t bits)
+
+cdef extern from "scalable.h":
+    ctypedef struct pyrebloomscalable:
+        uint64_t        capacity
+        double          error
+        double          growth
+        double          tightening
+        uint32_t        hash_family
+        uint32_t        num_filters
+        uint32_t        checked_filters
+        char          * key
+        char          * meta_key
+        pyrebloomctxt * filters
+        redisContext  * ctxt
+
+    bint init_scalable(pyrebloomscalable * ctxt, char * key, uint64_t capacity,
+        double error, double growth, double tightening, char * host,
+        uint32_t port, char * password, uint32_t db, uint32_t hash_family)
+    bint free_scalable(pyrebloomscalable * ctxt)
+
+    bint scalable_add(pyrebloomscalable * ctxt, char * data, uint32_t len)
+    int64_t scalable_add_complete(pyrebloomscalable * ctxt)
+
+    bint scalable_check_begin(pyrebloomscalable * ctxt)
+    bint scalable_check(pyrebloomscalable * ctxt, char * data, uint32_t len)
+    int scalable_check_begun(pyrebloomscalable * ctxt)
+    int scalable_check_next(pyrebloomscalable * ctxt)
+
+    bint scalable_delete(pyrebloomscalable * ctxt)
+
+cdef extern from "counting.h":
+    ctypedef struct pyrebloomcounting:
+        uint64_t        capacity
+        double          error
+        uint32_t        width
+        uint32_t        hash_family
+        char          * key
+        char          * meta_key
+        pyrebloomctxt   filter
+        redisContext  * ctxt
+
+    bint init_counting(pyrebloomcounting * ctxt, char * key, uint64_t capacity,
+        double error, uint32_t width, char * host, uint32_t port,
+        char * password, uint32_t db, uint32_t hash_family)
+    bint free_counting(pyrebloomcounting * ctxt)
+
+    bint counting_add(pyrebloomcounting * ctxt, char * data, uint32_t len)
+    int64_t counting_add_complete(pyrebloomcounting * ctxt, uint32_t count)
+
+    bint counting_remove(pyrebloomcounting * ctxt, char * data, uint32_t len)
+    int counting_remove_complete(pyrebloomcounting * ctxt, uint32_t count)
+
+    bint counting_check(pyrebloomcounting * ctxt, char * data, uint32_t len)
+    int counting_check_next(pyrebloomcounting * ctxt)
+
+    int counting_freeze(pyrebloomcounting * ctxt, char * key)
+
+    bint counting_delete(pyrebloomcounting * ctxt)
+
+cdef extern from "cuckoo.h":
+    ctypedef struct pyrebloomcuckoo:
+        uint64_t        capacity
+        double          error
+        uint32_t        hash_family
+        uint32_t        fingerprint_bits
+        uint32_t        bucket_size
+        uint64_t        buckets
+        uint32_t        num_keys
+        char          * key
+        char          * meta_key
+        char         ** keys
+        redisContext  * ctxt
+
+    bint init_cuckoo(pyrebloomcuckoo * ctxt, char * key, uint64_t capacity,
+        double error, char * host, uint32_t port, char * password,
+        uint32_t db, uint32_t hash_family)
+    bint free_cuckoo(pyrebloomcuckoo * ctxt)
+
+    bint cuckoo_add(pyrebloomcuckoo * ctxt, char * data, uint32_t len)
+    int64_t cuckoo_add_complete(pyrebloomcuckoo * ctxt, uint32_t count)
+
+    bint cuckoo_remove(pyrebloomcuckoo * ctxt, char * data, uint32_t len)
+    int cuckoo_remove_complete(pyrebloomcuckoo * ctxt, uint32_t count)
+
+    bint cuckoo_check(pyrebloomcuckoo * ctxt, char * data, uint32_t len)
+    int cuckoo_check_next(pyrebloomcuckoo * ctxt)
+
+    bint cuckoo_delete(pyrebloomcuckoo * ctxt)
+
+cdef extern from "xor.h":
+    ctypedef struct pyrebloomxor:
+        uint64_t        size
+        uint32_t        fingerprint_bits
+        uint32_t        hash_family
+        uint64_t        block_length
+        void          * fingerprints
+        uint32_t        num_keys
+        char            errstr[128]
+        char          * key
+        char         ** keys
+        redisContext  * ctxt
+
+    int xor_build(pyrebloomxor * ctxt, const char ** items,
+        const uint32_t * lengths,
+        uint64_t count, double error, uint32_t threads,
+        uint32_t hash_family) nogil
+    int xor_store(pyrebloomxor * ctxt, char * key, char * host, uint32_t port,
+        char * password, uint32_t db)
+    int xor_save(pyrebloomxor * ctxt, char * path)
+    int xor_load(pyrebloomxor * ctxt, char * path)
+
+    int init_xor(pyrebloomxor * ctxt, char * key, char * host, uint32_t port,
+        char * password, uint32_t db)
+    bint free_xor(pyrebloomxor * ctxt)
+
+    int xor_contains(pyrebloomxor * ctxt, char * data, uint32_t len)
+
+    bint xor_check(pyrebloomxor * ctxt, char * data, uint32_t len)
+    int xor_check_next(pyrebloomxor * ctxt)
+
+    bint xor_delete(pyrebloomxor * ctxt)
+
+cdef extern from "rotating.h":
+    ctypedef struct pyrebloomrotating:
+        uint64_t        capacity
+        double          error
+        uint32_t        period
+        uint32_t        generations
+        uint32_t        hash_family
+        uint64_t        current
+        char          * key
+        char          * meta_key
+        pyrebloomctxt * filters
+        redisContext  * ctxt
+
+    bint init_rotating(pyrebloomrotating * ctxt, char * key, uint64_t capacity,
+        double error, uint32_t period, uint32_t generations, char * host,
+        uint32_t port, char * password, uint32_t db, uint32_t hash_family)
+    bint free_rotating(pyrebloomrotating * ctxt)
+
+    bint rotating_add(pyrebloomrotating * ctxt, char * data, uint32_t len)
+    int64_t rotating_add_complete(pyrebloomrotating * ctxt, uint32_t count)
+
+    bint rotating_check(pyrebloomrotating * ctxt, char * data, uint32_t len)
+    int rotating_check_next(pyrebloomrotating * ctxt)
+
+    uint32_t rotating_num_keys(pyrebloomrotating * ctxt)
+    char * rotating_key(pyrebloomrotating * ctxt, uint32_t index)
+
+    bint rotating_delete(pyrebloomrotating * ctxt)
+
+cdef extern from "stable.h":
+    ctypedef struct pyrebloomstable:
+        uint64_t        capacity
+        double          error
+        uint32_t        width
+        uint32_t        decrements
+        uint32_t        hash_family
+        char          * key
+        char          * meta_key
+        pyrebloomctxt   filter
+        redisContext  * ctxt
+
+    bint init_stable(pyrebloomstable * ctxt, char * key, uint64_t capacity,
+        double error, uint32_t width, char * host, uint32_t port,
+        char * password, uint32_t db, uint32_t hash_family)
+    bint free_stable(pyrebloomstable * ctxt)
+
+    bint stable_add(pyrebloomstable * ctxt, char * data, uint32_t len)
+    int64_t stable_add_complete(pyrebloomstable * ctxt, uint32_t count)
+
+    bint stable_check(pyrebloomstable * ctxt, char * data, uint32_t len)
+    int stable_check_next(pyrebloomstable * ctxt)
+
+    bint stable_delete(pyrebloomstable * ctxt)
+
+cdef extern from "countmin.h":
+    ctypedef struct pyrebloomcountmin:
+        double          error
+        double          confidence
+        uint64_t        columns
+        uint32_t        rows
+        uint32_t        width
+        uint32_t        hash_family
+        char          * key
+        char          * meta_key
+        pyrebloomctxt   filter
+        redisContext  * ctxt
+
+    bint init_countmin(pyrebloomcountmin * ctxt, char * key, double error,
+        double confidence, uint32_t width, char * host, uint32_t port,
+        char * password, uint32_t db, uint32_t hash_family)
+    bint free_countmin(pyrebloomcountmin * ctxt)
+
+    bint countmin_increment(pyrebloomcountmin * ctxt, char * data,
+        uint32_t len, int64_t by)
+    bint countmin_count(pyrebloomcountmin * ctxt, char * data, uint32_t len)
+    int64_t countmin_next(pyrebloomcountmin * ctxt)
+
+    bint countmin_delete(pyrebloomcountmin * ctxt)
+
+cdef extern from "signature.h":
+    ctypedef struct pyrebloomsignature:
+        uint64_t        capacity
+        double          error
+        uint32_t        slots
+        uint32_t        hash_family
+        char          * key
+        char          * meta_key
+        char          * members_key
+        uint32_t      * found
+        pyrebloomctxt   filter
+        redisContext  * ctxt
+
+    bint init_signature(pyrebloomsignature * ctxt, char * key,
+        uint64_t capacity, double error, uint32_t slots, char * host,
+        uint32_t port, char * password, uint32_t db, uint32_t hash_family)
+    bint free_signature(pyrebloomsignature * ctxt)
+
+    int signature_member(pyrebloomsignature * ctxt, char * name, uint32_t len)
+    char * signature_name(pyrebloomsignature * ctxt, uint32_t slot)
+
+    bint signature_add(pyrebloomsignature * ctxt, uint32_t slot, char * data,
+        uint32_t len)
+    int64_t signature_add_complete(pyrebloomsignature * ctxt, uint32_t count)
+
+    bint signature_check(pyrebloomsignature * ctxt, char * data, uint32_t len)
+    int signature_check_next(pyrebloomsignature * ctxt)
+
+    bint signature_delete(pyrebloomsignature * ctxt)
+
+cdef extern from "prefix.h":
+    ctypedef struct pyrebloomprefix:
+        uint64_t        capacity
+        double          error
+        uint32_t        levels
+        char            separator
+        uint32_t        hash_family
+        char          * key
+        char          * meta_key
+        pyrebloomctxt * filters
+        redisContext  * ctxt
+
+    bint init_prefix(pyrebloomprefix * ctxt, char * key, uint64_t capacity,
+        double error, uint32_t levels, char separator, char * host,
+        uint32_t port, char * password, uint32_t db, uint32_t hash_family)
+    bint free_prefix(pyrebloomprefix * ctxt)
+
+    uint32_t prefix_count(pyrebloomprefix * ctxt, char * data, uint32_t len)
+
+    bint prefix_add(pyrebloomprefix * ctxt, char * data, uint32_t len)
+    int64_t prefix_add_complete(pyrebloomprefix * ctxt, uint32_t count)
+
+    bint prefix_check(pyrebloomprefix * ctxt, char * data, uint32_t len)
+    int prefix_check_next(pyrebloomprefix * ctxt)
+
+    bint prefix_delete(pyrebloomprefix * ctxt)
+
+cdef extern from "quotient.h":
+    ctypedef struct pyrebloomquotient:
+        uint64_t        capacity
+        double          error
+        uint32_t        hash_family
+        uint32_t        fingerprint_bits
+        uint32_t        quotient_bits
+        uint32_t        remainder_bits
+        uint32_t        slot_bytes
+        uint64_t        count
+        char          * key
+        char          * meta_key
+        char          * segment_key
+        redisContext  * ctxt
+
+    bint init_quotient(pyrebloomquotient * ctxt, char * key, uint64_t capacity,
+        double error, char * host, uint32_t port, char * password, uint32_t db,
+        uint32_t hash_family)
+    bint free_quotient(pyrebloomquotient * ctxt)
+
+    bint quotient_add(pyrebloomquotient * ctxt, char * data, uint32_t len)
+    int64_t quotient_add_complete(pyrebloomquotient * ctxt)
+
+    bint quotient_check(pyrebloomquotient * ctxt, char * data, uint32_t len)
+    int quotient_check_next(pyrebloomquotient * ctxt)
+
+    int quotient_grow(pyrebloomquotient * ctxt)
+    int quotient_merge(pyrebloomquotient * ctxt, char * key)
+
+    bint quotient_delete(pyrebloomquotient * ctxt)
+
+cdef extern from "packed.h":
+    ctypedef struct pyrebloompacked:
+        uint64_t        capacity
+        double          error
+        uint32_t        hash_family
+        uint32_t        tenants_per_segment
+        char          * key
+        char          * meta_key
+        char          * tenants_key
+        pyrebloomctxt   filter
+        redisContext  * ctxt
+
+    bint init_packed(pyrebloompacked * ctxt, char * key, uint64_t capacity,
+        double error, char * host, uint32_t port, char * password, uint32_t db,
+        uint32_t hash_family)
+    bint free_packed(pyrebloompacked * ctxt)
+
+    bint packed_tenant(pyrebloompacked * ctxt, char * name, uint32_t len,
+        int assign)
+    int packed_tenant_next(pyrebloompacked * ctxt, uint32_t * tenant)
+
+    bint packed_add(pyrebloompacked * ctxt, uint32_t tenant, char * data,
+        uint32_t len)
+    int64_t packed_add_complete(pyrebloompacked * ctxt)
+
+    bint packed_check(pyrebloompacked * ctxt, uint32_t tenant, char * data,
+        uint32_t len)
+    int packed_check_next(pyrebloompacked * ctxt)
+
+    int64_t packed_tenants(pyrebloompacked * ctxt)
+
+    bint packed_delete(pyrebloompacked * ctxt)
+
+cdef extern from "sync.h":
+    ctypedef struct pyrebloomsync:
+        uint32_t        page_bytes
+        uint64_t        pages_checked
+        uint64_t        pages_sent
+        uint64_t        bytes_sent
+        redisContext  * source
+        redisContext  * replica
+
+    bint init_sync(pyrebloomsync * ctxt, char * host, uint32_t port,
+        char * password, uint32_t db, char * replica_host,
+        uint32_t replica_port, char * replica_password, uint32_t replica_db,
+        uint32_t page_bytes)
+    bint free_sync(pyrebloomsync * ctxt)
+
+    int64_t sync_key(pyrebloomsync * ctxt, char * key)
+
+cdef extern from "archive.h":
+    uint32_t archive_page_bytes
+
+    int archive(pyrebloomctxt * ctxt, uint32_t page_bytes, uint64_t * size)
+    int rehydrate(pyrebloomctxt * ctxt)
+    int archive_check(pyrebloomctxt * ctxt, char * data, uint32_t len)
@@ -0,0 +1,390 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "counting.h"
+#include <stdio.h>
+#include <string.h>
+
+/* The version of the metadata layout for counting filters */
+static const uint32_t counting_version = 1;
+
+/* How many counters freeze reads at a time */
+static const uint32_t freeze_chunk = 65536;
+
+/* Load the description of a counting filter, or record it if it's new. A
+ * first segment without any metadata belongs to an ordinary filter that
+ * predates metadata, and mustn't be mistaken for counters.
+ *
+ *     KEYS = { metadata key, first segment key }
+ *     ARGV = { capacity, error, width, hash family, version }
+ *
+ * It replies with the recorded capacity, error, width and hash family. */
+static const char * counting_init_script =
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'counting' then\n"
+    "    return redis.call('HMGET', KEYS[1], 'capacity', 'error', 'width',\n"
+    "        'hash')\n"
+    "elseif redis.call('EXISTS', KEYS[1], KEYS[2]) > 0 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "elseif ARGV[1] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; capacity and error are required')\n"
+    "end\n"
+    "redis.call('HMSET', KEYS[1], 'type', 'counting', 'capacity', ARGV[1],\n"
+    "    'error', ARGV[2], 'width', ARGV[3], 'hash', ARGV[4],\n"
+    "    'version', ARGV[5])\n"
+    "return {ARGV[1], ARGV[2], ARGV[3], ARGV[4]}";
+
+int init_counting(pyrebloomcounting * ctxt, char * key, uint64_t capacity,
+    double error, uint32_t width, char * host, uint32_t port,
+    char * password, uint32_t db, uint32_t hash_family) {
+    redisReply * reply = NULL;
+    uint32_t args;
+
+    ctxt->key      = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    /* A counter of a single bit can't tell a new item from an old one. This
+     * has to be caught before it's recorded for everyone else. */
+    if (capacity != 0 && (width < 2 || width > 16)) {
+        strncpy(ctxt->ctxt->errstr, "Counters must be 2 to 16 bits wide",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->ctxt, "EVAL %s 2 %s %s.0 %lu %.17g %u %u %u",
+        counting_init_script, ctxt->meta_key, key, capacity, error, width,
+        hash_family, counting_version);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 4) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->capacity    = strtoull(reply->element[0]->str, NULL, 10);
+    ctxt->error       = strtod(reply->element[1]->str, NULL);
+    ctxt->width       = (uint32_t)(strtoul(reply->element[2]->str, NULL, 10));
+    ctxt->hash_family = (uint32_t)(strtoul(reply->element[3]->str, NULL, 10));
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT || ctxt->capacity == 0 ||
+        ctxt->error <= 0 || ctxt->error >= 1 ||
+        ctxt->width < 2 || ctxt->width > 16) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+
+    attach_pyrebloom(&ctxt->filter, ctxt->ctxt, key, ctxt->capacity,
+        ctxt->error, ctxt->hash_family, max_bits_per_key / ctxt->width);
+    snprintf(ctxt->type, sizeof(ctxt->type), "u%u", ctxt->width);
+    ctxt->per_item = (ctxt->filter.num_keys == 1) ? 1 : ctxt->filter.hashes;
+
+    /* BITFIELD key OVERFLOW SAT, and then INCRBY type offset delta for each
+     * of the hashes */
+    args = 4 + 4 * ctxt->filter.hashes;
+    ctxt->args    = (char *)(malloc(ctxt->filter.hashes * 24));
+    ctxt->argv    = (const char **)(malloc(args * sizeof(char *)));
+    ctxt->argvlen = (size_t *)(malloc(args * sizeof(size_t)));
+    return PYREBLOOM_OK;
+}
+
+int free_counting(pyrebloomcounting * ctxt) {
+    /* The connection is ours, not the filter's */
+    ctxt->filter.ctxt = NULL;
+    free_pyrebloom(&ctxt->filter);
+    free(ctxt->args);
+    free(ctxt->argv);
+    free(ctxt->argvlen);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+/* Queue up the BITFIELD commands that touch each of an item's counters. With
+ * a delta, the counters are incremented (saturating at either end), and
+ * without one they're just read. */
+static void counting_append(
+    pyrebloomcounting * ctxt, const char * data, uint32_t len,
+    const char * delta) {
+    pyrebloomctxt * filter = &ctxt->filter;
+    uint32_t i, j, argc = 0;
+    hash_offsets(filter, data, len);
+    for (i = 0; i < filter->hashes; ++i) {
+        uint64_t d = filter->offsets[i];
+        char * offset = ctxt->args + i * 24;
+        snprintf(offset, 24, "#%lu", d % filter->segment_bits);
+
+        if (argc == 0) {
+            ctxt->argv[argc++] = "BITFIELD";
+            ctxt->argv[argc++] = filter->keys[d / filter->segment_bits];
+            if (delta) {
+                ctxt->argv[argc++] = "OVERFLOW";
+                ctxt->argv[argc++] = "SAT";
+            }
+        }
+        ctxt->argv[argc++] = delta ? "INCRBY" : "GET";
+        ctxt->argv[argc++] = ctxt->type;
+        ctxt->argv[argc++] = offset;
+        if (delta) {
+            ctxt->argv[argc++] = delta;
+        }
+
+        /* Counters in different segments need commands of their own */
+        if (ctxt->per_item != 1 || i + 1 == filter->hashes) {
+            for (j = 0; j < argc; ++j) {
+                ctxt->argvlen[j] = strlen(ctxt->argv[j]);
+            }
+            redisAppendCommandArgv(ctxt->ctxt, argc, ctxt->argv,
+                ctxt->argvlen);
+            argc = 0;
+        }
+    }
+}
+
+/* Read the replies for one item, finding the smallest of its counters */
+static int counting_next(pyrebloomcounting * ctxt, long long * smallest) {
+    uint32_t i, j;
+    int result = PYREBLOOM_OK;
+    redisReply * reply = NULL;
+    *smallest = -1;
+    for (i = 0; i < ctxt->per_item; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+
+        if (reply->type == REDIS_REPLY_ERROR) {
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+            result = PYREBLOOM_ERROR;
+        } else if (reply->type == REDIS_REPLY_ARRAY) {
+            for (j = 0; j < reply->elements; ++j) {
+                long long value = reply->element[j]->integer;
+                if (*smallest < 0 || value < *smallest) {
+                    *smallest = value;
+                }
+            }
+        }
+        freeReplyObject(reply);
+    }
+    return result;
+}
+
+int counting_add(pyrebloomcounting * ctxt, const char * data, uint32_t len) {
+    counting_append(ctxt, data, len, "1");
+    return PYREBLOOM_OK;
+}
+
+int64_t counting_add_complete(pyrebloomcounting * ctxt, uint32_t count) {
+    uint32_t i, total = 0;
+    int failed = 0;
+    long long smallest;
+
+    for (i = 0; i < count; ++i) {
+        if (counting_next(ctxt, &smallest) == PYREBLOOM_ERROR) {
+            failed = 1;
+        } else if (smallest == 1) {
+            /* One of its counters was empty, so the item is new */
+            total += 1;
+        }
+    }
+
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+    return total;
+}
+
+int counting_remove(pyrebloomcounting * ctxt, const char * data, uint32_t len) {
+    counting_append(ctxt, data, len, "-1");
+    return PYREBLOOM_OK;
+}
+
+int counting_remove_complete(pyrebloomcounting * ctxt, uint32_t count) {
+    uint32_t i, total = 0;
+    int failed = 0;
+    long long smallest;
+
+    for (i = 0; i < count; ++i) {
+        if (counting_next(ctxt, &smallest) == PYREBLOOM_ERROR) {
+            failed = 1;
+        } else if (smallest == 0) {
+            /* The item is no longer in the filter */
+            total += 1;
+        }
+    }
+
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+    return total;
+}
+
+int counting_check(pyrebloomcounting * ctxt, const char * data, uint32_t len) {
+    counting_append(ctxt, data, len, NULL);
+    return PYREBLOOM_OK;
+}
+
+int counting_check_next(pyrebloomcounting * ctxt) {
+    long long smallest;
+    if (counting_next(ctxt, &smallest) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    return smallest > 0;
+}
+
+/* Whether the `index`th counter of `width` bits in `data` is non-zero.
+ * BITFIELD stores counters most significant bit first, just like SETBIT. */
+static int counter_set(const unsigned char * data, size_t length,
+    uint64_t index, uint32_t width) {
+    uint64_t bit = index * width, end = bit + width;
+    for (; bit < end; ++bit) {
+        if ((bit >> 3) < length && (data[bit >> 3] & (0x80 >> (bit & 7)))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Read the replies to the commands that have been pipelined so far */
+static int freeze_drain(redisContext * redis, uint32_t * pending, int result) {
+    redisReply * reply = NULL;
+    for (; *pending > 0; --(*pending)) {
+        if (redisGetReply(redis, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(redis->errstr, "No pending replies", errstr_size);
+            *pending = 0;
+            return PYREBLOOM_ERROR;
+        }
+        if (reply->type == REDIS_REPLY_ERROR && result == PYREBLOOM_OK) {
+            strncpy(redis->errstr, reply->str, errstr_size);
+            result = PYREBLOOM_ERROR;
+        }
+        freeReplyObject(reply);
+    }
+    return result;
+}
+
+int counting_freeze(pyrebloomcounting * ctxt, const char * key) {
+    pyrebloomctxt * filter = &ctxt->filter;
+    unsigned char * bitmap = (unsigned char *)(malloc(freeze_chunk / 8));
+    uint64_t start, counters, chunk, i;
+    uint32_t segment, pending = 0;
+    size_t length = strlen(key) + 12;
+    char * name = (char *)(malloc(length));
+    redisReply * reply = NULL;
+    int result = PYREBLOOM_OK;
+
+    if (strcmp(key, ctxt->key) == 0) {
+        strncpy(ctxt->ctxt->errstr, "Can't freeze a filter into itself",
+            errstr_size);
+        free(bitmap);
+        free(name);
+        return PYREBLOOM_ERROR;
+    }
+
+    /* Start from nothing, even if a filter of some other shape was there */
+    if (delete_recorded(ctxt->ctxt, key) == PYREBLOOM_ERROR) {
+        free(bitmap);
+        free(name);
+        return PYREBLOOM_ERROR;
+    }
+
+    /* The frozen filter keeps the same segments as the counters, so that
+     * each chunk of counters becomes a byte-aligned run of bits */
+    for (segment = 0; segment < filter->num_keys; ++segment) {
+        snprintf(name, length, "%s.%u", key, segment);
+        redisAppendCommand(ctxt->ctxt, "DEL %s", name);
+        ++pending;
+
+        counters = filter->bits - (uint64_t)(segment) * filter->segment_bits;
+        if (counters > filter->segment_bits) {
+            counters = filter->segment_bits;
+        }
+        for (start = 0; start < counters; start += freeze_chunk) {
+            /* Each chunk is read in the same round trip as the last one's
+             * bits are written */
+            redisAppendCommand(ctxt->ctxt, "GETRANGE %s %lu %lu",
+                filter->keys[segment], start * ctxt->width / 8,
+                (start + freeze_chunk) * ctxt->width / 8 - 1);
+            result = freeze_drain(ctxt->ctxt, &pending, result);
+            if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+                strncpy(ctxt->ctxt->errstr, "No pending replies",
+                    errstr_size);
+                free(bitmap);
+                free(name);
+                return PYREBLOOM_ERROR;
+            }
+            if (reply->type == REDIS_REPLY_ERROR) {
+                strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+                result = PYREBLOOM_ERROR;
+            } else if (reply->type == REDIS_REPLY_STRING && reply->len > 0) {
+                /* The last chunk may be short of a whole one */
+                chunk = counters - start;
+                if (chunk > freeze_chunk) {
+                    chunk = freeze_chunk;
+                }
+                memset(bitmap, 0, freeze_chunk / 8);
+                for (i = 0; i < chunk; ++i) {
+                    if (counter_set((unsigned char *)(reply->str), reply->len,
+                        i, ctxt->width)) {
+                        bitmap[i >> 3] |= 0x80 >> (i & 7);
+                    }
+                }
+                redisAppendCommand(ctxt->ctxt, "SETRANGE %s %lu %b", name,
+                    start / 8, bitmap, (size_t)((chunk + 7) / 8));
+                ++pending;
+            }
+            freeReplyObject(reply);
+        }
+    }
+
+    /* Describe it last, so that it isn't opened before it's complete */
+    snprintf(name, length, "%s.meta", key);
+    redisAppendCommand(ctxt->ctxt,
+        "HMSET %s type bloom capacity %lu error %.17g bits %lu hashes %u "
+        "segment_bits %lu hash %u layout %u version %u", name,
+        ctxt->capacity, ctxt->error, filter->bits, filter->hashes,
+        filter->segment_bits, ctxt->hash_family, PYREBLOOM_LAYOUT_STANDARD,
+        metadata_version);
+    ++pending;
+    result = freeze_drain(ctxt->ctxt, &pending, result);
+
+    free(bitmap);
+    free(name);
+    return result;
+}
+
+int counting_delete(pyrebloomcounting * ctxt) {
+    delete(&ctxt->filter);
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->meta_key));
+    return PYREBLOOM_OK;
+}
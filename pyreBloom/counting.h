@@ -0,0 +1,81 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef PYRE_COUNTING_H
+#define PYRE_COUNTING_H
+
+#include "bloom.h"
+
+/* A counting bloom filter keeps a small saturating counter where an ordinary
+ * filter keeps a bit, so that items can be removed as well as added. The
+ * counters are `width` bits wide (4 by default, which is plenty unless the
+ * filter is badly overfilled) and live in the segments `<key>.0`, `<key>.1`,
+ * ... where they're updated with BITFIELD. The filter is described by
+ * `<key>.meta`.
+ *
+ * Removing an item that was never added will remove other items with it, and
+ * a counter that saturates can no longer be trusted to count down, so it's
+ * up to the caller to only remove what it has added. */
+typedef struct {
+    uint64_t        capacity;
+    double          error;
+    uint32_t        width;
+    uint32_t        hash_family;
+    /* How many BITFIELD commands each item needs; one, unless the counters
+     * are spread across more than one segment */
+    uint32_t        per_item;
+    char            type[8];
+    char          * key;
+    char          * meta_key;
+    /* Scratch space for building BITFIELD commands */
+    char          * args;
+    const char   ** argv;
+    size_t        * argvlen;
+    /* The counters are described as though they were the bits of a filter */
+    pyrebloomctxt   filter;
+    redisContext  * ctxt;
+} pyrebloomcounting;
+
+int init_counting(pyrebloomcounting * ctxt, char * key, uint64_t capacity,
+    double error, uint32_t width, char * host, uint32_t port,
+    char * password, uint32_t db, uint32_t hash_family);
+int free_counting(pyrebloomcounting * ctxt);
+
+int counting_add(pyrebloomcounting * ctxt, const char * data, uint32_t len);
+int64_t counting_add_complete(pyrebloomcounting * ctxt, uint32_t count);
+
+int counting_remove(pyrebloomcounting * ctxt, const char * data, uint32_t len);
+int counting_remove_complete(pyrebloomcounting * ctxt, uint32_t count);
+
+int counting_check(pyrebloomcounting * ctxt, const char * data, uint32_t len);
+int counting_check_next(pyrebloomcounting * ctxt);
+
+/* Write an ordinary bloom filter to `key` with a bit set wherever a counter
+ * is non-zero, replacing any bloom filter that was there. It holds the same
+ * items in a fraction of the space, for when no more items need to be
+ * removed. */
+int counting_freeze(pyrebloomcounting * ctxt, const char * key);
+
+int counting_delete(pyrebloomcounting * ctxt);
+
+#endif
@@ -0,0 +1,235 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "countmin.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The version of the metadata layout for count-min sketches */
+static const uint32_t countmin_version = 1;
+
+/* Load the description of a count-min sketch, or record it if it's new. A
+ * first segment without any metadata belongs to an ordinary filter that
+ * predates metadata, and mustn't be mistaken for counters.
+ *
+ *     KEYS = { metadata key, first segment key }
+ *     ARGV = { error, confidence, columns, rows, width, hash family,
+ *              version }
+ *
+ * It replies with the recorded error, confidence, columns, rows, width and
+ * hash family. */
+static const char * countmin_init_script =
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'countmin' then\n"
+    "    return redis.call('HMGET', KEYS[1], 'error', 'confidence',\n"
+    "        'columns', 'rows', 'width', 'hash')\n"
+    "elseif redis.call('EXISTS', KEYS[1], KEYS[2]) > 0 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "elseif ARGV[3] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; error and confidence are required')\n"
+    "end\n"
+    "redis.call('HMSET', KEYS[1], 'type', 'countmin', 'error', ARGV[1],\n"
+    "    'confidence', ARGV[2], 'columns', ARGV[3], 'rows', ARGV[4],\n"
+    "    'width', ARGV[5], 'hash', ARGV[6], 'version', ARGV[7])\n"
+    "return {ARGV[1], ARGV[2], ARGV[3], ARGV[4], ARGV[5], ARGV[6]}";
+
+int init_countmin(pyrebloomcountmin * ctxt, char * key, double error,
+    double confidence, uint32_t width, char * host, uint32_t port,
+    char * password, uint32_t db, uint32_t hash_family) {
+    redisReply * reply = NULL;
+    uint64_t columns = 0;
+    uint32_t rows = 0, args;
+
+    ctxt->key      = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    /* This has to be caught before it's recorded for everyone else. Redis'
+     * unsigned fields are at most 63 bits. */
+    if (error != 0 && (width < 2 || width > 63 || error < 0 ||
+        error >= 1 || confidence <= 0 || confidence >= 1)) {
+        strncpy(ctxt->ctxt->errstr,
+            "Counters must be 2 to 63 bits wide, and the error and "
+            "confidence between 0 and 1", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    /* From Cormode and Muthukrishnan */
+    if (error > 0) {
+        columns = (uint64_t)(ceil(exp(1) / error));
+        rows    = (uint32_t)(ceil(log(1 / (1 - confidence))));
+    }
+    redisAppendCommand(ctxt->ctxt,
+        "EVAL %s 2 %s %s.0 %.17g %.17g %lu %u %u %u %u",
+        countmin_init_script, ctxt->meta_key, key, error, confidence, columns,
+        rows, width, hash_family, countmin_version);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 6) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->error       = strtod(reply->element[0]->str, NULL);
+    ctxt->confidence  = strtod(reply->element[1]->str, NULL);
+    ctxt->columns     = strtoull(reply->element[2]->str, NULL, 10);
+    ctxt->rows        = (uint32_t)(strtoul(reply->element[3]->str, NULL, 10));
+    ctxt->width       = (uint32_t)(strtoul(reply->element[4]->str, NULL, 10));
+    ctxt->hash_family = (uint32_t)(strtoul(reply->element[5]->str, NULL, 10));
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT || ctxt->columns == 0 ||
+        ctxt->rows == 0 || ctxt->width < 2 || ctxt->width > 63) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+
+    attach_shaped(&ctxt->filter, ctxt->ctxt, key, ctxt->columns * ctxt->rows,
+        ctxt->rows, ctxt->hash_family, max_bits_per_key / ctxt->width);
+    snprintf(ctxt->type, sizeof(ctxt->type), "u%u", ctxt->width);
+    ctxt->per_item = (ctxt->filter.num_keys == 1) ? 1 : ctxt->rows;
+
+    /* BITFIELD key OVERFLOW SAT, and then INCRBY type offset delta for each
+     * of the rows */
+    args = 4 + 4 * ctxt->rows;
+    ctxt->args    = (char *)(malloc(ctxt->rows * 24 + 24));
+    ctxt->argv    = (const char **)(malloc(args * sizeof(char *)));
+    ctxt->argvlen = (size_t *)(malloc(args * sizeof(size_t)));
+    return PYREBLOOM_OK;
+}
+
+int free_countmin(pyrebloomcountmin * ctxt) {
+    /* The connection is ours, not the filter's */
+    ctxt->filter.ctxt = NULL;
+    free_pyrebloom(&ctxt->filter);
+    free(ctxt->args);
+    free(ctxt->argv);
+    free(ctxt->argvlen);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+/* Queue up the BITFIELD commands that touch an item's counter in each row.
+ * With a delta, the counters are incremented (saturating at either end), and
+ * without one they're just read. */
+static void countmin_append(pyrebloomcountmin * ctxt, const char * data,
+    uint32_t len, const char * delta) {
+    pyrebloomctxt * filter = &ctxt->filter;
+    uint32_t i, j, argc = 0;
+    hash_offsets(filter, data, len);
+
+    for (i = 0; i < ctxt->rows; ++i) {
+        /* Row i's hash picks a counter in row i */
+        uint64_t d = i * ctxt->columns + filter->offsets[i] % ctxt->columns;
+        char * offset = ctxt->args + i * 24;
+        snprintf(offset, 24, "#%lu", d % filter->segment_bits);
+
+        if (argc == 0) {
+            ctxt->argv[argc++] = "BITFIELD";
+            ctxt->argv[argc++] = filter->keys[d / filter->segment_bits];
+            if (delta) {
+                ctxt->argv[argc++] = "OVERFLOW";
+                ctxt->argv[argc++] = "SAT";
+            }
+        }
+        ctxt->argv[argc++] = delta ? "INCRBY" : "GET";
+        ctxt->argv[argc++] = ctxt->type;
+        ctxt->argv[argc++] = offset;
+        if (delta) {
+            ctxt->argv[argc++] = delta;
+        }
+
+        /* Counters in different segments need commands of their own */
+        if (ctxt->per_item != 1 || i + 1 == ctxt->rows) {
+            for (j = 0; j < argc; ++j) {
+                ctxt->argvlen[j] = strlen(ctxt->argv[j]);
+            }
+            redisAppendCommandArgv(
+                ctxt->ctxt, argc, ctxt->argv, ctxt->argvlen);
+            argc = 0;
+        }
+    }
+}
+
+int countmin_increment(pyrebloomcountmin * ctxt, const char * data,
+    uint32_t len, int64_t by) {
+    char * delta = ctxt->args + ctxt->rows * 24;
+    snprintf(delta, 24, "%ld", by);
+    countmin_append(ctxt, data, len, delta);
+    return PYREBLOOM_OK;
+}
+
+int countmin_count(pyrebloomcountmin * ctxt, const char * data, uint32_t len) {
+    countmin_append(ctxt, data, len, NULL);
+    return PYREBLOOM_OK;
+}
+
+int64_t countmin_next(pyrebloomcountmin * ctxt) {
+    uint32_t i, j;
+    int64_t smallest = -1;
+    int failed = 0;
+    redisReply * reply = NULL;
+
+    for (i = 0; i < ctxt->per_item; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+
+        if (reply->type == REDIS_REPLY_ERROR) {
+            failed = 1;
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        } else if (reply->type == REDIS_REPLY_ARRAY) {
+            for (j = 0; j < reply->elements; ++j) {
+                int64_t value = reply->element[j]->integer;
+                if (smallest < 0 || value < smallest) {
+                    smallest = value;
+                }
+            }
+        }
+        freeReplyObject(reply);
+    }
+
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+    return smallest;
+}
+
+int countmin_delete(pyrebloomcountmin * ctxt) {
+    delete(&ctxt->filter);
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->meta_key));
+    return PYREBLOOM_OK;
+}
@@ -0,0 +1,79 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef PYRE_COUNTMIN_H
+#define PYRE_COUNTMIN_H
+
+#include "bloom.h"
+
+/* A count-min sketch estimates how many times each item has been counted, in
+ * a fixed amount of space however many distinct items there are. It has
+ * `rows` rows of `columns` counters, each `width` bits wide, and each row has
+ * a hash of its own that picks one counter in it for an item. Counting an
+ * item increments its counter in every row, and its estimate is the smallest
+ * of them. Estimates are never too low, and with probability `confidence`
+ * they're too high by at most `error` times the total of all counts.
+ *
+ * The counters live in the segments `<key>.0`, `<key>.1`, ... row after row,
+ * where they're updated with BITFIELD, and the sketch is described by
+ * `<key>.meta`. Counters saturate rather than wrap around. */
+typedef struct {
+    double          error;
+    double          confidence;
+    uint64_t        columns;
+    uint32_t        rows;
+    uint32_t        width;
+    uint32_t        hash_family;
+    /* How many BITFIELD commands each item needs; one, unless the counters
+     * are spread across more than one segment */
+    uint32_t        per_item;
+    char            type[8];
+    char          * key;
+    char          * meta_key;
+    /* Scratch space for building BITFIELD commands */
+    char          * args;
+    const char   ** argv;
+    size_t        * argvlen;
+    /* The counters are described as though they were the bits of a filter
+     * with a hash for each row */
+    pyrebloomctxt   filter;
+    redisContext  * ctxt;
+} pyrebloomcountmin;
+
+int init_countmin(pyrebloomcountmin * ctxt, char * key, double error,
+    double confidence, uint32_t width, char * host, uint32_t port,
+    char * password, uint32_t db, uint32_t hash_family);
+int free_countmin(pyrebloomcountmin * ctxt);
+
+/* Increments and counts are pipelined, and countmin_next returns the estimate
+ * for each item in turn: after it was incremented, or as it stands */
+int countmin_increment(pyrebloomcountmin * ctxt, const char * data,
+    uint32_t len, int64_t by);
+int countmin_count(pyrebloomcountmin * ctxt, const char * data, uint32_t len);
+int64_t countmin_next(pyrebloomcountmin * ctxt);
+
+int countmin_delete(pyrebloomcountmin * ctxt);
+
+#endif
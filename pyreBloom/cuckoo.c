@@ -0,0 +1,510 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "cuckoo.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The version of the metadata layout for cuckoo filters */
+static const uint32_t cuckoo_version = 1;
+
+/* Fingerprints per bucket, and how full the buckets are allowed to get. Four
+ * to a bucket can reliably be filled to about 95%. */
+static const uint32_t cuckoo_bucket_size = 4;
+static const double cuckoo_load = 0.95;
+
+/* How many fingerprints an add may move before giving up */
+static const uint32_t cuckoo_kicks = 500;
+
+/* The seed of the hash that gives an item its fingerprint and bucket */
+static const uint64_t cuckoo_seed = 314159265;
+
+/* Load the description of a cuckoo filter, or record it if it's new. A first
+ * segment without any metadata belongs to an ordinary filter that predates
+ * metadata.
+ *
+ *     KEYS = { metadata key, first segment key }
+ *     ARGV = { capacity, error, fingerprint bits, bucket size, buckets,
+ *              buckets per segment, hash family, version }
+ *
+ * It replies with those same fields, as recorded, but for the version. */
+static const char * cuckoo_init_script =
+    "local fields = {'capacity', 'error', 'fingerprint_bits', 'bucket_size',\n"
+    "    'buckets', 'segment_buckets', 'hash'}\n"
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'cuckoo' then\n"
+    "    return redis.call('HMGET', KEYS[1], unpack(fields))\n"
+    "elseif redis.call('EXISTS', KEYS[1], KEYS[2]) > 0 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "elseif ARGV[1] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; capacity and error are required')\n"
+    "end\n"
+    "redis.call('HSET', KEYS[1], 'type', 'cuckoo')\n"
+    "for i, field in ipairs(fields) do\n"
+    "    redis.call('HSET', KEYS[1], field, ARGV[i])\n"
+    "end\n"
+    "redis.call('HSET', KEYS[1], 'version', ARGV[8])\n"
+    "return {unpack(ARGV, 1, 7)}";
+
+/* What the add and remove scripts have in common: reading and writing the
+ * fingerprints in a bucket, and finding a fingerprint's other bucket, which
+ * must agree exactly with cuckoo_alternate.
+ *
+ *     KEYS = { segment keys }
+ *     ARGV = { fingerprint, bucket, fingerprint bits, bucket size, buckets,
+ *              buckets per segment, ... } */
+#define CUCKOO_PRELUDE                                                        \
+    "local fp, i1 = tonumber(ARGV[1]), tonumber(ARGV[2])\n"                   \
+    "local width, size = 'u' .. ARGV[3], tonumber(ARGV[4])\n"                 \
+    "local buckets, per = tonumber(ARGV[5]), tonumber(ARGV[6])\n"             \
+    "local function alternate(i, f)\n"                                        \
+    "    local lo = f % 65536\n"                                              \
+    "    local mixed = (lo * 1540483477 +\n"                                  \
+    "        (f - lo) / 65536 * 1540483477 % 65536 * 65536) % 4294967296\n"   \
+    "    return (mixed - i) % buckets\n"                                      \
+    "end\n"                                                                   \
+    "local function read(i)\n"                                                \
+    "    local args = {}\n"                                                   \
+    "    for j = 0, size - 1 do\n"                                            \
+    "        args[#args + 1] = 'GET'\n"                                       \
+    "        args[#args + 1] = width\n"                                       \
+    "        args[#args + 1] = '#' .. (i % per * size + j)\n"                 \
+    "    end\n"                                                               \
+    "    return redis.call('BITFIELD', KEYS[math.floor(i / per) + 1],\n"      \
+    "        unpack(args))\n"                                                 \
+    "end\n"                                                                   \
+    "local function write(i, j, value)\n"                                     \
+    "    redis.call('BITFIELD', KEYS[math.floor(i / per) + 1], 'SET',\n"      \
+    "        width, '#' .. (i % per * size + j), value)\n"                    \
+    "end\n"
+
+/* Add a fingerprint to whichever of its buckets has room. A fingerprint
+ * that's already there is stored again, so that every copy has to be
+ * removed before the item is gone, up to the two buckets' worth of copies
+ * that fit. If neither has room, fingerprints are moved to their other
+ * buckets to make some, starting from a pseudo-random slot. If that doesn't
+ * work out, everything is put back as it was.
+ *
+ *     ARGV = { ..., most fingerprints to move, random seed }
+ *
+ * It replies with 1 if the fingerprint is new to the filter, and 0 if it's
+ * another copy. */
+static const char * cuckoo_add_script = CUCKOO_PRELUDE
+    "local i2 = alternate(i1, fp)\n"
+    "local first, second = read(i1), read(i2)\n"
+    "local copies = 0\n"
+    "for j = 1, size do\n"
+    "    if first[j] == fp then copies = copies + 1 end\n"
+    "    if second[j] == fp then copies = copies + 1 end\n"
+    "end\n"
+    "if copies == 2 * size then\n"
+    "    return redis.error_reply('Too many copies of an item')\n"
+    "end\n"
+    "local new = (copies == 0) and 1 or 0\n"
+    "for j = 1, size do\n"
+    "    if first[j] == 0 then write(i1, j - 1, fp) return new end\n"
+    "end\n"
+    "for j = 1, size do\n"
+    "    if second[j] == 0 then write(i2, j - 1, fp) return new end\n"
+    "end\n"
+    "local random = tonumber(ARGV[8])\n"
+    "local i, bucket = i1, first\n"
+    "if random % 2 == 1 then i, bucket = i2, second end\n"
+    "local moved = {}\n"
+    "for kick = 1, tonumber(ARGV[7]) do\n"
+    "    random = random * 16807 % 2147483647\n"
+    "    local j = random % size\n"
+    "    local victim = bucket[j + 1]\n"
+    "    write(i, j, fp)\n"
+    "    moved[kick] = {i, j, victim}\n"
+    "    fp, i = victim, alternate(i, victim)\n"
+    "    bucket = read(i)\n"
+    "    for k = 1, size do\n"
+    "        if bucket[k] == 0 then write(i, k - 1, fp) return new end\n"
+    "    end\n"
+    "end\n"
+    "for kick = #moved, 1, -1 do\n"
+    "    write(moved[kick][1], moved[kick][2], moved[kick][3])\n"
+    "end\n"
+    "return redis.error_reply('Cuckoo filter is full')";
+
+/* Remove a fingerprint from whichever of its buckets it's in. It replies with
+ * 1 if it was removed, and 0 if it wasn't there. */
+static const char * cuckoo_remove_script = CUCKOO_PRELUDE
+    "for _, i in ipairs({i1, alternate(i1, fp)}) do\n"
+    "    local bucket = read(i)\n"
+    "    for j = 1, size do\n"
+    "        if bucket[j] == fp then write(i, j - 1, 0) return 1 end\n"
+    "    end\n"
+    "end\n"
+    "return 0";
+
+/* The other bucket a fingerprint may be in. It's its own inverse, so either
+ * bucket leads to the other. */
+static uint64_t cuckoo_alternate(
+    pyrebloomcuckoo * ctxt, uint64_t bucket, uint64_t fp) {
+    uint64_t mixed = (uint32_t)(fp) * (uint32_t)(0x5bd1e995);
+    return (mixed % ctxt->buckets + ctxt->buckets - bucket) % ctxt->buckets;
+}
+
+/* An item's fingerprint, which is never 0 since that marks an empty slot,
+ * and its first bucket */
+static void cuckoo_locate(pyrebloomcuckoo * ctxt, const char * data,
+    uint32_t len, uint64_t * fp, uint64_t * bucket) {
+    uint64_t h = hash_item(ctxt->hash_family, data, len, cuckoo_seed);
+    *fp = (h >> 32) & ((1ULL << ctxt->fingerprint_bits) - 1);
+    if (*fp == 0) {
+        *fp = 1;
+    }
+    *bucket = (h & 0xFFFFFFFF) % ctxt->buckets;
+}
+
+/* Copy a script's hash out of the reply to SCRIPT LOAD */
+static int cuckoo_sha(
+    pyrebloomcuckoo * ctxt, char * sha, size_t size, redisReply * reply) {
+    if (reply == NULL || reply->type != REDIS_REPLY_STRING) {
+        if (reply != NULL && reply->type == REDIS_REPLY_ERROR) {
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        }
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    snprintf(sha, size, "%s", reply->str);
+    freeReplyObject(reply);
+    return PYREBLOOM_OK;
+}
+
+/* Load the scripts again if redis has forgotten them */
+static int cuckoo_reload(pyrebloomcuckoo * ctxt) {
+    ctxt->reload = 0;
+    if (cuckoo_sha(ctxt, ctxt->add_sha, sizeof(ctxt->add_sha), redisCommand(
+        ctxt->ctxt, "SCRIPT LOAD %s", cuckoo_add_script)) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    return cuckoo_sha(ctxt, ctxt->remove_sha, sizeof(ctxt->remove_sha),
+        redisCommand(ctxt->ctxt, "SCRIPT LOAD %s", cuckoo_remove_script));
+}
+
+int init_cuckoo(pyrebloomcuckoo * ctxt, char * key, uint64_t capacity,
+    double error, char * host, uint32_t port, char * password, uint32_t db,
+    uint32_t hash_family) {
+    redisReply * reply = NULL;
+    uint32_t i, fingerprint_bits = 0;
+    uint64_t buckets = 0, segment_buckets = 0;
+    size_t args;
+
+    ctxt->key      = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+
+    /* What we'd like this filter to look like, if it doesn't exist yet. The
+     * chance of a false positive is about 2 * bucket size / 2 ^ bits. */
+    if (capacity != 0) {
+        fingerprint_bits = (uint32_t)(
+            ceil(log2(2.0 * cuckoo_bucket_size / error)));
+        if (fingerprint_bits < 4) {
+            fingerprint_bits = 4;
+        } else if (fingerprint_bits > 32) {
+            fingerprint_bits = 32;
+        }
+        buckets = (uint64_t)(
+            ceil(capacity / (cuckoo_bucket_size * cuckoo_load)));
+        segment_buckets = max_bits_per_key /
+            (cuckoo_bucket_size * fingerprint_bits);
+    }
+
+    /* Connecting, loading the scripts and agreeing on the description of the
+     * filter all happen in one round trip */
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->ctxt, "SCRIPT LOAD %s", cuckoo_add_script);
+    redisAppendCommand(ctxt->ctxt, "SCRIPT LOAD %s", cuckoo_remove_script);
+    redisAppendCommand(ctxt->ctxt,
+        "EVAL %s 2 %s %s.0 %lu %.17g %u %u %lu %lu %u %u", cuckoo_init_script,
+        ctxt->meta_key, key, capacity, error, fingerprint_bits,
+        cuckoo_bucket_size, buckets, segment_buckets, hash_family,
+        cuckoo_version);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR ||
+        cuckoo_sha(ctxt, ctxt->add_sha, sizeof(ctxt->add_sha), reply) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    reply = NULL;
+    redisGetReply(ctxt->ctxt, (void**)(&reply));
+    if (cuckoo_sha(ctxt, ctxt->remove_sha, sizeof(ctxt->remove_sha), reply) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    reply = NULL;
+    if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 7) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->capacity         = strtoull(reply->element[0]->str, NULL, 10);
+    ctxt->error            = strtod(reply->element[1]->str, NULL);
+    ctxt->fingerprint_bits = (uint32_t)(
+        strtoul(reply->element[2]->str, NULL, 10));
+    ctxt->bucket_size      = (uint32_t)(
+        strtoul(reply->element[3]->str, NULL, 10));
+    ctxt->buckets          = strtoull(reply->element[4]->str, NULL, 10);
+    ctxt->segment_buckets  = strtoull(reply->element[5]->str, NULL, 10);
+    ctxt->hash_family      = (uint32_t)(
+        strtoul(reply->element[6]->str, NULL, 10));
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT ||
+        ctxt->fingerprint_bits < 4 || ctxt->fingerprint_bits > 32 ||
+        ctxt->bucket_size == 0 || ctxt->bucket_size > 8 ||
+        ctxt->buckets == 0 || ctxt->segment_buckets == 0) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+
+    ctxt->num_keys = (uint32_t)(
+        (ctxt->buckets + ctxt->segment_buckets - 1) / ctxt->segment_buckets);
+    ctxt->keys = (char **)(malloc(ctxt->num_keys * sizeof(char *)));
+    for (i = 0; i < ctxt->num_keys; ++i) {
+        size_t length = strlen(key) + 10;
+        ctxt->keys[i] = (char *)(malloc(length));
+        snprintf(ctxt->keys[i], length, "%s.%u", key, i);
+    }
+    ctxt->per_item = (ctxt->num_keys == 1) ? 1 : 2;
+    ctxt->random = 1;
+    snprintf(ctxt->type, sizeof(ctxt->type), "u%u", ctxt->fingerprint_bits);
+
+    /* The arguments to the scripts that never change */
+    snprintf(ctxt->args[2], 24, "%u", ctxt->fingerprint_bits);
+    snprintf(ctxt->args[3], 24, "%u", ctxt->bucket_size);
+    snprintf(ctxt->args[4], 24, "%lu", ctxt->buckets);
+    snprintf(ctxt->args[5], 24, "%lu", ctxt->segment_buckets);
+    snprintf(ctxt->args[6], 24, "%u", cuckoo_kicks);
+    snprintf(ctxt->args[8], 24, "%u", ctxt->num_keys);
+
+    /* Enough for EVALSHA sha count keys... and the eight arguments, or for
+     * BITFIELD key and then GET type offset for both buckets */
+    args = 3 + ctxt->num_keys + 8;
+    if (args < 2 + 6 * ctxt->bucket_size) {
+        args = 2 + 6 * ctxt->bucket_size;
+    }
+    ctxt->argv    = (const char **)(malloc(args * sizeof(char *)));
+    ctxt->argvlen = (size_t *)(malloc(args * sizeof(size_t)));
+    return PYREBLOOM_OK;
+}
+
+int free_cuckoo(pyrebloomcuckoo * ctxt) {
+    uint32_t i;
+    if (ctxt->keys) {
+        for (i = 0; i < ctxt->num_keys; ++i) {
+            free(ctxt->keys[i]);
+        }
+        free(ctxt->keys);
+    }
+    free(ctxt->pending);
+    free(ctxt->argv);
+    free(ctxt->argvlen);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+/* Send the command that's been built up in argv */
+static void cuckoo_send(pyrebloomcuckoo * ctxt, uint32_t argc) {
+    uint32_t i;
+    for (i = 0; i < argc; ++i) {
+        ctxt->argvlen[i] = strlen(ctxt->argv[i]);
+    }
+    redisAppendCommandArgv(ctxt->ctxt, argc, ctxt->argv, ctxt->argvlen);
+}
+
+/* Queue up a run of one of the scripts for an item */
+static void cuckoo_script(pyrebloomcuckoo * ctxt, const char * sha,
+    const char * data, uint32_t len) {
+    uint64_t fp, bucket;
+    uint32_t i, argc = 0;
+    cuckoo_locate(ctxt, data, len, &fp, &bucket);
+    ctxt->random = (uint32_t)((uint64_t)(ctxt->random) * 16807 % 2147483647);
+    snprintf(ctxt->args[0], 24, "%lu", fp);
+    snprintf(ctxt->args[1], 24, "%lu", bucket);
+    snprintf(ctxt->args[7], 24, "%u", ctxt->random);
+
+    ctxt->argv[argc++] = "EVALSHA";
+    ctxt->argv[argc++] = sha;
+    ctxt->argv[argc++] = ctxt->args[8];
+    for (i = 0; i < ctxt->num_keys; ++i) {
+        ctxt->argv[argc++] = ctxt->keys[i];
+    }
+    for (i = 0; i < 8; ++i) {
+        ctxt->argv[argc++] = ctxt->args[i];
+    }
+    cuckoo_send(ctxt, argc);
+}
+
+/* Read the replies from a batch of scripts, counting how many did something */
+static int cuckoo_script_complete(pyrebloomcuckoo * ctxt, uint32_t count) {
+    uint32_t i, total = 0;
+    int failed = 0;
+    redisReply * reply = NULL;
+
+    for (i = 0; i < count; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+
+        /* A full filter fails only the items that didn't fit */
+        if (reply->type == REDIS_REPLY_ERROR) {
+            failed = 1;
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+            if (strncmp(reply->str, "NOSCRIPT", 8) == 0) {
+                ctxt->reload = 1;
+            }
+        } else {
+            total += reply->integer;
+        }
+        freeReplyObject(reply);
+    }
+
+    /* If redis restarted or had its scripts flushed, the batch failed, but
+     * the next one needn't */
+    if (ctxt->reload) {
+        cuckoo_reload(ctxt);
+    }
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+    return total;
+}
+
+int cuckoo_add(pyrebloomcuckoo * ctxt, const char * data, uint32_t len) {
+    cuckoo_script(ctxt, ctxt->add_sha, data, len);
+    return PYREBLOOM_OK;
+}
+
+int64_t cuckoo_add_complete(pyrebloomcuckoo * ctxt, uint32_t count) {
+    return cuckoo_script_complete(ctxt, count);
+}
+
+int cuckoo_remove(pyrebloomcuckoo * ctxt, const char * data, uint32_t len) {
+    cuckoo_script(ctxt, ctxt->remove_sha, data, len);
+    return PYREBLOOM_OK;
+}
+
+int cuckoo_remove_complete(pyrebloomcuckoo * ctxt, uint32_t count) {
+    return cuckoo_script_complete(ctxt, count);
+}
+
+int cuckoo_check(pyrebloomcuckoo * ctxt, const char * data, uint32_t len) {
+    uint64_t fp, buckets[2];
+    uint32_t i, j, argc = 0;
+    cuckoo_locate(ctxt, data, len, &fp, &buckets[0]);
+    buckets[1] = cuckoo_alternate(ctxt, buckets[0], fp);
+
+    /* Remember the fingerprint for when the buckets come back */
+    if (ctxt->num_pending == ctxt->pending_size) {
+        ctxt->pending_size = ctxt->pending_size ? ctxt->pending_size * 2 : 64;
+        ctxt->pending = (uint64_t *)(realloc(
+            ctxt->pending, ctxt->pending_size * sizeof(uint64_t)));
+    }
+    ctxt->pending[ctxt->num_pending++] = fp;
+
+    for (i = 0; i < 2; ++i) {
+        uint64_t segment = buckets[i] / ctxt->segment_buckets;
+        uint64_t first = buckets[i] % ctxt->segment_buckets * ctxt->bucket_size;
+        if (argc == 0) {
+            ctxt->argv[argc++] = "BITFIELD";
+            ctxt->argv[argc++] = ctxt->keys[segment];
+        }
+        for (j = 0; j < ctxt->bucket_size; ++j) {
+            char * slot = ctxt->slots[i * ctxt->bucket_size + j];
+            snprintf(slot, 24, "#%lu", first + j);
+            ctxt->argv[argc++] = "GET";
+            ctxt->argv[argc++] = ctxt->type;
+            ctxt->argv[argc++] = slot;
+        }
+        /* Buckets in different segments need commands of their own */
+        if (ctxt->per_item != 1 || i == 1) {
+            cuckoo_send(ctxt, argc);
+            argc = 0;
+        }
+    }
+    return PYREBLOOM_OK;
+}
+
+int cuckoo_check_next(pyrebloomcuckoo * ctxt) {
+    uint32_t i, j;
+    int result = 0, failed = 0;
+    uint64_t fp = ctxt->pending[ctxt->next_pending++];
+    redisReply * reply = NULL;
+    if (ctxt->next_pending == ctxt->num_pending) {
+        ctxt->next_pending = ctxt->num_pending = 0;
+    }
+
+    for (i = 0; i < ctxt->per_item; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+
+        if (reply->type == REDIS_REPLY_ERROR) {
+            failed = 1;
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        } else if (reply->type == REDIS_REPLY_ARRAY) {
+            for (j = 0; j < reply->elements; ++j) {
+                if ((uint64_t)(reply->element[j]->integer) == fp) {
+                    result = 1;
+                }
+            }
+        }
+        freeReplyObject(reply);
+    }
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+    return result;
+}
+
+int cuckoo_delete(pyrebloomcuckoo * ctxt) {
+    uint32_t i = 0;
+    for (; i < ctxt->num_keys; ++i) {
+        freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->keys[i]));
+    }
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->meta_key));
+    return PYREBLOOM_OK;
+}
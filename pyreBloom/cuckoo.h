@@ -0,0 +1,91 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef PYRE_CUCKOO_H
+#define PYRE_CUCKOO_H
+
+#include "bloom.h"
+
+/* A cuckoo filter keeps a short fingerprint of each item in one of two
+ * buckets, either of which can be found from the item alone. Below an error
+ * rate of around 1% it needs fewer bits per item than a bloom filter, a check
+ * reads only two buckets, and items can be removed.
+ *
+ * Fingerprints are `fingerprint_bits` wide, packed `bucket_size` to a bucket
+ * into the segments `<key>.0`, `<key>.1`, ... and read with BITFIELD. Adding
+ * an item may mean moving other fingerprints to their alternate buckets, so
+ * adds and removes happen in scripts, where concurrent clients can't see a
+ * fingerprint in transit. The filter is described by `<key>.meta`. */
+typedef struct {
+    uint64_t        capacity;
+    double          error;
+    uint32_t        hash_family;
+    uint32_t        fingerprint_bits;
+    uint32_t        bucket_size;
+    uint64_t        buckets;
+    uint64_t        segment_buckets;
+    uint32_t        num_keys;
+    /* How many commands each check needs; one, unless its buckets may be in
+     * different segments */
+    uint32_t        per_item;
+    /* Where relocations start, varied from one add to the next */
+    uint32_t        random;
+    /* Set when redis has forgotten our scripts, and they need loading */
+    int             reload;
+    /* The fingerprints of the items being checked, in the order they were
+     * queued up */
+    uint64_t      * pending;
+    uint32_t        num_pending;
+    uint32_t        next_pending;
+    uint32_t        pending_size;
+    char            type[8];
+    char            add_sha[48];
+    char            remove_sha[48];
+    /* Scratch space for building commands */
+    char            args[9][24];
+    char            slots[16][24];
+    const char   ** argv;
+    size_t        * argvlen;
+    char          * key;
+    char          * meta_key;
+    char         ** keys;
+    redisContext  * ctxt;
+} pyrebloomcuckoo;
+
+int init_cuckoo(pyrebloomcuckoo * ctxt, char * key, uint64_t capacity,
+    double error, char * host, uint32_t port, char * password, uint32_t db,
+    uint32_t hash_family);
+int free_cuckoo(pyrebloomcuckoo * ctxt);
+
+int cuckoo_add(pyrebloomcuckoo * ctxt, const char * data, uint32_t len);
+int64_t cuckoo_add_complete(pyrebloomcuckoo * ctxt, uint32_t count);
+
+int cuckoo_remove(pyrebloomcuckoo * ctxt, const char * data, uint32_t len);
+int cuckoo_remove_complete(pyrebloomcuckoo * ctxt, uint32_t count);
+
+int cuckoo_check(pyrebloomcuckoo * ctxt, const char * data, uint32_t len);
+int cuckoo_check_next(pyrebloomcuckoo * ctxt);
+
+int cuckoo_delete(pyrebloomcuckoo * ctxt);
+
+#endif
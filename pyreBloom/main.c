@@ -31,7 +31,8 @@ int main(int argc, char ** argv) {
     time_t start, end;
     uint32_t count = 100000;
 
-    init_pyrebloom(&ctxt, "testing", count, 0.1, "localhost", 6379, "");
+    init_pyrebloom(&ctxt, "testing", count, 0.1, "localhost", 6379, "", 0,
+        PYREBLOOM_HASH_MURMUR64A, PYREBLOOM_LAYOUT_STANDARD, 0, 0);
 
     time(&start);
     for (i = 0; i < count; ++i) {
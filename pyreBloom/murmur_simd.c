@@ -0,0 +1,245 @@
+/* Copyright (c) 2026 SEOmoz
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Multi-lane MurmurHash64A: hash one key under several seeds at once.
+ *
+ * Every item we add or check gets hashed once per seed, and the only part of
+ * MurmurHash64A that actually depends on the seed is the running value `h`.
+ * The per-block mixing of the key (`k`) and the tail bytes are the same for
+ * every seed, so we compute those once and carry 4 (AVX2) or 8 (AVX-512)
+ * copies of `h` in vector lanes. The results are bit-for-bit identical to
+ * MurmurHash64A in murmur.c, which is what keeps existing filters valid.
+ *
+ * The vector kernels are compiled with per-function target attributes and
+ * picked at runtime, so the extension still builds and runs on hosts without
+ * either instruction set. */
+
+#include <stdint.h>
+#include <string.h>
+
+static const uint64_t murmur_m = 0xc6a4a7935bd1e995ULL;
+static const int      murmur_r = 47;
+
+/* Read the i-th 8-byte block of the key, without assuming alignment */
+static inline uint64_t murmur_block(const unsigned char * data, uint32_t i) {
+    uint64_t k;
+    memcpy(&k, data + 8 * i, sizeof(k));
+    k *= murmur_m;
+    k ^= k >> murmur_r;
+    k *= murmur_m;
+    return k;
+}
+
+/* The trailing (len & 7) bytes, packed the way MurmurHash64A packs them */
+static inline uint64_t murmur_tail(const unsigned char * data, uint32_t len) {
+    const unsigned char * data2 = data + (len & ~7U);
+    uint64_t t = 0;
+    switch (len & 7) {
+    case 7: t ^= (uint64_t)(data2[6]) << 48;
+    case 6: t ^= (uint64_t)(data2[5]) << 40;
+    case 5: t ^= (uint64_t)(data2[4]) << 32;
+    case 4: t ^= (uint64_t)(data2[3]) << 24;
+    case 3: t ^= (uint64_t)(data2[2]) << 16;
+    case 2: t ^= (uint64_t)(data2[1]) << 8;
+    case 1: t ^= (uint64_t)(data2[0]);
+    };
+    return t;
+}
+
+static void MurmurHash64A_seeds_scalar(const void * key, uint32_t len,
+    const uint32_t * seeds, uint32_t count, uint64_t * out) {
+    uint32_t i;
+    for (i = 0; i < count; ++i) {
+        out[i] = MurmurHash64A(key, len, seeds[i]);
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PYREBLOOM_HAVE_SIMD 1
+#include <immintrin.h>
+
+/* AVX2 has no 64-bit multiply, so assemble the low 64 bits of the product
+ * out of three 32x32 multiplies */
+__attribute__((target("avx2")))
+static inline __m256i murmur_mul_avx2(__m256i a, __m256i b) {
+    __m256i lo    = _mm256_mul_epu32(a, b);
+    __m256i hi_lo = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+    __m256i lo_hi = _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32));
+    return _mm256_add_epi64(lo,
+        _mm256_slli_epi64(_mm256_add_epi64(hi_lo, lo_hi), 32));
+}
+
+/* Hash four seeds at a time; a short final group is padded out to four */
+__attribute__((target("avx2")))
+static void MurmurHash64A_seeds_avx2(const void * key, uint32_t len,
+    const uint32_t * seeds, uint32_t count, uint64_t * out) {
+    const unsigned char * data = (const unsigned char *)key;
+    const uint32_t blocks = len / 8;
+    const uint64_t tail = murmur_tail(data, len);
+    const __m256i m = _mm256_set1_epi64x((long long)murmur_m);
+    const __m256i lm = _mm256_set1_epi64x((long long)(len * murmur_m));
+    uint32_t pad_seeds[4] = { 0 };
+    uint64_t pad_out[4];
+    uint32_t i, j;
+
+    for (i = 0; i < count; i += 4) {
+        const uint32_t * s = seeds + i;
+        uint64_t * o = out + i;
+        if (count - i < 4) {
+            memcpy(pad_seeds, s, (count - i) * sizeof(uint32_t));
+            s = pad_seeds;
+            o = pad_out;
+        }
+
+        __m256i h = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)s));
+        h = _mm256_xor_si256(h, lm);
+        for (j = 0; j < blocks; ++j) {
+            h = _mm256_xor_si256(h,
+                _mm256_set1_epi64x((long long)murmur_block(data, j)));
+            h = murmur_mul_avx2(h, m);
+        }
+        if (len & 7) {
+            h = _mm256_xor_si256(h, _mm256_set1_epi64x((long long)tail));
+            h = murmur_mul_avx2(h, m);
+        }
+        h = _mm256_xor_si256(h, _mm256_srli_epi64(h, murmur_r));
+        h = murmur_mul_avx2(h, m);
+        h = _mm256_xor_si256(h, _mm256_srli_epi64(h, murmur_r));
+        _mm256_storeu_si256((__m256i *)o, h);
+
+        if (o == pad_out) {
+            memcpy(out + i, pad_out, (count - i) * sizeof(uint64_t));
+        }
+    }
+}
+
+/* Hash eight seeds at a time; a short final group is padded out to eight.
+ * The 64-bit multiply here has a much longer latency than the AVX2 emulation
+ * so with fewer than eight seeds we're better off with the narrower kernel. */
+__attribute__((target("avx512f,avx512dq")))
+static void MurmurHash64A_seeds_avx512(const void * key, uint32_t len,
+    const uint32_t * seeds, uint32_t count, uint64_t * out) {
+    const unsigned char * data = (const unsigned char *)key;
+    const uint32_t blocks = len / 8;
+    const uint64_t tail = murmur_tail(data, len);
+    const __m512i m = _mm512_set1_epi64((long long)murmur_m);
+    const __m512i lm = _mm512_set1_epi64((long long)(len * murmur_m));
+    uint32_t pad_seeds[8] = { 0 };
+    uint64_t pad_out[8];
+    uint32_t i, j;
+
+    if (count < 8) {
+        MurmurHash64A_seeds_avx2(key, len, seeds, count, out);
+        return;
+    }
+
+    for (i = 0; i < count; i += 8) {
+        const uint32_t * s = seeds + i;
+        uint64_t * o = out + i;
+        if (count - i < 8) {
+            memcpy(pad_seeds, s, (count - i) * sizeof(uint32_t));
+            s = pad_seeds;
+            o = pad_out;
+        }
+
+        __m512i h = _mm512_cvtepu32_epi64(
+            _mm256_loadu_si256((const __m256i *)s));
+        h = _mm512_xor_si512(h, lm);
+        for (j = 0; j < blocks; ++j) {
+            h = _mm512_xor_si512(h,
+                _mm512_set1_epi64((long long)murmur_block(data, j)));
+            h = _mm512_mullo_epi64(h, m);
+        }
+        if (len & 7) {
+            h = _mm512_xor_si512(h, _mm512_set1_epi64((long long)tail));
+            h = _mm512_mullo_epi64(h, m);
+        }
+        h = _mm512_xor_si512(h, _mm512_srli_epi64(h, murmur_r));
+        h = _mm512_mullo_epi64(h, m);
+        h = _mm512_xor_si512(h, _mm512_srli_epi64(h, murmur_r));
+        _mm512_storeu_si512((void *)o, h);
+
+        if (o == pad_out) {
+            memcpy(out + i, pad_out, (count - i) * sizeof(uint64_t));
+        }
+    }
+}
+#endif
+
+typedef void (*murmur_seeds_fn)(
+    const void *, uint32_t, const uint32_t *, uint32_t, uint64_t *);
+
+/* Pick the widest kernel this CPU supports. This is resolved once, and racing
+ * threads can only ever arrive at the same answer. */
+static murmur_seeds_fn murmur_seeds_resolve(void) {
+#ifdef PYREBLOOM_HAVE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512dq")) {
+        return MurmurHash64A_seeds_avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return MurmurHash64A_seeds_avx2;
+    }
+#endif
+    return MurmurHash64A_seeds_scalar;
+}
+
+/* Hash `key` once for each of the `count` seeds, writing the results to
+ * `out`. Equivalent to calling MurmurHash64A(key, len, seeds[i]) for each i. */
+void MurmurHash64A_seeds(const void * key, uint32_t len,
+    const uint32_t * seeds, uint32_t count, uint64_t * out) {
+    static murmur_seeds_fn fn = NULL;
+    if (fn == NULL) {
+        fn = murmur_seeds_resolve();
+    }
+    fn(key, len, seeds, count, out);
+}
+
+/* Hash with one kernel in particular, by name ("scalar", "avx2", "avx512",
+ * or "auto" for whichever MurmurHash64A_seeds picks), so that they can be
+ * checked against one another. Naming one that this CPU (or compiler) can't
+ * run is an error. */
+int MurmurHash64A_seeds_kernel(const char * kernel, const void * key,
+    uint32_t len, const uint32_t * seeds, uint32_t count, uint64_t * out) {
+    murmur_seeds_fn fn = NULL;
+    if (strcmp(kernel, "auto") == 0) {
+        fn = murmur_seeds_resolve();
+    } else if (strcmp(kernel, "scalar") == 0) {
+        fn = MurmurHash64A_seeds_scalar;
+    }
+#ifdef PYREBLOOM_HAVE_SIMD
+    __builtin_cpu_init();
+    if (strcmp(kernel, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        fn = MurmurHash64A_seeds_avx2;
+    } else if (strcmp(kernel, "avx512") == 0 &&
+        __builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512dq")) {
+        fn = MurmurHash64A_seeds_avx512;
+    }
+#endif
+    if (fn == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    fn(key, len, seeds, count, out);
+    return PYREBLOOM_OK;
+}
@@ -0,0 +1,387 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "packed.h"
+#include <stdio.h>
+#include <string.h>
+
+/* The version of the metadata layout for packed filters */
+static const uint32_t packed_version = 1;
+
+/* About how many bits go in each shared segment, and the most bits read or
+ * written by any one command of a batch */
+static const uint64_t packed_segment_bits = 1 << 27;
+static const uint32_t packed_batch_ops = 1024;
+
+/* Load the description of a packed filter, or record it if it's new.
+ *
+ *     KEYS = { metadata key, first segment key }
+ *     ARGV = { capacity, error, tenants per segment, hash family, version }
+ *
+ * It replies with the recorded capacity, error, tenants per segment and hash
+ * family. */
+static const char * packed_init_script =
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'packed' then\n"
+    "    return redis.call('HMGET', KEYS[1], 'capacity', 'error',\n"
+    "        'tenants_per_segment', 'hash')\n"
+    "elseif redis.call('EXISTS', KEYS[1], KEYS[2]) > 0 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "elseif ARGV[1] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; capacity and error are required')\n"
+    "end\n"
+    "redis.call('HMSET', KEYS[1], 'type', 'packed', 'capacity', ARGV[1],\n"
+    "    'error', ARGV[2], 'tenants_per_segment', ARGV[3], 'hash', ARGV[4],\n"
+    "    'version', ARGV[5], 'tenants', 0)\n"
+    "return {ARGV[1], ARGV[2], ARGV[3], ARGV[4]}";
+
+/* Find the number of a tenant, or give it the next free one.
+ *
+ *     KEYS = { metadata key, tenants key }
+ *     ARGV = { name } */
+static const char * packed_tenant_script =
+    "local tenant = redis.call('HGET', KEYS[2], ARGV[1])\n"
+    "if tenant then return tonumber(tenant) end\n"
+    "tenant = redis.call('HGET', KEYS[1], 'tenants')\n"
+    "if not tenant then\n"
+    "    return redis.error_reply(KEYS[1] .. ' has been deleted')\n"
+    "end\n"
+    "redis.call('HINCRBY', KEYS[1], 'tenants', 1)\n"
+    "redis.call('HSET', KEYS[2], ARGV[1], tenant)\n"
+    "return tonumber(tenant)";
+
+/* How many tenants' filters fit in a shared segment, given their shape */
+static uint32_t packed_per_segment(const pyrebloomctxt * filter) {
+    uint64_t tenants = packed_segment_bits / filter->bits;
+    return tenants ? (uint32_t)(tenants) : 1;
+}
+
+int init_packed(pyrebloompacked * ctxt, char * key, uint64_t capacity,
+    double error, char * host, uint32_t port, char * password, uint32_t db,
+    uint32_t hash_family) {
+    redisReply * reply = NULL;
+    uint32_t tenants_per_segment = 0;
+
+    ctxt->key         = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key    = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+    ctxt->tenants_key = (char *)(malloc(strlen(key) + 9));
+    snprintf(ctxt->tenants_key, strlen(key) + 9, "%s.tenants", key);
+
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (capacity != 0) {
+        if (error <= 0 || error >= 1) {
+            strncpy(ctxt->ctxt->errstr, "The error rate must be in (0, 1)",
+                errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+        /* What a tenant's filter would look like, to see how many fit */
+        attach_pyrebloom(&ctxt->filter, NULL, key, capacity, error,
+            hash_family, max_bits_per_key);
+        tenants_per_segment = packed_per_segment(&ctxt->filter);
+        free_pyrebloom(&ctxt->filter);
+        memset(&ctxt->filter, 0, sizeof(ctxt->filter));
+    }
+    redisAppendCommand(ctxt->ctxt, "EVAL %s 2 %s %s.0 %lu %.17g %u %u %u",
+        packed_init_script, ctxt->meta_key, key, capacity, error,
+        tenants_per_segment, hash_family, packed_version);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 4) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->capacity            = strtoull(reply->element[0]->str, NULL, 10);
+    ctxt->error               = strtod(reply->element[1]->str, NULL);
+    ctxt->tenants_per_segment = (uint32_t)(
+        strtoul(reply->element[2]->str, NULL, 10));
+    ctxt->hash_family         = (uint32_t)(
+        strtoul(reply->element[3]->str, NULL, 10));
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT || ctxt->capacity == 0 ||
+        ctxt->error <= 0 || ctxt->error >= 1 ||
+        ctxt->tenants_per_segment == 0) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+
+    attach_pyrebloom(&ctxt->filter, ctxt->ctxt, key, ctxt->capacity,
+        ctxt->error, ctxt->hash_family, max_bits_per_key);
+    return PYREBLOOM_OK;
+}
+
+int free_packed(pyrebloompacked * ctxt) {
+    /* The connection is ours, not the filter's */
+    ctxt->filter.ctxt = NULL;
+    free_pyrebloom(&ctxt->filter);
+    free(ctxt->batch);
+    free(ctxt->segments);
+    free(ctxt->hits);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    free(ctxt->tenants_key);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+int packed_tenant(pyrebloompacked * ctxt, const char * name, uint32_t len,
+    int assign) {
+    if (assign) {
+        redisAppendCommand(ctxt->ctxt, "EVAL %s 2 %s %s %b",
+            packed_tenant_script, ctxt->meta_key, ctxt->tenants_key, name,
+            (size_t)(len));
+    } else {
+        redisAppendCommand(ctxt->ctxt, "HGET %s %b", ctxt->tenants_key, name,
+            (size_t)(len));
+    }
+    ++ctxt->pending;
+    return PYREBLOOM_OK;
+}
+
+int packed_tenant_next(pyrebloompacked * ctxt, uint32_t * tenant) {
+    redisReply * reply = NULL;
+    int result = 0;
+    if (ctxt->pending == 0 ||
+        redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+        strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    --ctxt->pending;
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        result = PYREBLOOM_ERROR;
+    } else if (reply->type == REDIS_REPLY_INTEGER) {
+        *tenant = (uint32_t)(reply->integer);
+        result = 1;
+    } else if (reply->type == REDIS_REPLY_STRING) {
+        *tenant = (uint32_t)(strtoul(reply->str, NULL, 10));
+        result = 1;
+    }
+    freeReplyObject(reply);
+    return result;
+}
+
+/* Queue up the bits of an item in a tenant's filter */
+static void packed_queue(pyrebloompacked * ctxt, uint32_t tenant,
+    const char * data, uint32_t len) {
+    pyrebloomctxt * filter = &ctxt->filter;
+    uint64_t base = (uint64_t)(tenant % ctxt->tenants_per_segment) *
+        filter->bits;
+    uint32_t i;
+    if (ctxt->batched == ctxt->batch_size) {
+        ctxt->batch_size = ctxt->batch_size ? ctxt->batch_size * 2 : 64;
+        ctxt->batch = (uint64_t *)(realloc(ctxt->batch,
+            (uint64_t)(ctxt->batch_size) * filter->hashes * sizeof(uint64_t)));
+        ctxt->segments = (uint32_t *)(realloc(ctxt->segments,
+            ctxt->batch_size * sizeof(uint32_t)));
+        ctxt->hits = (uint32_t *)(realloc(ctxt->hits,
+            ctxt->batch_size * sizeof(uint32_t)));
+    }
+    hash_offsets(filter, data, len);
+    for (i = 0; i < filter->hashes; ++i) {
+        ctxt->batch[(uint64_t)(ctxt->batched) * filter->hashes + i] =
+            base + filter->offsets[i];
+    }
+    ctxt->segments[ctxt->batched] = tenant / ctxt->tenants_per_segment;
+    ctxt->hits[ctxt->batched++] = 0;
+}
+
+static int packed_compare(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)(a), y = *(const uint64_t *)(b);
+    return (x > y) - (x < y);
+}
+
+/* Send the queued items' bits to their segments, a BITFIELD for each segment
+ * (or a few, for big batches), and then read them all back. Items are sorted
+ * by segment so that each segment's items are together. Setting bits replies
+ * with what they were before, so either way `hits` ends up with how many of
+ * each item's bits were already set. */
+static int packed_flush(pyrebloompacked * ctxt, int setting) {
+    uint32_t hashes = ctxt->filter.hashes, per_op = setting ? 4 : 3;
+    uint32_t per_command = packed_batch_ops / hashes, reading, start, end;
+    uint32_t i, j, argc;
+    uint64_t * order = (uint64_t *)(malloc(
+        (ctxt->batched + 1) * sizeof(uint64_t)));
+    const char ** argv;
+    size_t * argvlen;
+    char * slots, * name;
+    size_t length = strlen(ctxt->key) + 16;
+    redisReply * reply = NULL;
+    int failed = 0;
+
+    if (per_command == 0) {
+        per_command = 1;
+    }
+    argv    = (const char **)(malloc(
+        (2 + per_op * per_command * hashes) * sizeof(char *)));
+    argvlen = (size_t *)(malloc(
+        (2 + per_op * per_command * hashes) * sizeof(size_t)));
+    slots   = (char *)(malloc(per_command * hashes * 24));
+    name    = (char *)(malloc(length));
+    for (i = 0; i < ctxt->batched; ++i) {
+        order[i] = ((uint64_t)(ctxt->segments[i]) << 32) | i;
+    }
+    qsort(order, ctxt->batched, sizeof(uint64_t), packed_compare);
+
+    for (reading = 0; reading < 2; ++reading) {
+        for (start = 0; start < ctxt->batched; start = end) {
+            uint32_t segment = (uint32_t)(order[start] >> 32);
+            for (end = start; end < ctxt->batched && end - start < per_command
+                && (uint32_t)(order[end] >> 32) == segment; ++end);
+
+            if (!reading) {
+                snprintf(name, length, "%s.%u", ctxt->key, segment);
+                argc = 0;
+                argv[argc++] = "BITFIELD";
+                argv[argc++] = name;
+                for (i = start; i < end; ++i) {
+                    const uint64_t * bits = ctxt->batch +
+                        (order[i] & 0xFFFFFFFF) * hashes;
+                    for (j = 0; j < hashes; ++j) {
+                        char * slot = slots + 24 * ((i - start) * hashes + j);
+                        snprintf(slot, 24, "%lu", bits[j]);
+                        argv[argc++] = setting ? "SET" : "GET";
+                        argv[argc++] = "u1";
+                        argv[argc++] = slot;
+                        if (setting) {
+                            argv[argc++] = "1";
+                        }
+                    }
+                }
+                for (i = 0; i < argc; ++i) {
+                    argvlen[i] = strlen(argv[i]);
+                }
+                redisAppendCommandArgv(ctxt->ctxt, argc, argv, argvlen);
+                continue;
+            }
+
+            if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+                strncpy(ctxt->ctxt->errstr, "No pending replies",
+                    errstr_size);
+                failed = 1;
+                break;
+            }
+            if (reply->type == REDIS_REPLY_ERROR) {
+                failed = 1;
+                strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+            } else if (reply->type == REDIS_REPLY_ARRAY &&
+                reply->elements == (end - start) * hashes) {
+                for (i = 0; i < reply->elements; ++i) {
+                    ctxt->hits[order[start + i / hashes] & 0xFFFFFFFF] +=
+                        (uint32_t)(reply->element[i]->integer);
+                }
+            }
+            freeReplyObject(reply);
+        }
+    }
+
+    free(order);
+    free(argv);
+    free(argvlen);
+    free(slots);
+    free(name);
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+int packed_add(pyrebloompacked * ctxt, uint32_t tenant, const char * data,
+    uint32_t len) {
+    packed_queue(ctxt, tenant, data, len);
+    return PYREBLOOM_OK;
+}
+
+int64_t packed_add_complete(pyrebloompacked * ctxt) {
+    uint32_t i;
+    uint64_t total = 0;
+    int failed = (packed_flush(ctxt, 1) == PYREBLOOM_ERROR);
+    for (i = 0; i < ctxt->batched; ++i) {
+        if (ctxt->hits[i] != ctxt->filter.hashes) {
+            total += 1;
+        }
+    }
+    ctxt->batched = 0;
+    return failed ? PYREBLOOM_ERROR : (int64_t)(total);
+}
+
+int packed_check(pyrebloompacked * ctxt, uint32_t tenant, const char * data,
+    uint32_t len) {
+    packed_queue(ctxt, tenant, data, len);
+    return PYREBLOOM_OK;
+}
+
+int packed_check_next(pyrebloompacked * ctxt) {
+    int result;
+    /* The whole batch is checked when the first result is asked for */
+    if (ctxt->next_batched == 0) {
+        ctxt->batch_result = packed_flush(ctxt, 0);
+    }
+    result = (ctxt->hits[ctxt->next_batched++] == ctxt->filter.hashes);
+    if (ctxt->next_batched >= ctxt->batched) {
+        ctxt->batched = ctxt->next_batched = 0;
+    }
+    return (ctxt->batch_result == PYREBLOOM_ERROR) ? PYREBLOOM_ERROR : result;
+}
+
+int64_t packed_tenants(pyrebloompacked * ctxt) {
+    int64_t result = 0;
+    redisReply * reply = redisCommand(ctxt->ctxt, "HGET %s tenants",
+        ctxt->meta_key);
+    if (reply == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        result = PYREBLOOM_ERROR;
+    } else if (reply->type == REDIS_REPLY_STRING) {
+        result = (int64_t)(strtoll(reply->str, NULL, 10));
+    }
+    freeReplyObject(reply);
+    return result;
+}
+
+int packed_delete(pyrebloompacked * ctxt) {
+    int64_t tenants = packed_tenants(ctxt), segment, segments;
+    size_t length = strlen(ctxt->key) + 16;
+    char * name = (char *)(malloc(length));
+    segments = (tenants > 0) ?
+        (tenants + ctxt->tenants_per_segment - 1) / ctxt->tenants_per_segment :
+        0;
+    for (segment = 0; segment < segments; ++segment) {
+        snprintf(name, length, "%s.%ld", ctxt->key, segment);
+        freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", name));
+    }
+    free(name);
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s %s", ctxt->meta_key,
+        ctxt->tenants_key));
+    return PYREBLOOM_OK;
+}
@@ -0,0 +1,93 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef PYRE_PACKED_H
+#define PYRE_PACKED_H
+
+#include "bloom.h"
+
+/* A packed filter holds many small bloom filters of the same shape, one for
+ * each tenant, at fixed ranges of bits inside a few large shared segments,
+ * rather than giving each one keys of its own. Tenant n's filter is the
+ * `bits` bits starting at bit (n % tenants_per_segment) * bits of the
+ * segment `<key>.<n / tenants_per_segment>`.
+ *
+ * The names of the tenants are mapped to their numbers in `<key>.tenants`,
+ * and the whole thing is described by `<key>.meta`. Adds and checks for any
+ * number of tenants are batched into one BITFIELD for each segment. */
+typedef struct {
+    uint64_t        capacity;
+    double          error;
+    uint32_t        hash_family;
+    uint32_t        tenants_per_segment;
+    char          * key;
+    char          * meta_key;
+    char          * tenants_key;
+    /* Items added or checked are queued up here: the segment and bit of each
+     * of their hashes, and then how many of those bits were already set */
+    uint64_t      * batch;
+    uint32_t      * segments;
+    uint32_t      * hits;
+    uint32_t        batched;
+    uint32_t        next_batched;
+    uint32_t        batch_size;
+    int             batch_result;
+    /* Tenants whose numbers have been asked for, and not yet read */
+    uint32_t        pending;
+    /* Each tenant's range is described as though it were a filter */
+    pyrebloomctxt   filter;
+    redisContext  * ctxt;
+} pyrebloompacked;
+
+int init_packed(pyrebloompacked * ctxt, char * key, uint64_t capacity,
+    double error, char * host, uint32_t port, char * password, uint32_t db,
+    uint32_t hash_family);
+int free_packed(pyrebloompacked * ctxt);
+
+/* Look up the numbers of tenants by name, giving new ones the next free
+ * number if `assign` is set. These are pipelined, and each call to
+ * packed_tenant_next returns 1 and sets `tenant` if it has a number, or 0 if
+ * it doesn't. */
+int packed_tenant(pyrebloompacked * ctxt, const char * name, uint32_t len,
+    int assign);
+int packed_tenant_next(pyrebloompacked * ctxt, uint32_t * tenant);
+
+/* Add items to tenants' filters. These are batched, and sent when
+ * packed_add_complete is called, which returns how many of them were new. */
+int packed_add(pyrebloompacked * ctxt, uint32_t tenant, const char * data,
+    uint32_t len);
+int64_t packed_add_complete(pyrebloompacked * ctxt);
+
+/* Checks are batched too, and sent when the first result is asked for */
+int packed_check(pyrebloompacked * ctxt, uint32_t tenant, const char * data,
+    uint32_t len);
+int packed_check_next(pyrebloompacked * ctxt);
+
+/* How many tenants there are, and so how many segments */
+int64_t packed_tenants(pyrebloompacked * ctxt);
+
+int packed_delete(pyrebloompacked * ctxt);
+
+#endif
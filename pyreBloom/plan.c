@@ -0,0 +1,87 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+/* Lay out the trade-off between memory and hashes for a filter, and which
+ * one a filter made with the same arguments would be given:
+ *
+ *     ./plan <capacity> <error> [cost of each hash] [most bits]
+ *
+ * The cost of each hash is relative to the memory of the smallest filter, so
+ * with a cost of 0.05, a filter that saves 4 hashes is worth 20% more memory.
+ * This doesn't need redis. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bloom.h"
+
+int main(int argc, char ** argv) {
+    uint64_t capacity, max_bits = 0, bits, least;
+    double error, probe_cost = 0;
+    uint32_t hashes, chosen, shown;
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s <capacity> <error> [cost of each hash] [most bits]\n",
+            argv[0]);
+        return 1;
+    }
+    capacity = strtoull(argv[1], NULL, 10);
+    error    = strtod(argv[2], NULL);
+    if (argc > 3) {
+        probe_cost = strtod(argv[3], NULL);
+    }
+    if (argc > 4) {
+        max_bits = strtoull(argv[4], NULL, 10);
+    }
+    if (capacity == 0 || error <= 0 || error >= 1) {
+        fprintf(stderr, "The capacity must be positive, and the error rate "
+            "between 0 and 1\n");
+        return 1;
+    }
+
+    chosen = plan_hashes(capacity, error, probe_cost, max_bits);
+    least  = bits_for_hashes(capacity, error, 0);
+    /* Past twice the hashes of the smallest filter, it only gets worse */
+    shown  = 2 * plan_hashes(capacity, error, 0, 0);
+    if (shown > plan_max_hashes) {
+        shown = plan_max_hashes;
+    }
+
+    printf("%lu items at %g, with each hash costing %g\n\n", capacity, error,
+        probe_cost);
+    printf("hashes              bits          MB   memory     cost\n");
+    for (hashes = 1; hashes <= shown; ++hashes) {
+        bits = bits_for_hashes(capacity, error, hashes);
+        printf("%6u  %16lu  %10.1f  %6.2fx  %7.3f%s\n", hashes, bits,
+            bits / 8.0 / 1048576, (double)(bits) / least,
+            plan_cost(capacity, error, hashes, probe_cost),
+            (hashes == chosen) ? "  <- chosen" :
+            (max_bits != 0 && bits > max_bits) ? "  over budget" : "");
+    }
+    if (chosen == 0) {
+        printf("\nNo filter fits in %lu bits\n", max_bits);
+        return 1;
+    }
+    return 0;
+}
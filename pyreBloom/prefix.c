@@ -0,0 +1,320 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "prefix.h"
+#include <stdio.h>
+#include <string.h>
+
+/* The version of the metadata layout for prefix filters */
+static const uint32_t prefix_version = 1;
+
+/* The most levels a prefix filter may have */
+static const uint32_t max_levels = 64;
+
+/* Load the description of a prefix filter, or record it if it's new. The
+ * separator is kept as the number of its byte.
+ *
+ *     KEYS = { metadata key, first segment key of the first level }
+ *     ARGV = { capacity, error, levels, separator, hash family, version }
+ *
+ * It replies with the recorded capacity, error, levels, separator and hash
+ * family. */
+static const char * prefix_init_script =
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'prefix' then\n"
+    "    return redis.call('HMGET', KEYS[1], 'capacity', 'error', 'levels',\n"
+    "        'separator', 'hash')\n"
+    "elseif redis.call('EXISTS', KEYS[1], KEYS[2]) > 0 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "elseif ARGV[1] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; capacity and error are required')\n"
+    "end\n"
+    "redis.call('HMSET', KEYS[1], 'type', 'prefix', 'capacity', ARGV[1],\n"
+    "    'error', ARGV[2], 'levels', ARGV[3], 'separator', ARGV[4],\n"
+    "    'hash', ARGV[5], 'version', ARGV[6])\n"
+    "return {ARGV[1], ARGV[2], ARGV[3], ARGV[4], ARGV[5]}";
+
+int init_prefix(pyrebloomprefix * ctxt, char * key, uint64_t capacity,
+    double error, uint32_t levels, char separator, char * host,
+    uint32_t port, char * password, uint32_t db, uint32_t hash_family) {
+    redisReply * reply = NULL;
+    uint32_t i, args, hashes;
+    size_t length = strlen(key) + 16;
+    char * name;
+
+    ctxt->key      = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (capacity != 0 && (levels == 0 || levels > max_levels)) {
+        strncpy(ctxt->ctxt->errstr, "A prefix filter has 1 to 64 levels",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->ctxt, "EVAL %s 2 %s %s.l0.0 %lu %.17g %u %u %u %u",
+        prefix_init_script, ctxt->meta_key, key, capacity, error, levels,
+        (uint32_t)((unsigned char)(separator)), hash_family, prefix_version);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 5) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->capacity    = strtoull(reply->element[0]->str, NULL, 10);
+    ctxt->error       = strtod(reply->element[1]->str, NULL);
+    ctxt->levels      = (uint32_t)(strtoul(reply->element[2]->str, NULL, 10));
+    ctxt->separator   = (char)(strtoul(reply->element[3]->str, NULL, 10));
+    ctxt->hash_family = (uint32_t)(strtoul(reply->element[4]->str, NULL, 10));
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT || ctxt->capacity == 0 ||
+        ctxt->error <= 0 || ctxt->error >= 1 || ctxt->levels == 0 ||
+        ctxt->levels > max_levels) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+
+    /* Every level is the same shape */
+    name = (char *)(malloc(length));
+    ctxt->filters = (pyrebloomctxt *)(
+        calloc(ctxt->levels, sizeof(pyrebloomctxt)));
+    for (i = 0; i < ctxt->levels; ++i) {
+        snprintf(name, length, "%s.l%u", key, i);
+        attach_pyrebloom(&ctxt->filters[i], ctxt->ctxt, name, ctxt->capacity,
+            ctxt->error, ctxt->hash_family, max_bits_per_key);
+    }
+    free(name);
+    hashes = ctxt->filters[0].hashes;
+    ctxt->per_item = (ctxt->filters[0].num_keys == 1) ? 1 : hashes;
+
+    /* BITFIELD key, and then SET u1 offset 1 for each of the hashes */
+    args = 2 + 4 * hashes;
+    ctxt->args    = (char *)(malloc(hashes * 24));
+    ctxt->argv    = (const char **)(malloc(args * sizeof(char *)));
+    ctxt->argvlen = (size_t *)(malloc(args * sizeof(size_t)));
+    return PYREBLOOM_OK;
+}
+
+int free_prefix(pyrebloomprefix * ctxt) {
+    uint32_t i;
+    for (i = 0; ctxt->filters && i < ctxt->levels; ++i) {
+        /* The connection is ours, not the filters' */
+        ctxt->filters[i].ctxt = NULL;
+        free_pyrebloom(&ctxt->filters[i]);
+    }
+    free(ctxt->filters);
+    free(ctxt->queue);
+    free(ctxt->args);
+    free(ctxt->argv);
+    free(ctxt->argvlen);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+uint32_t prefix_count(pyrebloomprefix * ctxt, const char * data,
+    uint32_t len) {
+    uint32_t i, count = 1;
+    if (len > 0 && data[len - 1] == ctxt->separator) {
+        --len;
+    }
+    for (i = 0; i < len; ++i) {
+        count += (data[i] == ctxt->separator);
+    }
+    return count;
+}
+
+/* A second, independent-enough hash of a prefix for double hashing */
+static uint64_t prefix_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x | 1;
+}
+
+/* Queue up the BITFIELD commands that set or read one prefix's bits */
+static void prefix_command(pyrebloomprefix * ctxt, pyrebloomctxt * filter,
+    uint64_t chain, int setting) {
+    uint64_t step = prefix_mix(chain);
+    uint32_t i, j, argc = 0;
+    for (i = 0; i < filter->hashes; ++i) {
+        uint64_t d = (chain + i * step) % filter->bits;
+        char * offset = ctxt->args + i * 24;
+        snprintf(offset, 24, "%lu", d % filter->segment_bits);
+
+        if (argc == 0) {
+            ctxt->argv[argc++] = "BITFIELD";
+            ctxt->argv[argc++] = filter->keys[d / filter->segment_bits];
+        }
+        ctxt->argv[argc++] = setting ? "SET" : "GET";
+        ctxt->argv[argc++] = "u1";
+        ctxt->argv[argc++] = offset;
+        if (setting) {
+            ctxt->argv[argc++] = "1";
+        }
+
+        /* Bits in different segments need commands of their own */
+        if (ctxt->per_item != 1 || i + 1 == filter->hashes) {
+            for (j = 0; j < argc; ++j) {
+                ctxt->argvlen[j] = strlen(ctxt->argv[j]);
+            }
+            redisAppendCommandArgv(ctxt->ctxt, argc, ctxt->argv,
+                ctxt->argvlen);
+            argc = 0;
+        }
+    }
+}
+
+/* Hash each of an item's prefixes in one pass, queueing up the commands for
+ * each one at its level, and remember how many there were */
+static void prefix_append(pyrebloomprefix * ctxt, const char * data,
+    uint32_t len, int setting) {
+    uint64_t chain = ctxt->filters[0].seeds[0];
+    uint32_t i, start = 0, depth = 0;
+
+    if (len > 0 && data[len - 1] == ctxt->separator) {
+        --len;
+    }
+    for (i = 0; i <= len; ++i) {
+        if (i < len && data[i] != ctxt->separator) {
+            continue;
+        }
+        chain = hash_item(ctxt->hash_family, data + start, i - start, chain);
+        prefix_command(ctxt, &ctxt->filters[
+            (depth < ctxt->levels) ? depth : ctxt->levels - 1], chain,
+            setting);
+        start = i + 1;
+        ++depth;
+    }
+
+    if (ctxt->queued == ctxt->queue_size) {
+        ctxt->queue_size = ctxt->queue_size ? ctxt->queue_size * 2 : 64;
+        ctxt->queue = (uint32_t *)(realloc(ctxt->queue,
+            ctxt->queue_size * sizeof(uint32_t)));
+    }
+    ctxt->queue[ctxt->queued++] = depth;
+}
+
+/* Read the replies for the next item's prefixes, finding how many leading
+ * prefixes had all of their bits set, and whether the whole item did */
+static int prefix_next(pyrebloomprefix * ctxt, uint32_t * leading,
+    int * whole) {
+    uint32_t depth, i, j, k, set, hashes = ctxt->filters[0].hashes;
+    int failed = 0;
+    redisReply * reply = NULL;
+
+    if (ctxt->next_queued == ctxt->queued) {
+        strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    depth = ctxt->queue[ctxt->next_queued++];
+    if (ctxt->next_queued == ctxt->queued) {
+        ctxt->queued = ctxt->next_queued = 0;
+    }
+
+    *leading = 0;
+    *whole = 0;
+    for (i = 0; i < depth; ++i) {
+        for (j = 0, set = 0; j < ctxt->per_item; ++j) {
+            if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+                strncpy(ctxt->ctxt->errstr, "No pending replies",
+                    errstr_size);
+                return PYREBLOOM_ERROR;
+            }
+            if (reply->type == REDIS_REPLY_ERROR) {
+                failed = 1;
+                strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+            } else if (reply->type == REDIS_REPLY_ARRAY) {
+                for (k = 0; k < reply->elements; ++k) {
+                    set += (uint32_t)(reply->element[k]->integer);
+                }
+            }
+            freeReplyObject(reply);
+        }
+        if (set == hashes && *leading == i) {
+            *leading += 1;
+        }
+        *whole = (set == hashes);
+    }
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+int prefix_add(pyrebloomprefix * ctxt, const char * data, uint32_t len) {
+    prefix_append(ctxt, data, len, 1);
+    return PYREBLOOM_OK;
+}
+
+int64_t prefix_add_complete(pyrebloomprefix * ctxt, uint32_t count) {
+    uint32_t i, leading, total = 0;
+    int whole, failed = 0;
+
+    for (i = 0; i < count; ++i) {
+        if (prefix_next(ctxt, &leading, &whole) == PYREBLOOM_ERROR) {
+            failed = 1;
+        } else if (!whole) {
+            total += 1;
+        }
+    }
+
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+    return total;
+}
+
+int prefix_check(pyrebloomprefix * ctxt, const char * data, uint32_t len) {
+    prefix_append(ctxt, data, len, 0);
+    return PYREBLOOM_OK;
+}
+
+int prefix_check_next(pyrebloomprefix * ctxt) {
+    uint32_t leading;
+    int whole;
+    if (prefix_next(ctxt, &leading, &whole) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    return leading;
+}
+
+int prefix_delete(pyrebloomprefix * ctxt) {
+    uint32_t i;
+    for (i = 0; i < ctxt->levels; ++i) {
+        delete(&ctxt->filters[i]);
+    }
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->meta_key));
+    return PYREBLOOM_OK;
+}
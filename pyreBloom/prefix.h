@@ -0,0 +1,90 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef PYRE_PREFIX_H
+#define PYRE_PREFIX_H
+
+#include "bloom.h"
+
+/* A prefix filter holds items made of components split by a `separator`,
+ * like urls without their scheme, and can say whether any item added so far
+ * starts with a given run of whole components. Each item's prefixes of one,
+ * two, three ... components are added to a filter for each of `levels`
+ * levels, `<key>.l0`, `<key>.l1`, ... with prefixes that are deeper than
+ * that all going in the last. Each level has room for `capacity` prefixes.
+ *
+ * Rather than hashing every prefix from the start, each component is hashed
+ * seeded with the hash of the prefix before it, so the hashing for all of an
+ * item's prefixes is a single pass over it. The bits of each prefix come
+ * from its hash by double hashing. Adding or checking an item pipelines all
+ * of its prefixes at once. The filter is described by `<key>.meta`. */
+typedef struct {
+    uint64_t        capacity;
+    double          error;
+    uint32_t        levels;
+    char            separator;
+    uint32_t        hash_family;
+    /* How many BITFIELD commands each prefix needs; one, unless the levels'
+     * bits are spread across more than one segment */
+    uint32_t        per_item;
+    char          * key;
+    char          * meta_key;
+    /* How many prefixes each item that's been added or checked has, until
+     * their replies are read */
+    uint32_t      * queue;
+    uint32_t        queued;
+    uint32_t        next_queued;
+    uint32_t        queue_size;
+    /* Scratch space for building BITFIELD commands */
+    char          * args;
+    const char   ** argv;
+    size_t        * argvlen;
+    pyrebloomctxt * filters;
+    redisContext  * ctxt;
+} pyrebloomprefix;
+
+int init_prefix(pyrebloomprefix * ctxt, char * key, uint64_t capacity,
+    double error, uint32_t levels, char separator, char * host,
+    uint32_t port, char * password, uint32_t db, uint32_t hash_family);
+int free_prefix(pyrebloomprefix * ctxt);
+
+/* The number of components in an item. A trailing separator is ignored, so
+ * `moz.com/blog/` and `moz.com/blog` are the same. */
+uint32_t prefix_count(pyrebloomprefix * ctxt, const char * data, uint32_t len);
+
+/* Adds are pipelined, and prefix_add_complete returns how many of the items
+ * were new */
+int prefix_add(pyrebloomprefix * ctxt, const char * data, uint32_t len);
+int64_t prefix_add_complete(pyrebloomprefix * ctxt, uint32_t count);
+
+/* Checks are pipelined, and prefix_check_next returns how many of the leading
+ * prefixes of each item in turn have been seen. An item is itself a prefix
+ * of something added when that's all of its components. */
+int prefix_check(pyrebloomprefix * ctxt, const char * data, uint32_t len);
+int prefix_check_next(pyrebloomprefix * ctxt);
+
+int prefix_delete(pyrebloomprefix * ctxt);
+
+#endif
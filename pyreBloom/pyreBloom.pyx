@@ -22,9 +22,93 @@
 import math
 import random
 
+from libc.stdlib cimport malloc, free
 cimport bloom
 
 
+# The hash families a filter may be created with, by name
+HASH_FAMILIES = {
+	'murmur64a': bloom.PYREBLOOM_HASH_MURMUR64A,
+	'xxh3'     : bloom.PYREBLOOM_HASH_XXH3,
+	'wyhash'   : bloom.PYREBLOOM_HASH_WYHASH,
+}
+
+
+def hash_family_name(family):
+	'''Return the name of a hash family given its value'''
+	for name, value in HASH_FAMILIES.items():
+		if value == family:
+			return name
+
+
+# The ways a filter's bits may be laid out across its keys, by name
+LAYOUTS = {
+	'standard'   : bloom.PYREBLOOM_LAYOUT_STANDARD,
+	'partitioned': bloom.PYREBLOOM_LAYOUT_PARTITIONED,
+	'sharded'    : bloom.PYREBLOOM_LAYOUT_SHARDED,
+	'blocked'    : bloom.PYREBLOOM_LAYOUT_BLOCKED,
+	'sparse'     : bloom.PYREBLOOM_LAYOUT_SPARSE,
+}
+
+
+def layout_name(layout):
+	'''Return the name of a layout given its value'''
+	for name, value in LAYOUTS.items():
+		if value == layout:
+			return name
+
+
+def plan(capacity, error, probe_cost=0, max_bits=0):
+	'''Lay out the trade-off between bits and hashes for a filter of `capacity`
+	items at `error`, as a dict for each number of hashes with the bits that
+	takes, its memory as a multiple of the fewest bits it could have and its
+	relative cost with `probe_cost` for each hash. The one that a filter made
+	with the same arguments would have is marked as chosen.'''
+	chosen = bloom.plan_hashes(capacity, error, probe_cost, max_bits)
+	least = bloom.bits_for_hashes(capacity, error, 0)
+	return [{
+		'hashes': hashes,
+		'bits'  : bloom.bits_for_hashes(capacity, error, hashes),
+		'memory': float(bloom.bits_for_hashes(capacity, error, hashes)) / least,
+		'cost'  : bloom.plan_cost(capacity, error, hashes, probe_cost),
+		'chosen': hashes == chosen,
+	} for hashes in range(1, bloom.plan_max_hashes + 1)]
+
+
+def estimated_items(bits_set, bits, hashes):
+	'''Estimate how many distinct items were added to a filter from how many
+	of its bits are set (Swamidass and Baldi)'''
+	return bloom.estimate_items(bits_set, bits, hashes)
+
+
+def hash_item(value, seed=0, hash_family='murmur64a'):
+	'''Hash a value once with one of the hash families'''
+	if hash_family not in HASH_FAMILIES:
+		raise pyreBloomException('Unknown hash family %s' % hash_family)
+	return bloom.hash_item(HASH_FAMILIES[hash_family], value, len(value), seed)
+
+
+def hash_seeds(value, seeds, kernel='scalar'):
+	'''Hash a value with MurmurHash64A once for each of the seeds, the way a
+	filter hashes its items, with a particular kernel ('scalar', 'avx2',
+	'avx512' or 'auto' for the fastest this machine has). A kernel this
+	machine can't run raises pyreBloomException.'''
+	cdef bloom.uint32_t * s = <bloom.uint32_t *>malloc(
+		(len(seeds) + 1) * sizeof(bloom.uint32_t))
+	cdef bloom.uint64_t * out = <bloom.uint64_t *>malloc(
+		(len(seeds) + 1) * sizeof(bloom.uint64_t))
+	for i, seed in enumerate(seeds):
+		s[i] = seed
+	r = bloom.MurmurHash64A_seeds_kernel(kernel, <char *>value, len(value), s,
+		len(seeds), out)
+	hashes = [out[i] for i in range(len(seeds))]
+	free(s)
+	free(out)
+	if r < 0:
+		raise pyreBloomException('No %s kernel on this machine' % kernel)
+	return hashes
+
+
 class pyreBloomException(Exception):
 	'''Some sort of exception has happened internally'''
 	pass
@@ -33,6 +117,15 @@ class pyreBloomException(Exception):
 cdef class pyreBloom(object):
 	cdef bloom.pyrebloomctxt context
 	cdef bytes               key
+	cdef bint                local_reads
+	
+	property capacity:
+		def __get__(self):
+			return self.context.capacity
+	
+	property error:
+		def __get__(self):
+			return self.context.error
 	
 	property bits:
 		def __get__(self):
@@ -41,12 +134,55 @@ cdef class pyreBloom(object):
 	property hashes:
 		def __get__(self):
 			return self.context.hashes
-	
-	def __cinit__(self, key, capacity, error, host='127.0.0.1', port=6379,
-		password='', db=0):
+
+	property hash_family:
+		'''The name of the hash this filter uses. Whoever first created the
+		filter decided this, so it may differ from what we asked for.'''
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+
+	property layout:
+		'''How this filter's bits are laid out across its keys. Like the hash,
+		whoever first created the filter decided this.'''
+		def __get__(self):
+			return layout_name(self.context.layout)
+
+	property archived:
+		'''Whether this filter's bits are compressed in <key>.archive, as of
+		our last add or check'''
+		def __get__(self):
+			return bool(self.context.archived)
+
+	def __cinit__(self, key, capacity=0, error=0, host='127.0.0.1', port=6379,
+		password='', db=0, hash_family='murmur64a', layout='standard',
+		power_of_two=False, hashes=0, probe_cost=None, max_bits=0,
+		rehydrate=True):
+		'''Open the filter at `key`, creating it for `capacity` items at the
+		`error` rate if it doesn't exist yet. Its number of hashes is either
+		asked for with `hashes`, or planned from `probe_cost` and `max_bits`,
+		but not both: giving `hashes` alongside either is an error.'''
 		self.key = key
+		self.local_reads = not rehydrate
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if layout not in LAYOUTS:
+			raise pyreBloomException('Unknown layout %s' % layout)
+		if power_of_two and layout != 'standard':
+			raise pyreBloomException(
+				'Only standard filters can be sized to a power of two')
+		if hashes and (probe_cost is not None or max_bits):
+			raise pyreBloomException(
+				'hashes can\'t be combined with probe_cost or max_bits')
+		# Trade memory for fewer hashes, if each one costs something
+		if capacity and (probe_cost is not None or max_bits):
+			hashes = bloom.plan_hashes(capacity, error, probe_cost or 0,
+				max_bits)
+			if not hashes:
+				raise pyreBloomException(
+					'No filter of at most %i bits has that error rate' % max_bits)
 		if bloom.init_pyrebloom(&self.context, self.key, capacity,
-			error, host, port, password, db):
+			error, host, port, password, db, HASH_FAMILIES[hash_family],
+			LAYOUTS[layout], power_of_two, hashes):
 			raise pyreBloomException(self.context.ctxt.errstr)
 	
 	def __dealloc__(self):
@@ -55,13 +191,398 @@ cdef class pyreBloom(object):
 	def delete(self):
 		bloom.delete(&self.context)
 	
+	def archive(self, page_bytes=bloom.archive_page_bytes):
+		'''Compress the filter's bits into <key>.archive a page at a time,
+		and delete its segments. Returns the size of the archive in bytes. If
+		anything is added to the filter in the meantime, it's left as it was
+		and this raises.'''
+		cdef bloom.uint64_t size
+		# Every segment is read, so it's worth making sure they're current
+		self.refresh()
+		if bloom.archive(&self.context, page_bytes, &size) < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return size
+	
+	def rehydrate(self):
+		'''Write an archived filter's bits back into its segments, or cancel
+		an archive that's under way. Anything that needs them does this on its
+		own.'''
+		if bloom.rehydrate(&self.context) < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	cdef thaw(self, bint writing=False):
+		# Anything that needs the bits rehydrates an archived filter, and
+		# anything that sets them cancels an archive that's under way
+		if self.context.archived or (writing and self.context.archiving):
+			self.rehydrate()
+	
+	def fill(self):
+		'''The fraction of the filter's bits that are set'''
+		cdef bloom.uint64_t count
+		self.thaw()
+		if bloom.bits_set(&self.context, &count) < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return float(count) / self.context.bits
+	
+	def estimate(self, samples=0, sample_bytes=4096):
+		'''Estimate how many items are in the filter, the fraction of its bits
+		that are set and its false positive rate, as a dict. These follow from
+		the running count of new items that every client keeps in its metadata,
+		or with `samples`, from the bits set in that many random ranges of
+		`sample_bytes` bytes, without scanning all of them.'''
+		cdef bloom.uint64_t count
+		cdef double fill
+		bits, hashes = self.context.bits, self.context.hashes
+		if samples:
+			self.thaw()
+			if bloom.sample_fill(&self.context, samples, sample_bytes,
+				&fill) < 0:
+				raise pyreBloomException(self.context.ctxt.errstr)
+			fill = min(fill, 1.0)
+			items = estimated_items(int(fill * bits), bits, hashes)
+		else:
+			if bloom.items_added(&self.context, &count) < 0:
+				raise pyreBloomException(self.context.ctxt.errstr)
+			items = count
+			fill = 1 - math.exp(-float(hashes) * items / bits)
+		return {'items': items, 'fill': fill, 'error': fill ** hashes}
+	
+	def fold(self, max_fill=0.5, times=None):
+		'''Halve the filter, ORing the upper half of its bits into the lower
+		half, for as long as it would be at most `max_fill` full afterwards
+		(or exactly `times` times). Returns how many times it was folded.'''
+		folds = 0
+		# Folding pairs up the segments, so they must be current
+		self.refresh()
+		self.thaw(True)
+		while times is None or folds < times:
+			if times is None:
+				# Folding a fill of f leaves it about 2f - f^2 full
+				fill = self.fill()
+				if not bloom.foldable(&self.context) or (
+					2 * fill - fill * fill > max_fill):
+					break
+			if bloom.fold(&self.context) < 0:
+				raise pyreBloomException(self.context.ctxt.errstr)
+			folds += 1
+		return folds
+	
+	cdef combine(self, keys, into, bloom.uint32_t intersect):
+		if not getattr(keys, '__iter__', False):
+			keys = [keys]
+		cdef const char ** names = <const char **>malloc(
+			len(keys) * sizeof(char *))
+		cdef const char * dest = NULL
+		for i, key in enumerate(keys):
+			names[i] = key
+		if into is not None:
+			dest = into
+		self.thaw(True)
+		r = bloom.combine(&self.context, dest, names, len(keys), intersect)
+		free(names)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	cdef combined_bits(self, keys, bloom.uint32_t intersect):
+		if not getattr(keys, '__iter__', False):
+			keys = [keys]
+		cdef const char ** names = <const char **>malloc(
+			len(keys) * sizeof(char *))
+		cdef bloom.uint64_t count
+		for i, key in enumerate(keys):
+			names[i] = key
+		self.thaw()
+		r = bloom.combined_bits(&self.context, names, len(keys), intersect,
+			&count)
+		free(names)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return count
+	
+	def union(self, keys, into=None):
+		'''OR the bits of the filters at `keys` into this one, or with this
+		one's into a new filter at `into`. They must all be the same shape.'''
+		self.combine(keys, into, 0)
+	
+	def intersection(self, keys, into=None):
+		'''AND the bits of the filters at `keys` with this one's, in place or
+		into a new filter at `into`. Its false positive rate is at least that
+		of either filter.'''
+		self.combine(keys, into, 1)
+	
+	def cardinality(self):
+		'''Estimate how many distinct items have been added'''
+		cdef bloom.uint64_t count
+		self.thaw()
+		if bloom.bits_set(&self.context, &count) < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return estimated_items(count, self.context.bits, self.context.hashes)
+	
+	def union_cardinality(self, keys):
+		'''Estimate how many distinct items are in this filter or the filters
+		at `keys`, without storing their union'''
+		return estimated_items(self.combined_bits(keys, 0),
+			self.context.bits, self.context.hashes)
+	
+	def intersection_cardinality(self, key):
+		'''Estimate how many items are in both this filter and the one at
+		`key`, as the items in each less the items in either'''
+		return self.overlap(key)[0]
+	
+	def jaccard(self, key):
+		'''Estimate the Jaccard similarity of this filter and the one at
+		`key`: the items in both over the items in either'''
+		both, either = self.overlap(key)
+		return both / either if either > 0 else 0.0
+	
+	cdef overlap(self, key):
+		cdef bloom.uint64_t ours
+		self.thaw()
+		if bloom.bits_set(&self.context, &ours) < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		either = self.combined_bits(key, 0)
+		# Every bit is in the union once, and in the intersection if it's set
+		# in both, which gives how many are set in theirs
+		theirs = either + self.combined_bits(key, 1) - ours
+		bits, hashes = self.context.bits, self.context.hashes
+		union = estimated_items(either, bits, hashes)
+		both = (estimated_items(ours, bits, hashes) +
+			estimated_items(theirs, bits, hashes) - union)
+		return max(both, 0.0), union
+	
+	cdef refresh(self):
+		# Read the filter's shape and state from its metadata again, since it
+		# may have been folded, archived or rehydrated since we last looked.
+		# Whatever we sent in the meantime has to be sent again.
+		if bloom.refresh(&self.context) < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def put(self, value):
+		while True:
+			self.thaw(True)
+			if getattr(value, '__iter__', False):
+				r = [bloom.add(&self.context, v, len(v)) for v in value]
+				r = bloom.add_complete(&self.context, len(value))
+			else:
+				bloom.add(&self.context, value, len(value))
+				r = bloom.add_complete(&self.context, 1)
+			if not self.context.stale:
+				break
+			self.refresh()
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def add(self, value):
+		return self.put(value)
+	
+	def extend(self, values):
+		return self.put(values)
+	
+	cdef checks(self, values):
+		# Check each of the values, with the fence's result last. An archived
+		# filter is read where it is, a few pages at a time, unless we're to
+		# rehydrate it.
+		if self.context.archived and self.local_reads:
+			r = [bloom.archive_check(&self.context, v, len(v)) for v in values]
+			bloom.check_fence(&self.context)
+		else:
+			self.thaw()
+			r = [bloom.check(&self.context, v, len(v)) for v in values]
+			bloom.check_fence(&self.context)
+			r = [bloom.check_next(&self.context) for i in range(len(values))]
+		r.append(bloom.check_complete(&self.context))
+		return r
+	
+	def contains(self, value):
+		# If the object is 'iterable'...
+		iterable = getattr(value, '__iter__', False)
+		values = value if iterable else [value]
+		r = self.checks(values)
+		while self.context.stale:
+			self.refresh()
+			r = self.checks(values)
+		if (min(r) < 0):
+			raise pyreBloomException(self.context.ctxt.errstr)
+		if iterable:
+			return [v for v, included in zip(values, r) if included]
+		return bool(r[0])
+	
+	def __contains__(self, value):
+		return self.contains(value)
+
+	def keys(self):
+		'''Return a list of the keys used in this bloom filter'''
+		if self.context.archived:
+			return [self.context.archive_key]
+		keys = [self.context.keys[i] for i in range(self.context.num_keys)]
+		if self.context.sparse_key != NULL:
+			keys.append(self.context.sparse_key)
+		return keys
+
+
+cdef class pyreScalableBloom(object):
+	'''A bloom filter that grows as items are added to it. The capacity given
+	is that of the first of a chain of filters, each `growth` times larger than
+	the last, with the false positive rate of the chain kept under `error`.'''
+	cdef bloom.pyrebloomscalable context
+	cdef bytes                   key
+	
+	property capacity:
+		def __get__(self):
+			return self.context.capacity
+	
+	property error:
+		def __get__(self):
+			return self.context.error
+	
+	property growth:
+		def __get__(self):
+			return self.context.growth
+	
+	property tightening:
+		def __get__(self):
+			return self.context.tightening
+	
+	property filters:
+		'''How many filters are in the chain, as of our last operation'''
+		def __get__(self):
+			return self.context.num_filters
+	
+	property bits:
+		def __get__(self):
+			return sum(self.context.filters[i].bits
+				for i in range(self.context.num_filters))
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key, capacity=0, error=0, growth=2, tightening=0.5,
+		host='127.0.0.1', port=6379, password='', db=0,
+		hash_family='murmur64a'):
+		self.key = key
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if bloom.init_scalable(&self.context, self.key, capacity, error,
+			growth, tightening, host, port, password, db,
+			HASH_FAMILIES[hash_family]):
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_scalable(&self.context)
+	
+	def delete(self):
+		bloom.scalable_delete(&self.context)
+	
+	def put(self, value):
+		if getattr(value, '__iter__', False):
+			r = [bloom.scalable_add(&self.context, v, len(v)) for v in value]
+			r = bloom.scalable_add_complete(&self.context)
+		else:
+			bloom.scalable_add(&self.context, value, len(value))
+			r = bloom.scalable_add_complete(&self.context)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def add(self, value):
+		return self.put(value)
+	
+	def extend(self, values):
+		return self.put(values)
+	
+	def contains(self, value):
+		# If the object is 'iterable'...
+		if getattr(value, '__iter__', False):
+			if not len(value):
+				return []
+			bloom.scalable_check_begin(&self.context)
+			r = [bloom.scalable_check(&self.context, v, len(v)) for v in value]
+			grew = bloom.scalable_check_begun(&self.context)
+			r = [bloom.scalable_check_next(&self.context) for i in range(len(value))]
+			if grew < 0 or min(r) < 0:
+				raise pyreBloomException(self.context.ctxt.errstr)
+			if grew:
+				# Someone started a new filter since we last looked, so anything
+				# we didn't find may be in there
+				misses = [v for v, included in zip(value, r) if not included]
+				found = set(self.contains(misses))
+				return [v for v, included in zip(value, r)
+					if included or v in found]
+			return [v for v, included in zip(value, r) if included]
+		else:
+			return bool(self.contains([value]))
+	
+	def __contains__(self, value):
+		return self.contains(value)
+	
+	def keys(self):
+		'''Return a list of the keys used by the filters in the chain'''
+		return [self.context.filters[i].keys[j]
+			for i in range(self.context.num_filters)
+			for j in range(self.context.filters[i].num_keys)]
+
+
+cdef class pyreCountingBloom(object):
+	'''A bloom filter that items can be removed from, as well as added to. Each
+	bit of an ordinary filter becomes a counter `width` bits wide, so it takes
+	`width` times the space. Only remove items that have actually been added.'''
+	cdef bloom.pyrebloomcounting context
+	cdef bytes                   key
+	cdef object                  connection
+	
+	property capacity:
+		def __get__(self):
+			return self.context.capacity
+	
+	property error:
+		def __get__(self):
+			return self.context.error
+	
+	property width:
+		def __get__(self):
+			return self.context.width
+	
+	property counters:
+		def __get__(self):
+			return self.context.filter.bits
+	
+	property bits:
+		def __get__(self):
+			return self.context.filter.bits * self.context.width
+	
+	property hashes:
+		def __get__(self):
+			return self.context.filter.hashes
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key, capacity=0, error=0, width=4, host='127.0.0.1',
+		port=6379, password='', db=0, hash_family='murmur64a'):
+		self.key = key
+		self.connection = dict(host=host, port=port, password=password, db=db)
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if bloom.init_counting(&self.context, self.key, capacity, error, width,
+			host, port, password, db, HASH_FAMILIES[hash_family]):
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_counting(&self.context)
+	
+	def delete(self):
+		bloom.counting_delete(&self.context)
+	
 	def put(self, value):
 		if getattr(value, '__iter__', False):
-			r = [bloom.add(&self.context, v, len(v)) for v in value]
-			r = bloom.add_complete(&self.context, len(value))
+			r = [bloom.counting_add(&self.context, v, len(v)) for v in value]
+			r = bloom.counting_add_complete(&self.context, len(value))
 		else:
-			bloom.add(&self.context, value, len(value))
-			r = bloom.add_complete(&self.context, 1)
+			bloom.counting_add(&self.context, value, len(value))
+			r = bloom.counting_add_complete(&self.context, 1)
 		if r < 0:
 			raise pyreBloomException(self.context.ctxt.errstr)
 		return r
@@ -72,24 +593,1071 @@ cdef class pyreBloom(object):
 	def extend(self, values):
 		return self.put(values)
 	
+	def remove(self, value):
+		'''Remove an item, or a list of items, returning how many of them are no
+		longer in the filter'''
+		if getattr(value, '__iter__', False):
+			r = [bloom.counting_remove(&self.context, v, len(v)) for v in value]
+			r = bloom.counting_remove_complete(&self.context, len(value))
+		else:
+			bloom.counting_remove(&self.context, value, len(value))
+			r = bloom.counting_remove_complete(&self.context, 1)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
 	def contains(self, value):
 		# If the object is 'iterable'...
 		if getattr(value, '__iter__', False):
-			r = [bloom.check(&self.context, v, len(v)) for v in value]
-			r = [bloom.check_next(&self.context) for i in range(len(value))]
+			r = [bloom.counting_check(&self.context, v, len(v)) for v in value]
+			r = [bloom.counting_check_next(&self.context) for i in range(len(value))]
 			if (min(r) < 0):
 				raise pyreBloomException(self.context.ctxt.errstr)
 			return [v for v, included in zip(value, r) if included]
 		else:
-			bloom.check(&self.context, value, len(value))
-			r = bloom.check_next(&self.context)
+			bloom.counting_check(&self.context, value, len(value))
+			r = bloom.counting_check_next(&self.context)
 			if (r < 0):
 				raise pyreBloomException(self.context.ctxt.errstr)
 			return bool(r)
 	
 	def __contains__(self, value):
 		return self.contains(value)
+	
+	def freeze(self, key):
+		'''Write an ordinary bloom filter holding the same items to `key`,
+		replacing any bloom filter there, and return it'''
+		if bloom.counting_freeze(&self.context, key):
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return pyreBloom(key, **self.connection)
+	
+	def keys(self):
+		'''Return a list of the keys used in this filter'''
+		return [self.context.filter.keys[i]
+			for i in range(self.context.filter.num_keys)]
 
+
+cdef class pyreCuckoo(object):
+	'''A cuckoo filter, which keeps a short fingerprint of each item rather than
+	setting bits. At error rates below about 1% it's smaller than a bloom
+	filter, checks are faster, and items can be removed. Unlike a bloom filter,
+	it can become full, at which point adding to it is an error.'''
+	cdef bloom.pyrebloomcuckoo context
+	cdef bytes                 key
+	
+	property capacity:
+		def __get__(self):
+			return self.context.capacity
+	
+	property error:
+		def __get__(self):
+			return self.context.error
+	
+	property fingerprint_bits:
+		def __get__(self):
+			return self.context.fingerprint_bits
+	
+	property bucket_size:
+		def __get__(self):
+			return self.context.bucket_size
+	
+	property buckets:
+		def __get__(self):
+			return self.context.buckets
+	
+	property bits:
+		def __get__(self):
+			return (self.context.buckets * self.context.bucket_size *
+				self.context.fingerprint_bits)
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key, capacity=0, error=0, host='127.0.0.1', port=6379,
+		password='', db=0, hash_family='murmur64a'):
+		self.key = key
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if bloom.init_cuckoo(&self.context, self.key, capacity, error, host,
+			port, password, db, HASH_FAMILIES[hash_family]):
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_cuckoo(&self.context)
+	
+	def delete(self):
+		bloom.cuckoo_delete(&self.context)
+	
+	def put(self, value):
+		if getattr(value, '__iter__', False):
+			r = [bloom.cuckoo_add(&self.context, v, len(v)) for v in value]
+			r = bloom.cuckoo_add_complete(&self.context, len(value))
+		else:
+			bloom.cuckoo_add(&self.context, value, len(value))
+			r = bloom.cuckoo_add_complete(&self.context, 1)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def add(self, value):
+		return self.put(value)
+	
+	def extend(self, values):
+		return self.put(values)
+	
+	def remove(self, value):
+		'''Remove an item, or a list of items, returning how many were found'''
+		if getattr(value, '__iter__', False):
+			r = [bloom.cuckoo_remove(&self.context, v, len(v)) for v in value]
+			r = bloom.cuckoo_remove_complete(&self.context, len(value))
+		else:
+			bloom.cuckoo_remove(&self.context, value, len(value))
+			r = bloom.cuckoo_remove_complete(&self.context, 1)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def contains(self, value):
+		# If the object is 'iterable'...
+		if getattr(value, '__iter__', False):
+			r = [bloom.cuckoo_check(&self.context, v, len(v)) for v in value]
+			r = [bloom.cuckoo_check_next(&self.context) for i in range(len(value))]
+			if (min(r) < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return [v for v, included in zip(value, r) if included]
+		else:
+			bloom.cuckoo_check(&self.context, value, len(value))
+			r = bloom.cuckoo_check_next(&self.context)
+			if (r < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return bool(r)
+	
+	def __contains__(self, value):
+		return self.contains(value)
+	
 	def keys(self):
-		'''Return a list of the keys used in this bloom filter'''
+		'''Return a list of the keys used in this filter'''
 		return [self.context.keys[i] for i in range(self.context.num_keys)]
+
+
+cdef class pyreXor(object):
+	'''A static filter, built once from all of its items and never changed
+	after that. It takes less space than a bloom filter with the same error
+	rate, and checks read just three fingerprints. It's either stored in redis
+	at `key` or saved to a local file at `path`, and can be opened from either
+	without giving any items.'''
+	cdef bloom.pyrebloomxor context
+	cdef bytes              key
+	cdef bytes              path
+	
+	property size:
+		def __get__(self):
+			return self.context.size
+	
+	property fingerprint_bits:
+		def __get__(self):
+			return self.context.fingerprint_bits
+	
+	property bits:
+		def __get__(self):
+			return 3 * self.context.block_length * self.context.fingerprint_bits
+	
+	property error:
+		def __get__(self):
+			return 0.5 ** self.context.fingerprint_bits
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key=None, items=None, error=0.001, threads=0,
+		host='127.0.0.1', port=6379, password='', db=0, path=None,
+		hash_family='murmur64a'):
+		cdef const char ** data
+		cdef bloom.uint32_t * lengths
+		cdef bloom.uint64_t count, i
+		cdef bloom.uint32_t workers = threads, family
+		cdef double rate = error
+		cdef int r
+		if key is None and path is None:
+			raise pyreBloomException('A key or a path is required')
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		self.key = key
+		self.path = path
+		family = HASH_FAMILIES[hash_family]
+		
+		if items is None:
+			if path is not None:
+				r = bloom.xor_load(&self.context, self.path)
+			else:
+				r = bloom.init_xor(&self.context, self.key, host, port, password,
+					db)
+			if r < 0:
+				raise pyreBloomException(self.context.errstr)
+			return
+		
+		# The items have to stay referenced while they're hashed
+		items = list(items)
+		count = len(items)
+		data = <const char **>malloc((count + 1) * sizeof(char *))
+		lengths = <bloom.uint32_t *>malloc((count + 1) * sizeof(bloom.uint32_t))
+		for i in range(count):
+			data[i] = items[i]
+			lengths[i] = len(items[i])
+		with nogil:
+			r = bloom.xor_build(&self.context, data, lengths, count, rate,
+				workers, family)
+		free(data)
+		free(lengths)
+		if r < 0:
+			raise pyreBloomException(self.context.errstr)
+		if path is not None and bloom.xor_save(&self.context, self.path) < 0:
+			raise pyreBloomException(self.context.errstr)
+		if key is not None and bloom.xor_store(&self.context, self.key, host,
+			port, password, db) < 0:
+			raise pyreBloomException(self.context.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_xor(&self.context)
+	
+	def delete(self):
+		'''Delete the filter from redis. A local file is left alone.'''
+		bloom.xor_delete(&self.context)
+	
+	def save(self, path):
+		'''Save the filter to a local file'''
+		if bloom.xor_save(&self.context, path) < 0:
+			raise pyreBloomException(self.context.errstr)
+	
+	def contains(self, value):
+		# Filters in memory are checked right here
+		if self.context.fingerprints != NULL:
+			if getattr(value, '__iter__', False):
+				return [v for v in value
+					if bloom.xor_contains(&self.context, v, len(v))]
+			return bool(bloom.xor_contains(&self.context, value, len(value)))
+		
+		# If the object is 'iterable'...
+		if getattr(value, '__iter__', False):
+			r = [bloom.xor_check(&self.context, v, len(v)) for v in value]
+			r = [bloom.xor_check_next(&self.context) for i in range(len(value))]
+			if (min(r or [0]) < 0):
+				raise pyreBloomException(self.context.errstr)
+			return [v for v, included in zip(value, r) if included]
+		else:
+			bloom.xor_check(&self.context, value, len(value))
+			r = bloom.xor_check_next(&self.context)
+			if (r < 0):
+				raise pyreBloomException(self.context.errstr)
+			return bool(r)
+	
+	def __contains__(self, value):
+		return self.contains(value)
+	
+	def keys(self):
+		'''Return a list of the keys used in this filter'''
+		return [self.context.keys[i] for i in range(self.context.num_keys)]
+
+
+cdef class pyreRotatingBloom(object):
+	'''A bloom filter that only remembers items for a while. Each `period`
+	seconds starts a new generation, the last `generations` of which are
+	checked, and older ones are dropped. The capacity is that of a single
+	generation, and the false positive rate of all of them together is kept
+	under `error`.'''
+	cdef bloom.pyrebloomrotating context
+	cdef bytes                   key
+	
+	property capacity:
+		def __get__(self):
+			return self.context.capacity
+	
+	property error:
+		def __get__(self):
+			return self.context.error
+	
+	property period:
+		def __get__(self):
+			return self.context.period
+	
+	property generations:
+		def __get__(self):
+			return self.context.generations
+	
+	property generation:
+		'''The number of the current generation, as of our last operation'''
+		def __get__(self):
+			return self.context.current
+	
+	property bits:
+		'''The bits in each generation'''
+		def __get__(self):
+			return self.context.filters[
+				self.context.current % self.context.generations].bits
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key, capacity=0, error=0, period=86400, generations=7,
+		host='127.0.0.1', port=6379, password='', db=0,
+		hash_family='murmur64a'):
+		self.key = key
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if bloom.init_rotating(&self.context, self.key, capacity, error,
+			period, generations, host, port, password, db,
+			HASH_FAMILIES[hash_family]):
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_rotating(&self.context)
+	
+	def delete(self):
+		bloom.rotating_delete(&self.context)
+	
+	def put(self, value):
+		if getattr(value, '__iter__', False):
+			r = [bloom.rotating_add(&self.context, v, len(v)) for v in value]
+			r = bloom.rotating_add_complete(&self.context, len(value))
+		else:
+			bloom.rotating_add(&self.context, value, len(value))
+			r = bloom.rotating_add_complete(&self.context, 1)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def add(self, value):
+		return self.put(value)
+	
+	def extend(self, values):
+		return self.put(values)
+	
+	def contains(self, value):
+		# If the object is 'iterable'...
+		if getattr(value, '__iter__', False):
+			r = [bloom.rotating_check(&self.context, v, len(v)) for v in value]
+			r = [bloom.rotating_check_next(&self.context)
+				for i in range(len(value))]
+			if (min(r or [0]) < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return [v for v, included in zip(value, r) if included]
+		else:
+			bloom.rotating_check(&self.context, value, len(value))
+			r = bloom.rotating_check_next(&self.context)
+			if (r < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return bool(r)
+	
+	def __contains__(self, value):
+		return self.contains(value)
+	
+	def keys(self):
+		'''Return a list of the keys of the live generations, newest first'''
+		return [bloom.rotating_key(&self.context, i)
+			for i in range(bloom.rotating_num_keys(&self.context))]
+
+
+cdef class pyreStableBloom(object):
+	'''A bloom filter for an endless stream of items, which never fills up.
+	Each item added counts down a few other cells, so items that haven't been
+	seen in a while are eventually forgotten, and the false positive rate stays
+	at `error` however many items are added.'''
+	cdef bloom.pyrebloomstable context
+	cdef bytes                 key
+	
+	property capacity:
+		def __get__(self):
+			return self.context.capacity
+	
+	property error:
+		def __get__(self):
+			return self.context.error
+	
+	property width:
+		def __get__(self):
+			return self.context.width
+	
+	property decrements:
+		def __get__(self):
+			return self.context.decrements
+	
+	property cells:
+		def __get__(self):
+			return self.context.filter.bits
+	
+	property bits:
+		def __get__(self):
+			return self.context.filter.bits * self.context.width
+	
+	property hashes:
+		def __get__(self):
+			return self.context.filter.hashes
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key, capacity=0, error=0, width=3, host='127.0.0.1',
+		port=6379, password='', db=0, hash_family='murmur64a'):
+		self.key = key
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if bloom.init_stable(&self.context, self.key, capacity, error, width,
+			host, port, password, db, HASH_FAMILIES[hash_family]):
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_stable(&self.context)
+	
+	def delete(self):
+		bloom.stable_delete(&self.context)
+	
+	def put(self, value):
+		if getattr(value, '__iter__', False):
+			r = [bloom.stable_add(&self.context, v, len(v)) for v in value]
+			r = bloom.stable_add_complete(&self.context, len(value))
+		else:
+			bloom.stable_add(&self.context, value, len(value))
+			r = bloom.stable_add_complete(&self.context, 1)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def add(self, value):
+		return self.put(value)
+	
+	def extend(self, values):
+		return self.put(values)
+	
+	def contains(self, value):
+		# If the object is 'iterable'...
+		if getattr(value, '__iter__', False):
+			r = [bloom.stable_check(&self.context, v, len(v)) for v in value]
+			r = [bloom.stable_check_next(&self.context) for i in range(len(value))]
+			if (min(r or [0]) < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return [v for v, included in zip(value, r) if included]
+		else:
+			bloom.stable_check(&self.context, value, len(value))
+			r = bloom.stable_check_next(&self.context)
+			if (r < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return bool(r)
+	
+	def __contains__(self, value):
+		return self.contains(value)
+	
+	def keys(self):
+		'''Return a list of the keys used in this filter'''
+		return [self.context.filter.keys[i]
+			for i in range(self.context.filter.num_keys)]
+
+
+cdef class pyreCountMin(object):
+	'''A count-min sketch, which estimates how many times each item has been
+	counted in a fixed amount of space. Estimates are never too low, and with
+	probability `confidence`, too high by at most `error` times the total of
+	all the counts.'''
+	cdef bloom.pyrebloomcountmin context
+	cdef bytes                   key
+	
+	property error:
+		def __get__(self):
+			return self.context.error
+	
+	property confidence:
+		def __get__(self):
+			return self.context.confidence
+	
+	property columns:
+		def __get__(self):
+			return self.context.columns
+	
+	property rows:
+		def __get__(self):
+			return self.context.rows
+	
+	property width:
+		def __get__(self):
+			return self.context.width
+	
+	property bits:
+		def __get__(self):
+			return self.context.columns * self.context.rows * self.context.width
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key, error=0, confidence=0.999, width=32,
+		host='127.0.0.1', port=6379, password='', db=0,
+		hash_family='murmur64a'):
+		self.key = key
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if bloom.init_countmin(&self.context, self.key, error, confidence,
+			width, host, port, password, db, HASH_FAMILIES[hash_family]):
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_countmin(&self.context)
+	
+	def delete(self):
+		bloom.countmin_delete(&self.context)
+	
+	def increment(self, value, by=1):
+		'''Count an item, or a list of items, `by` times each, returning the
+		new estimates'''
+		if getattr(value, '__iter__', False):
+			r = [bloom.countmin_increment(&self.context, v, len(v), by)
+				for v in value]
+			r = [bloom.countmin_next(&self.context) for i in range(len(value))]
+			if (min(r or [0]) < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return r
+		else:
+			bloom.countmin_increment(&self.context, value, len(value), by)
+			r = bloom.countmin_next(&self.context)
+			if (r < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return r
+	
+	def add(self, value):
+		return self.increment(value)
+	
+	def extend(self, values):
+		return self.increment(values)
+	
+	def count(self, value):
+		'''Estimate how many times an item, or each of a list of items, has
+		been counted'''
+		if getattr(value, '__iter__', False):
+			r = [bloom.countmin_count(&self.context, v, len(v)) for v in value]
+			r = [bloom.countmin_next(&self.context) for i in range(len(value))]
+			if (min(r or [0]) < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return r
+		else:
+			bloom.countmin_count(&self.context, value, len(value))
+			r = bloom.countmin_next(&self.context)
+			if (r < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return r
+	
+	def keys(self):
+		'''Return a list of the keys used in this sketch'''
+		return [self.context.filter.keys[i]
+			for i in range(self.context.filter.num_keys)]
+
+
+cdef class pyreSignatureIndex(object):
+	'''Many bloom filters of the same shape, one for each of up to `slots`
+	named members, stored so that finding which members have an item takes
+	just one read for each of the filters' hashes, however many members there
+	are.'''
+	cdef bloom.pyrebloomsignature context
+	cdef bytes                    key
+	
+	property capacity:
+		def __get__(self):
+			return self.context.capacity
+	
+	property error:
+		def __get__(self):
+			return self.context.error
+	
+	property slots:
+		def __get__(self):
+			return self.context.slots
+	
+	property bits:
+		def __get__(self):
+			return self.context.filter.bits * self.context.slots
+	
+	property hashes:
+		def __get__(self):
+			return self.context.filter.hashes
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key, capacity=0, error=0, slots=1024,
+		host='127.0.0.1', port=6379, password='', db=0,
+		hash_family='murmur64a'):
+		self.key = key
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if bloom.init_signature(&self.context, self.key, capacity, error, slots,
+			host, port, password, db, HASH_FAMILIES[hash_family]):
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_signature(&self.context)
+	
+	def delete(self):
+		bloom.signature_delete(&self.context)
+	
+	def add(self, member, value):
+		'''Add an item, or a list of items, to a member's filter, returning how
+		many of them were new to it'''
+		slot = bloom.signature_member(&self.context, member, len(member))
+		if slot < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		if getattr(value, '__iter__', False):
+			r = [bloom.signature_add(&self.context, slot, v, len(v))
+				for v in value]
+			r = bloom.signature_add_complete(&self.context, len(value))
+		else:
+			bloom.signature_add(&self.context, slot, value, len(value))
+			r = bloom.signature_add_complete(&self.context, 1)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def extend(self, member, values):
+		return self.add(member, values)
+	
+	def _next(self):
+		# The slots of the members that have the next item checked
+		r = bloom.signature_check_next(&self.context)
+		if r < 0:
+			return None
+		return [self.context.found[i] for i in range(r)]
+	
+	def _names(self, slots):
+		names = []
+		for slot in slots:
+			name = bloom.signature_name(&self.context, slot)
+			if name != NULL:
+				names.append(name)
+		return names
+	
+	def contains(self, value):
+		'''Return the names of the members that have an item or, for a list of
+		items, a list of them for each item'''
+		# If the object is 'iterable'...
+		if getattr(value, '__iter__', False):
+			r = [bloom.signature_check(&self.context, v, len(v)) for v in value]
+			r = [self._next() for i in range(len(value))]
+			if None in r:
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return [self._names(slots) for slots in r]
+		else:
+			bloom.signature_check(&self.context, value, len(value))
+			r = self._next()
+			if r is None:
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return self._names(r)
+	
+	def keys(self):
+		'''Return a list of the keys used in this index'''
+		return [self.context.filter.keys[i]
+			for i in range(self.context.filter.num_keys)]
+
+
+cdef class pyrePrefixBloom(object):
+	'''A bloom filter of items made of components split by a separator, like
+	urls without their scheme, which can also say whether anything added
+	starts with a given run of whole components. There's a filter for each of
+	`levels` levels of prefix, each with room for `capacity` prefixes.'''
+	cdef bloom.pyrebloomprefix context
+	cdef bytes                 key
+	
+	property capacity:
+		def __get__(self):
+			return self.context.capacity
+	
+	property error:
+		def __get__(self):
+			return self.context.error
+	
+	property levels:
+		def __get__(self):
+			return self.context.levels
+	
+	property separator:
+		def __get__(self):
+			return chr(<unsigned char>self.context.separator)
+	
+	property bits:
+		def __get__(self):
+			return self.context.filters[0].bits * self.context.levels
+	
+	property hashes:
+		def __get__(self):
+			return self.context.filters[0].hashes
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key, capacity=0, error=0, levels=8, separator='/',
+		host='127.0.0.1', port=6379, password='', db=0,
+		hash_family='murmur64a'):
+		self.key = key
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if len(separator) != 1:
+			raise pyreBloomException('The separator must be a single byte')
+		if bloom.init_prefix(&self.context, self.key, capacity, error, levels,
+			ord(separator), host, port, password, db,
+			HASH_FAMILIES[hash_family]):
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_prefix(&self.context)
+	
+	def delete(self):
+		bloom.prefix_delete(&self.context)
+	
+	def put(self, value):
+		if getattr(value, '__iter__', False):
+			r = [bloom.prefix_add(&self.context, v, len(v)) for v in value]
+			r = bloom.prefix_add_complete(&self.context, len(value))
+		else:
+			bloom.prefix_add(&self.context, value, len(value))
+			r = bloom.prefix_add_complete(&self.context, 1)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def add(self, value):
+		return self.put(value)
+	
+	def extend(self, values):
+		return self.put(values)
+	
+	def depth(self, value):
+		'''Return how many of the leading components of an item have been seen
+		as a prefix of anything added, or a list of them for a list of items'''
+		if getattr(value, '__iter__', False):
+			r = [bloom.prefix_check(&self.context, v, len(v)) for v in value]
+			r = [bloom.prefix_check_next(&self.context) for i in range(len(value))]
+			if (min(r or [0]) < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return r
+		else:
+			bloom.prefix_check(&self.context, value, len(value))
+			r = bloom.prefix_check_next(&self.context)
+			if (r < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return r
+	
+	def contains(self, value):
+		'''Whether anything added starts with the prefix, or for a list of
+		prefixes, those that something does'''
+		# If the object is 'iterable'...
+		if getattr(value, '__iter__', False):
+			r = self.depth(value)
+			return [v for v, depth in zip(value, r)
+				if depth == bloom.prefix_count(&self.context, v, len(v))]
+		else:
+			return self.depth(value) == bloom.prefix_count(
+				&self.context, value, len(value))
+	
+	def __contains__(self, value):
+		return self.contains(value)
+	
+	def keys(self):
+		'''Return a list of the keys used by the filters of every level'''
+		return [self.context.filters[i].keys[j]
+			for i in range(self.context.levels)
+			for j in range(self.context.filters[i].num_keys)]
+
+
+cdef class pyreQuotient(object):
+	'''A quotient filter, which keeps a fingerprint of each item in sorted runs
+	of slots. Since the fingerprints can be read back out of it, it can be
+	doubled in size with grow() once it fills up, or have another quotient
+	filter merged into it, without the items that were added to either one.
+	Adding to a full filter is an error.'''
+	cdef bloom.pyrebloomquotient context
+	cdef bytes                   key
+	
+	property capacity:
+		def __get__(self):
+			return self.context.capacity
+	
+	property error:
+		def __get__(self):
+			return self.context.error
+	
+	property fingerprint_bits:
+		def __get__(self):
+			return self.context.fingerprint_bits
+	
+	property quotient_bits:
+		def __get__(self):
+			return self.context.quotient_bits
+	
+	property remainder_bits:
+		def __get__(self):
+			return self.context.remainder_bits
+	
+	property slot_bytes:
+		def __get__(self):
+			return self.context.slot_bytes
+	
+	property slots:
+		def __get__(self):
+			return 1 << self.context.quotient_bits
+	
+	property bits:
+		def __get__(self):
+			return (1 << self.context.quotient_bits) * self.context.slot_bytes * 8
+	
+	property count:
+		'''How many items the filter held when this client last looked'''
+		def __get__(self):
+			return self.context.count
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key, capacity=0, error=0, host='127.0.0.1', port=6379,
+		password='', db=0, hash_family='murmur64a'):
+		self.key = key
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if bloom.init_quotient(&self.context, self.key, capacity, error, host,
+			port, password, db, HASH_FAMILIES[hash_family]):
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_quotient(&self.context)
+	
+	def delete(self):
+		bloom.quotient_delete(&self.context)
+	
+	def grow(self):
+		'''Double the number of slots in the filter'''
+		if bloom.quotient_grow(&self.context) < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def merge(self, key):
+		'''Add everything in the quotient filter at `key` to this one, growing
+		it as needed. Both must have been made with the same capacity and error
+		rate, although either may have grown since.'''
+		if bloom.quotient_merge(&self.context, key) < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def put(self, value):
+		if getattr(value, '__iter__', False):
+			r = [bloom.quotient_add(&self.context, v, len(v)) for v in value]
+			r = bloom.quotient_add_complete(&self.context)
+		else:
+			bloom.quotient_add(&self.context, value, len(value))
+			r = bloom.quotient_add_complete(&self.context)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def add(self, value):
+		return self.put(value)
+	
+	def extend(self, values):
+		return self.put(values)
+	
+	def contains(self, value):
+		# If the object is 'iterable'...
+		if getattr(value, '__iter__', False):
+			r = [bloom.quotient_check(&self.context, v, len(v)) for v in value]
+			r = [bloom.quotient_check_next(&self.context) for i in range(len(value))]
+			if (min(r or [0]) < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return [v for v, included in zip(value, r) if included]
+		else:
+			bloom.quotient_check(&self.context, value, len(value))
+			r = bloom.quotient_check_next(&self.context)
+			if (r < 0):
+				raise pyreBloomException(self.context.ctxt.errstr)
+			return bool(r)
+	
+	def __contains__(self, value):
+		return self.contains(value)
+	
+	def keys(self):
+		'''Return a list of the keys used in this filter'''
+		return [self.context.segment_key]
+
+
+cdef class pyrePackedBloom(object):
+	'''Many small bloom filters of the same shape, one for each named tenant,
+	packed into fixed ranges of a few large shared keys rather than each having
+	keys of its own. Items for any number of tenants can be added or checked in
+	one batch.'''
+	cdef bloom.pyrebloompacked context
+	cdef bytes                 key
+	# The numbers of the tenants we've looked up, by name
+	cdef dict                  tenants
+	
+	property capacity:
+		def __get__(self):
+			return self.context.capacity
+	
+	property error:
+		def __get__(self):
+			return self.context.error
+	
+	property bits:
+		'''The bits of each tenant's filter'''
+		def __get__(self):
+			return self.context.filter.bits
+	
+	property hashes:
+		def __get__(self):
+			return self.context.filter.hashes
+	
+	property tenants_per_segment:
+		def __get__(self):
+			return self.context.tenants_per_segment
+	
+	property hash_family:
+		def __get__(self):
+			return hash_family_name(self.context.hash_family)
+	
+	def __cinit__(self, key, capacity=0, error=0, host='127.0.0.1', port=6379,
+		password='', db=0, hash_family='murmur64a'):
+		self.key = key
+		self.tenants = {}
+		if hash_family not in HASH_FAMILIES:
+			raise pyreBloomException('Unknown hash family %s' % hash_family)
+		if bloom.init_packed(&self.context, self.key, capacity, error, host,
+			port, password, db, HASH_FAMILIES[hash_family]):
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_packed(&self.context)
+	
+	def delete(self):
+		bloom.packed_delete(&self.context)
+		self.tenants = {}
+	
+	def _lookup(self, names, assign):
+		# Find the numbers of any tenants we haven't seen yet, all at once
+		cdef bloom.uint32_t tenant
+		missing = [n for n in set(names) if n not in self.tenants]
+		for name in missing:
+			bloom.packed_tenant(&self.context, name, len(name), assign)
+		r = []
+		for name in missing:
+			r.append(bloom.packed_tenant_next(&self.context, &tenant))
+			if r[-1] == 1:
+				self.tenants[name] = tenant
+		if missing and min(r) < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+	
+	def add_pairs(self, pairs):
+		'''Add a list of (tenant, item) pairs, returning how many of the items
+		were new to their tenants' filters'''
+		pairs = list(pairs)
+		self._lookup([tenant for tenant, value in pairs], True)
+		for tenant, value in pairs:
+			bloom.packed_add(&self.context, self.tenants[tenant], value,
+				len(value))
+		r = bloom.packed_add_complete(&self.context)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def contains_pairs(self, pairs):
+		'''Return the (tenant, item) pairs whose tenant has the item'''
+		pairs = list(pairs)
+		self._lookup([tenant for tenant, value in pairs], False)
+		# Tenants that have never had anything added have nothing
+		known = [(t, v) for t, v in pairs if t in self.tenants]
+		r = [bloom.packed_check(&self.context, self.tenants[t], v, len(v))
+			for t, v in known]
+		r = [bloom.packed_check_next(&self.context) for i in range(len(known))]
+		if (min(r or [0]) < 0):
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return [pair for pair, included in zip(known, r) if included]
+	
+	def add(self, tenant, value):
+		'''Add an item, or a list of items, to a tenant's filter, returning how
+		many of them were new to it'''
+		if getattr(value, '__iter__', False):
+			return self.add_pairs([(tenant, v) for v in value])
+		return self.add_pairs([(tenant, value)])
+	
+	def extend(self, tenant, values):
+		return self.add(tenant, values)
+	
+	def contains(self, tenant, value):
+		# If the object is 'iterable'...
+		if getattr(value, '__iter__', False):
+			return [v for t, v in self.contains_pairs([(tenant, v) for v in value])]
+		return bool(self.contains_pairs([(tenant, value)]))
+	
+	def count(self):
+		'''How many tenants there are'''
+		r = bloom.packed_tenants(&self.context)
+		if r < 0:
+			raise pyreBloomException(self.context.ctxt.errstr)
+		return r
+	
+	def keys(self):
+		'''Return a list of the shared keys used by all the tenants'''
+		per = self.context.tenants_per_segment
+		return [self.key + (b'.%i' % i)
+			for i in range((self.count() + per - 1) // per)]
+
+
+cdef class pyreSync(object):
+	'''Keeps copies of filters on a replica redis in step with the source,
+	sending only the pages of each key that differ between the two. A filter's
+	keys are those from its keys(), along with its metadata at <key>.meta.'''
+	cdef bloom.pyrebloomsync context
+	
+	property page_bytes:
+		def __get__(self):
+			return self.context.page_bytes
+	
+	property pages_checked:
+		'''How many pages have been compared, over every sync'''
+		def __get__(self):
+			return self.context.pages_checked
+	
+	property pages_sent:
+		'''How many pages (or whole keys) have been sent, over every sync'''
+		def __get__(self):
+			return self.context.pages_sent
+	
+	property bytes_sent:
+		def __get__(self):
+			return self.context.bytes_sent
+	
+	def __cinit__(self, host='127.0.0.1', port=6379, password='', db=0,
+		replica_host='127.0.0.1', replica_port=6379, replica_password='',
+		replica_db=0, page_bytes=65536):
+		if bloom.init_sync(&self.context, host, port, password, db,
+			replica_host, replica_port, replica_password, replica_db,
+			page_bytes):
+			raise pyreBloomException(self.context.source.errstr)
+	
+	def __dealloc__(self):
+		bloom.free_sync(&self.context)
+	
+	def sync(self, keys):
+		'''Bring each of the keys on the replica up to date with the source,
+		returning how many pages were sent'''
+		if not getattr(keys, '__iter__', False):
+			keys = [keys]
+		sent = 0
+		for key in keys:
+			r = bloom.sync_key(&self.context, key)
+			if r < 0:
+				raise pyreBloomException(self.context.source.errstr)
+			sent += r
+		return sent
+
+
+def open(key, host='127.0.0.1', port=6379, password='', db=0):
+	'''Open an existing filter by its key alone. Its capacity, error rate and
+	everything else are read from the metadata recorded when it was created.'''
+	return pyreBloom(key, host=host, port=port, password=password, db=db)
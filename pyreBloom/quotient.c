@@ -0,0 +1,879 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "quotient.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The version of the metadata layout for quotient filters */
+static const uint32_t quotient_version = 1;
+
+/* Filters are sized to be at most this full at their capacity. Runs get long
+ * and adds get slow as they fill beyond that. */
+static const double quotient_load = 0.75;
+
+/* The most items sent to each run of the script, the most bytes read or
+ * written at a time when growing, and the largest a table can be (the
+ * largest a redis string can be) */
+static const uint32_t quotient_chunk = 512;
+static const uint32_t transfer_bytes = 1 << 20;
+static const uint64_t max_table_bytes = 1ULL << 29;
+
+/* The seed for fingerprints, which is the same as the first seed of a bloom
+ * filter */
+static const uint64_t quotient_seed = 314159265;
+
+/* The metadata bits of each slot, beneath its remainder */
+#define QF_OCCUPIED     4
+#define QF_CONTINUATION 2
+#define QF_SHIFTED      1
+
+/* Load the description of a quotient filter, or record it if it's new.
+ *
+ *     KEYS = { metadata key, segment key }
+ *     ARGV = { capacity, error, fingerprint bits, quotient bits, remainder
+ *              bits, slot bytes, hash family, version }
+ *
+ * It replies with the recorded capacity, error, fingerprint, quotient and
+ * remainder bits, slot bytes, hash family and count. */
+static const char * quotient_init_script =
+    "local fields = {'capacity', 'error', 'fingerprint_bits',\n"
+    "    'quotient_bits', 'remainder_bits', 'slot_bytes', 'hash'}\n"
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'quotient' then\n"
+    "    fields[#fields + 1] = 'count'\n"
+    "    return redis.call('HMGET', KEYS[1], unpack(fields))\n"
+    "elseif redis.call('EXISTS', KEYS[1], KEYS[2]) > 0 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "elseif ARGV[1] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; capacity and error are required')\n"
+    "end\n"
+    "redis.call('HSET', KEYS[1], 'type', 'quotient')\n"
+    "for i, field in ipairs(fields) do\n"
+    "    redis.call('HSET', KEYS[1], field, ARGV[i])\n"
+    "end\n"
+    "redis.call('HMSET', KEYS[1], 'count', 0, 'version', ARGV[8])\n"
+    "return {ARGV[1], ARGV[2], ARGV[3], ARGV[4], ARGV[5], ARGV[6], ARGV[7],\n"
+    "    '0'}";
+
+/* Add or look for a batch of fingerprints, each given as its quotient and
+ * remainder. This follows the algorithms of Bender et al. exactly as
+ * qf_run_start and qf_insert do below. Slots are big-endian numbers with the
+ * remainder above the three metadata bits, and the table wraps around. If
+ * the filter has been resized since the client last looked, it refuses the
+ * whole batch.
+ *
+ *     KEYS = { metadata key, segment key }
+ *     ARGV = { 'add' or 'check', quotient bits, remainder bits, slot bytes,
+ *              quotient, remainder, quotient, remainder, ... }
+ *
+ * It replies with a 1 or 0 for each fingerprint: whether it was new, or
+ * whether it was there. A full filter adds what it can, and then fails. */
+static const char * quotient_script =
+    "local q, B = tonumber(ARGV[2]), tonumber(ARGV[4])\n"
+    "local meta = redis.call('HMGET', KEYS[1], 'quotient_bits', 'count')\n"
+    "if tonumber(meta[1]) ~= q then\n"
+    "    return redis.error_reply('STALE ' .. KEYS[1] .. ' has been resized')\n"
+    "end\n"
+    "local size, cache = 2 ^ q, {}\n"
+    "local function get(i)\n"
+    "    local v = cache[i]\n"
+    "    if v == nil then\n"
+    "        local s = redis.call('GETRANGE', KEYS[2], i * B, i * B + B - 1)\n"
+    "        v = 0\n"
+    "        for j = 1, B do v = v * 256 + (string.byte(s, j) or 0) end\n"
+    "        cache[i] = v\n"
+    "    end\n"
+    "    return v\n"
+    "end\n"
+    "local function set(i, v)\n"
+    "    cache[i] = v\n"
+    "    local bytes = {}\n"
+    "    for j = B, 1, -1 do\n"
+    "        bytes[j] = v % 256\n"
+    "        v = math.floor(v / 256)\n"
+    "    end\n"
+    "    redis.call('SETRANGE', KEYS[2], i * B, string.char(unpack(bytes)))\n"
+    "end\n"
+    "local function has(v, bit) return math.floor(v / bit) % 2 == 1 end\n"
+    "local function rem(v) return math.floor(v / 8) end\n"
+    "local function incr(i) return (i + 1) % size end\n"
+    "local function run_start(fq)\n"
+    "    local b = fq\n"
+    "    while has(get(b), 1) do b = (b - 1) % size end\n"
+    "    local s = b\n"
+    "    while b ~= fq do\n"
+    "        repeat s = incr(s) until not has(get(s), 2)\n"
+    "        repeat b = incr(b) until has(get(b), 4)\n"
+    "    end\n"
+    "    return s\n"
+    "end\n"
+    "local function lookup(fq, fr)\n"
+    "    if not has(get(fq), 4) then return 0 end\n"
+    "    local s = run_start(fq)\n"
+    "    repeat\n"
+    "        local r = rem(get(s))\n"
+    "        if r == fr then return 1 elseif r > fr then return 0 end\n"
+    "        s = incr(s)\n"
+    "    until not has(get(s), 2)\n"
+    "    return 0\n"
+    "end\n"
+    "local function shift_in(s, entry)\n"
+    "    local empty\n"
+    "    repeat\n"
+    "        local prev = get(s)\n"
+    "        empty = (prev % 8 == 0)\n"
+    "        if not empty then\n"
+    "            if not has(prev, 1) then prev = prev + 1 end\n"
+    "            if has(prev, 4) then\n"
+    "                entry, prev = entry + 4, prev - 4\n"
+    "            end\n"
+    "        end\n"
+    "        set(s, entry)\n"
+    "        entry, s = prev, incr(s)\n"
+    "    until empty\n"
+    "end\n"
+    "local function insert(fq, fr)\n"
+    "    local t, entry = get(fq), fr * 8\n"
+    "    if t % 8 == 0 then\n"
+    "        set(fq, entry + 4)\n"
+    "        return\n"
+    "    end\n"
+    "    if not has(t, 4) then set(fq, t + 4) end\n"
+    "    local start = run_start(fq)\n"
+    "    local s = start\n"
+    "    if has(t, 4) then\n"
+    "        repeat\n"
+    "            local r = rem(get(s))\n"
+    "            if r > fr then break end\n"
+    "            s = incr(s)\n"
+    "        until not has(get(s), 2)\n"
+    "        if s == start then\n"
+    "            set(start, get(start) + 2)\n"
+    "        else\n"
+    "            entry = entry + 2\n"
+    "        end\n"
+    "    end\n"
+    "    if s ~= fq then entry = entry + 1 end\n"
+    "    shift_in(s, entry)\n"
+    "end\n"
+    "local results, added, full = {}, 0, false\n"
+    "for i = 5, #ARGV, 2 do\n"
+    "    local fq, fr = tonumber(ARGV[i]), tonumber(ARGV[i + 1])\n"
+    "    local found = lookup(fq, fr)\n"
+    "    if ARGV[1] == 'add' then\n"
+    "        if found == 0 then\n"
+    "            if tonumber(meta[2]) + added + 1 >= size then\n"
+    "                full = true\n"
+    "                break\n"
+    "            end\n"
+    "            insert(fq, fr)\n"
+    "            added = added + 1\n"
+    "        end\n"
+    "        found = 1 - found\n"
+    "    end\n"
+    "    results[#results + 1] = found\n"
+    "end\n"
+    "if added > 0 then redis.call('HINCRBY', KEYS[1], 'count', added) end\n"
+    "if full then return redis.error_reply(KEYS[1] .. ' is full') end\n"
+    "return results";
+
+/* Replace a filter's table with a new one, unless it changed since it was
+ * read, and describe the new one.
+ *
+ *     KEYS = { metadata key, segment key, new segment key }
+ *     ARGV = { quotient bits and count as read, and then the new quotient
+ *              bits, remainder bits, slot bytes and count } */
+static const char * quotient_swap_script =
+    "local meta = redis.call('HMGET', KEYS[1], 'quotient_bits', 'count')\n"
+    "if meta[1] ~= ARGV[1] or meta[2] ~= ARGV[2] then\n"
+    "    redis.call('DEL', KEYS[3])\n"
+    "    return redis.error_reply(KEYS[1] ..\n"
+    "        ' changed while it was being resized; try again')\n"
+    "end\n"
+    "redis.call('RENAME', KEYS[3], KEYS[2])\n"
+    "redis.call('HMSET', KEYS[1], 'quotient_bits', ARGV[3],\n"
+    "    'remainder_bits', ARGV[4], 'slot_bytes', ARGV[5], 'count', ARGV[6])\n"
+    "return redis.status_reply('OK')";
+
+/* A table held in memory while it's resized */
+typedef struct {
+    unsigned char * data;
+    uint64_t        slots;
+    uint32_t        bytes;
+} qf_table;
+
+static uint64_t qf_get(const qf_table * t, uint64_t i) {
+    const unsigned char * p = t->data + i * t->bytes;
+    uint64_t v = 0;
+    uint32_t j;
+    for (j = 0; j < t->bytes; ++j) {
+        v = (v << 8) | p[j];
+    }
+    return v;
+}
+
+static void qf_set(qf_table * t, uint64_t i, uint64_t v) {
+    unsigned char * p = t->data + i * t->bytes;
+    uint32_t j;
+    for (j = t->bytes; j-- > 0; v >>= 8) {
+        p[j] = (unsigned char)(v & 0xFF);
+    }
+}
+
+/* Where the run of fingerprints with quotient fq starts */
+static uint64_t qf_run_start(const qf_table * t, uint64_t fq) {
+    uint64_t b = fq, s;
+    while (qf_get(t, b) & QF_SHIFTED) {
+        b = (b + t->slots - 1) % t->slots;
+    }
+    s = b;
+    while (b != fq) {
+        do {
+            s = (s + 1) % t->slots;
+        } while (qf_get(t, s) & QF_CONTINUATION);
+        do {
+            b = (b + 1) % t->slots;
+        } while (!(qf_get(t, b) & QF_OCCUPIED));
+    }
+    return s;
+}
+
+/* Add a fingerprint, returning whether it was new */
+static int qf_insert(qf_table * t, uint64_t fq, uint64_t fr) {
+    uint64_t v = qf_get(t, fq), entry = fr << 3, start, s, prev;
+    int empty;
+    if ((v & 7) == 0) {
+        qf_set(t, fq, entry | QF_OCCUPIED);
+        return 1;
+    }
+    if (!(v & QF_OCCUPIED)) {
+        qf_set(t, fq, v | QF_OCCUPIED);
+    }
+    start = qf_run_start(t, fq);
+    s = start;
+    if (v & QF_OCCUPIED) {
+        /* Runs are sorted, so find where it goes in this one */
+        do {
+            uint64_t r = qf_get(t, s) >> 3;
+            if (r == fr) {
+                return 0;
+            } else if (r > fr) {
+                break;
+            }
+            s = (s + 1) % t->slots;
+        } while (qf_get(t, s) & QF_CONTINUATION);
+        if (s == start) {
+            qf_set(t, start, qf_get(t, start) | QF_CONTINUATION);
+        } else {
+            entry |= QF_CONTINUATION;
+        }
+    }
+    if (s != fq) {
+        entry |= QF_SHIFTED;
+    }
+    /* Shift everything from s along by one, up to the next empty slot. The
+     * occupied bits belong to the slots, and stay where they are. */
+    do {
+        prev = qf_get(t, s);
+        empty = ((prev & 7) == 0);
+        if (!empty) {
+            prev |= QF_SHIFTED;
+            if (prev & QF_OCCUPIED) {
+                entry |= QF_OCCUPIED;
+                prev &= ~(uint64_t)(QF_OCCUPIED);
+            }
+        }
+        qf_set(t, s, entry);
+        entry = prev;
+        s = (s + 1) % t->slots;
+    } while (!empty);
+    return 1;
+}
+
+/* Add every fingerprint in one table to another, returning how many were new
+ * to it. Each one's quotient is found by walking the runs of each cluster,
+ * starting just after an empty slot so that no cluster is split. */
+static uint64_t qf_transfer(const qf_table * src, uint32_t src_remainder,
+    qf_table * dst, uint32_t dst_remainder) {
+    uint64_t start, i, slot, v, fp, quotient = 0, total = 0;
+    uint64_t mask = (1ULL << dst_remainder) - 1;
+    for (start = 0; start < src->slots && (qf_get(src, start) & 7); ++start);
+    for (i = 1; start < src->slots && i <= src->slots; ++i) {
+        slot = (start + i) % src->slots;
+        v = qf_get(src, slot);
+        if ((v & 7) == 0) {
+            continue;
+        } else if (!(v & QF_SHIFTED)) {
+            quotient = slot;
+        } else if (!(v & QF_CONTINUATION)) {
+            do {
+                quotient = (quotient + 1) % src->slots;
+            } while (!(qf_get(src, quotient) & QF_OCCUPIED));
+        }
+        fp = (quotient << src_remainder) | (v >> 3);
+        total += qf_insert(dst, fp >> dst_remainder, fp & mask);
+    }
+    return total;
+}
+
+/* Copy a script's hash out of the reply to SCRIPT LOAD */
+static int quotient_sha(pyrebloomquotient * ctxt, redisReply * reply) {
+    if (reply == NULL || reply->type != REDIS_REPLY_STRING) {
+        if (reply != NULL && reply->type == REDIS_REPLY_ERROR) {
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        }
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    snprintf(ctxt->sha, sizeof(ctxt->sha), "%s", reply->str);
+    freeReplyObject(reply);
+    return PYREBLOOM_OK;
+}
+
+/* Whether a shape makes sense, and fits in a single segment */
+static int quotient_valid(uint32_t quotient_bits, uint32_t remainder_bits,
+    uint32_t slot_bytes) {
+    return quotient_bits > 0 && quotient_bits < 40 && remainder_bits > 0 &&
+        slot_bytes > 0 && slot_bytes <= 4 &&
+        remainder_bits + 3 <= slot_bytes * 8 &&
+        ((uint64_t)(slot_bytes) << quotient_bits) <= max_table_bytes;
+}
+
+/* Read the parts of the description that change as the filter is resized */
+static int quotient_refresh(pyrebloomquotient * ctxt) {
+    redisReply * reply = redisCommand(ctxt->ctxt,
+        "HMGET %s quotient_bits remainder_bits slot_bytes count",
+        ctxt->meta_key);
+    uint32_t i;
+    if (reply == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 4) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    for (i = 0; i < 4; ++i) {
+        if (reply->element[i]->type != REDIS_REPLY_STRING) {
+            strncpy(ctxt->ctxt->errstr, "No metadata for the filter",
+                errstr_size);
+            freeReplyObject(reply);
+            return PYREBLOOM_ERROR;
+        }
+    }
+    ctxt->quotient_bits  = (uint32_t)(
+        strtoul(reply->element[0]->str, NULL, 10));
+    ctxt->remainder_bits = (uint32_t)(
+        strtoul(reply->element[1]->str, NULL, 10));
+    ctxt->slot_bytes     = (uint32_t)(
+        strtoul(reply->element[2]->str, NULL, 10));
+    ctxt->count          = strtoull(reply->element[3]->str, NULL, 10);
+    freeReplyObject(reply);
+
+    if (!quotient_valid(ctxt->quotient_bits, ctxt->remainder_bits,
+        ctxt->slot_bytes) ||
+        ctxt->quotient_bits + ctxt->remainder_bits != ctxt->fingerprint_bits) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    return PYREBLOOM_OK;
+}
+
+int init_quotient(pyrebloomquotient * ctxt, char * key, uint64_t capacity,
+    double error, char * host, uint32_t port, char * password, uint32_t db,
+    uint32_t hash_family) {
+    redisReply * reply = NULL;
+    uint32_t quotient_bits = 0, remainder_bits = 0, slot_bytes = 0;
+
+    ctxt->key         = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key    = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+    ctxt->segment_key = (char *)(malloc(strlen(key) + 3));
+    snprintf(ctxt->segment_key, strlen(key) + 3, "%s.0", key);
+
+    /* What we'd like this filter to look like, if it doesn't exist yet. The
+     * chance of a false positive is about the load over 2 ^ remainder bits,
+     * and whatever bits are left over in a slot go to the remainder. Since
+     * doubling the filter halves the load, that stays the same as it grows. */
+    if (capacity != 0) {
+        remainder_bits = (uint32_t)(ceil(log2(1.0 / error)));
+        slot_bytes = (remainder_bits + 3 + 7) / 8;
+        if (slot_bytes > 4) {
+            slot_bytes = 4;
+        }
+        remainder_bits = slot_bytes * 8 - 3;
+        quotient_bits = (uint32_t)(ceil(log2(capacity / quotient_load)));
+        if (quotient_bits < 1) {
+            quotient_bits = 1;
+        }
+    }
+
+    /* Connecting, loading the script and agreeing on the description of the
+     * filter all happen in one round trip */
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (capacity != 0 &&
+        !quotient_valid(quotient_bits, remainder_bits, slot_bytes)) {
+        strncpy(ctxt->ctxt->errstr, "Quotient filter would be too large",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->ctxt, "SCRIPT LOAD %s", quotient_script);
+    redisAppendCommand(ctxt->ctxt,
+        "EVAL %s 2 %s %s %lu %.17g %u %u %u %u %u %u", quotient_init_script,
+        ctxt->meta_key, ctxt->segment_key, capacity, error,
+        quotient_bits + remainder_bits, quotient_bits, remainder_bits,
+        slot_bytes, hash_family, quotient_version);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR ||
+        quotient_sha(ctxt, reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    reply = NULL;
+    if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 8) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->capacity         = strtoull(reply->element[0]->str, NULL, 10);
+    ctxt->error            = strtod(reply->element[1]->str, NULL);
+    ctxt->fingerprint_bits = (uint32_t)(
+        strtoul(reply->element[2]->str, NULL, 10));
+    ctxt->quotient_bits    = (uint32_t)(
+        strtoul(reply->element[3]->str, NULL, 10));
+    ctxt->remainder_bits   = (uint32_t)(
+        strtoul(reply->element[4]->str, NULL, 10));
+    ctxt->slot_bytes       = (uint32_t)(
+        strtoul(reply->element[5]->str, NULL, 10));
+    ctxt->hash_family      = (uint32_t)(
+        strtoul(reply->element[6]->str, NULL, 10));
+    ctxt->count            = strtoull(reply->element[7]->str, NULL, 10);
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT ||
+        !quotient_valid(ctxt->quotient_bits, ctxt->remainder_bits,
+            ctxt->slot_bytes) ||
+        ctxt->quotient_bits + ctxt->remainder_bits != ctxt->fingerprint_bits) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    return PYREBLOOM_OK;
+}
+
+int free_quotient(pyrebloomquotient * ctxt) {
+    free(ctxt->batch);
+    free(ctxt->results);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    free(ctxt->segment_key);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+/* Queue up an item's fingerprint to be sent with the rest of the batch */
+static void quotient_queue(
+    pyrebloomquotient * ctxt, const char * data, uint32_t len) {
+    if (ctxt->batched == ctxt->batch_size) {
+        ctxt->batch_size = ctxt->batch_size ? ctxt->batch_size * 2 : 64;
+        ctxt->batch = (uint64_t *)(realloc(ctxt->batch,
+            ctxt->batch_size * sizeof(uint64_t)));
+        ctxt->results = (uint8_t *)(realloc(ctxt->results,
+            ctxt->batch_size * sizeof(uint8_t)));
+    }
+    ctxt->results[ctxt->batched] = 0;
+    ctxt->batch[ctxt->batched++] = hash_item(ctxt->hash_family, data, len,
+        quotient_seed) >> (64 - ctxt->fingerprint_bits);
+}
+
+/* Send the batch to the script a chunk at a time, and read back what became
+ * of each item. A chunk that finds the filter has been resized, or that redis
+ * has forgotten the script, is sent again once we've caught up. */
+static int quotient_flush(pyrebloomquotient * ctxt, int adding) {
+    uint32_t chunks = (ctxt->batched + quotient_chunk - 1) / quotient_chunk;
+    uint32_t chunk, i, j, first, last, argc, attempt, retry = chunks;
+    uint8_t * again = (uint8_t *)(malloc(chunks + 1));
+    char * args = (char *)(malloc((4 + 2 * quotient_chunk) * 24));
+    const char ** argv = (const char **)(
+        malloc((9 + 2 * quotient_chunk) * sizeof(char *)));
+    size_t * argvlen = (size_t *)(
+        malloc((9 + 2 * quotient_chunk) * sizeof(size_t)));
+    redisReply * reply = NULL;
+    int failed = 0, stale, reload;
+
+    memset(again, 1, chunks + 1);
+    for (attempt = 0; retry > 0 && attempt < 3 && !failed; ++attempt) {
+        uint64_t mask = (1ULL << ctxt->remainder_bits) - 1;
+        snprintf(args, 24, "%u", ctxt->quotient_bits);
+        snprintf(args + 24, 24, "%u", ctxt->remainder_bits);
+        snprintf(args + 48, 24, "%u", ctxt->slot_bytes);
+        for (chunk = 0; chunk < chunks; ++chunk) {
+            if (!again[chunk]) {
+                continue;
+            }
+            first = chunk * quotient_chunk;
+            last = first + quotient_chunk;
+            if (last > ctxt->batched) {
+                last = ctxt->batched;
+            }
+            argc = 0;
+            argv[argc++] = "EVALSHA";
+            argv[argc++] = ctxt->sha;
+            argv[argc++] = "2";
+            argv[argc++] = ctxt->meta_key;
+            argv[argc++] = ctxt->segment_key;
+            argv[argc++] = adding ? "add" : "check";
+            argv[argc++] = args;
+            argv[argc++] = args + 24;
+            argv[argc++] = args + 48;
+            for (i = first, j = 3; i < last; ++i, j += 2) {
+                uint64_t fp = ctxt->batch[i];
+                snprintf(args + j * 24, 24, "%lu",
+                    fp >> ctxt->remainder_bits);
+                snprintf(args + (j + 1) * 24, 24, "%lu", fp & mask);
+                argv[argc++] = args + j * 24;
+                argv[argc++] = args + (j + 1) * 24;
+            }
+            for (i = 0; i < argc; ++i) {
+                argvlen[i] = strlen(argv[i]);
+            }
+            redisAppendCommandArgv(ctxt->ctxt, argc, argv, argvlen);
+        }
+
+        stale = reload = 0;
+        for (chunk = 0; chunk < chunks; ++chunk) {
+            if (!again[chunk]) {
+                continue;
+            }
+            if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+                strncpy(ctxt->ctxt->errstr, "No pending replies",
+                    errstr_size);
+                failed = 1;
+                break;
+            }
+            if (reply->type == REDIS_REPLY_ERROR &&
+                strncmp(reply->str, "STALE", 5) == 0) {
+                stale = 1;
+            } else if (reply->type == REDIS_REPLY_ERROR &&
+                strncmp(reply->str, "NOSCRIPT", 8) == 0) {
+                reload = 1;
+            } else {
+                again[chunk] = 0;
+                --retry;
+                if (reply->type == REDIS_REPLY_ERROR) {
+                    failed = 1;
+                    strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+                } else if (reply->type == REDIS_REPLY_ARRAY) {
+                    first = chunk * quotient_chunk;
+                    for (i = 0; i < reply->elements &&
+                        first + i < ctxt->batched; ++i) {
+                        ctxt->results[first + i] =
+                            (uint8_t)(reply->element[i]->integer);
+                    }
+                }
+            }
+            freeReplyObject(reply);
+        }
+
+        /* Catch up with whatever happened, and try the rest again */
+        if (!failed && stale && quotient_refresh(ctxt) == PYREBLOOM_ERROR) {
+            failed = 1;
+        }
+        if (!failed && reload && quotient_sha(ctxt, redisCommand(ctxt->ctxt,
+            "SCRIPT LOAD %s", quotient_script)) == PYREBLOOM_ERROR) {
+            failed = 1;
+        }
+    }
+    if (retry > 0 && !failed) {
+        strncpy(ctxt->ctxt->errstr, "The filter kept changing size",
+            errstr_size);
+        failed = 1;
+    }
+
+    free(again);
+    free(args);
+    free(argv);
+    free(argvlen);
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+int quotient_add(pyrebloomquotient * ctxt, const char * data, uint32_t len) {
+    quotient_queue(ctxt, data, len);
+    return PYREBLOOM_OK;
+}
+
+int64_t quotient_add_complete(pyrebloomquotient * ctxt) {
+    uint32_t i;
+    uint64_t total = 0;
+    int result = quotient_flush(ctxt, 1);
+    for (i = 0; i < ctxt->batched; ++i) {
+        total += ctxt->results[i];
+    }
+    ctxt->count += total;
+    ctxt->batched = 0;
+    return (result == PYREBLOOM_ERROR) ? PYREBLOOM_ERROR : (int64_t)(total);
+}
+
+int quotient_check(pyrebloomquotient * ctxt, const char * data,
+    uint32_t len) {
+    quotient_queue(ctxt, data, len);
+    return PYREBLOOM_OK;
+}
+
+int quotient_check_next(pyrebloomquotient * ctxt) {
+    int result;
+    /* The whole batch is checked when the first result is asked for */
+    if (ctxt->next_batched == 0) {
+        ctxt->batch_result = quotient_flush(ctxt, 0);
+    }
+    result = ctxt->results[ctxt->next_batched++];
+    if (ctxt->next_batched >= ctxt->batched) {
+        ctxt->batched = ctxt->next_batched = 0;
+    }
+    return (ctxt->batch_result == PYREBLOOM_ERROR) ? PYREBLOOM_ERROR : result;
+}
+
+/* Read the table at `key` into memory a chunk at a time */
+static int quotient_read(pyrebloomquotient * ctxt, const char * key,
+    qf_table * table) {
+    uint64_t size = table->slots * table->bytes, start;
+    redisReply * reply = NULL;
+    int failed = 0;
+
+    table->data = (unsigned char *)(calloc(size, 1));
+    for (start = 0; start < size; start += transfer_bytes) {
+        redisAppendCommand(ctxt->ctxt, "GETRANGE %s %lu %lu", key, start,
+            start + transfer_bytes - 1);
+    }
+    for (start = 0; start < size; start += transfer_bytes) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+        if (reply->type == REDIS_REPLY_ERROR) {
+            failed = 1;
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        } else if (reply->type == REDIS_REPLY_STRING) {
+            size_t length = reply->len;
+            if (start + length > size) {
+                length = size - start;
+            }
+            memcpy(table->data + start, reply->str, length);
+        }
+        freeReplyObject(reply);
+    }
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+/* Write a new table beside the current one, and then swap it in along with
+ * its description, so long as nobody added anything in the meantime */
+static int quotient_store(pyrebloomquotient * ctxt, qf_table * table,
+    uint32_t quotient_bits, uint32_t remainder_bits, uint64_t count) {
+    uint64_t size = table->slots * table->bytes, start;
+    size_t length = strlen(ctxt->key) + 6;
+    char * name = (char *)(malloc(length));
+    uint32_t pending = 0;
+    redisReply * reply = NULL;
+    int result = PYREBLOOM_OK;
+
+    snprintf(name, length, "%s.grow", ctxt->key);
+    redisAppendCommand(ctxt->ctxt, "DEL %s", name);
+    ++pending;
+    for (start = 0; start < size; start += transfer_bytes) {
+        size_t chunk = (size - start < transfer_bytes) ?
+            (size_t)(size - start) : transfer_bytes;
+        redisAppendCommand(ctxt->ctxt, "SETRANGE %s %lu %b", name, start,
+            table->data + start, chunk);
+        ++pending;
+    }
+    redisAppendCommand(ctxt->ctxt, "EVAL %s 3 %s %s %s %u %lu %u %u %u %lu",
+        quotient_swap_script, ctxt->meta_key, ctxt->segment_key, name,
+        ctxt->quotient_bits, ctxt->count, quotient_bits, remainder_bits,
+        table->bytes, count);
+    ++pending;
+
+    for (; pending > 0; --pending) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            free(name);
+            return PYREBLOOM_ERROR;
+        }
+        if (reply->type == REDIS_REPLY_ERROR && result == PYREBLOOM_OK) {
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+            result = PYREBLOOM_ERROR;
+        }
+        freeReplyObject(reply);
+    }
+    free(name);
+
+    if (result == PYREBLOOM_OK) {
+        ctxt->quotient_bits  = quotient_bits;
+        ctxt->remainder_bits = remainder_bits;
+        ctxt->slot_bytes     = table->bytes;
+        ctxt->count          = count;
+    }
+    return result;
+}
+
+/* Rebuild this filter with `quotient_bits`, adding in the fingerprints of
+ * another table too if there is one */
+static int quotient_rebuild(pyrebloomquotient * ctxt, uint32_t quotient_bits,
+    const qf_table * other, uint32_t other_remainder) {
+    uint32_t remainder_bits = ctxt->fingerprint_bits - quotient_bits;
+    qf_table current = { NULL, 1ULL << ctxt->quotient_bits, ctxt->slot_bytes };
+    qf_table table = { NULL, 1ULL << quotient_bits,
+        (remainder_bits + 3 + 7) / 8 };
+    uint64_t count;
+    int result;
+
+    if (ctxt->fingerprint_bits <= quotient_bits ||
+        !quotient_valid(quotient_bits, remainder_bits, table.bytes)) {
+        strncpy(ctxt->ctxt->errstr, "Quotient filter can't grow any larger",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    if (quotient_read(ctxt, ctxt->segment_key, &current) == PYREBLOOM_ERROR) {
+        free(current.data);
+        return PYREBLOOM_ERROR;
+    }
+    table.data = (unsigned char *)(calloc(table.slots * table.bytes, 1));
+    count = qf_transfer(&current, ctxt->remainder_bits, &table,
+        remainder_bits);
+    free(current.data);
+    if (other) {
+        count += qf_transfer(other, other_remainder, &table, remainder_bits);
+    }
+    result = quotient_store(ctxt, &table, quotient_bits, remainder_bits,
+        count);
+    free(table.data);
+    return result;
+}
+
+int quotient_grow(pyrebloomquotient * ctxt) {
+    if (quotient_refresh(ctxt) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    return quotient_rebuild(ctxt, ctxt->quotient_bits + 1, NULL, 0);
+}
+
+int quotient_merge(pyrebloomquotient * ctxt, const char * key) {
+    redisReply * reply = NULL;
+    size_t length = strlen(key) + 6;
+    char * name = (char *)(malloc(length));
+    uint32_t i, fingerprint_bits, hash_family, quotient_bits;
+    uint64_t count;
+    qf_table other = { NULL, 0, 0 };
+    uint32_t other_remainder;
+    int result;
+
+    if (quotient_refresh(ctxt) == PYREBLOOM_ERROR) {
+        free(name);
+        return PYREBLOOM_ERROR;
+    }
+    snprintf(name, length, "%s.meta", key);
+    reply = redisCommand(ctxt->ctxt, "HMGET %s type fingerprint_bits "
+        "quotient_bits remainder_bits slot_bytes hash count", name);
+    if (reply == NULL) {
+        free(name);
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 7 ||
+        reply->element[0]->type != REDIS_REPLY_STRING ||
+        strcmp(reply->element[0]->str, "quotient") != 0) {
+        snprintf(ctxt->ctxt->errstr, errstr_size,
+            "%s doesn't describe a quotient filter", name);
+        freeReplyObject(reply);
+        free(name);
+        return PYREBLOOM_ERROR;
+    }
+    for (i = 1; i < 7; ++i) {
+        if (reply->element[i]->type != REDIS_REPLY_STRING) {
+            strncpy(ctxt->ctxt->errstr, "Malformed filter metadata",
+                errstr_size);
+            freeReplyObject(reply);
+            free(name);
+            return PYREBLOOM_ERROR;
+        }
+    }
+    fingerprint_bits = (uint32_t)(strtoul(reply->element[1]->str, NULL, 10));
+    quotient_bits    = (uint32_t)(strtoul(reply->element[2]->str, NULL, 10));
+    other_remainder  = (uint32_t)(strtoul(reply->element[3]->str, NULL, 10));
+    other.bytes      = (uint32_t)(strtoul(reply->element[4]->str, NULL, 10));
+    hash_family      = (uint32_t)(strtoul(reply->element[5]->str, NULL, 10));
+    count            = strtoull(reply->element[6]->str, NULL, 10);
+    freeReplyObject(reply);
+
+    if (fingerprint_bits != ctxt->fingerprint_bits ||
+        hash_family != ctxt->hash_family ||
+        !quotient_valid(quotient_bits, other_remainder, other.bytes) ||
+        quotient_bits + other_remainder != fingerprint_bits) {
+        strncpy(ctxt->ctxt->errstr,
+            "Only quotient filters with the same fingerprints can be merged",
+            errstr_size);
+        free(name);
+        return PYREBLOOM_ERROR;
+    }
+
+    /* Big enough for both, without being any fuller than usual */
+    other.slots = 1ULL << quotient_bits;
+    if (quotient_bits < ctxt->quotient_bits) {
+        quotient_bits = ctxt->quotient_bits;
+    }
+    while ((double)(ctxt->count + count) >
+        quotient_load * (double)(1ULL << quotient_bits)) {
+        ++quotient_bits;
+    }
+
+    snprintf(name, length, "%s.0", key);
+    result = quotient_read(ctxt, name, &other);
+    if (result == PYREBLOOM_OK) {
+        result = quotient_rebuild(ctxt, quotient_bits, &other,
+            other_remainder);
+    }
+    free(other.data);
+    free(name);
+    return result;
+}
+
+int quotient_delete(pyrebloomquotient * ctxt) {
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s %s", ctxt->segment_key,
+        ctxt->meta_key));
+    ctxt->count = 0;
+    return PYREBLOOM_OK;
+}
@@ -0,0 +1,93 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef PYRE_QUOTIENT_H
+#define PYRE_QUOTIENT_H
+
+#include "bloom.h"
+
+/* A quotient filter keeps a `fingerprint_bits` fingerprint of each item in a
+ * table of 2 ^ `quotient_bits` slots. The top bits of the fingerprint (its
+ * quotient) pick a slot, and the rest (its remainder) are stored in or near
+ * that slot, in sorted runs, along with three bits that say how to find the
+ * run for each slot. Since the whole fingerprint can be recovered from where
+ * its remainder sits, a filter can be doubled in size, or merged with
+ * another one, without the items that were added to it: each fingerprint
+ * just gives one bit of its remainder to its quotient.
+ *
+ * Each slot is `slot_bytes` bytes in the single segment `<key>.0`. Adds and
+ * checks are batched into scripts, since adding a fingerprint may shift the
+ * ones after it. The filter is described by `<key>.meta`, including how many
+ * fingerprints it holds. */
+typedef struct {
+    uint64_t        capacity;
+    double          error;
+    uint32_t        hash_family;
+    uint32_t        fingerprint_bits;
+    uint32_t        quotient_bits;
+    uint32_t        remainder_bits;
+    uint32_t        slot_bytes;
+    /* How many fingerprints the filter held when we last looked */
+    uint64_t        count;
+    /* The fingerprints of the items being added or checked, and what became
+     * of each of them */
+    uint64_t      * batch;
+    uint8_t       * results;
+    uint32_t        batched;
+    uint32_t        next_batched;
+    uint32_t        batch_size;
+    int             batch_result;
+    char            sha[48];
+    char          * key;
+    char          * meta_key;
+    char          * segment_key;
+    redisContext  * ctxt;
+} pyrebloomquotient;
+
+int init_quotient(pyrebloomquotient * ctxt, char * key, uint64_t capacity,
+    double error, char * host, uint32_t port, char * password, uint32_t db,
+    uint32_t hash_family);
+int free_quotient(pyrebloomquotient * ctxt);
+
+/* Adds are batched, and quotient_add_complete returns how many of the items
+ * were new. Checks are batched too, and sent when the first result is read. */
+int quotient_add(pyrebloomquotient * ctxt, const char * data, uint32_t len);
+int64_t quotient_add_complete(pyrebloomquotient * ctxt);
+
+int quotient_check(pyrebloomquotient * ctxt, const char * data, uint32_t len);
+int quotient_check_next(pyrebloomquotient * ctxt);
+
+/* Double the number of slots, in one pass over the filter. Other clients
+ * pick up the new size on their next batch, but a batch that's added while
+ * the filter grows makes growing fail, to be tried again. */
+int quotient_grow(pyrebloomquotient * ctxt);
+
+/* Add every fingerprint of the quotient filter at `key` to this one, growing
+ * it if needed. The two must have fingerprints of the same size and hash. */
+int quotient_merge(pyrebloomquotient * ctxt, const char * key);
+
+int quotient_delete(pyrebloomquotient * ctxt);
+
+#endif
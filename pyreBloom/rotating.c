@@ -0,0 +1,430 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "rotating.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* The version of the metadata layout for rotating filters */
+static const uint32_t rotating_version = 1;
+
+/* Load the description of a rotating filter, or record it if it's new.
+ *
+ *     KEYS = { metadata key }
+ *     ARGV = { capacity, error, period, generations, hash family, version }
+ *
+ * It replies with the recorded capacity, error, period, generations and hash
+ * family. */
+static const char * rotating_init_script =
+    "local fields = {'capacity', 'error', 'period', 'generations', 'hash'}\n"
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'rotating' then\n"
+    "    return redis.call('HMGET', KEYS[1], unpack(fields))\n"
+    "elseif redis.call('EXISTS', KEYS[1]) == 1 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "elseif ARGV[1] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; capacity and error are required')\n"
+    "end\n"
+    "redis.call('HMSET', KEYS[1], 'type', 'rotating', 'capacity', ARGV[1],\n"
+    "    'error', ARGV[2], 'period', ARGV[3], 'generations', ARGV[4],\n"
+    "    'hash', ARGV[5], 'version', ARGV[6])\n"
+    "return {ARGV[1], ARGV[2], ARGV[3], ARGV[4], ARGV[5]}";
+
+/* Check for an item in each generation in turn, stopping at the first that
+ * has it. Every generation has the same shape, so the item's bits are at the
+ * same offsets in each.
+ *
+ *     KEYS = { the segment of each of the item's bits in the newest
+ *              generation, then the next newest, ... }
+ *     ARGV = { hashes, offset of each bit in its segment } */
+static const char * rotating_check_script =
+    "local hashes = tonumber(ARGV[1])\n"
+    "for first = 0, #KEYS - 1, hashes do\n"
+    "    local found = true\n"
+    "    for i = 1, hashes do\n"
+    "        if redis.call('GETBIT', KEYS[first + i], ARGV[i + 1]) == 0 then\n"
+    "            found = false\n"
+    "            break\n"
+    "        end\n"
+    "    end\n"
+    "    if found then\n"
+    "        return 1\n"
+    "    end\n"
+    "end\n"
+    "return 0";
+
+/* Marks a generation that hasn't been set up */
+static const uint64_t rotating_none = (uint64_t)(-1);
+
+/* The generation it is now, by redis' clock */
+static uint64_t rotating_generation(pyrebloomrotating * ctxt) {
+    struct timeval now;
+    int64_t micros;
+    gettimeofday(&now, NULL);
+    micros = (int64_t)(now.tv_sec) * 1000000 + now.tv_usec + ctxt->clock_offset;
+    return (uint64_t)(micros) / ((uint64_t)(ctxt->period) * 1000000);
+}
+
+/* How many generations are live */
+static uint32_t rotating_live(pyrebloomrotating * ctxt) {
+    return (ctxt->current + 1 < ctxt->generations) ?
+        (uint32_t)(ctxt->current + 1) : ctxt->generations;
+}
+
+/* Set up the live generations, if the current one has changed, and unlink
+ * the keys of any that have aged out since we last looked. The UNLINKs'
+ * replies are read ahead of whatever's pipelined after them. */
+static void rotating_rotate(pyrebloomrotating * ctxt) {
+    uint64_t now = rotating_generation(ctxt), g, first;
+    uint32_t i, slot, num_keys;
+    size_t length = strlen(ctxt->key) + 48;
+    char * name;
+    if (now == ctxt->current && ctxt->numbers[now % ctxt->generations] == now) {
+        return;
+    }
+
+    name = (char *)(malloc(length));
+    first = (now + 1 > ctxt->generations) ? now + 1 - ctxt->generations : 0;
+    for (g = first; g <= now; ++g) {
+        slot = (uint32_t)(g % ctxt->generations);
+        if (ctxt->numbers[slot] == g) {
+            continue;
+        }
+        if (ctxt->numbers[slot] != rotating_none) {
+            ctxt->filters[slot].ctxt = NULL;
+            free_pyrebloom(&ctxt->filters[slot]);
+        }
+        memset(&ctxt->filters[slot], 0, sizeof(pyrebloomctxt));
+        snprintf(name, length, "%s.g%lu", ctxt->key, g);
+        attach_pyrebloom(&ctxt->filters[slot], ctxt->ctxt, name,
+            ctxt->capacity, ctxt->error / ctxt->generations,
+            ctxt->hash_family, max_bits_per_key);
+        ctxt->numbers[slot] = g;
+    }
+
+    /* Their keys would expire soon enough anyway, but there's no sense in
+     * waiting. Those that were live when we last looked are unlinked, or
+     * just the last to age out if we've never looked, but never more than
+     * `generations` of them. */
+    if (first > 0) {
+        g = first - 1;
+        if (ctxt->current + 1 > ctxt->generations &&
+            ctxt->current + 1 - ctxt->generations < g) {
+            g = ctxt->current + 1 - ctxt->generations;
+        }
+        if (g + ctxt->generations < first) {
+            g = first - ctxt->generations;
+        }
+        num_keys = ctxt->filters[now % ctxt->generations].num_keys;
+        for (; g < first; ++g) {
+            for (i = 0; i < num_keys; ++i) {
+                snprintf(name, length, "%s.g%lu.%u", ctxt->key, g, i);
+                redisAppendCommand(ctxt->ctxt, "UNLINK %s", name);
+                ctxt->housekeeping += 1;
+            }
+        }
+    }
+    ctxt->current = now;
+    free(name);
+}
+
+/* Read the replies to `count` housekeeping commands */
+static int rotating_drain(pyrebloomrotating * ctxt, uint32_t count) {
+    redisReply * reply = NULL;
+    int failed = 0;
+    for (; count > 0; --count) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+        if (reply->type == REDIS_REPLY_ERROR) {
+            failed = 1;
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        }
+        freeReplyObject(reply);
+    }
+    return failed ? PYREBLOOM_ERROR : PYREBLOOM_OK;
+}
+
+/* Copy the script's hash out of the reply to SCRIPT LOAD */
+static int rotating_sha(pyrebloomrotating * ctxt, redisReply * reply) {
+    if (reply == NULL || reply->type != REDIS_REPLY_STRING) {
+        if (reply != NULL && reply->type == REDIS_REPLY_ERROR) {
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        }
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    snprintf(ctxt->check_sha, sizeof(ctxt->check_sha), "%s", reply->str);
+    freeReplyObject(reply);
+    return PYREBLOOM_OK;
+}
+
+int init_rotating(pyrebloomrotating * ctxt, char * key, uint64_t capacity,
+    double error, uint32_t period, uint32_t generations, char * host,
+    uint32_t port, char * password, uint32_t db, uint32_t hash_family) {
+    redisReply * reply = NULL;
+    struct timeval now;
+    uint32_t i, hashes;
+
+    ctxt->key      = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+
+    /* Connecting, loading the script, reading redis' clock and agreeing on
+     * the description of the filter all happen in one round trip */
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (capacity != 0 && (period == 0 || generations == 0)) {
+        strncpy(ctxt->ctxt->errstr,
+            "The period and generations must be positive", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->ctxt, "SCRIPT LOAD %s", rotating_check_script);
+    redisAppendCommand(ctxt->ctxt, "TIME");
+    redisAppendCommand(ctxt->ctxt, "EVAL %s 1 %s %lu %.17g %u %u %u %u",
+        rotating_init_script, ctxt->meta_key, capacity, error, period,
+        generations, hash_family, rotating_version);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR ||
+        rotating_sha(ctxt, reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+
+    /* Halfway through the round trip is as good a guess as any for when
+     * redis read its clock */
+    reply = NULL;
+    if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+        return PYREBLOOM_ERROR;
+    }
+    gettimeofday(&now, NULL);
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 2) {
+        ctxt->clock_offset =
+            strtoll(reply->element[0]->str, NULL, 10) * 1000000 +
+            strtoll(reply->element[1]->str, NULL, 10) -
+            ((int64_t)(now.tv_sec) * 1000000 + now.tv_usec);
+    }
+    freeReplyObject(reply);
+
+    reply = NULL;
+    if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 5) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->capacity    = strtoull(reply->element[0]->str, NULL, 10);
+    ctxt->error       = strtod(reply->element[1]->str, NULL);
+    ctxt->period      = (uint32_t)(strtoul(reply->element[2]->str, NULL, 10));
+    ctxt->generations = (uint32_t)(strtoul(reply->element[3]->str, NULL, 10));
+    ctxt->hash_family = (uint32_t)(strtoul(reply->element[4]->str, NULL, 10));
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT || ctxt->capacity == 0 ||
+        ctxt->error <= 0 || ctxt->error >= 1 || ctxt->period == 0 ||
+        ctxt->generations == 0) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+
+    ctxt->numbers = (uint64_t *)(
+        malloc(ctxt->generations * sizeof(uint64_t)));
+    ctxt->filters = (pyrebloomctxt *)(
+        calloc(ctxt->generations, sizeof(pyrebloomctxt)));
+    for (i = 0; i < ctxt->generations; ++i) {
+        ctxt->numbers[i] = rotating_none;
+    }
+    rotating_rotate(ctxt);
+
+    /* Enough for EVALSHA sha count, a key for every bit in every generation,
+     * and then the number of hashes and each bit's offset */
+    hashes = ctxt->filters[ctxt->current % ctxt->generations].hashes;
+    ctxt->args    = (char *)(malloc((hashes + 2) * 24));
+    ctxt->argv    = (const char **)(malloc(
+        (4 + (ctxt->generations + 1) * hashes) * sizeof(char *)));
+    ctxt->argvlen = (size_t *)(malloc(
+        (4 + (ctxt->generations + 1) * hashes) * sizeof(size_t)));
+    return PYREBLOOM_OK;
+}
+
+int free_rotating(pyrebloomrotating * ctxt) {
+    uint32_t i;
+    for (i = 0; i < ctxt->generations && ctxt->numbers; ++i) {
+        if (ctxt->numbers[i] != rotating_none) {
+            /* The connection is ours, not theirs */
+            ctxt->filters[i].ctxt = NULL;
+            free_pyrebloom(&ctxt->filters[i]);
+        }
+    }
+    free(ctxt->numbers);
+    free(ctxt->filters);
+    free(ctxt->args);
+    free(ctxt->argv);
+    free(ctxt->argvlen);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+int rotating_add(pyrebloomrotating * ctxt, const char * data, uint32_t len) {
+    if (ctxt->queued == 0) {
+        rotating_rotate(ctxt);
+    }
+    ctxt->queued += 1;
+    return add(&ctxt->filters[ctxt->current % ctxt->generations], data, len);
+}
+
+int64_t rotating_add_complete(pyrebloomrotating * ctxt, uint32_t count) {
+    pyrebloomctxt * newest = &ctxt->filters[ctxt->current % ctxt->generations];
+    uint64_t expiry = (ctxt->current + ctxt->generations) * ctxt->period;
+    uint32_t i, housekeeping = ctxt->housekeeping;
+    int64_t added;
+    int failed = 0;
+
+    /* The current generation lives until it's no longer live. This goes
+     * after the adds, since there's nothing to expire until they're done. */
+    for (i = 0; i < newest->num_keys; ++i) {
+        redisAppendCommand(ctxt->ctxt, "EXPIREAT %s %lu", newest->keys[i],
+            expiry);
+    }
+    ctxt->queued = ctxt->housekeeping = 0;
+
+    failed = rotating_drain(ctxt, housekeeping) == PYREBLOOM_ERROR;
+    added = add_complete(newest, count);
+    failed = (rotating_drain(ctxt, newest->num_keys) == PYREBLOOM_ERROR) ||
+        failed || added < 0;
+    return failed ? PYREBLOOM_ERROR : added;
+}
+
+int rotating_check(pyrebloomrotating * ctxt, const char * data, uint32_t len) {
+    pyrebloomctxt * newest;
+    uint32_t i, j, live, argc = 0;
+    if (ctxt->checking == 0) {
+        rotating_rotate(ctxt);
+    }
+    ctxt->checking += 1;
+
+    newest = &ctxt->filters[ctxt->current % ctxt->generations];
+    live = rotating_live(ctxt);
+    hash_offsets(newest, data, len);
+    snprintf(ctxt->args, 24, "%u", live * newest->hashes);
+    snprintf(ctxt->args + 24, 24, "%u", newest->hashes);
+
+    ctxt->argv[argc++] = "EVALSHA";
+    ctxt->argv[argc++] = ctxt->check_sha;
+    ctxt->argv[argc++] = ctxt->args;
+    for (j = 0; j < live; ++j) {
+        pyrebloomctxt * filter =
+            &ctxt->filters[(ctxt->current - j) % ctxt->generations];
+        for (i = 0; i < newest->hashes; ++i) {
+            ctxt->argv[argc++] =
+                filter->keys[newest->offsets[i] / newest->segment_bits];
+        }
+    }
+    ctxt->argv[argc++] = ctxt->args + 24;
+    for (i = 0; i < newest->hashes; ++i) {
+        char * slot = ctxt->args + 24 * (i + 2);
+        snprintf(slot, 24, "%lu", newest->offsets[i] % newest->segment_bits);
+        ctxt->argv[argc++] = slot;
+    }
+
+    for (i = 0; i < argc; ++i) {
+        ctxt->argvlen[i] = strlen(ctxt->argv[i]);
+    }
+    redisAppendCommandArgv(ctxt->ctxt, argc, ctxt->argv, ctxt->argvlen);
+    return PYREBLOOM_OK;
+}
+
+int rotating_check_next(pyrebloomrotating * ctxt) {
+    redisReply * reply = NULL;
+    int result = 0, failed = 0;
+
+    if (ctxt->housekeeping > 0) {
+        failed = rotating_drain(ctxt, ctxt->housekeeping) == PYREBLOOM_ERROR;
+        ctxt->housekeeping = 0;
+    }
+    ctxt->checking -= 1;
+
+    if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+        strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        failed = 1;
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        if (strncmp(reply->str, "NOSCRIPT", 8) == 0) {
+            ctxt->reload = 1;
+        }
+    } else {
+        result = (reply->integer != 0);
+    }
+    freeReplyObject(reply);
+
+    /* If redis restarted or had its scripts flushed, this batch failed, but
+     * the next one needn't */
+    if (ctxt->reload && ctxt->checking == 0) {
+        ctxt->reload = 0;
+        rotating_sha(ctxt, redisCommand(
+            ctxt->ctxt, "SCRIPT LOAD %s", rotating_check_script));
+    }
+    return failed ? PYREBLOOM_ERROR : result;
+}
+
+uint32_t rotating_num_keys(pyrebloomrotating * ctxt) {
+    return rotating_live(ctxt) *
+        ctxt->filters[ctxt->current % ctxt->generations].num_keys;
+}
+
+const char * rotating_key(pyrebloomrotating * ctxt, uint32_t index) {
+    uint32_t num_keys = ctxt->filters[ctxt->current % ctxt->generations].num_keys;
+    pyrebloomctxt * filter = &ctxt->filters[
+        (ctxt->current - index / num_keys) % ctxt->generations];
+    return filter->keys[index % num_keys];
+}
+
+int rotating_delete(pyrebloomrotating * ctxt) {
+    uint32_t i;
+    rotating_drain(ctxt, ctxt->housekeeping);
+    ctxt->housekeeping = 0;
+    for (i = 0; i < ctxt->generations; ++i) {
+        if (ctxt->numbers[i] != rotating_none) {
+            delete(&ctxt->filters[i]);
+        }
+    }
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->meta_key));
+    return PYREBLOOM_OK;
+}
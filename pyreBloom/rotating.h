@@ -0,0 +1,91 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef PYRE_ROTATING_H
+#define PYRE_ROTATING_H
+
+#include "bloom.h"
+
+/* A rotating filter remembers items for between `generations - 1` and
+ * `generations` periods of `period` seconds. Each period has a filter of its
+ * own, `<key>.g<n>` where n is the number of periods since the epoch, sized
+ * for `capacity` items with an error rate of `error / generations`, so that
+ * all of them together stay under `error`. Items are added to the current
+ * generation, and checks look in all of the live ones, newest first.
+ *
+ * Generations are numbered by redis' clock rather than ours, so that every
+ * client agrees on them. Each generation's keys expire once it's no longer
+ * live, and the client that notices a generation has aged out unlinks it, so
+ * the memory used never grows past `generations` filters. The filter is
+ * described by `<key>.meta`. */
+typedef struct {
+    uint64_t        capacity;
+    double          error;
+    uint32_t        period;
+    uint32_t        generations;
+    uint32_t        hash_family;
+    /* The difference between redis' clock and ours, in microseconds */
+    int64_t         clock_offset;
+    /* The newest generation, and the live generations themselves, with
+     * generation n in filters[n % generations] */
+    uint64_t        current;
+    uint64_t      * numbers;
+    pyrebloomctxt * filters;
+    /* How many items are queued up to be added or checked, and how many
+     * replies to housekeeping commands are ahead of theirs */
+    uint32_t        queued;
+    uint32_t        checking;
+    uint32_t        housekeeping;
+    /* Set when redis has forgotten our script, and it needs loading */
+    int             reload;
+    char            check_sha[48];
+    /* Scratch space for building commands */
+    char          * args;
+    const char   ** argv;
+    size_t        * argvlen;
+    char          * key;
+    char          * meta_key;
+    redisContext  * ctxt;
+} pyrebloomrotating;
+
+int init_rotating(pyrebloomrotating * ctxt, char * key, uint64_t capacity,
+    double error, uint32_t period, uint32_t generations, char * host,
+    uint32_t port, char * password, uint32_t db, uint32_t hash_family);
+int free_rotating(pyrebloomrotating * ctxt);
+
+int rotating_add(pyrebloomrotating * ctxt, const char * data, uint32_t len);
+int64_t rotating_add_complete(pyrebloomrotating * ctxt, uint32_t count);
+
+/* Each check is a single script that looks in the live generations from
+ * newest to oldest, and stops at the first that has the item */
+int rotating_check(pyrebloomrotating * ctxt, const char * data, uint32_t len);
+int rotating_check_next(pyrebloomrotating * ctxt);
+
+/* The keys of the live generations */
+uint32_t rotating_num_keys(pyrebloomrotating * ctxt);
+const char * rotating_key(pyrebloomrotating * ctxt, uint32_t index);
+
+int rotating_delete(pyrebloomrotating * ctxt);
+
+#endif
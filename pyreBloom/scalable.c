@@ -0,0 +1,323 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "scalable.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The version of the metadata layout for scalable filters */
+static const uint32_t scalable_version = 1;
+
+/* Load the description of a scalable filter, or record it if it's new.
+ *
+ *     KEYS = { metadata key }
+ *     ARGV = { capacity, error, growth, tightening, hash family, version }
+ *
+ * It replies with the recorded capacity, error, growth, tightening, hash
+ * family, number of filters and number of items in the newest. */
+static const char * scalable_init_script =
+    "local fields = {'capacity', 'error', 'growth', 'tightening', 'hash',\n"
+    "    'filters', 'count'}\n"
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'scalable' then\n"
+    "    return redis.call('HMGET', KEYS[1], unpack(fields))\n"
+    "elseif redis.call('EXISTS', KEYS[1]) == 1 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "elseif ARGV[1] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; capacity and error are required')\n"
+    "end\n"
+    "redis.call('HMSET', KEYS[1], 'type', 'scalable', 'capacity', ARGV[1],\n"
+    "    'error', ARGV[2], 'growth', ARGV[3], 'tightening', ARGV[4],\n"
+    "    'hash', ARGV[5], 'version', ARGV[6], 'filters', 1, 'count', 0)\n"
+    "return {ARGV[1], ARGV[2], ARGV[3], ARGV[4], ARGV[5], '1', '0'}";
+
+/* Account for items added to the newest filter, and start a new filter when
+ * it reaches capacity. If another client has already moved on to a newer
+ * filter, the items are left unaccounted for rather than credited to the
+ * wrong filter. If the filter's been deleted, its metadata is recreated.
+ *
+ *     KEYS = { metadata key }
+ *     ARGV = { items added, index of their filter, its capacity,
+ *              capacity, error, growth, tightening, hash family, version }
+ *
+ * It replies with the current number of filters, and the number of items
+ * in the newest. */
+static const char * scalable_grow_script =
+    "local filters = tonumber(redis.call('HGET', KEYS[1], 'filters'))\n"
+    "if not filters then\n"
+    "    filters = 1\n"
+    "    redis.call('HMSET', KEYS[1], 'type', 'scalable', 'capacity', ARGV[4],\n"
+    "        'error', ARGV[5], 'growth', ARGV[6], 'tightening', ARGV[7],\n"
+    "        'hash', ARGV[8], 'version', ARGV[9], 'filters', 1, 'count', 0)\n"
+    "end\n"
+    "local count = tonumber(redis.call('HGET', KEYS[1], 'count'))\n"
+    "if filters == tonumber(ARGV[2]) + 1 then\n"
+    "    count = redis.call('HINCRBY', KEYS[1], 'count', ARGV[1])\n"
+    "    if count >= tonumber(ARGV[3]) then\n"
+    "        filters = filters + 1\n"
+    "        count = 0\n"
+    "        redis.call('HMSET', KEYS[1], 'filters', filters, 'count', 0)\n"
+    "    end\n"
+    "end\n"
+    "return {filters, count}";
+
+/* Make sure we know about the first `count` filters in the chain */
+static int scalable_extend(pyrebloomscalable * ctxt, uint32_t count) {
+    uint32_t i;
+    if (count <= ctxt->num_filters) {
+        return PYREBLOOM_OK;
+    }
+
+    ctxt->filters = (pyrebloomctxt *)(realloc(
+        ctxt->filters, count * sizeof(pyrebloomctxt)));
+    for (i = ctxt->num_filters; i < count; ++i) {
+        double capacity = ctxt->capacity * pow(ctxt->growth, i);
+        double error = ctxt->error * (1 - ctxt->tightening) *
+            pow(ctxt->tightening, i);
+        size_t length = strlen(ctxt->key) + 12;
+        char * key = (char *)(malloc(length));
+        snprintf(key, length, "%s.s%u", ctxt->key, i);
+
+        memset(&ctxt->filters[i], 0, sizeof(pyrebloomctxt));
+        attach_pyrebloom(&ctxt->filters[i], ctxt->ctxt, key,
+            (uint64_t)(capacity), error, ctxt->hash_family, max_bits_per_key);
+        free(key);
+    }
+    ctxt->num_filters = count;
+    return PYREBLOOM_OK;
+}
+
+/* Forget about all but the first filter in the chain */
+static void scalable_truncate(pyrebloomscalable * ctxt) {
+    uint32_t i;
+    for (i = 1; i < ctxt->num_filters; ++i) {
+        ctxt->filters[i].ctxt = NULL;
+        free_pyrebloom(&ctxt->filters[i]);
+    }
+    ctxt->num_filters = 1;
+    ctxt->room = (ctxt->filters[0].capacity > 0xFFFFFFFF) ? 0xFFFFFFFF :
+        (uint32_t)(ctxt->filters[0].capacity);
+}
+
+/* Having heard how many items are in the newest filter, work out how many
+ * more can be added before it's full. Even a full filter takes one more, so
+ * that we can find out if it's been replaced. */
+static void scalable_fill(pyrebloomscalable * ctxt, uint64_t count) {
+    uint64_t capacity = ctxt->filters[ctxt->num_filters - 1].capacity;
+    uint64_t room = (count < capacity) ? capacity - count : 1;
+    ctxt->room = (room > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)(room);
+}
+
+int init_scalable(pyrebloomscalable * ctxt, char * key, uint64_t capacity,
+    double error, double growth, double tightening, char * host,
+    uint32_t port, char * password, uint32_t db, uint32_t hash_family) {
+    redisReply * reply = NULL;
+    uint32_t filters;
+    uint64_t count;
+
+    ctxt->key      = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->ctxt, "EVAL %s 1 %s %lu %.17g %.17g %.17g %u %u",
+        scalable_init_script, ctxt->meta_key, capacity, error, growth,
+        tightening, hash_family, scalable_version);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 7) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->capacity    = strtoull(reply->element[0]->str, NULL, 10);
+    ctxt->error       = strtod(reply->element[1]->str, NULL);
+    ctxt->growth      = strtod(reply->element[2]->str, NULL);
+    ctxt->tightening  = strtod(reply->element[3]->str, NULL);
+    ctxt->hash_family = (uint32_t)(strtoul(reply->element[4]->str, NULL, 10));
+    filters           = (uint32_t)(strtoul(reply->element[5]->str, NULL, 10));
+    count             = strtoull(reply->element[6]->str, NULL, 10);
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT || ctxt->capacity == 0 ||
+        ctxt->growth < 1 || ctxt->tightening <= 0 || ctxt->tightening >= 1) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+
+    scalable_extend(ctxt, filters ? filters : 1);
+    scalable_fill(ctxt, count);
+    return PYREBLOOM_OK;
+}
+
+int free_scalable(pyrebloomscalable * ctxt) {
+    uint32_t i;
+    for (i = 0; i < ctxt->num_filters; ++i) {
+        /* The connection is ours, not theirs */
+        ctxt->filters[i].ctxt = NULL;
+        free_pyrebloom(&ctxt->filters[i]);
+    }
+    free(ctxt->filters);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+/* Send the queued items to the newest filter, and account for them */
+static int64_t scalable_flush(pyrebloomscalable * ctxt) {
+    pyrebloomctxt * newest = &ctxt->filters[ctxt->num_filters - 1];
+    redisReply * reply = NULL;
+    uint32_t filters;
+    int64_t added = add_complete(newest, ctxt->queued);
+    ctxt->queued = 0;
+    if (added < 0) {
+        return PYREBLOOM_ERROR;
+    }
+
+    reply = redisCommand(ctxt->ctxt,
+        "EVAL %s 1 %s %li %u %lu %lu %.17g %.17g %.17g %u %u",
+        scalable_grow_script, ctxt->meta_key, added, ctxt->num_filters - 1,
+        newest->capacity, ctxt->capacity, ctxt->error, ctxt->growth,
+        ctxt->tightening, ctxt->hash_family, scalable_version);
+    if (reply == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 2) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    filters = (uint32_t)(reply->element[0]->integer);
+    scalable_extend(ctxt, filters);
+    scalable_fill(ctxt, (uint64_t)(reply->element[1]->integer));
+    freeReplyObject(reply);
+    return added;
+}
+
+int scalable_add(pyrebloomscalable * ctxt, const char * data, uint32_t len) {
+    if (ctxt->queued >= ctxt->room) {
+        int64_t added = scalable_flush(ctxt);
+        if (added < 0 || ctxt->added < 0) {
+            ctxt->added = PYREBLOOM_ERROR;
+        } else {
+            ctxt->added += added;
+        }
+    }
+    ctxt->queued += 1;
+    return add(&ctxt->filters[ctxt->num_filters - 1], data, len);
+}
+
+int64_t scalable_add_complete(pyrebloomscalable * ctxt) {
+    int64_t added = ctxt->added;
+    int64_t flushed = scalable_flush(ctxt);
+    ctxt->added = 0;
+    if (added < 0 || flushed < 0) {
+        return PYREBLOOM_ERROR;
+    }
+    return added + flushed;
+}
+
+int scalable_check_begin(pyrebloomscalable * ctxt) {
+    redisAppendCommand(ctxt->ctxt, "HGET %s filters", ctxt->meta_key);
+    ctxt->checked_filters = ctxt->num_filters;
+    return PYREBLOOM_OK;
+}
+
+int scalable_check(pyrebloomscalable * ctxt, const char * data, uint32_t len) {
+    uint32_t i;
+    for (i = 0; i < ctxt->checked_filters; ++i) {
+        check(&ctxt->filters[i], data, len);
+    }
+    return PYREBLOOM_OK;
+}
+
+int scalable_check_begun(pyrebloomscalable * ctxt) {
+    redisReply * reply = NULL;
+    uint32_t filters = 1;
+    if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+        strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    /* No metadata means the filter's been deleted out from under us */
+    if (reply->type == REDIS_REPLY_STRING) {
+        filters = (uint32_t)(strtoul(reply->str, NULL, 10));
+    }
+    freeReplyObject(reply);
+
+    scalable_extend(ctxt, filters);
+    return ctxt->num_filters > ctxt->checked_filters;
+}
+
+int scalable_check_next(pyrebloomscalable * ctxt) {
+    uint32_t i;
+    int result = 0, failed = 0;
+    for (i = 0; i < ctxt->checked_filters; ++i) {
+        int r = check_next(&ctxt->filters[i]);
+        if (r < 0) {
+            failed = 1;
+        } else {
+            result = result || r;
+        }
+    }
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+    return result;
+}
+
+int scalable_delete(pyrebloomscalable * ctxt) {
+    uint32_t i;
+    redisReply * reply = redisCommand(
+        ctxt->ctxt, "HGET %s filters", ctxt->meta_key);
+    if (reply != NULL && reply->type == REDIS_REPLY_STRING) {
+        scalable_extend(ctxt, (uint32_t)(strtoul(reply->str, NULL, 10)));
+    }
+    freeReplyObject(reply);
+
+    for (i = 0; i < ctxt->num_filters; ++i) {
+        delete(&ctxt->filters[i]);
+    }
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->meta_key));
+    scalable_truncate(ctxt);
+    return PYREBLOOM_OK;
+}
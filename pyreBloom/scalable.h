@@ -0,0 +1,80 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef PYRE_SCALABLE_H
+#define PYRE_SCALABLE_H
+
+#include "bloom.h"
+
+/* A scalable bloom filter is a chain of ordinary filters. Each one is
+ * `growth` times larger than the last, with an error rate `tightening` times
+ * smaller, so that the false positive rate of the whole chain stays under
+ * `error` however many filters get added. Items only ever go into the newest
+ * filter, and checks consult all of them in the same pipeline.
+ *
+ * The filters are `<key>.s0`, `<key>.s1`, ... and share one connection. The
+ * chain is described by `<key>.meta`, which also tracks how many filters
+ * there are and how full the newest one is. */
+typedef struct {
+    uint64_t        capacity;
+    double          error;
+    double          growth;
+    double          tightening;
+    uint32_t        hash_family;
+    uint32_t        num_filters;
+    uint32_t        checked_filters;
+    /* Adds are queued up for the newest filter until they would overfill
+     * it, at which point they're sent and the chain is allowed to grow */
+    uint32_t        queued;
+    uint32_t        room;
+    int64_t         added;
+    char          * key;
+    char          * meta_key;
+    pyrebloomctxt * filters;
+    redisContext  * ctxt;
+} pyrebloomscalable;
+
+int init_scalable(pyrebloomscalable * ctxt, char * key, uint64_t capacity,
+    double error, double growth, double tightening, char * host,
+    uint32_t port, char * password, uint32_t db, uint32_t hash_family);
+int free_scalable(pyrebloomscalable * ctxt);
+
+/* Items added by scalable_add may be sent in several batches, so that no
+ * filter is filled past its capacity. scalable_add_complete sends whatever's
+ * left, and returns how many of all the items added were new. */
+int scalable_add(pyrebloomscalable * ctxt, const char * data, uint32_t len);
+int64_t scalable_add_complete(pyrebloomscalable * ctxt);
+
+/* Checks are bracketed by scalable_check_begin, which queues up a read of the
+ * number of filters ahead of the checks, and scalable_check_begun, which reads
+ * it back before any scalable_check_next. The latter returns 1 if filters
+ * were added since the checks were queued, in which case any items that came
+ * back negative should be checked again. */
+int scalable_check_begin(pyrebloomscalable * ctxt);
+int scalable_check(pyrebloomscalable * ctxt, const char * data, uint32_t len);
+int scalable_check_begun(pyrebloomscalable * ctxt);
+int scalable_check_next(pyrebloomscalable * ctxt);
+
+int scalable_delete(pyrebloomscalable * ctxt);
+
+#endif
@@ -0,0 +1,354 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "signature.h"
+#include <stdio.h>
+#include <string.h>
+
+/* The version of the metadata layout for signature indexes */
+static const uint32_t signature_version = 1;
+
+/* Load the description of a signature index, or record it if it's new. A
+ * first segment without any metadata belongs to an ordinary filter that
+ * predates metadata, and mustn't be mistaken for rows.
+ *
+ *     KEYS = { metadata key, first segment key }
+ *     ARGV = { capacity, error, slots, hash family, version }
+ *
+ * It replies with the recorded capacity, error, slots and hash family. */
+static const char * signature_init_script =
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'signature' then\n"
+    "    return redis.call('HMGET', KEYS[1], 'capacity', 'error', 'slots',\n"
+    "        'hash')\n"
+    "elseif redis.call('EXISTS', KEYS[1], KEYS[2]) > 0 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "elseif ARGV[1] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; capacity and error are required')\n"
+    "end\n"
+    "redis.call('HMSET', KEYS[1], 'type', 'signature', 'capacity', ARGV[1],\n"
+    "    'error', ARGV[2], 'slots', ARGV[3], 'hash', ARGV[4],\n"
+    "    'version', ARGV[5], 'members', 0)\n"
+    "return {ARGV[1], ARGV[2], ARGV[3], ARGV[4]}";
+
+/* Find the slot of a member, or give it the next free one.
+ *
+ *     KEYS = { metadata key, members key }
+ *     ARGV = { name, slots } */
+static const char * signature_member_script =
+    "local slot = redis.call('HGET', KEYS[2], ARGV[1])\n"
+    "if slot then return tonumber(slot) end\n"
+    "slot = redis.call('HGET', KEYS[1], 'members')\n"
+    "if not slot then\n"
+    "    return redis.error_reply(KEYS[1] .. ' has been deleted')\n"
+    "elseif tonumber(slot) >= tonumber(ARGV[2]) then\n"
+    "    return redis.error_reply(KEYS[1] .. ' has no free slots')\n"
+    "end\n"
+    "redis.call('HINCRBY', KEYS[1], 'members', 1)\n"
+    "redis.call('HSET', KEYS[2], ARGV[1], slot)\n"
+    "return tonumber(slot)";
+
+int init_signature(pyrebloomsignature * ctxt, char * key, uint64_t capacity,
+    double error, uint32_t slots, char * host, uint32_t port,
+    char * password, uint32_t db, uint32_t hash_family) {
+    redisReply * reply = NULL;
+    uint32_t args;
+
+    ctxt->key         = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key    = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+    ctxt->members_key = (char *)(malloc(strlen(key) + 9));
+    snprintf(ctxt->members_key, strlen(key) + 9, "%s.members", key);
+
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    /* Rows are read and ANDed a word at a time, so they're whole words */
+    slots = (slots + 63) & ~63;
+    if (capacity != 0 && (slots == 0 || slots > (1 << 24))) {
+        strncpy(ctxt->ctxt->errstr, "An index must have 1 to 2^24 slots",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->ctxt, "EVAL %s 2 %s %s.0 %lu %.17g %u %u %u",
+        signature_init_script, ctxt->meta_key, key, capacity, error, slots,
+        hash_family, signature_version);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 4) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->capacity    = strtoull(reply->element[0]->str, NULL, 10);
+    ctxt->error       = strtod(reply->element[1]->str, NULL);
+    ctxt->slots       = (uint32_t)(strtoul(reply->element[2]->str, NULL, 10));
+    ctxt->hash_family = (uint32_t)(strtoul(reply->element[3]->str, NULL, 10));
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT || ctxt->capacity == 0 ||
+        ctxt->error <= 0 || ctxt->error >= 1 || ctxt->slots == 0 ||
+        ctxt->slots % 64 != 0 || ctxt->slots > (1 << 24)) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+
+    attach_pyrebloom(&ctxt->filter, ctxt->ctxt, key, ctxt->capacity,
+        ctxt->error, ctxt->hash_family, max_bits_per_key / ctxt->slots);
+    ctxt->per_item = (ctxt->filter.num_keys == 1) ? 1 : ctxt->filter.hashes;
+
+    /* BITFIELD key, and then SET u1 offset 1 for each of the hashes */
+    args = 2 + 4 * ctxt->filter.hashes;
+    ctxt->args    = (char *)(malloc(ctxt->filter.hashes * 24));
+    ctxt->argv    = (const char **)(malloc(args * sizeof(char *)));
+    ctxt->argvlen = (size_t *)(malloc(args * sizeof(size_t)));
+    ctxt->result  = (uint64_t *)(malloc(ctxt->slots / 8));
+    ctxt->found   = (uint32_t *)(malloc(ctxt->slots * sizeof(uint32_t)));
+    ctxt->names   = (char **)(calloc(ctxt->slots, sizeof(char *)));
+    return PYREBLOOM_OK;
+}
+
+/* Forget the names of the members, so that they're read again */
+static void signature_forget(pyrebloomsignature * ctxt) {
+    uint32_t i;
+    for (i = 0; ctxt->names && i < ctxt->slots; ++i) {
+        free(ctxt->names[i]);
+        ctxt->names[i] = NULL;
+    }
+}
+
+int free_signature(pyrebloomsignature * ctxt) {
+    /* The connection is ours, not the filter's */
+    ctxt->filter.ctxt = NULL;
+    free_pyrebloom(&ctxt->filter);
+    signature_forget(ctxt);
+    free(ctxt->names);
+    free(ctxt->args);
+    free(ctxt->argv);
+    free(ctxt->argvlen);
+    free(ctxt->result);
+    free(ctxt->found);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    free(ctxt->members_key);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+int signature_member(pyrebloomsignature * ctxt, const char * name,
+    uint32_t len) {
+    int result = PYREBLOOM_ERROR;
+    redisReply * reply = redisCommand(ctxt->ctxt, "EVAL %s 2 %s %s %b %u",
+        signature_member_script, ctxt->meta_key, ctxt->members_key, name,
+        (size_t)(len), ctxt->slots);
+    if (reply == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+    } else if (reply->type == REDIS_REPLY_INTEGER) {
+        result = (int)(reply->integer);
+    }
+    freeReplyObject(reply);
+    return result;
+}
+
+const char * signature_name(pyrebloomsignature * ctxt, uint32_t slot) {
+    redisReply * reply = NULL;
+    uint32_t i;
+
+    if (slot >= ctxt->slots) {
+        return NULL;
+    } else if (ctxt->names[slot] == NULL) {
+        /* A member we haven't heard of yet, so read them all again */
+        reply = redisCommand(ctxt->ctxt, "HGETALL %s", ctxt->members_key);
+        if (reply == NULL) {
+            return NULL;
+        }
+        if (reply->type == REDIS_REPLY_ARRAY) {
+            signature_forget(ctxt);
+            for (i = 0; i + 1 < reply->elements; i += 2) {
+                uint32_t member = (uint32_t)(
+                    strtoul(reply->element[i + 1]->str, NULL, 10));
+                if (member < ctxt->slots && ctxt->names[member] == NULL) {
+                    ctxt->names[member] = (char *)(
+                        malloc(reply->element[i]->len + 1));
+                    memcpy(ctxt->names[member], reply->element[i]->str,
+                        reply->element[i]->len);
+                    ctxt->names[member][reply->element[i]->len] = '\0';
+                }
+            }
+        }
+        freeReplyObject(reply);
+    }
+    return ctxt->names[slot];
+}
+
+int signature_add(pyrebloomsignature * ctxt, uint32_t slot,
+    const char * data, uint32_t len) {
+    pyrebloomctxt * filter = &ctxt->filter;
+    uint32_t i, j, argc = 0;
+    hash_offsets(filter, data, len);
+    for (i = 0; i < filter->hashes; ++i) {
+        /* The member's bit in the row for this offset */
+        uint64_t d = filter->offsets[i];
+        char * offset = ctxt->args + i * 24;
+        snprintf(offset, 24, "%lu",
+            (d % filter->segment_bits) * ctxt->slots + slot);
+
+        if (argc == 0) {
+            ctxt->argv[argc++] = "BITFIELD";
+            ctxt->argv[argc++] = filter->keys[d / filter->segment_bits];
+        }
+        ctxt->argv[argc++] = "SET";
+        ctxt->argv[argc++] = "u1";
+        ctxt->argv[argc++] = offset;
+        ctxt->argv[argc++] = "1";
+
+        /* Rows in different segments need commands of their own */
+        if (ctxt->per_item != 1 || i + 1 == filter->hashes) {
+            for (j = 0; j < argc; ++j) {
+                ctxt->argvlen[j] = strlen(ctxt->argv[j]);
+            }
+            redisAppendCommandArgv(ctxt->ctxt, argc, ctxt->argv,
+                ctxt->argvlen);
+            argc = 0;
+        }
+    }
+    return PYREBLOOM_OK;
+}
+
+int64_t signature_add_complete(pyrebloomsignature * ctxt, uint32_t count) {
+    uint32_t i, j, k, set, total = 0;
+    int failed = 0;
+    redisReply * reply = NULL;
+
+    for (i = 0; i < count; ++i) {
+        for (j = 0, set = 0; j < ctxt->per_item; ++j) {
+            if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+                strncpy(ctxt->ctxt->errstr, "No pending replies",
+                    errstr_size);
+                return PYREBLOOM_ERROR;
+            }
+            if (reply->type == REDIS_REPLY_ERROR) {
+                failed = 1;
+                strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+            } else if (reply->type == REDIS_REPLY_ARRAY) {
+                for (k = 0; k < reply->elements; ++k) {
+                    set += (uint32_t)(reply->element[k]->integer);
+                }
+            }
+            freeReplyObject(reply);
+        }
+        if (set != ctxt->filter.hashes) {
+            total += 1;
+        }
+    }
+
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+    return total;
+}
+
+int signature_check(pyrebloomsignature * ctxt, const char * data,
+    uint32_t len) {
+    pyrebloomctxt * filter = &ctxt->filter;
+    uint64_t start;
+    uint32_t i;
+    hash_offsets(filter, data, len);
+    for (i = 0; i < filter->hashes; ++i) {
+        uint64_t d = filter->offsets[i];
+        start = (d % filter->segment_bits) * (ctxt->slots / 8);
+        redisAppendCommand(ctxt->ctxt, "GETRANGE %s %lu %lu",
+            filter->keys[d / filter->segment_bits], start,
+            start + ctxt->slots / 8 - 1);
+    }
+    return PYREBLOOM_OK;
+}
+
+int signature_check_next(pyrebloomsignature * ctxt) {
+    uint32_t words = ctxt->slots / 64, i, j, found = 0;
+    int failed = 0;
+    redisReply * reply = NULL;
+
+    memset(ctxt->result, 0xFF, ctxt->slots / 8);
+    for (i = 0; i < ctxt->filter.hashes; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+        if (reply->type == REDIS_REPLY_ERROR) {
+            failed = 1;
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+        } else if (reply->type == REDIS_REPLY_STRING) {
+            /* Rows that haven't been written all the way are short */
+            uint64_t word;
+            for (j = 0; j < words; ++j) {
+                if ((j + 1) * 8 <= reply->len) {
+                    memcpy(&word, reply->str + j * 8, 8);
+                } else {
+                    word = 0;
+                    if (j * 8 < reply->len) {
+                        memcpy(&word, reply->str + j * 8, reply->len - j * 8);
+                    }
+                }
+                ctxt->result[j] &= word;
+            }
+        }
+        freeReplyObject(reply);
+    }
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+
+    /* Bits are numbered from the most significant bit of each byte */
+    for (i = 0; i < words; ++i) {
+        const unsigned char * bytes = (const unsigned char *)(
+            ctxt->result + i);
+        if (ctxt->result[i] == 0) {
+            continue;
+        }
+        for (j = 0; j < 64; ++j) {
+            if (bytes[j >> 3] & (0x80 >> (j & 7))) {
+                ctxt->found[found++] = i * 64 + j;
+            }
+        }
+    }
+    return found;
+}
+
+int signature_delete(pyrebloomsignature * ctxt) {
+    delete(&ctxt->filter);
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s %s", ctxt->meta_key,
+        ctxt->members_key));
+    signature_forget(ctxt);
+    return PYREBLOOM_OK;
+}
@@ -0,0 +1,92 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef PYRE_SIGNATURE_H
+#define PYRE_SIGNATURE_H
+
+#include "bloom.h"
+
+/* A bit-sliced signature index holds many bloom filters of the same shape,
+ * one for each of up to `slots` members, stored transposed: for each bit of
+ * the filters there's a row with that bit of every member's filter, one bit
+ * per member. Finding which members have an item then means reading just
+ * the item's `hashes` rows and ANDing them together, rather than checking
+ * every member's filter in turn.
+ *
+ * The rows are kept one after another in the segments `<key>.0`, `<key>.1`,
+ * ... the index is described by `<key>.meta`, and the names of the members
+ * are mapped to their slots in `<key>.members`. */
+typedef struct {
+    uint64_t        capacity;
+    double          error;
+    uint32_t        slots;
+    uint32_t        hash_family;
+    /* How many BITFIELD commands adding an item needs; one, unless the rows
+     * are spread across more than one segment */
+    uint32_t        per_item;
+    char          * key;
+    char          * meta_key;
+    char          * members_key;
+    /* Scratch space for building BITFIELD commands */
+    char          * args;
+    const char   ** argv;
+    size_t        * argvlen;
+    /* The AND of the rows of the last item checked, and the slots of the
+     * members that have it */
+    uint64_t      * result;
+    uint32_t      * found;
+    /* The names of the members in each slot, as last read */
+    char         ** names;
+    /* Each row is described as though it were a bit of a filter */
+    pyrebloomctxt   filter;
+    redisContext  * ctxt;
+} pyrebloomsignature;
+
+int init_signature(pyrebloomsignature * ctxt, char * key, uint64_t capacity,
+    double error, uint32_t slots, char * host, uint32_t port,
+    char * password, uint32_t db, uint32_t hash_family);
+int free_signature(pyrebloomsignature * ctxt);
+
+/* The slot of the named member, giving it the next free one if it's new */
+int signature_member(pyrebloomsignature * ctxt, const char * name,
+    uint32_t len);
+/* The name of the member in a slot, or NULL if it has none */
+const char * signature_name(pyrebloomsignature * ctxt, uint32_t slot);
+
+/* Add an item to the filter of the member in `slot`. These are pipelined,
+ * and signature_add_complete returns how many of them were new. */
+int signature_add(pyrebloomsignature * ctxt, uint32_t slot,
+    const char * data, uint32_t len);
+int64_t signature_add_complete(pyrebloomsignature * ctxt, uint32_t count);
+
+/* Checks are pipelined too. signature_check_next returns how many members
+ * have each item in turn, and leaves their slots in ctxt->found. */
+int signature_check(pyrebloomsignature * ctxt, const char * data,
+    uint32_t len);
+int signature_check_next(pyrebloomsignature * ctxt);
+
+int signature_delete(pyrebloomsignature * ctxt);
+
+#endif
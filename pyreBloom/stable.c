@@ -0,0 +1,329 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "stable.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* The version of the metadata layout for stable filters */
+static const uint32_t stable_version = 1;
+
+/* Load the description of a stable filter, or record it if it's new. A first
+ * segment without any metadata belongs to an ordinary filter that predates
+ * metadata, and mustn't be mistaken for cells.
+ *
+ *     KEYS = { metadata key, first segment key }
+ *     ARGV = { capacity, error, width, decrements, hash family, version }
+ *
+ * It replies with the recorded capacity, error, width, decrements and hash
+ * family. */
+static const char * stable_init_script =
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'stable' then\n"
+    "    return redis.call('HMGET', KEYS[1], 'capacity', 'error', 'width',\n"
+    "        'decrements', 'hash')\n"
+    "elseif redis.call('EXISTS', KEYS[1], KEYS[2]) > 0 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "elseif ARGV[1] == '0' then\n"
+    "    return redis.error_reply('No metadata for ' .. KEYS[1] ..\n"
+    "        '; capacity and error are required')\n"
+    "end\n"
+    "redis.call('HMSET', KEYS[1], 'type', 'stable', 'capacity', ARGV[1],\n"
+    "    'error', ARGV[2], 'width', ARGV[3], 'decrements', ARGV[4],\n"
+    "    'hash', ARGV[5], 'version', ARGV[6])\n"
+    "return {ARGV[1], ARGV[2], ARGV[3], ARGV[4], ARGV[5]}";
+
+/* The number of cells to count down for each item added, so that the false
+ * positive rate settles at `error`. From Deng and Rafiei, the fraction of
+ * cells that are zero settles at (1 / (1 + 1 / (P (1 / k - 1 / m)))) ^ max,
+ * and an item is a false positive when none of its k cells are zero. */
+static uint32_t stable_decrements(
+    uint64_t cells, uint32_t hashes, uint32_t width, double error) {
+    double largest = (double)((1 << width) - 1);
+    double decrements = 1.0 / (
+        (pow(1.0 / (1.0 - pow(error, 1.0 / hashes)), 1.0 / largest) - 1.0) *
+        (1.0 / hashes - 1.0 / cells));
+    if (!(decrements >= 1)) {
+        return 1;
+    } else if (decrements > cells) {
+        return (uint32_t)(cells);
+    }
+    return (uint32_t)(ceil(decrements));
+}
+
+int init_stable(pyrebloomstable * ctxt, char * key, uint64_t capacity,
+    double error, uint32_t width, char * host, uint32_t port,
+    char * password, uint32_t db, uint32_t hash_family) {
+    redisReply * reply = NULL;
+    struct timeval now;
+    uint32_t args, decrements = 0, hashes;
+    uint64_t bits;
+
+    ctxt->key      = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    /* This has to be caught before it's recorded for everyone else */
+    if (capacity != 0 && (width < 1 || width > 16)) {
+        strncpy(ctxt->ctxt->errstr, "Cells must be 1 to 16 bits wide",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    if (capacity != 0) {
+        bits = (uint64_t)(-(log(error) * capacity) / (log(2) * log(2)));
+        hashes = (uint32_t)(ceil(log(2) * bits / capacity));
+        decrements = stable_decrements(bits, hashes, width, error);
+    }
+    redisAppendCommand(ctxt->ctxt, "EVAL %s 2 %s %s.0 %lu %.17g %u %u %u %u",
+        stable_init_script, ctxt->meta_key, key, capacity, error, width,
+        decrements, hash_family, stable_version);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 5) {
+        strncpy(ctxt->ctxt->errstr, "Malformed filter metadata", errstr_size);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->capacity    = strtoull(reply->element[0]->str, NULL, 10);
+    ctxt->error       = strtod(reply->element[1]->str, NULL);
+    ctxt->width       = (uint32_t)(strtoul(reply->element[2]->str, NULL, 10));
+    ctxt->decrements  = (uint32_t)(strtoul(reply->element[3]->str, NULL, 10));
+    ctxt->hash_family = (uint32_t)(strtoul(reply->element[4]->str, NULL, 10));
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT || ctxt->capacity == 0 ||
+        ctxt->error <= 0 || ctxt->error >= 1 ||
+        ctxt->width < 1 || ctxt->width > 16 || ctxt->decrements == 0) {
+        strncpy(ctxt->ctxt->errstr, "Unsupported filter metadata",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+
+    attach_pyrebloom(&ctxt->filter, ctxt->ctxt, key, ctxt->capacity,
+        ctxt->error, ctxt->hash_family, max_bits_per_key / ctxt->width);
+    if (ctxt->decrements > ctxt->filter.bits) {
+        ctxt->decrements = (uint32_t)(ctxt->filter.bits);
+    }
+    snprintf(ctxt->type, sizeof(ctxt->type), "u%u", ctxt->width);
+    snprintf(ctxt->largest, sizeof(ctxt->largest), "%u",
+        (1u << ctxt->width) - 1);
+    ctxt->per_item = (ctxt->filter.num_keys == 1) ? 1 : ctxt->filter.hashes;
+
+    /* Different clients shouldn't count down the same runs of cells */
+    gettimeofday(&now, NULL);
+    ctxt->random = ((uint64_t)(now.tv_sec) * 1000000 + now.tv_usec) ^
+        ((uint64_t)(getpid()) << 32) ^ (uint64_t)(uintptr_t)(ctxt);
+    if (ctxt->random == 0) {
+        ctxt->random = 1;
+    }
+
+    /* BITFIELD key OVERFLOW SAT, INCRBY type offset -1 for each cell counted
+     * down and SET type offset largest for each of the hashes */
+    args = 4 + 4 * (ctxt->decrements + ctxt->filter.hashes);
+    ctxt->args    = (char *)(malloc(
+        (ctxt->decrements + ctxt->filter.hashes) * 24));
+    ctxt->argv    = (const char **)(malloc(args * sizeof(char *)));
+    ctxt->argvlen = (size_t *)(malloc(args * sizeof(size_t)));
+    return PYREBLOOM_OK;
+}
+
+int free_stable(pyrebloomstable * ctxt) {
+    /* The connection is ours, not the filter's */
+    ctxt->filter.ctxt = NULL;
+    free_pyrebloom(&ctxt->filter);
+    free(ctxt->args);
+    free(ctxt->argv);
+    free(ctxt->argvlen);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    redisFree(ctxt->ctxt);
+    return PYREBLOOM_OK;
+}
+
+/* Send the command that's been built up in argv */
+static void stable_send(pyrebloomstable * ctxt, uint32_t argc) {
+    uint32_t i;
+    for (i = 0; i < argc; ++i) {
+        ctxt->argvlen[i] = strlen(ctxt->argv[i]);
+    }
+    redisAppendCommandArgv(ctxt->ctxt, argc, ctxt->argv, ctxt->argvlen);
+}
+
+/* Queue up the BITFIELD commands that touch each of an item's cells. When
+ * adding, a run of other cells in one segment is counted down first, in the
+ * same command as the item's cells if they're all in one segment, or else in
+ * a command of its own. */
+static void stable_append(
+    pyrebloomstable * ctxt, const char * data, uint32_t len, int adding) {
+    pyrebloomctxt * filter = &ctxt->filter;
+    uint32_t i, argc = 0;
+    hash_offsets(filter, data, len);
+
+    if (adding) {
+        uint64_t start, segment, length;
+        ctxt->random ^= ctxt->random >> 12;
+        ctxt->random ^= ctxt->random << 25;
+        ctxt->random ^= ctxt->random >> 27;
+        start   = (ctxt->random * 2685821657736338717ULL) % filter->bits;
+        segment = start / filter->segment_bits;
+        length  = filter->bits - segment * filter->segment_bits;
+        if (length > filter->segment_bits) {
+            length = filter->segment_bits;
+        }
+        start %= filter->segment_bits;
+
+        ctxt->argv[argc++] = "BITFIELD";
+        ctxt->argv[argc++] = filter->keys[segment];
+        ctxt->argv[argc++] = "OVERFLOW";
+        ctxt->argv[argc++] = "SAT";
+        for (i = 0; i < ctxt->decrements; ++i) {
+            char * offset = ctxt->args + (filter->hashes + i) * 24;
+            snprintf(offset, 24, "#%lu", (start + i) % length);
+            ctxt->argv[argc++] = "INCRBY";
+            ctxt->argv[argc++] = ctxt->type;
+            ctxt->argv[argc++] = offset;
+            ctxt->argv[argc++] = "-1";
+        }
+        if (ctxt->per_item != 1) {
+            stable_send(ctxt, argc);
+            argc = 0;
+        }
+    }
+
+    for (i = 0; i < filter->hashes; ++i) {
+        uint64_t d = filter->offsets[i];
+        char * offset = ctxt->args + i * 24;
+        snprintf(offset, 24, "#%lu", d % filter->segment_bits);
+
+        if (argc == 0) {
+            ctxt->argv[argc++] = "BITFIELD";
+            ctxt->argv[argc++] = filter->keys[d / filter->segment_bits];
+        }
+        ctxt->argv[argc++] = adding ? "SET" : "GET";
+        ctxt->argv[argc++] = ctxt->type;
+        ctxt->argv[argc++] = offset;
+        if (adding) {
+            ctxt->argv[argc++] = ctxt->largest;
+        }
+
+        /* Cells in different segments need commands of their own */
+        if (ctxt->per_item != 1 || i + 1 == filter->hashes) {
+            stable_send(ctxt, argc);
+            argc = 0;
+        }
+    }
+}
+
+/* Read the replies for one item, finding the smallest of its cells as they
+ * were before it was added, or as they are now for a check */
+static int stable_next(
+    pyrebloomstable * ctxt, int adding, long long * smallest) {
+    uint32_t i, j, replies = ctxt->per_item, skip = 0;
+    int result = PYREBLOOM_OK;
+    redisReply * reply = NULL;
+    *smallest = -1;
+
+    /* The replies to the cells counted down come first */
+    if (adding) {
+        if (replies == 1) {
+            skip = ctxt->decrements;
+        } else {
+            replies += 1;
+        }
+    }
+    for (i = 0; i < replies; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+
+        if (reply->type == REDIS_REPLY_ERROR) {
+            strncpy(ctxt->ctxt->errstr, reply->str, errstr_size);
+            result = PYREBLOOM_ERROR;
+        } else if (reply->type == REDIS_REPLY_ARRAY &&
+            !(adding && replies > 1 && i == 0)) {
+            for (j = skip; j < reply->elements; ++j) {
+                long long value = reply->element[j]->integer;
+                if (*smallest < 0 || value < *smallest) {
+                    *smallest = value;
+                }
+            }
+        }
+        freeReplyObject(reply);
+    }
+    return result;
+}
+
+int stable_add(pyrebloomstable * ctxt, const char * data, uint32_t len) {
+    stable_append(ctxt, data, len, 1);
+    return PYREBLOOM_OK;
+}
+
+int64_t stable_add_complete(pyrebloomstable * ctxt, uint32_t count) {
+    uint32_t i, total = 0;
+    int failed = 0;
+    long long smallest;
+
+    for (i = 0; i < count; ++i) {
+        if (stable_next(ctxt, 1, &smallest) == PYREBLOOM_ERROR) {
+            failed = 1;
+        } else if (smallest == 0) {
+            /* One of its cells was empty, so the item is new */
+            total += 1;
+        }
+    }
+
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+    return total;
+}
+
+int stable_check(pyrebloomstable * ctxt, const char * data, uint32_t len) {
+    stable_append(ctxt, data, len, 0);
+    return PYREBLOOM_OK;
+}
+
+int stable_check_next(pyrebloomstable * ctxt) {
+    long long smallest;
+    if (stable_next(ctxt, 0, &smallest) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    return smallest > 0;
+}
+
+int stable_delete(pyrebloomstable * ctxt) {
+    delete(&ctxt->filter);
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->meta_key));
+    return PYREBLOOM_OK;
+}
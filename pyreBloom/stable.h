@@ -0,0 +1,82 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef PYRE_STABLE_H
+#define PYRE_STABLE_H
+
+#include "bloom.h"
+
+/* A stable bloom filter never fills up. Like a counting filter it keeps a
+ * small counter, `width` bits wide, for each of its cells, and adding an item
+ * sets each of its cells to the largest value a counter can hold. But first,
+ * `decrements` other cells are counted down by one, so that items that
+ * haven't been seen in a while gradually fade away. However long the stream
+ * of items, the false positive rate settles at `error`, in exchange for
+ * forgetting (and so failing to find) items that were added long ago.
+ *
+ * It has as many cells as an ordinary filter of `capacity` has bits, in the
+ * segments `<key>.0`, `<key>.1`, ... and is described by `<key>.meta`. The
+ * cells counted down for each item are a run starting from a random one, as
+ * suggested by Deng and Rafiei, so that they can be written together. */
+typedef struct {
+    uint64_t        capacity;
+    double          error;
+    uint32_t        width;
+    uint32_t        decrements;
+    uint32_t        hash_family;
+    /* How many BITFIELD commands checking an item needs; one, unless the
+     * cells are spread across more than one segment, in which case adding an
+     * item needs another for its decrements */
+    uint32_t        per_item;
+    /* Where the next run of decrements starts */
+    uint64_t        random;
+    char            type[8];
+    char            largest[12];
+    char          * key;
+    char          * meta_key;
+    /* Scratch space for building BITFIELD commands */
+    char          * args;
+    const char   ** argv;
+    size_t        * argvlen;
+    /* The cells are described as though they were the bits of a filter */
+    pyrebloomctxt   filter;
+    redisContext  * ctxt;
+} pyrebloomstable;
+
+int init_stable(pyrebloomstable * ctxt, char * key, uint64_t capacity,
+    double error, uint32_t width, char * host, uint32_t port,
+    char * password, uint32_t db, uint32_t hash_family);
+int free_stable(pyrebloomstable * ctxt);
+
+/* Adds are pipelined just like those of an ordinary filter, and
+ * stable_add_complete returns how many of the items were new */
+int stable_add(pyrebloomstable * ctxt, const char * data, uint32_t len);
+int64_t stable_add_complete(pyrebloomstable * ctxt, uint32_t count);
+
+int stable_check(pyrebloomstable * ctxt, const char * data, uint32_t len);
+int stable_check_next(pyrebloomstable * ctxt);
+
+int stable_delete(pyrebloomstable * ctxt);
+
+#endif
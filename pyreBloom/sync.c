@@ -0,0 +1,319 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "sync.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* About how many bytes of a key are checksummed by each call to the script,
+ * so that neither side is blocked for long */
+static const uint64_t sync_call_bytes = 1 << 24;
+
+/* Checksum a run of pages of a string.
+ *
+ *     KEYS = { key }
+ *     ARGV = { first page, pages, page bytes }
+ *
+ * It replies with the SHA1 of each page, or an empty string for pages that
+ * are entirely zero or past the end of the string. */
+static const char * sync_checksum_script =
+    "local size = tonumber(ARGV[3])\n"
+    "local first = tonumber(ARGV[1])\n"
+    "local sums = {}\n"
+    "for i = 0, tonumber(ARGV[2]) - 1 do\n"
+    "    local start = (first + i) * size\n"
+    "    local page = redis.call('GETRANGE', KEYS[1], start, start + size - 1)\n"
+    "    if string.find(page, '[^%z]') then\n"
+    "        sums[i + 1] = redis.sha1hex(page)\n"
+    "    else\n"
+    "        sums[i + 1] = ''\n"
+    "    end\n"
+    "end\n"
+    "return sums";
+
+/* Either side's errors are reported in the source's context */
+static void sync_error(pyrebloomsync * ctxt, const char * message) {
+    if (message != ctxt->source->errstr) {
+        strncpy(ctxt->source->errstr, message, errstr_size);
+    }
+}
+
+/* Read the next reply from one side, or record why there isn't a usable one.
+ * Either way, the next reply can be read afterwards. */
+static redisReply * sync_reply(pyrebloomsync * ctxt, redisContext * redis) {
+    redisReply * reply = NULL;
+    if (redisGetReply(redis, (void**)(&reply)) == REDIS_ERR) {
+        sync_error(ctxt, redis->errstr);
+        return NULL;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        sync_error(ctxt, reply->str);
+        freeReplyObject(reply);
+        return NULL;
+    }
+    return reply;
+}
+
+/* Remove a key from the replica */
+static int sync_delete(pyrebloomsync * ctxt, const char * key) {
+    redisReply * reply = NULL;
+    redisAppendCommand(ctxt->replica, "DEL %s", key);
+    reply = sync_reply(ctxt, ctxt->replica);
+    if (reply == NULL) {
+        return PYREBLOOM_ERROR;
+    }
+    freeReplyObject(reply);
+    return PYREBLOOM_OK;
+}
+
+/* Read the length of a key from each side */
+static int sync_lengths(pyrebloomsync * ctxt, const char * key,
+    uint64_t * length, uint64_t * replica_length) {
+    redisReply * source = NULL, * replica = NULL;
+    int result = PYREBLOOM_ERROR;
+    redisAppendCommand(ctxt->source, "STRLEN %s", key);
+    redisAppendCommand(ctxt->replica, "STRLEN %s", key);
+    source = sync_reply(ctxt, ctxt->source);
+    replica = sync_reply(ctxt, ctxt->replica);
+    if (source != NULL && replica != NULL) {
+        *length = (uint64_t)(source->integer);
+        *replica_length = (uint64_t)(replica->integer);
+        result = PYREBLOOM_OK;
+    }
+    freeReplyObject(source);
+    freeReplyObject(replica);
+    return result;
+}
+
+/* Send the pages of a string whose checksums differ between the two sides */
+static int64_t sync_string(pyrebloomsync * ctxt, const char * key) {
+    redisReply * source = NULL, * replica = NULL, * reply = NULL;
+    uint64_t length, replica_length, pages, page, start;
+    uint32_t i, count, changed, written;
+    uint32_t * pending = NULL;
+    int64_t sent = 0;
+    int failed = 0;
+
+    if (sync_lengths(ctxt, key, &length, &replica_length) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    /* SETRANGE can't shorten a string, so a longer replica starts over */
+    if (replica_length > length) {
+        if (sync_delete(ctxt, key) == PYREBLOOM_ERROR) {
+            return PYREBLOOM_ERROR;
+        }
+        replica_length = 0;
+    }
+
+    pages = (length + ctxt->page_bytes - 1) / ctxt->page_bytes;
+    pending = (uint32_t *)(malloc(ctxt->pages_per_call * sizeof(uint32_t)));
+    for (page = 0; page < pages && !failed; page += count) {
+        count = (pages - page < ctxt->pages_per_call) ?
+            (uint32_t)(pages - page) : ctxt->pages_per_call;
+        redisAppendCommand(ctxt->source, "EVALSHA %s 1 %s %lu %u %u",
+            ctxt->checksum_sha, key, page, count, ctxt->page_bytes);
+        redisAppendCommand(ctxt->replica, "EVALSHA %s 1 %s %lu %u %u",
+            ctxt->checksum_sha, key, page, count, ctxt->page_bytes);
+        source = sync_reply(ctxt, ctxt->source);
+        replica = sync_reply(ctxt, ctxt->replica);
+        if (source == NULL || replica == NULL ||
+            source->type != REDIS_REPLY_ARRAY || source->elements != count ||
+            replica->type != REDIS_REPLY_ARRAY || replica->elements != count) {
+            if (source != NULL && replica != NULL) {
+                sync_error(ctxt, "Malformed page checksums");
+            }
+            freeReplyObject(source);
+            freeReplyObject(replica);
+            failed = 1;
+            break;
+        }
+        for (i = 0, changed = 0; i < count; ++i) {
+            if (source->element[i]->len != replica->element[i]->len ||
+                memcmp(source->element[i]->str, replica->element[i]->str,
+                    source->element[i]->len) != 0) {
+                pending[changed++] = i;
+            }
+        }
+        freeReplyObject(source);
+        freeReplyObject(replica);
+        ctxt->pages_checked += count;
+
+        /* Read all of the changed pages, and then write them all */
+        for (i = 0; i < changed; ++i) {
+            start = (page + pending[i]) * ctxt->page_bytes;
+            redisAppendCommand(ctxt->source, "GETRANGE %s %lu %lu", key,
+                start, start + ctxt->page_bytes - 1);
+        }
+        for (i = 0, written = 0; i < changed; ++i) {
+            reply = sync_reply(ctxt, ctxt->source);
+            if (reply == NULL) {
+                failed = 1;
+                continue;
+            }
+            start = (page + pending[i]) * ctxt->page_bytes;
+            redisAppendCommand(ctxt->replica, "SETRANGE %s %lu %b", key, start,
+                reply->str, (size_t)(reply->len));
+            if (start + reply->len > replica_length) {
+                replica_length = start + reply->len;
+            }
+            ctxt->bytes_sent += reply->len;
+            ++written;
+            freeReplyObject(reply);
+        }
+        for (i = 0; i < written; ++i) {
+            reply = sync_reply(ctxt, ctxt->replica);
+            failed = failed || reply == NULL;
+            freeReplyObject(reply);
+        }
+        ctxt->pages_sent += written;
+        sent += written;
+    }
+    free(pending);
+
+    /* Zero pages at the end weren't sent, but the lengths should still agree,
+     * and the last byte of the source is then a zero */
+    if (!failed && replica_length < length) {
+        redisAppendCommand(ctxt->replica, "SETRANGE %s %lu %b", key,
+            length - 1, "", (size_t)(1));
+        reply = sync_reply(ctxt, ctxt->replica);
+        failed = reply == NULL;
+        freeReplyObject(reply);
+    }
+    return failed ? PYREBLOOM_ERROR : sent;
+}
+
+/* Copy a key that isn't a string in one piece, if it differs */
+static int64_t sync_whole(pyrebloomsync * ctxt, const char * key) {
+    redisReply * source = NULL, * replica = NULL, * reply = NULL;
+    int64_t sent = PYREBLOOM_ERROR;
+    redisAppendCommand(ctxt->source, "DUMP %s", key);
+    redisAppendCommand(ctxt->replica, "DUMP %s", key);
+    source = sync_reply(ctxt, ctxt->source);
+    replica = sync_reply(ctxt, ctxt->replica);
+    if (source == NULL || replica == NULL) {
+        sent = PYREBLOOM_ERROR;
+    } else if (source->type != REDIS_REPLY_STRING) {
+        /* It's gone since we looked */
+        sent = sync_delete(ctxt, key) == PYREBLOOM_ERROR ?
+            PYREBLOOM_ERROR : 0;
+    } else if (replica->type == REDIS_REPLY_STRING &&
+        replica->len == source->len &&
+        memcmp(replica->str, source->str, source->len) == 0) {
+        sent = 0;
+    } else {
+        redisAppendCommand(ctxt->replica, "RESTORE %s 0 %b REPLACE", key,
+            source->str, (size_t)(source->len));
+        reply = sync_reply(ctxt, ctxt->replica);
+        if (reply != NULL) {
+            ctxt->pages_sent += 1;
+            ctxt->bytes_sent += source->len;
+            sent = 1;
+        }
+        freeReplyObject(reply);
+    }
+    freeReplyObject(source);
+    freeReplyObject(replica);
+    return sent;
+}
+
+int init_sync(pyrebloomsync * ctxt, char * host, uint32_t port,
+    char * password, uint32_t db, char * replica_host, uint32_t replica_port,
+    char * replica_password, uint32_t replica_db, uint32_t page_bytes) {
+    redisReply * reply = NULL;
+    ctxt->page_bytes     = page_bytes;
+    ctxt->pages_per_call = (page_bytes == 0 || page_bytes > sync_call_bytes) ?
+        1 : (uint32_t)(sync_call_bytes / page_bytes);
+    ctxt->pages_checked  = 0;
+    ctxt->pages_sent     = 0;
+    ctxt->bytes_sent     = 0;
+
+    /* Both handshakes, each loading the checksum script, are under way
+     * before either is read. The script is the same on both sides, and so
+     * is its SHA1. */
+    if (begin_handshake(&ctxt->source, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->source, "SCRIPT LOAD %s", sync_checksum_script);
+    if (begin_handshake(&ctxt->replica, replica_host, replica_port,
+        replica_password, replica_db) == PYREBLOOM_ERROR) {
+        sync_error(ctxt, ctxt->replica->errstr);
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->replica, "SCRIPT LOAD %s", sync_checksum_script);
+    if (finish_handshake(ctxt->source, 2, &reply) == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+    snprintf(ctxt->checksum_sha, sizeof(ctxt->checksum_sha), "%s",
+        reply->type == REDIS_REPLY_STRING ? reply->str : "");
+    freeReplyObject(reply);
+    if (finish_handshake(ctxt->replica, 2, &reply) == PYREBLOOM_ERROR) {
+        sync_error(ctxt, ctxt->replica->errstr);
+        return PYREBLOOM_ERROR;
+    }
+    freeReplyObject(reply);
+
+    if (page_bytes == 0) {
+        sync_error(ctxt, "Pages must be at least one byte");
+        return PYREBLOOM_ERROR;
+    }
+    return PYREBLOOM_OK;
+}
+
+int free_sync(pyrebloomsync * ctxt) {
+    redisFree(ctxt->source);
+    redisFree(ctxt->replica);
+    return PYREBLOOM_OK;
+}
+
+int64_t sync_key(pyrebloomsync * ctxt, const char * key) {
+    redisReply * source = NULL, * replica = NULL;
+    int64_t sent = PYREBLOOM_ERROR;
+
+    /* What each side has under this key */
+    redisAppendCommand(ctxt->source, "TYPE %s", key);
+    redisAppendCommand(ctxt->replica, "TYPE %s", key);
+    source = sync_reply(ctxt, ctxt->source);
+    replica = sync_reply(ctxt, ctxt->replica);
+    if (source == NULL || replica == NULL) {
+        sent = PYREBLOOM_ERROR;
+    } else if (strcmp(source->str, "none") == 0) {
+        sent = (strcmp(replica->str, "none") == 0 ||
+            sync_delete(ctxt, key) == PYREBLOOM_OK) ?
+            0 : PYREBLOOM_ERROR;
+    } else if (strcmp(source->str, "string") != 0) {
+        sent = sync_whole(ctxt, key);
+    } else if (strcmp(replica->str, "string") != 0 &&
+        strcmp(replica->str, "none") != 0 &&
+        sync_delete(ctxt, key) == PYREBLOOM_ERROR) {
+        /* Something else under this key on the replica is replaced */
+        sent = PYREBLOOM_ERROR;
+    } else {
+        sent = sync_string(ctxt, key);
+    }
+    freeReplyObject(source);
+    freeReplyObject(replica);
+    return sent;
+}
@@ -0,0 +1,67 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef PYRE_SYNC_H
+#define PYRE_SYNC_H
+
+#include "bloom.h"
+
+/* Keeps copies of filters on a replica in step with the source, sending only
+ * what has changed. Each string key is compared a page of `page_bytes` at a
+ * time: a script on each side replies with a checksum for every page, and
+ * only the pages whose checksums differ are read from the source and written
+ * to the replica with SETRANGE. Pages that are entirely zero have no
+ * checksum, so they're never sent to a replica that's missing them.
+ *
+ * Nothing is kept between syncs, since the replica's own pages are the
+ * baseline, and so a replica that's fallen behind, drifted or been emptied
+ * is simply brought back in step. Keys that aren't strings (metadata,
+ * sets of offsets) are small, and are copied whole with DUMP and RESTORE,
+ * and keys missing from the source are deleted from the replica. */
+typedef struct {
+    uint32_t        page_bytes;
+    /* How many pages are checksummed by each call to the script */
+    uint32_t        pages_per_call;
+    /* The checksum script, which both sides load when we connect */
+    char            checksum_sha[48];
+    /* Running totals for every key synced on this context */
+    uint64_t        pages_checked;
+    uint64_t        pages_sent;
+    uint64_t        bytes_sent;
+    /* Errors from either side are reported in source->errstr */
+    redisContext  * source;
+    redisContext  * replica;
+} pyrebloomsync;
+
+int init_sync(pyrebloomsync * ctxt, char * host, uint32_t port,
+    char * password, uint32_t db, char * replica_host, uint32_t replica_port,
+    char * replica_password, uint32_t replica_db, uint32_t page_bytes);
+int free_sync(pyrebloomsync * ctxt);
+
+/* Bring one key on the replica up to date with the source, returning how
+ * many pages (or whole keys) were sent */
+int64_t sync_key(pyrebloomsync * ctxt, const char * key);
+
+#endif
@@ -0,0 +1,86 @@
+/* wyhash (final version 4) implementation taken from:
+ *
+ *    https://github.com/wangyi-fudan/wyhash
+ *
+ * which is released into the public domain (The Unlicense). Only the 64-bit
+ * hash with the default secret is included. */
+
+#include <stdint.h>
+#include <string.h>
+
+static const uint64_t wyhash_secret[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL };
+
+static inline void wyhash_mum(uint64_t * a, uint64_t * b) {
+    __uint128_t r = (__uint128_t)(*a) * (*b);
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t wyhash_mix(uint64_t a, uint64_t b) {
+    wyhash_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t wyhash_r8(const unsigned char * p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t wyhash_r4(const unsigned char * p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t wyhash_r3(const unsigned char * p, uint32_t k) {
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t wyhash(const void * key, uint32_t len, uint64_t seed) {
+    const unsigned char * p = (const unsigned char *)key;
+    const uint64_t * s = wyhash_secret;
+    uint64_t a, b;
+
+    seed ^= wyhash_mix(seed ^ s[0], s[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wyhash_r4(p) << 32) | wyhash_r4(p + ((len >> 3) << 2));
+            b = (wyhash_r4(p + len - 4) << 32) |
+                wyhash_r4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = wyhash_r3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        uint32_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wyhash_mix(wyhash_r8(p) ^ s[1], wyhash_r8(p + 8) ^ seed);
+                see1 = wyhash_mix(wyhash_r8(p + 16) ^ s[2],
+                    wyhash_r8(p + 24) ^ see1);
+                see2 = wyhash_mix(wyhash_r8(p + 32) ^ s[3],
+                    wyhash_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wyhash_mix(wyhash_r8(p) ^ s[1], wyhash_r8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyhash_r8(p + i - 16);
+        b = wyhash_r8(p + i - 8);
+    }
+    a ^= s[1];
+    b ^= seed;
+    wyhash_mum(&a, &b);
+    return wyhash_mix(a ^ s[0] ^ len, b ^ s[1]);
+}
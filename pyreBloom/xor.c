@@ -0,0 +1,668 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "xor.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The version of the metadata layout for xor filters, and of local files */
+static const uint32_t xor_version = 1;
+
+/* The seed of the hash that's computed once for each item, before it's mixed
+ * with the seed of a particular attempt at building the filter */
+static const uint64_t xor_item_seed = 314159265;
+
+/* Building a filter fails now and then, in which case it's tried again with
+ * another seed. Failing this many times means something's very wrong. */
+static const uint32_t xor_attempts = 100;
+
+/* How many fingerprint bytes go in each SETRANGE, and how many SETRANGEs are
+ * pipelined before their replies are read */
+static const uint64_t xor_chunk = 1 << 20;
+static const uint32_t xor_pipeline = 16;
+
+/* What a local file starts with. Fields are in host byte order. */
+typedef struct {
+    char            magic[8];
+    uint32_t        version;
+    uint32_t        fingerprint_bits;
+    uint32_t        hash_family;
+    uint32_t        reserved;
+    uint64_t        size;
+    uint64_t        block_length;
+    uint64_t        seed;
+} xor_header;
+
+static const char xor_magic[8] = "pyrexor";
+
+/* Make way for a filter to be stored at a key, deleting any xor filter that
+ * was there before. Anything else that was there is left alone.
+ *
+ *     KEYS = { metadata key, first segment key }
+ *     ARGV = { key } */
+static const char * xor_store_script =
+    "local kind = redis.call('HGET', KEYS[1], 'type')\n"
+    "if kind == 'xor' then\n"
+    "    local segments = redis.call('HGET', KEYS[1], 'segments')\n"
+    "    for i = 0, tonumber(segments) - 1 do\n"
+    "        redis.call('DEL', ARGV[1] .. '.' .. i)\n"
+    "    end\n"
+    "    redis.call('DEL', KEYS[1])\n"
+    "elseif redis.call('EXISTS', KEYS[1], KEYS[2]) > 0 then\n"
+    "    return redis.error_reply(KEYS[1] .. ' describes a ' ..\n"
+    "        (kind or 'bloom'))\n"
+    "end\n"
+    "return 0";
+
+static uint64_t xor_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t xor_rotl(uint64_t h, uint32_t r) {
+    return (h << r) | (h >> (64 - r));
+}
+
+/* Map 32 bits of a hash onto [0, n) without a division */
+static uint64_t xor_reduce(uint32_t h, uint64_t n) {
+    return ((uint64_t)(h) * n) >> 32;
+}
+
+/* The three fingerprints that an item's fingerprint is the xor of, one from
+ * each third of the filter */
+static void xor_positions(
+    const pyrebloomxor * ctxt, uint64_t hash, uint64_t * positions) {
+    uint64_t length = ctxt->block_length;
+    positions[0] = xor_reduce((uint32_t)(hash), length);
+    positions[1] = xor_reduce((uint32_t)(xor_rotl(hash, 21)), length) + length;
+    positions[2] = xor_reduce((uint32_t)(xor_rotl(hash, 42)), length) +
+        2 * length;
+}
+
+static uint32_t xor_fingerprint(const pyrebloomxor * ctxt, uint64_t hash) {
+    uint64_t fingerprint = hash ^ (hash >> 32);
+    if (ctxt->fingerprint_bits < 32) {
+        fingerprint &= (1ULL << ctxt->fingerprint_bits) - 1;
+    }
+    return (uint32_t)(fingerprint);
+}
+
+static uint64_t xor_hash(
+    const pyrebloomxor * ctxt, const char * data, uint32_t len) {
+    return xor_mix(
+        hash_item(ctxt->hash_family, data, len, xor_item_seed) + ctxt->seed);
+}
+
+static uint32_t xor_get(const pyrebloomxor * ctxt, uint64_t i) {
+    switch (ctxt->fingerprint_bits) {
+    case 8:
+        return ((const uint8_t *)(ctxt->fingerprints))[i];
+    case 16:
+        return ((const uint16_t *)(ctxt->fingerprints))[i];
+    default:
+        return ((const uint32_t *)(ctxt->fingerprints))[i];
+    }
+}
+
+static void xor_set(pyrebloomxor * ctxt, uint64_t i, uint32_t value) {
+    switch (ctxt->fingerprint_bits) {
+    case 8:
+        ((uint8_t *)(ctxt->fingerprints))[i] = (uint8_t)(value);
+        break;
+    case 16:
+        ((uint16_t *)(ctxt->fingerprints))[i] = (uint16_t)(value);
+        break;
+    default:
+        ((uint32_t *)(ctxt->fingerprints))[i] = value;
+    }
+}
+
+/* How many fingerprints there are in all */
+static uint64_t xor_entries(const pyrebloomxor * ctxt) {
+    return 3 * ctxt->block_length;
+}
+
+/* Hashing the items is most of the work of building a filter, and is split
+ * between threads */
+typedef struct {
+    const char     ** items;
+    const uint32_t  * lengths;
+    uint64_t        * hashes;
+    uint64_t          start;
+    uint64_t          end;
+    uint32_t          hash_family;
+} xor_job;
+
+static void * xor_hash_job(void * arg) {
+    xor_job * job = (xor_job *)(arg);
+    uint64_t i;
+    for (i = job->start; i < job->end; ++i) {
+        job->hashes[i] = hash_item(job->hash_family, job->items[i],
+            job->lengths[i], xor_item_seed);
+    }
+    return NULL;
+}
+
+static int xor_compare(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *)(a), y = *(const uint64_t *)(b);
+    return (x > y) - (x < y);
+}
+
+/* Try to build the filter with the current seed. Positions that only one
+ * remaining item maps to are peeled off one at a time, and then assigned
+ * fingerprints in the reverse order, each of which is the last of its item's
+ * three to be decided. */
+static int xor_peel(pyrebloomxor * ctxt, const uint64_t * hashes,
+    uint64_t * masks, uint32_t * counts, uint64_t * queue,
+    uint64_t * stack_hashes, uint64_t * stack_positions) {
+    uint64_t entries = xor_entries(ctxt), positions[3];
+    uint64_t i, j, queued = 0, stacked = 0;
+
+    memset(masks, 0, entries * sizeof(uint64_t));
+    memset(counts, 0, entries * sizeof(uint32_t));
+    for (i = 0; i < ctxt->size; ++i) {
+        uint64_t hash = xor_mix(hashes[i] + ctxt->seed);
+        xor_positions(ctxt, hash, positions);
+        for (j = 0; j < 3; ++j) {
+            masks[positions[j]] ^= hash;
+            counts[positions[j]] += 1;
+        }
+    }
+
+    for (i = 0; i < entries; ++i) {
+        if (counts[i] == 1) {
+            queue[queued++] = i;
+        }
+    }
+    while (queued > 0) {
+        uint64_t position = queue[--queued], hash;
+        if (counts[position] != 1) {
+            continue;
+        }
+        hash = masks[position];
+        stack_hashes[stacked] = hash;
+        stack_positions[stacked++] = position;
+        xor_positions(ctxt, hash, positions);
+        for (j = 0; j < 3; ++j) {
+            masks[positions[j]] ^= hash;
+            counts[positions[j]] -= 1;
+            if (counts[positions[j]] == 1) {
+                queue[queued++] = positions[j];
+            }
+        }
+    }
+    if (stacked != ctxt->size) {
+        return PYREBLOOM_ERROR;
+    }
+
+    memset(ctxt->fingerprints, 0, entries * ctxt->fingerprint_bits / 8);
+    while (stacked > 0) {
+        uint64_t hash = stack_hashes[--stacked];
+        uint32_t fingerprint = xor_fingerprint(ctxt, hash);
+        xor_positions(ctxt, hash, positions);
+        for (j = 0; j < 3; ++j) {
+            if (positions[j] != stack_positions[stacked]) {
+                fingerprint ^= xor_get(ctxt, positions[j]);
+            }
+        }
+        xor_set(ctxt, stack_positions[stacked], fingerprint);
+    }
+    return PYREBLOOM_OK;
+}
+
+int xor_build(pyrebloomxor * ctxt, const char ** items,
+    const uint32_t * lengths, uint64_t count, double error, uint32_t threads,
+    uint32_t hash_family) {
+    uint64_t * hashes, * masks, * queue, * stack_hashes, * stack_positions;
+    uint64_t i, unique, entries;
+    uint32_t * counts, attempt;
+    int result = PYREBLOOM_ERROR;
+
+    if (hash_family >= PYREBLOOM_HASH_COUNT) {
+        strncpy(ctxt->errstr, "Unknown hash family", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->hash_family = hash_family;
+
+    /* The chance of a false positive is 2 ^ -bits */
+    if (error >= 1.0 / 256) {
+        ctxt->fingerprint_bits = 8;
+    } else if (error >= 1.0 / 65536) {
+        ctxt->fingerprint_bits = 16;
+    } else {
+        ctxt->fingerprint_bits = 32;
+    }
+
+    /* Hash the items in parallel */
+    hashes = (uint64_t *)(malloc((count ? count : 1) * sizeof(uint64_t)));
+    if (threads == 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (processors > 0) ? (uint32_t)(processors) : 1;
+    }
+    if (threads > count / 1024 + 1) {
+        threads = (uint32_t)(count / 1024 + 1);
+    }
+    {
+        pthread_t * workers = (pthread_t *)(
+            malloc(threads * sizeof(pthread_t)));
+        xor_job * jobs = (xor_job *)(malloc(threads * sizeof(xor_job)));
+        char * started = (char *)(calloc(threads, 1));
+        for (i = 0; i < threads; ++i) {
+            jobs[i].items       = items;
+            jobs[i].lengths     = lengths;
+            jobs[i].hashes      = hashes;
+            jobs[i].start       = count * i / threads;
+            jobs[i].end         = count * (i + 1) / threads;
+            jobs[i].hash_family = hash_family;
+            /* A worker that can't be started has its items hashed here */
+            if (i > 0) {
+                started[i] = (pthread_create(&workers[i], NULL, xor_hash_job,
+                    &jobs[i]) == 0);
+                if (!started[i]) {
+                    xor_hash_job(&jobs[i]);
+                }
+            }
+        }
+        xor_hash_job(&jobs[0]);
+        for (i = 1; i < threads; ++i) {
+            if (started[i]) {
+                pthread_join(workers[i], NULL);
+            }
+        }
+        free(workers);
+        free(jobs);
+        free(started);
+    }
+
+    /* The same item twice can never be peeled */
+    qsort(hashes, count, sizeof(uint64_t), xor_compare);
+    for (i = 0, unique = 0; i < count; ++i) {
+        if (unique == 0 || hashes[unique - 1] != hashes[i]) {
+            hashes[unique++] = hashes[i];
+        }
+    }
+
+    ctxt->size         = unique;
+    ctxt->block_length = ((uint64_t)(1.23 * unique) + 32) / 3;
+    entries            = xor_entries(ctxt);
+    free(ctxt->fingerprints);
+    ctxt->fingerprints = malloc(entries * ctxt->fingerprint_bits / 8);
+
+    masks           = (uint64_t *)(malloc(entries * sizeof(uint64_t)));
+    counts          = (uint32_t *)(malloc(entries * sizeof(uint32_t)));
+    queue           = (uint64_t *)(malloc(entries * sizeof(uint64_t)));
+    stack_hashes    = (uint64_t *)(malloc((unique + 1) * sizeof(uint64_t)));
+    stack_positions = (uint64_t *)(malloc((unique + 1) * sizeof(uint64_t)));
+
+    for (attempt = 0, ctxt->seed = 0; attempt < xor_attempts; ++attempt) {
+        ctxt->seed = xor_mix(ctxt->seed + 0x9e3779b97f4a7c15ULL);
+        if (xor_peel(ctxt, hashes, masks, counts, queue, stack_hashes,
+            stack_positions) == PYREBLOOM_OK) {
+            result = PYREBLOOM_OK;
+            break;
+        }
+    }
+    if (result == PYREBLOOM_ERROR) {
+        strncpy(ctxt->errstr, "Couldn't build the filter", errstr_size);
+    }
+
+    free(hashes);
+    free(masks);
+    free(counts);
+    free(queue);
+    free(stack_hashes);
+    free(stack_positions);
+    return result;
+}
+
+/* Name the segments the filter's fingerprints are stored in */
+static void xor_name(pyrebloomxor * ctxt, const char * key) {
+    uint32_t i;
+    ctxt->key      = (char *)(malloc(strlen(key) + 1));
+    strcpy(ctxt->key, key);
+    ctxt->meta_key = (char *)(malloc(strlen(key) + 6));
+    snprintf(ctxt->meta_key, strlen(key) + 6, "%s.meta", key);
+
+    ctxt->segment_entries = max_bits_per_key / ctxt->fingerprint_bits;
+    ctxt->num_keys = (uint32_t)((xor_entries(ctxt) +
+        ctxt->segment_entries - 1) / ctxt->segment_entries);
+    ctxt->keys = (char **)(malloc(ctxt->num_keys * sizeof(char *)));
+    for (i = 0; i < ctxt->num_keys; ++i) {
+        size_t length = strlen(key) + 10;
+        ctxt->keys[i] = (char *)(malloc(length));
+        snprintf(ctxt->keys[i], length, "%s.%u", key, i);
+    }
+    ctxt->per_item = (ctxt->num_keys == 1) ? 1 : 3;
+    snprintf(ctxt->type, sizeof(ctxt->type), "u%u", ctxt->fingerprint_bits);
+}
+
+/* Read the replies to the commands that have been pipelined so far */
+static int xor_drain(pyrebloomxor * ctxt, uint32_t * pending, int result) {
+    redisReply * reply = NULL;
+    for (; *pending > 0; --(*pending)) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->errstr, ctxt->ctxt->errstr, errstr_size);
+            *pending = 0;
+            return PYREBLOOM_ERROR;
+        }
+        if (reply->type == REDIS_REPLY_ERROR && result == PYREBLOOM_OK) {
+            strncpy(ctxt->errstr, reply->str, errstr_size);
+            result = PYREBLOOM_ERROR;
+        }
+        freeReplyObject(reply);
+    }
+    return result;
+}
+
+int xor_store(pyrebloomxor * ctxt, char * key, char * host, uint32_t port,
+    char * password, uint32_t db) {
+    uint64_t entry, entries = xor_entries(ctxt), bytes = ctxt->fingerprint_bits / 8;
+    unsigned char * chunk;
+    uint32_t segment, pending = 2;
+    int result;
+
+    xor_name(ctxt, key);
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        strncpy(ctxt->errstr, ctxt->ctxt->errstr, errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->ctxt, "EVAL %s 2 %s %s.0 %s", xor_store_script,
+        ctxt->meta_key, key, key);
+    result = xor_drain(ctxt, &pending, PYREBLOOM_OK);
+    if (result == PYREBLOOM_ERROR) {
+        return PYREBLOOM_ERROR;
+    }
+
+    /* Fingerprints are stored most significant byte first, which is how
+     * BITFIELD reads them back */
+    chunk = (unsigned char *)(malloc(xor_chunk * bytes));
+    for (segment = 0; segment < ctxt->num_keys; ++segment) {
+        uint64_t first = (uint64_t)(segment) * ctxt->segment_entries;
+        uint64_t last = first + ctxt->segment_entries;
+        if (last > entries) {
+            last = entries;
+        }
+        for (entry = first; entry < last; entry += xor_chunk) {
+            uint64_t i, length = last - entry, b;
+            if (length > xor_chunk) {
+                length = xor_chunk;
+            }
+            for (i = 0; i < length; ++i) {
+                uint32_t fingerprint = xor_get(ctxt, entry + i);
+                for (b = 0; b < bytes; ++b) {
+                    chunk[i * bytes + b] = (unsigned char)(
+                        fingerprint >> (8 * (bytes - b - 1)));
+                }
+            }
+            redisAppendCommand(ctxt->ctxt, "SETRANGE %s %lu %b",
+                ctxt->keys[segment], (entry - first) * bytes, chunk,
+                (size_t)(length * bytes));
+            if (++pending == xor_pipeline) {
+                result = xor_drain(ctxt, &pending, result);
+            }
+        }
+    }
+    free(chunk);
+
+    /* Describe it last, so that it isn't opened before it's complete */
+    redisAppendCommand(ctxt->ctxt,
+        "HMSET %s type xor size %lu fingerprint_bits %u block_length %lu "
+        "seed %lu hash %u segment_entries %lu segments %u version %u",
+        ctxt->meta_key, ctxt->size, ctxt->fingerprint_bits,
+        ctxt->block_length, ctxt->seed, ctxt->hash_family,
+        ctxt->segment_entries, ctxt->num_keys, xor_version);
+    ++pending;
+    return xor_drain(ctxt, &pending, result);
+}
+
+int xor_save(pyrebloomxor * ctxt, const char * path) {
+    xor_header header;
+    size_t bytes = xor_entries(ctxt) * ctxt->fingerprint_bits / 8;
+    FILE * file;
+
+    if (ctxt->fingerprints == NULL) {
+        strncpy(ctxt->errstr, "Only filters in memory can be saved",
+            errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, xor_magic, sizeof(header.magic));
+    header.version          = xor_version;
+    header.fingerprint_bits = ctxt->fingerprint_bits;
+    header.hash_family      = ctxt->hash_family;
+    header.size             = ctxt->size;
+    header.block_length     = ctxt->block_length;
+    header.seed             = ctxt->seed;
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        snprintf(ctxt->errstr, errstr_size, "Couldn't open %s", path);
+        return PYREBLOOM_ERROR;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(ctxt->fingerprints, 1, bytes, file) != bytes) {
+        snprintf(ctxt->errstr, errstr_size, "Couldn't write %s", path);
+        fclose(file);
+        return PYREBLOOM_ERROR;
+    }
+    if (fclose(file) != 0) {
+        snprintf(ctxt->errstr, errstr_size, "Couldn't write %s", path);
+        return PYREBLOOM_ERROR;
+    }
+    return PYREBLOOM_OK;
+}
+
+int xor_load(pyrebloomxor * ctxt, const char * path) {
+    xor_header header;
+    size_t bytes;
+    FILE * file = fopen(path, "rb");
+    if (file == NULL) {
+        snprintf(ctxt->errstr, errstr_size, "Couldn't open %s", path);
+        return PYREBLOOM_ERROR;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, xor_magic, sizeof(header.magic)) != 0 ||
+        header.version != xor_version ||
+        header.hash_family >= PYREBLOOM_HASH_COUNT ||
+        (header.fingerprint_bits != 8 && header.fingerprint_bits != 16 &&
+         header.fingerprint_bits != 32)) {
+        snprintf(ctxt->errstr, errstr_size, "%s isn't an xor filter", path);
+        fclose(file);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->size             = header.size;
+    ctxt->fingerprint_bits = header.fingerprint_bits;
+    ctxt->hash_family      = header.hash_family;
+    ctxt->block_length     = header.block_length;
+    ctxt->seed             = header.seed;
+
+    bytes = xor_entries(ctxt) * ctxt->fingerprint_bits / 8;
+    free(ctxt->fingerprints);
+    ctxt->fingerprints = malloc(bytes);
+    if (fread(ctxt->fingerprints, 1, bytes, file) != bytes) {
+        snprintf(ctxt->errstr, errstr_size, "%s is truncated", path);
+        fclose(file);
+        return PYREBLOOM_ERROR;
+    }
+    fclose(file);
+    return PYREBLOOM_OK;
+}
+
+int init_xor(pyrebloomxor * ctxt, char * key, char * host, uint32_t port,
+    char * password, uint32_t db) {
+    redisReply * reply = NULL;
+    uint32_t i;
+
+    if (begin_handshake(&ctxt->ctxt, host, port, password, db) ==
+        PYREBLOOM_ERROR) {
+        strncpy(ctxt->errstr, ctxt->ctxt->errstr, errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    redisAppendCommand(ctxt->ctxt,
+        "HMGET %s.meta type size fingerprint_bits block_length seed hash", key);
+    if (finish_handshake(ctxt->ctxt, 2, &reply) == PYREBLOOM_ERROR) {
+        strncpy(ctxt->errstr, ctxt->ctxt->errstr, errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    for (i = 0; i < reply->elements; ++i) {
+        if (reply->element[i]->type != REDIS_REPLY_STRING) {
+            break;
+        }
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 6 ||
+        i != reply->elements || strcmp(reply->element[0]->str, "xor") != 0) {
+        snprintf(ctxt->errstr, errstr_size, "No xor filter at %s", key);
+        freeReplyObject(reply);
+        return PYREBLOOM_ERROR;
+    }
+    ctxt->size             = strtoull(reply->element[1]->str, NULL, 10);
+    ctxt->fingerprint_bits = (uint32_t)(
+        strtoul(reply->element[2]->str, NULL, 10));
+    ctxt->block_length     = strtoull(reply->element[3]->str, NULL, 10);
+    ctxt->seed             = strtoull(reply->element[4]->str, NULL, 10);
+    ctxt->hash_family      = (uint32_t)(
+        strtoul(reply->element[5]->str, NULL, 10));
+    freeReplyObject(reply);
+
+    if (ctxt->hash_family >= PYREBLOOM_HASH_COUNT ||
+        ctxt->block_length == 0 || (ctxt->fingerprint_bits != 8 &&
+        ctxt->fingerprint_bits != 16 && ctxt->fingerprint_bits != 32)) {
+        strncpy(ctxt->errstr, "Unsupported filter metadata", errstr_size);
+        return PYREBLOOM_ERROR;
+    }
+    xor_name(ctxt, key);
+    return PYREBLOOM_OK;
+}
+
+int free_xor(pyrebloomxor * ctxt) {
+    uint32_t i;
+    if (ctxt->keys) {
+        for (i = 0; i < ctxt->num_keys; ++i) {
+            free(ctxt->keys[i]);
+        }
+        free(ctxt->keys);
+    }
+    free(ctxt->fingerprints);
+    free(ctxt->pending);
+    free(ctxt->key);
+    free(ctxt->meta_key);
+    if (ctxt->ctxt) {
+        redisFree(ctxt->ctxt);
+    }
+    return PYREBLOOM_OK;
+}
+
+int xor_contains(pyrebloomxor * ctxt, const char * data, uint32_t len) {
+    uint64_t hash = xor_hash(ctxt, data, len), positions[3];
+    xor_positions(ctxt, hash, positions);
+    return xor_fingerprint(ctxt, hash) == (xor_get(ctxt, positions[0]) ^
+        xor_get(ctxt, positions[1]) ^ xor_get(ctxt, positions[2]));
+}
+
+int xor_check(pyrebloomxor * ctxt, const char * data, uint32_t len) {
+    uint64_t hash = xor_hash(ctxt, data, len), positions[3];
+    uint32_t i, j, argc = 0;
+    xor_positions(ctxt, hash, positions);
+
+    /* Remember the fingerprint for when the others come back */
+    if (ctxt->num_pending == ctxt->pending_size) {
+        ctxt->pending_size = ctxt->pending_size ? ctxt->pending_size * 2 : 64;
+        ctxt->pending = (uint64_t *)(realloc(
+            ctxt->pending, ctxt->pending_size * sizeof(uint64_t)));
+    }
+    ctxt->pending[ctxt->num_pending++] = xor_fingerprint(ctxt, hash);
+
+    for (i = 0; i < 3; ++i) {
+        if (argc == 0) {
+            ctxt->argv[argc++] = "BITFIELD";
+            ctxt->argv[argc++] =
+                ctxt->keys[positions[i] / ctxt->segment_entries];
+        }
+        snprintf(ctxt->slots[i], 24, "#%lu",
+            positions[i] % ctxt->segment_entries);
+        ctxt->argv[argc++] = "GET";
+        ctxt->argv[argc++] = ctxt->type;
+        ctxt->argv[argc++] = ctxt->slots[i];
+
+        /* Fingerprints in different segments need commands of their own */
+        if (ctxt->per_item != 1 || i == 2) {
+            for (j = 0; j < argc; ++j) {
+                ctxt->argvlen[j] = strlen(ctxt->argv[j]);
+            }
+            redisAppendCommandArgv(ctxt->ctxt, argc, ctxt->argv,
+                ctxt->argvlen);
+            argc = 0;
+        }
+    }
+    return PYREBLOOM_OK;
+}
+
+int xor_check_next(pyrebloomxor * ctxt) {
+    uint32_t i, j, fingerprint = 0;
+    int failed = 0;
+    uint64_t expected = ctxt->pending[ctxt->next_pending++];
+    redisReply * reply = NULL;
+    if (ctxt->next_pending == ctxt->num_pending) {
+        ctxt->next_pending = ctxt->num_pending = 0;
+    }
+
+    for (i = 0; i < ctxt->per_item; ++i) {
+        if (redisGetReply(ctxt->ctxt, (void**)(&reply)) == REDIS_ERR) {
+            strncpy(ctxt->errstr, "No pending replies", errstr_size);
+            return PYREBLOOM_ERROR;
+        }
+
+        if (reply->type == REDIS_REPLY_ERROR) {
+            failed = 1;
+            strncpy(ctxt->errstr, reply->str, errstr_size);
+        } else if (reply->type == REDIS_REPLY_ARRAY) {
+            for (j = 0; j < reply->elements; ++j) {
+                fingerprint ^= (uint32_t)(reply->element[j]->integer);
+            }
+        }
+        freeReplyObject(reply);
+    }
+    if (failed) {
+        return PYREBLOOM_ERROR;
+    }
+    return fingerprint == expected;
+}
+
+int xor_delete(pyrebloomxor * ctxt) {
+    uint32_t i = 0;
+    if (ctxt->ctxt == NULL) {
+        return PYREBLOOM_OK;
+    }
+    for (; i < ctxt->num_keys; ++i) {
+        freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->keys[i]));
+    }
+    freeReplyObject(redisCommand(ctxt->ctxt, "DEL %s", ctxt->meta_key));
+    return PYREBLOOM_OK;
+}
@@ -0,0 +1,100 @@
+/* Copyright (c) 2026 SEOmoz
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef PYRE_XOR_H
+#define PYRE_XOR_H
+
+#include "bloom.h"
+
+/* An xor filter is built once from a fixed set of items, and never changes
+ * after that. In exchange, it takes about 1.23 fingerprints' worth of bits
+ * per item, where a bloom filter with the same error rate would take about
+ * 1.44, and a check needs just three fingerprints.
+ *
+ * A filter is built in memory from all of its items, and then either stored
+ * in redis, in the segments `<key>.0`, `<key>.1`, ... and described by
+ * `<key>.meta`, or saved to a local file. It can be opened from either, and
+ * checks against a local file are just three reads of memory. Errors are
+ * copied into `errstr`, since a local filter has no connection to put them
+ * in. */
+typedef struct {
+    uint64_t        size;
+    uint32_t        fingerprint_bits;
+    uint32_t        hash_family;
+    uint64_t        block_length;
+    uint64_t        seed;
+    /* The fingerprints, if the filter is in memory rather than in redis */
+    void          * fingerprints;
+    /* How the fingerprints are spread across segments, if in redis */
+    uint64_t        segment_entries;
+    uint32_t        num_keys;
+    uint32_t        per_item;
+    /* The fingerprints of the items being checked against redis, in the
+     * order they were queued up */
+    uint64_t      * pending;
+    uint32_t        num_pending;
+    uint32_t        next_pending;
+    uint32_t        pending_size;
+    /* Scratch space for building commands */
+    char            type[8];
+    char            slots[3][24];
+    const char    * argv[11];
+    size_t          argvlen[11];
+    char            errstr[128];
+    char          * key;
+    char          * meta_key;
+    char         ** keys;
+    redisContext  * ctxt;
+} pyrebloomxor;
+
+/* Build a filter in memory from `count` items, with a false positive rate no
+ * worse than `error`. Items are hashed by `threads` threads, or one for each
+ * processor if it's 0. Duplicate items are fine. */
+int xor_build(pyrebloomxor * ctxt, const char ** items,
+    const uint32_t * lengths, uint64_t count, double error, uint32_t threads,
+    uint32_t hash_family);
+
+/* Store a filter that's been built at `key`, replacing any xor filter there,
+ * and keep the connection for checking against it */
+int xor_store(pyrebloomxor * ctxt, char * key, char * host, uint32_t port,
+    char * password, uint32_t db);
+
+/* Save a filter that's been built or loaded to a local file, or load one */
+int xor_save(pyrebloomxor * ctxt, const char * path);
+int xor_load(pyrebloomxor * ctxt, const char * path);
+
+/* Open a filter that's been stored in redis */
+int init_xor(pyrebloomxor * ctxt, char * key, char * host, uint32_t port,
+    char * password, uint32_t db);
+int free_xor(pyrebloomxor * ctxt);
+
+/* Check an item against a filter in memory */
+int xor_contains(pyrebloomxor * ctxt, const char * data, uint32_t len);
+
+/* Check items against a filter in redis */
+int xor_check(pyrebloomxor * ctxt, const char * data, uint32_t len);
+int xor_check_next(pyrebloomxor * ctxt);
+
+int xor_delete(pyrebloomxor * ctxt);
+
+#endif
@@ -0,0 +1,240 @@
+/* XXH3 (64-bit, seeded) implementation following the reference in:
+ *
+ *    https://github.com/Cyan4973/xxHash
+ *
+ * xxHash is BSD 2-clause licensed. This is a portable, scalar-only rendition
+ * of XXH3_64bits_withSeed and produces the same values as xxHash 0.8. */
+
+#include <stdint.h>
+#include <string.h>
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define XXH_SECRET_SIZE      192
+#define XXH_STRIPE_LEN       64
+#define XXH_SECRET_CONSUME   8
+
+static const unsigned char xxh3_ksecret[XXH_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+    0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+    0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+    0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+    0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+    0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+    0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+    0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+    0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+static inline uint32_t xxh_read32(const unsigned char * p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh_read64(const unsigned char * p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t xxh_rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh_mul128_fold64(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t xxh64_avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t xxh3_avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+static inline uint64_t xxh3_rrmxmx(uint64_t h, uint64_t len) {
+    h ^= xxh_rotl64(h, 49) ^ xxh_rotl64(h, 24);
+    h *= XXH_PRIME_MX2;
+    h ^= (h >> 35) + len;
+    h *= XXH_PRIME_MX2;
+    return h ^ (h >> 28);
+}
+
+static inline uint64_t xxh3_mix16(
+    const unsigned char * in, const unsigned char * secret, uint64_t seed) {
+    return xxh_mul128_fold64(
+        xxh_read64(in)     ^ (xxh_read64(secret)     + seed),
+        xxh_read64(in + 8) ^ (xxh_read64(secret + 8) - seed));
+}
+
+static uint64_t xxh3_len_0to16(
+    const unsigned char * in, uint32_t len, uint64_t seed) {
+    const unsigned char * s = xxh3_ksecret;
+    if (len > 8) {
+        uint64_t lo = xxh_read64(in) ^
+            ((xxh_read64(s + 24) ^ xxh_read64(s + 32)) + seed);
+        uint64_t hi = xxh_read64(in + len - 8) ^
+            ((xxh_read64(s + 40) ^ xxh_read64(s + 48)) - seed);
+        uint64_t acc = len + __builtin_bswap64(lo) + hi +
+            xxh_mul128_fold64(lo, hi);
+        return xxh3_avalanche(acc);
+    }
+    if (len >= 4) {
+        uint64_t input;
+        seed ^= (uint64_t)__builtin_bswap32((uint32_t)seed) << 32;
+        input = xxh_read32(in + len - 4) + ((uint64_t)xxh_read32(in) << 32);
+        return xxh3_rrmxmx(input ^
+            ((xxh_read64(s + 8) ^ xxh_read64(s + 16)) - seed), len);
+    }
+    if (len > 0) {
+        uint32_t combined = ((uint32_t)in[0] << 16) |
+            ((uint32_t)in[len >> 1] << 24) | (uint32_t)in[len - 1] | (len << 8);
+        return xxh64_avalanche((uint64_t)combined ^
+            ((uint64_t)(xxh_read32(s) ^ xxh_read32(s + 4)) + seed));
+    }
+    return xxh64_avalanche(seed ^ (xxh_read64(s + 56) ^ xxh_read64(s + 64)));
+}
+
+static uint64_t xxh3_len_17to128(
+    const unsigned char * in, uint32_t len, uint64_t seed) {
+    const unsigned char * s = xxh3_ksecret;
+    uint64_t acc = len * XXH_PRIME64_1;
+    if (len > 32) {
+        if (len > 64) {
+            if (len > 96) {
+                acc += xxh3_mix16(in + 48, s + 96, seed);
+                acc += xxh3_mix16(in + len - 64, s + 112, seed);
+            }
+            acc += xxh3_mix16(in + 32, s + 64, seed);
+            acc += xxh3_mix16(in + len - 48, s + 80, seed);
+        }
+        acc += xxh3_mix16(in + 16, s + 32, seed);
+        acc += xxh3_mix16(in + len - 32, s + 48, seed);
+    }
+    acc += xxh3_mix16(in, s, seed);
+    acc += xxh3_mix16(in + len - 16, s + 16, seed);
+    return xxh3_avalanche(acc);
+}
+
+static uint64_t xxh3_len_129to240(
+    const unsigned char * in, uint32_t len, uint64_t seed) {
+    const unsigned char * s = xxh3_ksecret;
+    uint64_t acc = len * XXH_PRIME64_1;
+    uint32_t i, rounds = len / 16;
+    for (i = 0; i < 8; ++i) {
+        acc += xxh3_mix16(in + 16 * i, s + 16 * i, seed);
+    }
+    acc = xxh3_avalanche(acc);
+    for (i = 8; i < rounds; ++i) {
+        acc += xxh3_mix16(in + 16 * i, s + 16 * (i - 8) + 3, seed);
+    }
+    /* The last 16 bytes use the last 17 bytes of the minimum-size secret */
+    acc += xxh3_mix16(in + len - 16, s + 136 - 17, seed);
+    return xxh3_avalanche(acc);
+}
+
+static inline void xxh3_accumulate_512(
+    uint64_t * acc, const unsigned char * in, const unsigned char * secret) {
+    uint32_t i;
+    for (i = 0; i < 8; ++i) {
+        uint64_t data = xxh_read64(in + 8 * i);
+        uint64_t key = data ^ xxh_read64(secret + 8 * i);
+        acc[i ^ 1] += data;
+        acc[i] += (uint64_t)(uint32_t)key * (key >> 32);
+    }
+}
+
+static inline void xxh3_scramble(uint64_t * acc, const unsigned char * secret) {
+    uint32_t i;
+    for (i = 0; i < 8; ++i) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= xxh_read64(secret + 8 * i);
+        acc[i] = a * XXH_PRIME32_1;
+    }
+}
+
+static uint64_t xxh3_hash_long(
+    const unsigned char * in, uint32_t len, uint64_t seed) {
+    unsigned char secret[XXH_SECRET_SIZE];
+    uint64_t acc[8] = {
+        XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+        XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1 };
+    const uint32_t stripes_per_block =
+        (XXH_SECRET_SIZE - XXH_STRIPE_LEN) / XXH_SECRET_CONSUME;
+    const uint32_t block_len = XXH_STRIPE_LEN * stripes_per_block;
+    const uint32_t blocks = (len - 1) / block_len;
+    uint32_t i, n, stripes;
+    uint64_t result;
+
+    /* Seeded long hashes derive their own secret from the default one */
+    for (i = 0; i < XXH_SECRET_SIZE / 16; ++i) {
+        uint64_t lo = xxh_read64(xxh3_ksecret + 16 * i) + seed;
+        uint64_t hi = xxh_read64(xxh3_ksecret + 16 * i + 8) - seed;
+        memcpy(secret + 16 * i, &lo, sizeof(lo));
+        memcpy(secret + 16 * i + 8, &hi, sizeof(hi));
+    }
+
+    for (n = 0; n < blocks; ++n) {
+        for (i = 0; i < stripes_per_block; ++i) {
+            xxh3_accumulate_512(acc, in + n * block_len + i * XXH_STRIPE_LEN,
+                secret + i * XXH_SECRET_CONSUME);
+        }
+        xxh3_scramble(acc, secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN);
+    }
+
+    stripes = ((len - 1) - block_len * blocks) / XXH_STRIPE_LEN;
+    for (i = 0; i < stripes; ++i) {
+        xxh3_accumulate_512(acc, in + blocks * block_len + i * XXH_STRIPE_LEN,
+            secret + i * XXH_SECRET_CONSUME);
+    }
+    xxh3_accumulate_512(acc, in + len - XXH_STRIPE_LEN,
+        secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN - 7);
+
+    result = len * XXH_PRIME64_1;
+    for (i = 0; i < 4; ++i) {
+        result += xxh_mul128_fold64(
+            acc[2 * i]     ^ xxh_read64(secret + 11 + 16 * i),
+            acc[2 * i + 1] ^ xxh_read64(secret + 11 + 16 * i + 8));
+    }
+    return xxh3_avalanche(result);
+}
+
+uint64_t XXH3_64bits_withSeed(const void * key, uint32_t len, uint64_t seed) {
+    const unsigned char * in = (const unsigned char *)key;
+    if (len <= 16) {
+        return xxh3_len_0to16(in, len, seed);
+    } else if (len <= 128) {
+        return xxh3_len_17to128(in, len, seed);
+    } else if (len <= 240) {
+        return xxh3_len_129to240(in, len, seed);
+    }
+    return xxh3_hash_long(in, len, seed);
+}
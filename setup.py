@@ -1,21 +1,15 @@
 from distutils.core import setup
+from Cython.Distutils import build_ext
+from Cython.Distutils import Extension
 
-ext_files = ['pyreBloom/bloom.c']
+ext_files = ['pyreBloom/bloom.c', 'pyreBloom/scalable.c',
+    'pyreBloom/counting.c', 'pyreBloom/cuckoo.c', 'pyreBloom/xor.c',
+    'pyreBloom/rotating.c', 'pyreBloom/stable.c', 'pyreBloom/countmin.c',
+    'pyreBloom/signature.c', 'pyreBloom/prefix.c',
+    'pyreBloom/quotient.c', 'pyreBloom/packed.c', 'pyreBloom/sync.c',
+    'pyreBloom/archive.c', 'pyreBloom/pyreBloom.pyx']
 
-kwargs = {}
-
-try:
-    from Cython.Distutils import build_ext
-    from Cython.Distutils import Extension
-    print('Building from Cython')
-    ext_files.append('pyreBloom/pyreBloom.pyx')
-    kwargs['cmdclass'] = {'build_ext': build_ext}
-except ImportError:
-    from distutils.core import Extension
-    ext_files.append('pyreBloom/pyreBloom.c')
-    print('Building from C')
-
-ext_modules = [Extension("pyreBloom", ext_files, libraries=['hiredis'],
+ext_modules = [Extension("pyreBloom", ext_files, libraries=['hiredis', 'pthread'],
                          library_dirs=['/usr/local/lib'],
                          include_dirs=['/usr/local/include'])]
 
@@ -26,6 +20,7 @@ setup(
     author_email = 'dan@seomoz.org',
     license = 'MIT License',
     ext_modules = ext_modules,
+    cmdclass = {'build_ext': build_ext},
     classifiers = [
         'Intended Audience :: Developers',
         'License :: OSI Approved :: MIT License',
@@ -33,5 +28,4 @@ setup(
         'Programming Language :: Cython',
         'Topic :: Software Development :: Libraries :: Python Modules',
         ],
-  **kwargs
 )
@@ -95,6 +95,931 @@ class FunctionalityTest(BaseTest):
         self.assertEqual(tests, bloom.contains(tests))
 
 
+class HashFamilyTest(BaseTest):
+    '''Make sure we can pick a hash, and that all clients agree on it'''
+    def test_families(self):
+        '''Every hash family should meet our accuracy expectations'''
+        included = sample_strings(20, 5000)
+        excluded = sample_strings(20, 5000)
+        for family in pyreBloom.HASH_FAMILIES:
+            self.bloom.delete()
+            bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+                self.ERROR_RATE, hash_family=family)
+            self.assertEqual(bloom.hash_family, family)
+            bloom.extend(included)
+            self.assertEqual(included, bloom.contains(included))
+            false_rate = float(len(bloom.contains(excluded))) / len(excluded)
+            self.assertLess(false_rate, 0.1)
+
+    def test_agreement(self):
+        '''The hash recorded at creation wins over whatever a client asks for'''
+        self.bloom.delete()
+        first = pyreBloom.pyreBloom(self.KEY, self.CAPACITY, self.ERROR_RATE,
+            hash_family='xxh3')
+        second = pyreBloom.pyreBloom(self.KEY, self.CAPACITY, self.ERROR_RATE)
+        self.assertEqual(second.hash_family, 'xxh3')
+        first.extend(['hello', 'how', 'are', 'you'])
+        self.assertEqual(['hello', 'how', 'are', 'you'],
+            second.contains(['hello', 'how', 'are', 'you']))
+
+    def test_legacy(self):
+        '''Filters without metadata were built with murmur'''
+        self.bloom.delete()
+        self.redis.setbit('pyreBloomTesting.0', 0, 1)
+        bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY, self.ERROR_RATE,
+            hash_family='wyhash')
+        self.assertEqual(bloom.hash_family, 'murmur64a')
+
+    def test_unknown(self):
+        '''Asking for a hash we don't have is an error'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE, hash_family='md5')
+
+
+class HashTest(unittest.TestCase):
+    '''Make sure every way we hash agrees with the reference hashes'''
+    SEEDS = [314159265, 1664525, 1013904223, 0, 1, 4294967295, 2718281828,
+        42, 7]
+    DATA = ''.join(chr((i * 37 + 200) % 256) for i in range(17))
+
+    def kernel(self, kernel):
+        '''MurmurHash64A_seeds matches MurmurHash64A for keys with every length
+        of tail, and for full and partial groups of seeds'''
+        try:
+            pyreBloom.hash_seeds('', [1], kernel)
+        except pyreBloomException:
+            self.skipTest('No %s kernel on this machine' % kernel)
+        for length in range(18):
+            for count in (1, 3, 4, 5, 8, 9):
+                data, seeds = self.DATA[:length], self.SEEDS[:count]
+                self.assertEqual(
+                    pyreBloom.hash_seeds(data, seeds, kernel),
+                    pyreBloom.hash_seeds(data, seeds, 'scalar'))
+
+    def test_auto(self):
+        '''Whichever kernel is picked matches MurmurHash64A'''
+        self.kernel('auto')
+
+    def test_avx2(self):
+        '''The AVX2 kernel matches MurmurHash64A'''
+        self.kernel('avx2')
+
+    def test_avx512(self):
+        '''The AVX-512 kernel matches MurmurHash64A'''
+        self.kernel('avx512')
+
+    def test_xxh3(self):
+        '''XXH3 matches xxHash 0.8 on inputs that take every path through it,
+        with and without a seed'''
+        vectors = [
+            (0, 0x2d06800538d394c2, 0x602b0e2cd6662c8b),
+            (1, 0xfc1537fc103cb7cf, 0xdc8dd066f0b411a6),
+            (3, 0xd9863a9d0c373ef9, 0xbe7c84b90f286005),
+            (4, 0xa212dc7af1f1145a, 0xeb0232efba03991c),
+            (8, 0xe5d40a4a17dde58a, 0x52ec4f311adfa44e),
+            (9, 0x417b1b6958af6653, 0x832af33d83b30324),
+            (16, 0xbebc4a4705ffa0ec, 0x74f73c7846245800),
+            (17, 0xbe38692697418a8f, 0x0ee4535b2e862016),
+            (128, 0x80083a20fe0cc8a1, 0x9588f23bbffb27d6),
+            (129, 0xc4f1ba76b8e3ed71, 0x65db36ffe9625d9f),
+            (240, 0x46ee3161a1e07c8d, 0x21b339836cd260e4),
+            (241, 0xca2e1d158f84010d, 0x06c6b31c47e08610),
+            (1024, 0x823d349317f204e1, 0x687541eb869b3925),
+            (2500, 0x9f0a8888b555ae00, 0x2133efc8beedd5f5)]
+        data = ''.join(chr(32 + i % 95) for i in range(2500))
+        for length, unseeded, seeded in vectors:
+            self.assertEqual(
+                pyreBloom.hash_item(data[:length], 0, hash_family='xxh3'),
+                unseeded)
+            self.assertEqual(pyreBloom.hash_item(data[:length],
+                0x9E3779B97F4A7C15, hash_family='xxh3'), seeded)
+
+    def test_wyhash(self):
+        '''wyhash matches the test vectors of its final version 4'''
+        vectors = [
+            ('', 0x93228a4de0eec5a2),
+            ('a', 0xc5bac3db178713c4),
+            ('abc', 0xa97f2f7b1d9b3314),
+            ('message digest', 0x786d1f1df3801df4),
+            ('abcdefghijklmnopqrstuvwxyz', 0xdca5a8138ad37c87),
+            ('ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789',
+                0xb9e734f117cfaf70),
+            ('1234567890' * 8, 0x6cc5eab49a92d617)]
+        for seed, (data, expected) in enumerate(vectors):
+            self.assertEqual(
+                pyreBloom.hash_item(data, seed, hash_family='wyhash'),
+                expected)
+
+    def test_unknown(self):
+        '''Asking for a kernel that doesn't exist is an error'''
+        self.assertRaises(pyreBloomException, pyreBloom.hash_seeds, 'hello',
+            [1], 'sse')
+
+
+class LayoutTest(BaseTest):
+    '''Make sure we can lay a filter out in slices, one for each hash'''
+    def setUp(self):
+        BaseTest.setUp(self)
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, layout='partitioned')
+
+    def test_partitioned(self):
+        '''A partitioned filter meets our accuracy expectations'''
+        included = sample_strings(20, 5000)
+        excluded = sample_strings(20, 5000)
+        self.assertEqual(self.bloom.layout, 'partitioned')
+        self.assertGreater(self.bloom.extend(included), len(included) * 0.9)
+        self.assertEqual(self.bloom.extend(included), 0)
+        self.assertEqual(included, self.bloom.contains(included))
+        self.assertTrue(included[0] in self.bloom)
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, 0.1)
+
+    def test_slices(self):
+        '''Each hash has a key of its own'''
+        self.bloom.add('hello')
+        keys = ['pyreBloomTesting.slice%i' % i
+            for i in range(self.bloom.hashes)]
+        self.assertEqual(self.bloom.keys(), keys)
+        for key in keys:
+            self.assertEqual(self.redis.bitcount(key), 1)
+
+    def test_agreement(self):
+        '''The layout recorded at creation wins over what a client asks for'''
+        bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY, self.ERROR_RATE)
+        self.assertEqual(bloom.layout, 'partitioned')
+        self.bloom.extend(['hello', 'how', 'are', 'you'])
+        self.assertEqual(['hello', 'how', 'are', 'you'],
+            pyreBloom.open(self.KEY).contains(['hello', 'how', 'are', 'you']))
+
+    def test_legacy(self):
+        '''Filters without metadata use the standard layout'''
+        self.bloom.delete()
+        self.redis.setbit('pyreBloomTesting.0', 0, 1)
+        bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY, self.ERROR_RATE,
+            layout='partitioned')
+        self.assertEqual(bloom.layout, 'standard')
+
+    def test_unknown(self):
+        '''Asking for a layout we don't have is an error'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE, layout='striped')
+
+    def test_error(self):
+        '''Redis errors in a batch are raised'''
+        self.redis.hset('pyreBloomTesting.slice0', 'hello', 5)
+        self.assertRaises(pyreBloomException, self.bloom.extend, ['a', 'b'])
+        self.assertRaises(pyreBloomException, self.bloom.contains, ['a', 'b'])
+        self.redis.delete('pyreBloomTesting.slice0')
+        self.bloom.add('a')
+        self.assertTrue('a' in self.bloom)
+
+
+class BlockedTest(BaseTest):
+    '''Make sure we can keep each item's bits in a single word'''
+    CAPACITY = 100000
+    ERROR_RATE = 0.01
+
+    def setUp(self):
+        BaseTest.setUp(self)
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, layout='blocked')
+
+    def test_blocked(self):
+        '''A blocked filter is a little less accurate than an ordinary one'''
+        included = sample_strings(20, self.CAPACITY)
+        excluded = sample_strings(20, 50000)
+        self.assertEqual(self.bloom.layout, 'blocked')
+        self.assertEqual(self.bloom.bits % 64, 0)
+        self.assertGreater(self.bloom.extend(included), len(included) * 0.99)
+        self.assertEqual(self.bloom.extend(included[:100]), 0)
+        self.assertEqual(included, self.bloom.contains(included))
+        self.assertTrue(included[0] in self.bloom)
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        # Crowding every item into one word costs some accuracy
+        self.assertLess(false_rate, self.ERROR_RATE * 3)
+
+    def test_word(self):
+        '''Each item's bits are all in one 64-bit word'''
+        self.bloom.add('hello')
+        value = self.redis.get(self.bloom.keys()[0])
+        words = [i // 8 for i, byte in enumerate(bytearray(value)) if byte]
+        self.assertEqual(len(set(w // 8 for w in words)), 1)
+        self.assertTrue('hello' in self.bloom)
+        self.assertEqual(self.bloom.contains(['hello', 'world']), ['hello'])
+
+    def test_open(self):
+        '''Opening a blocked filter finds the same items'''
+        self.bloom.extend(['hello', 'how', 'are', 'you'])
+        bloom = pyreBloom.open(self.KEY)
+        self.assertEqual(bloom.layout, 'blocked')
+        self.assertEqual(['hello', 'how', 'are', 'you'],
+            bloom.contains(['hello', 'how', 'are', 'you']))
+
+    def test_error(self):
+        '''Redis errors are raised, and don't disturb the commands that
+        follow'''
+        self.redis.hset(self.bloom.keys()[0], 'hello', 5)
+        self.assertRaises(pyreBloomException, self.bloom.extend, ['a', 'b'])
+        self.assertRaises(pyreBloomException, self.bloom.contains, ['a', 'b'])
+        self.redis.delete(self.bloom.keys()[0])
+        self.bloom.add('a')
+        self.assertEqual(self.bloom.contains(['a', 'a']), ['a', 'a'])
+
+
+class ShardedTest(BaseTest):
+    '''Make sure we can keep each item's bits in a single small segment'''
+    CAPACITY = 1000000
+    ERROR_RATE = 0.01
+
+    def setUp(self):
+        BaseTest.setUp(self)
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, layout='sharded')
+
+    def test_sharded(self):
+        '''A sharded filter meets our accuracy expectations'''
+        included = sample_strings(20, 5000)
+        excluded = sample_strings(20, 5000)
+        self.assertEqual(self.bloom.layout, 'sharded')
+        self.assertEqual(self.bloom.extend(included), len(included))
+        self.assertEqual(self.bloom.extend(included), 0)
+        self.assertEqual(included, self.bloom.contains(included))
+        self.assertTrue(included[0] in self.bloom)
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, 0.01)
+
+    def test_shards(self):
+        '''The number of shards follows from the capacity, and each item
+        only touches one of them'''
+        self.assertEqual(len(self.bloom.keys()),
+            (self.bloom.bits + 2 ** 20 - 1) // 2 ** 20)
+        self.assertGreater(len(self.bloom.keys()), 1)
+        self.bloom.add('hello')
+        counts = [self.redis.bitcount(key) for key in self.bloom.keys()]
+        self.assertEqual(len([count for count in counts if count]), 1)
+        self.assertEqual(sum(counts), self.bloom.hashes)
+
+        # With enough items, every shard gets some
+        self.bloom.extend(sample_strings(20, 1000))
+        for key in self.bloom.keys():
+            self.assertTrue(self.redis.exists(key))
+
+    def test_open(self):
+        '''Opening a sharded filter gets the same shards'''
+        self.bloom.extend(['hello', 'how', 'are', 'you'])
+        bloom = pyreBloom.open(self.KEY)
+        self.assertEqual(bloom.layout, 'sharded')
+        self.assertEqual(bloom.keys(), self.bloom.keys())
+        self.assertEqual(['hello', 'how', 'are', 'you'],
+            bloom.contains(['hello', 'how', 'are', 'you']))
+
+    def test_error(self):
+        '''Redis errors are raised'''
+        for key in self.bloom.keys():
+            self.redis.hset(key, 'hello', 5)
+        self.assertRaises(pyreBloomException, self.bloom.extend, ['a', 'b'])
+        self.assertRaises(pyreBloomException, self.bloom.contains, ['a', 'b'])
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, layout='sharded')
+        self.bloom.add('a')
+        self.assertTrue('a' in self.bloom)
+
+
+class SparseTest(BaseTest):
+    '''Make sure small filters are kept as sets of offsets'''
+    CAPACITY = 1000000
+    ERROR_RATE = 0.01
+
+    def setUp(self):
+        BaseTest.setUp(self)
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, layout='sparse')
+
+    def test_sparse(self):
+        '''A few items are kept in a set, not a bitmap'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.assertEqual(self.bloom.layout, 'sparse')
+        self.assertEqual(self.bloom.extend(tests), len(tests))
+        self.assertEqual(self.bloom.extend(tests), 0)
+        self.assertEqual(tests, self.bloom.contains(tests + ['goodbye']))
+        self.assertTrue('hello' in self.bloom)
+        self.assertFalse(self.redis.exists(self.KEY + '.0'))
+        self.assertLessEqual(self.redis.scard(self.KEY + '.sparse'),
+            len(tests) * self.bloom.hashes)
+        self.assertLess(self.bloom.fill(), 0.001)
+        self.assertEqual(self.bloom.keys(),
+            [self.KEY + '.0', self.KEY + '.sparse'])
+
+    def test_dense(self):
+        '''Once there are enough offsets, it becomes a standard filter'''
+        included = sample_strings(20, 5000)
+        excluded = sample_strings(20, 5000)
+        self.bloom.extend(included[:50])
+        other = pyreBloom.open(self.KEY)
+        self.assertEqual(other.layout, 'sparse')
+        self.bloom.extend(included[50:])
+        self.assertFalse(self.redis.exists(self.KEY + '.sparse'))
+        self.assertEqual(included, self.bloom.contains(included))
+        self.assertEqual(included, other.contains(included))
+        bloom = pyreBloom.open(self.KEY)
+        self.assertEqual(bloom.layout, 'standard')
+        self.assertEqual(included, bloom.contains(included))
+        self.assertEqual(bloom.bits, self.bloom.bits)
+        false_rate = float(len(bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, self.ERROR_RATE)
+
+    def test_error(self):
+        '''Redis errors are raised, and don't disturb the commands that
+        follow'''
+        self.redis.hset(self.KEY + '.sparse', 'hello', 5)
+        self.assertRaises(pyreBloomException, self.bloom.extend, ['a', 'b'])
+        self.assertRaises(pyreBloomException, self.bloom.contains, ['a', 'b'])
+        self.redis.delete(self.KEY + '.sparse')
+        self.bloom.add('a')
+        self.assertEqual(self.bloom.contains(['a', 'b']), ['a'])
+
+    def test_reload(self):
+        '''If redis forgets the script, it's loaded again'''
+        self.redis.script_flush()
+        self.assertRaises(pyreBloomException, self.bloom.contains, ['a', 'b'])
+        self.bloom.add('a')
+        self.redis.script_flush()
+        self.assertRaises(pyreBloomException, self.bloom.extend, ['a', 'b'])
+        self.assertEqual(self.bloom.contains(['a', 'b']), ['a'])
+
+
+class FoldTest(BaseTest):
+    '''Make sure underfilled filters can be folded to free memory'''
+    CAPACITY = 1000000
+    ERROR_RATE = 0.01
+
+    def setUp(self):
+        BaseTest.setUp(self)
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, power_of_two=True)
+
+    def test_power_of_two(self):
+        '''Sizing to a power of two rounds the bits up'''
+        self.assertEqual(self.bloom.bits, 2 ** 24)
+        self.assertEqual(pyreBloom.open(self.KEY).bits, 2 ** 24)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            'pyreBloomTestingOther', self.CAPACITY, self.ERROR_RATE,
+            layout='partitioned', power_of_two=True)
+
+    def test_fold(self):
+        '''Folding halves the bits, and keeps every item'''
+        included = sample_strings(20, 5000)
+        self.bloom.extend(included)
+        self.assertEqual(self.bloom.fold(times=2), 2)
+        self.assertEqual(self.bloom.bits, 2 ** 22)
+        self.assertEqual(self.redis.strlen(self.bloom.keys()[0]), 2 ** 19)
+        self.assertEqual(included, self.bloom.contains(included))
+        bloom = pyreBloom.open(self.KEY)
+        self.assertEqual(bloom.bits, 2 ** 22)
+        self.assertEqual(included, bloom.contains(included))
+
+    def test_stale(self):
+        '''Clients that had the filter open when it was folded catch up'''
+        included = sample_strings(20, 5000)
+        other = pyreBloom.open(self.KEY)
+        self.bloom.extend(included[:2500])
+        self.assertEqual(self.bloom.fold(times=2), 2)
+        self.assertEqual(included[:2500], other.contains(included[:2500]))
+        self.assertEqual(other.bits, 2 ** 22)
+        other.extend(included[2500:])
+        self.assertEqual(included, self.bloom.contains(included))
+
+    def test_stale_adds(self):
+        '''Adds sent to the bits a filter had before it was folded are sent
+        again, and whatever they set past its end is cleared away'''
+        included = sample_strings(20, 5000)
+        other = pyreBloom.open(self.KEY)
+        self.assertEqual(self.bloom.fold(times=2), 2)
+        self.assertGreater(other.extend(included), 4950)
+        self.assertEqual(other.bits, 2 ** 22)
+        self.assertEqual(self.redis.strlen(self.bloom.keys()[0]), 2 ** 19)
+        self.assertEqual(included, self.bloom.contains(included))
+
+    def test_stale_fold(self):
+        '''A client that's behind can still fold the filter'''
+        included = sample_strings(20, 5000)
+        self.bloom.extend(included)
+        other = pyreBloom.open(self.KEY)
+        self.assertEqual(other.fold(times=1), 1)
+        self.assertEqual(self.bloom.fold(times=1), 1)
+        self.assertEqual(self.bloom.bits, 2 ** 22)
+        self.assertEqual(included, other.contains(included))
+        self.assertEqual(other.bits, 2 ** 22)
+
+    def test_fill(self):
+        '''Folding is driven by how full the filter is'''
+        included = sample_strings(20, 5000)
+        excluded = sample_strings(20, 5000)
+        self.bloom.extend(included)
+        self.assertLess(self.bloom.fill(), 0.01)
+        self.assertGreater(self.bloom.fold(), 5)
+        self.assertLess(self.bloom.fill(), 0.5)
+        self.assertGreater(self.bloom.fill(), 0.25)
+        self.assertEqual(self.bloom.fold(), 0)
+        self.assertEqual(included, self.bloom.contains(included))
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, 0.05)
+
+    def test_unfoldable(self):
+        '''Filters that can't be halved evenly aren't folded'''
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, layout='blocked')
+        self.assertEqual(self.bloom.fold(), 0)
+        self.assertRaises(pyreBloomException, self.bloom.fold, times=1)
+
+
+class CombineTest(BaseTest):
+    '''Make sure filters of the same shape can be combined in redis'''
+    OTHER = 'pyreBloomTestingOther'
+    INTO = 'pyreBloomTestingInto'
+
+    def setUp(self):
+        BaseTest.setUp(self)
+        self.other = pyreBloom.pyreBloom(self.OTHER, self.CAPACITY,
+            self.ERROR_RATE)
+
+    def tearDown(self):
+        BaseTest.tearDown(self)
+        for key in (self.OTHER, self.INTO):
+            pyreBloom.pyreBloom(key, 1, 0.1).delete()
+
+    def test_union(self):
+        '''A union has the items of both filters'''
+        ours, theirs = sample_strings(20, 1000), sample_strings(20, 1000)
+        self.bloom.extend(ours)
+        self.other.extend(theirs)
+        self.bloom.union(self.OTHER)
+        self.assertEqual(self.bloom.contains(ours + theirs), ours + theirs)
+        self.assertLess(len(self.other.contains(ours)), 200)
+
+    def test_union_into(self):
+        '''A union can be stored as a new filter'''
+        ours, theirs = sample_strings(20, 1000), sample_strings(20, 1000)
+        self.bloom.extend(ours)
+        self.other.extend(theirs)
+        self.bloom.union([self.OTHER], into=self.INTO)
+        union = pyreBloom.open(self.INTO)
+        self.assertEqual(union.capacity, self.CAPACITY)
+        self.assertEqual(union.bits, self.bloom.bits)
+        self.assertEqual(union.contains(ours + theirs), ours + theirs)
+        self.assertLess(len(self.bloom.contains(theirs)), 200)
+
+    def test_intersection(self):
+        '''An intersection has the items of both, and few of the others'''
+        common = sample_strings(20, 1000)
+        ours, theirs = sample_strings(20, 1000), sample_strings(20, 1000)
+        self.bloom.extend(common + ours)
+        self.other.extend(common + theirs)
+        self.bloom.intersection(self.OTHER, into=self.INTO)
+        both = pyreBloom.open(self.INTO)
+        self.assertEqual(both.contains(common), common)
+        self.assertLess(len(both.contains(ours + theirs)), 400)
+        self.bloom.intersection(self.OTHER)
+        self.assertEqual(self.bloom.contains(common), common)
+
+    def test_partitioned(self):
+        '''Filters of other layouts are combined segment by segment'''
+        self.bloom.delete()
+        self.other.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, layout='partitioned')
+        self.other = pyreBloom.pyreBloom(self.OTHER, self.CAPACITY,
+            self.ERROR_RATE, layout='partitioned')
+        ours, theirs = sample_strings(20, 1000), sample_strings(20, 1000)
+        self.bloom.extend(ours)
+        self.other.extend(theirs)
+        self.bloom.union(self.OTHER, into=self.INTO)
+        union = pyreBloom.open(self.INTO)
+        self.assertEqual(union.layout, 'partitioned')
+        self.assertEqual(union.contains(ours + theirs), ours + theirs)
+        for key in union.keys():
+            self.assertTrue(self.redis.exists(key))
+
+    def test_cardinality(self):
+        '''Cardinalities are estimated from the bits that are set'''
+        samples = sample_strings(20, 7000)
+        self.bloom.extend(samples[:5000])
+        self.other.extend(samples[3000:])
+        self.assertAlmostEqual(self.bloom.cardinality(), 5000, delta=250)
+        self.assertAlmostEqual(
+            self.bloom.union_cardinality(self.OTHER), 7000, delta=350)
+        self.assertAlmostEqual(
+            self.bloom.intersection_cardinality(self.OTHER), 2000, delta=300)
+        self.assertAlmostEqual(self.bloom.jaccard(self.OTHER), 2.0 / 7,
+            delta=0.05)
+        self.assertFalse(self.redis.exists(self.KEY + '.combine'))
+
+    def test_empty(self):
+        '''Empty filters have nothing in common'''
+        self.assertEqual(self.bloom.cardinality(), 0)
+        self.assertEqual(self.bloom.jaccard(self.OTHER), 0)
+
+    def test_mismatch(self):
+        '''Only filters of the same shape can be combined'''
+        self.other.delete()
+        self.other = pyreBloom.pyreBloom(self.OTHER, self.CAPACITY * 2,
+            self.ERROR_RATE)
+        self.assertRaises(pyreBloomException, self.bloom.union, self.OTHER)
+        self.assertRaises(pyreBloomException, self.bloom.jaccard, self.OTHER)
+        self.assertRaises(pyreBloomException, self.bloom.union,
+            'pyreBloomTestingMissing')
+
+    def test_sparse(self):
+        '''Sparse filters have no bitmaps to combine'''
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, layout='sparse')
+        self.assertRaises(pyreBloomException, self.bloom.union, self.OTHER)
+
+
+class EstimateTest(BaseTest):
+    '''Make sure we can tell how full a filter is without scanning it'''
+    CAPACITY = 100000
+    ERROR_RATE = 0.01
+    INTO = 'pyreBloomTestingInto'
+
+    def tearDown(self):
+        BaseTest.tearDown(self)
+        pyreBloom.pyreBloom(self.INTO, 1, 0.1).delete()
+
+    def test_count(self):
+        '''New items are counted as they're added'''
+        samples = sample_strings(20, 2000)
+        self.bloom.extend(samples)
+        self.bloom.extend(samples[:1000])
+        estimate = self.bloom.estimate()
+        self.assertAlmostEqual(estimate['items'], 2000, delta=10)
+        self.assertLess(estimate['error'], self.ERROR_RATE)
+        self.assertAlmostEqual(estimate['fill'], self.bloom.fill(),
+            delta=0.01)
+
+    def test_shared(self):
+        '''Every client adds to the same count, each batch's going out with
+        the next one'''
+        other = pyreBloom.open(self.KEY)
+        self.bloom.extend(sample_strings(20, 1000))
+        self.bloom.add('hello')
+        self.assertAlmostEqual(other.estimate()['items'], 1000, delta=10)
+        other.extend(sample_strings(20, 1000))
+        self.assertAlmostEqual(self.bloom.estimate()['items'], 1001,
+            delta=10)
+        del other
+        self.assertAlmostEqual(self.bloom.estimate()['items'], 2001,
+            delta=20)
+
+    def test_abandoned(self):
+        '''Closing a client part way through a batch still counts the batches
+        that came before it'''
+        other = pyreBloom.open(self.KEY)
+        other.extend(sample_strings(20, 1000))
+        self.assertRaises(TypeError, other.extend, ['hello', None])
+        del other
+        self.assertAlmostEqual(self.bloom.estimate()['items'], 1000,
+            delta=10)
+
+    def test_flushed(self):
+        '''A count that redis has forgotten the script for goes out again'''
+        for i in range(3):
+            self.bloom.extend(sample_strings(20, 1000))
+            if i == 1:
+                self.redis.script_flush()
+        self.bloom.add('hello')
+        self.assertAlmostEqual(self.bloom.estimate()['items'], 3001,
+            delta=20)
+
+    def test_sampled(self):
+        '''Sampling a few ranges of bits is close to counting them all'''
+        self.bloom.extend(sample_strings(20, 20000))
+        fill = self.bloom.fill()
+        estimate = self.bloom.estimate(samples=32, sample_bytes=1024)
+        self.assertAlmostEqual(estimate['fill'], fill, delta=0.02)
+        self.assertAlmostEqual(estimate['items'], 20000, delta=2000)
+        self.assertAlmostEqual(estimate['error'],
+            estimate['fill'] ** self.bloom.hashes)
+        self.assertRaises(pyreBloomException, self.bloom.estimate,
+            samples=1, sample_bytes=0)
+
+    def test_layouts(self):
+        '''Samples are taken from the keys of any layout'''
+        for layout in ('partitioned', 'sparse'):
+            self.bloom.delete()
+            self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+                self.ERROR_RATE, layout=layout)
+            self.bloom.extend(sample_strings(20, 50))
+            self.assertAlmostEqual(self.bloom.estimate()['items'], 50,
+                delta=1)
+            self.assertAlmostEqual(
+                self.bloom.estimate(samples=64)['fill'], self.bloom.fill(),
+                delta=0.005)
+
+    def test_combined(self):
+        '''A union starts counting from an estimate of what's in it'''
+        self.bloom.extend(sample_strings(20, 3000))
+        self.bloom.union([], into=self.INTO)
+        union = pyreBloom.open(self.INTO)
+        self.assertAlmostEqual(union.estimate()['items'], 3000, delta=150)
+
+
+class PlanTest(BaseTest):
+    '''Make sure filters can trade memory for fewer hashes'''
+    CAPACITY = 100000
+    ERROR_RATE = 0.001
+
+    def test_plan(self):
+        '''Without a cost for hashing, the fewest bits are chosen'''
+        plan = pyreBloom.plan(self.CAPACITY, self.ERROR_RATE)
+        chosen = [row for row in plan if row['chosen']]
+        self.assertEqual(len(chosen), 1)
+        self.assertEqual(chosen[0]['hashes'], self.bloom.hashes)
+        self.assertAlmostEqual(chosen[0]['memory'], 1.0, delta=0.01)
+        self.assertEqual(min(row['cost'] for row in plan), chosen[0]['cost'])
+
+    def test_probe_cost(self):
+        '''When hashes cost something, a few are traded for memory'''
+        plan = pyreBloom.plan(self.CAPACITY, self.ERROR_RATE, 0.07)
+        chosen = [row for row in plan if row['chosen']][0]
+        self.assertLess(chosen['hashes'], self.bloom.hashes)
+        self.assertLess(chosen['memory'], 1.3)
+        self.assertEqual(min(row['cost'] for row in plan), chosen['cost'])
+
+    def test_filter(self):
+        '''A filter sized for its probes still meets its error rate'''
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, probe_cost=0.2)
+        self.assertLess(self.bloom.hashes, 6)
+        self.assertEqual(pyreBloom.open(self.KEY).hashes, self.bloom.hashes)
+        included = sample_strings(20, self.CAPACITY)
+        excluded = sample_strings(20, 10000)
+        self.bloom.extend(included)
+        self.assertEqual(len(self.bloom.contains(included[:5000])), 5000)
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, self.ERROR_RATE * 2)
+
+    def test_budget(self):
+        '''The memory budget is never exceeded, or else it's an error'''
+        least = pyreBloom.plan(self.CAPACITY, self.ERROR_RATE)[9]['bits']
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, probe_cost=1, max_bits=least * 2)
+        self.assertLessEqual(self.bloom.bits, least * 2)
+        self.bloom.delete()
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE, max_bits=least / 2)
+
+    def test_hashes(self):
+        '''Asking for a number of hashes sizes the bits to match'''
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, hashes=4)
+        self.assertEqual(self.bloom.hashes, 4)
+        self.assertEqual(self.bloom.bits,
+            pyreBloom.plan(self.CAPACITY, self.ERROR_RATE)[3]['bits'])
+
+    def test_hashes_and_plan(self):
+        '''Asking for hashes and for a plan at once is an error'''
+        self.bloom.delete()
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE, hashes=4, probe_cost=0.2)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE, hashes=4,
+            max_bits=10 ** 9)
+
+
+class ArchiveTest(BaseTest):
+    '''Make sure cold filters can be archived and brought back'''
+    OTHER = 'pyreBloomTestingOther'
+
+    def tearDown(self):
+        BaseTest.tearDown(self)
+        pyreBloom.pyreBloom(self.OTHER, 1, 0.1).delete()
+
+    def test_archive(self):
+        '''Archiving compresses the bits and deletes the segments'''
+        self.bloom.extend(sample_strings(20, 1000))
+        size = self.bloom.archive()
+        self.assertLess(size, self.bloom.bits / 8 / 2)
+        self.assertTrue(self.bloom.archived)
+        self.assertEqual(self.bloom.keys(), [self.KEY + '.archive'])
+        self.assertFalse(self.redis.exists(self.KEY + '.0'))
+        self.assertEqual(self.redis.hget(self.KEY + '.meta', 'state'),
+            'archived')
+        self.assertTrue(pyreBloom.open(self.KEY).archived)
+        # Archiving it again does nothing
+        self.assertEqual(self.bloom.archive(), size)
+
+    def test_full(self):
+        '''A full filter is close to random, but no bigger archived'''
+        self.bloom.extend(sample_strings(20, self.CAPACITY))
+        self.assertLessEqual(self.bloom.archive(),
+            self.bloom.bits / 8 + self.bloom.bits / 8 / 4096 + 1)
+
+    def test_local(self):
+        '''An archived filter can be read without rehydrating it'''
+        included = sample_strings(20, 1000)
+        excluded = sample_strings(20, 1000)
+        self.bloom.extend(included)
+        expected = self.bloom.contains(excluded)
+        self.bloom.archive(page_bytes=256)
+        bloom = pyreBloom.pyreBloom(self.KEY, rehydrate=False)
+        self.assertEqual(bloom.contains(included), included)
+        self.assertEqual(bloom.contains(excluded), expected)
+        self.assertTrue(included[0] in bloom)
+        self.assertTrue(bloom.archived)
+        self.assertFalse(self.redis.exists(self.KEY + '.0'))
+
+    def test_rehydrate(self):
+        '''Reading an archived filter rehydrates it by default'''
+        included = sample_strings(20, 1000)
+        excluded = sample_strings(20, 1000)
+        self.bloom.extend(included)
+        expected = self.bloom.contains(excluded)
+        self.bloom.archive()
+        bloom = pyreBloom.open(self.KEY)
+        self.assertEqual(bloom.contains(included), included)
+        self.assertFalse(bloom.archived)
+        self.assertEqual(bloom.keys(), [self.KEY + '.0'])
+        self.assertFalse(self.redis.exists(self.KEY + '.archive'))
+        self.assertEqual(self.redis.hget(self.KEY + '.meta', 'state'), None)
+        self.assertEqual(bloom.contains(excluded), expected)
+        # Whoever rehydrates it second finds nothing left to do
+        self.bloom.rehydrate()
+        self.assertEqual(self.bloom.contains(included), included)
+
+    def test_add(self):
+        '''Adding to an archived filter rehydrates it first'''
+        included = sample_strings(20, 1000)
+        self.bloom.extend(included[:500])
+        self.bloom.archive()
+        self.bloom.extend(included[500:])
+        self.assertFalse(self.bloom.archived)
+        self.assertEqual(self.bloom.contains(included), included)
+        self.assertAlmostEqual(self.bloom.estimate()['items'], 1000, delta=10)
+
+    def test_stale_writer(self):
+        '''A client that had the filter open when it was archived rehydrates
+        it when it next adds'''
+        included = sample_strings(20, 1000)
+        writer = pyreBloom.open(self.KEY)
+        self.bloom.extend(included[:500])
+        self.bloom.archive()
+        writer.extend(included[500:])
+        self.assertFalse(writer.archived)
+        self.assertFalse(self.redis.exists(self.KEY + '.archive'))
+        self.assertEqual(self.bloom.contains(included), included)
+
+    def test_cancel(self):
+        '''Adding to a filter that's being archived cancels the archive'''
+        included = sample_strings(20, 1000)
+        meta = self.KEY + '.meta'
+        writer = pyreBloom.open(self.KEY)
+        self.bloom.extend(included[:500])
+        # As archive() leaves it while it's compressing the segments
+        self.redis.hset(meta, 'state', 'archiving')
+        self.redis.hincrby(meta, 'epoch', 1)
+        self.redis.hset(self.KEY + '.archive', '0:0', 'partial')
+        # Reading it goes to the segments, and leaves the archive be
+        reader = pyreBloom.open(self.KEY)
+        self.assertEqual(reader.contains(included[:500]), included[:500])
+        self.assertFalse(reader.archived)
+        self.assertTrue(self.redis.hexists(meta, 'state'))
+        writer.extend(included[500:])
+        self.assertFalse(self.redis.hexists(meta, 'state'))
+        self.assertFalse(self.redis.exists(self.KEY + '.archive'))
+        self.assertEqual(self.bloom.contains(included), included)
+        # Whoever opens it while it's being archived cancels it too
+        self.redis.hset(meta, 'state', 'archiving')
+        pyreBloom.open(self.KEY).add('hello')
+        self.assertFalse(self.redis.hexists(meta, 'state'))
+
+    def test_stale_archive(self):
+        '''A client that's behind can still archive the filter'''
+        included = sample_strings(20, 1000)
+        other = pyreBloom.open(self.KEY)
+        other.extend(included)
+        other.archive()
+        other.rehydrate()
+        self.bloom.archive()
+        self.assertTrue(self.bloom.archived)
+        self.assertFalse(self.redis.exists(self.KEY + '.0'))
+        self.assertEqual(self.bloom.contains(included), included)
+
+    def test_stale_reader(self):
+        '''A client reading the archive notices when it's rehydrated, and
+        when it's archived again'''
+        included = sample_strings(20, 1000)
+        self.bloom.extend(included[:500])
+        self.bloom.archive(page_bytes=256)
+        reader = pyreBloom.pyreBloom(self.KEY, rehydrate=False)
+        self.assertEqual(reader.contains(included[:500]), included[:500])
+        self.bloom.extend(included[500:])
+        self.assertEqual(reader.contains(included), included)
+        self.assertFalse(reader.archived)
+        self.bloom.archive(page_bytes=256)
+        self.assertEqual(reader.contains(included), included)
+        self.assertTrue(reader.archived)
+        self.assertFalse(self.redis.exists(self.KEY + '.0'))
+
+    def test_layouts(self):
+        '''Filters of every layout with segments can be archived'''
+        for layout in ('partitioned', 'sharded', 'blocked'):
+            bloom = pyreBloom.pyreBloom(self.OTHER, 100000, 0.01,
+                layout=layout)
+            included = sample_strings(20, 2000)
+            excluded = sample_strings(20, 2000)
+            bloom.extend(included)
+            expected = bloom.contains(excluded)
+            bloom.archive(page_bytes=1024)
+            reader = pyreBloom.pyreBloom(self.OTHER, rehydrate=False)
+            self.assertEqual(reader.contains(included), included)
+            self.assertEqual(reader.contains(excluded), expected)
+            bloom.rehydrate()
+            self.assertEqual(bloom.contains(included), included)
+            self.assertEqual(bloom.contains(excluded), expected)
+            bloom.delete()
+
+    def test_errors(self):
+        '''Sparse filters, odd pages and archived filters can't be archived,
+        given odd pages or combined'''
+        bloom = pyreBloom.pyreBloom(self.OTHER, 1000, 0.01, layout='sparse')
+        self.assertRaises(pyreBloomException, bloom.archive)
+        bloom.delete()
+        self.assertRaises(pyreBloomException, self.bloom.archive, 0)
+        bloom = pyreBloom.pyreBloom(self.OTHER, self.CAPACITY,
+            self.ERROR_RATE)
+        bloom.add('hello')
+        bloom.archive()
+        self.assertRaises(pyreBloomException, self.bloom.union, self.OTHER)
+
+    def test_delete(self):
+        '''Deleting an archived filter deletes its archive'''
+        self.bloom.add('hello')
+        self.bloom.archive()
+        self.bloom.delete()
+        self.assertFalse(self.redis.exists(self.KEY + '.archive'))
+        self.assertFalse(self.redis.exists(self.KEY + '.meta'))
+
+
+class MetadataTest(BaseTest):
+    '''Make sure filters describe themselves to the clients that open them'''
+    def test_open(self):
+        '''We can open an existing filter knowing only its key'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.bloom.extend(tests)
+        bloom = pyreBloom.open(self.KEY)
+        self.assertEqual(bloom.capacity, self.CAPACITY)
+        self.assertAlmostEqual(bloom.error, self.ERROR_RATE)
+        self.assertEqual(bloom.bits, self.bloom.bits)
+        self.assertEqual(bloom.hashes, self.bloom.hashes)
+        self.assertEqual(tests, bloom.contains(tests))
+
+    def test_open_missing(self):
+        '''Opening a filter that was never created is an error'''
+        self.assertRaises(pyreBloomException, pyreBloom.open,
+            'pyreBloomTestingMissing')
+
+    def test_mismatch(self):
+        '''A client asking for a different size gets the recorded one'''
+        bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY * 10, 0.001)
+        self.assertEqual(bloom.capacity, self.CAPACITY)
+        self.assertEqual(bloom.bits, self.bloom.bits)
+        self.assertEqual(bloom.hashes, self.bloom.hashes)
+
+    def test_legacy(self):
+        '''Filters from before the metadata keep their original shape, however
+        a client asks for them to be sized or laid out'''
+        options = [{'layout': 'blocked'}, {'layout': 'sharded'},
+            {'power_of_two': True}, {'hashes': 2}]
+        for kwargs in options:
+            for hash_family in (None, 'xxh3'):
+                self.bloom.delete()
+                self.redis.setbit(self.KEY + '.0', 0, 1)
+                if hash_family:
+                    # Metadata that only recorded the hash
+                    self.redis.hmset(self.KEY + '.meta',
+                        {'hash': 1, 'version': 1})
+                bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+                    self.ERROR_RATE, **kwargs)
+                self.assertEqual(bloom.bits, self.bloom.bits)
+                self.assertEqual(bloom.hashes, self.bloom.hashes)
+                self.assertEqual(bloom.layout, 'standard')
+                self.assertEqual(bloom.hash_family, hash_family or 'murmur64a')
+                self.assertEqual(pyreBloom.open(self.KEY).bits, bloom.bits)
+
+
 class DbTest(BaseTest):
     '''Make sure we can select a database'''
     def test_select_db(self):
@@ -106,6 +1031,14 @@ class DbTest(BaseTest):
         self.bloom.extend(samples)
         self.assertEqual(len(bloom.contains(samples)), 0)
 
+    def test_bad_db(self):
+        '''A database that can't be selected is an error, and nothing is
+        written to db 0 instead'''
+        self.bloom.delete()
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom, self.KEY,
+            self.CAPACITY, self.ERROR_RATE, db=100000)
+        self.assertEqual(self.redis.keys(self.KEY + '*'), [])
+
 
 class AllocationTest(BaseTest):
     '''Tests about large allocations'''
@@ -132,6 +1065,43 @@ class AllocationTest(BaseTest):
             ['pyreBloomTesting.0', 'pyreBloomTesting.1'])
 
 
+class LargeCapacityTest(BaseTest):
+    '''Make sure capacities past 32 bits survive the trip through redis'''
+    CAPACITY = 5000000000
+    ERROR_RATE = 0.1
+
+    def test_capacity(self):
+        '''The capacity and shape are recorded without being truncated'''
+        self.assertEqual(self.bloom.capacity, self.CAPACITY)
+        self.assertGreater(self.bloom.bits, 2 ** 32)
+        bloom = pyreBloom.open(self.KEY)
+        self.assertEqual(bloom.capacity, self.CAPACITY)
+        self.assertEqual(bloom.bits, self.bloom.bits)
+        self.assertEqual(bloom.hashes, self.bloom.hashes)
+
+    def test_keys(self):
+        '''Every bit has a segment, and the segments are named as before'''
+        segments = (self.bloom.bits + 2 ** 32 - 2) // (2 ** 32 - 1)
+        self.assertEqual(self.bloom.keys(),
+            ['%s.%i' % (self.KEY, i) for i in range(segments)])
+
+    def test_structures(self):
+        '''The other structures keep capacities past 32 bits as well'''
+        for cls in (pyreBloom.pyreScalableBloom, pyreBloom.pyreCountingBloom,
+            pyreBloom.pyreCuckoo, pyreBloom.pyreStableBloom,
+            pyreBloom.pyrePackedBloom):
+            structure = cls(self.KEY + '.structure', self.CAPACITY, 0.1)
+            try:
+                self.assertEqual(structure.capacity, self.CAPACITY)
+            finally:
+                structure.delete()
+
+    def test_quotient(self):
+        '''A quotient filter is one string, so it can't be sized this big'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreQuotient,
+            self.KEY + '.structure', self.CAPACITY, 0.1)
+
+
 class Accuracytest(BaseTest):
     '''Make sure we meet our accuracy expectations for the bloom filter'''
     def test_random(self):
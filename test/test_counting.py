@@ -0,0 +1,151 @@
+#! /usr/bin/env python
+
+'''Tests for counting bloom filters'''
+
+import random
+import string
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    CAPACITY = 10000
+    ERROR_RATE = 0.01
+    KEY = 'pyreCountingTesting'
+    FROZEN = 'pyreCountingTestingFrozen'
+
+    def setUp(self):
+        self.bloom = pyreBloom.pyreCountingBloom(
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+
+    def tearDown(self):
+        self.bloom.delete()
+        pyreBloom.pyreBloom(self.FROZEN, 1, 0.1).delete()
+
+
+class CountingTest(BaseTest):
+    def test_add(self):
+        '''Make sure we can add, check existing in a basic way'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.assertEqual(self.bloom.extend(tests), len(tests))
+        self.assertEqual(self.bloom.extend(tests), 0)
+        for test in tests:
+            self.assertTrue(test in self.bloom)
+        self.assertEqual(tests, self.bloom.contains(tests))
+        self.assertEqual(self.bloom.width, 4)
+        self.assertEqual(self.bloom.bits, self.bloom.counters * 4)
+
+    def test_remove(self):
+        '''Items that are removed are no longer in the filter'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.bloom.extend(tests)
+        self.assertEqual(self.bloom.remove('hello'), 1)
+        self.assertFalse('hello' in self.bloom)
+        self.assertEqual(self.bloom.remove(['how', 'are']), 2)
+        self.assertEqual(['you', 'today'], self.bloom.contains(tests))
+
+    def test_remove_duplicate(self):
+        '''An item added twice must be removed twice'''
+        self.bloom.add('hello')
+        self.bloom.add('hello')
+        self.assertEqual(self.bloom.remove('hello'), 0)
+        self.assertTrue('hello' in self.bloom)
+        self.assertEqual(self.bloom.remove('hello'), 1)
+        self.assertFalse('hello' in self.bloom)
+
+    def test_accuracy(self):
+        '''Removing items doesn't disturb the others'''
+        included = sample_strings(20, 5000)
+        removed = sample_strings(20, 2000)
+        excluded = sample_strings(20, 5000)
+        self.bloom.extend(included)
+        self.bloom.extend(removed)
+        self.bloom.remove(removed)
+        self.assertEqual(len(included), len(self.bloom.contains(included)))
+
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, self.ERROR_RATE * 2)
+        false_rate = float(len(self.bloom.contains(removed))) / len(removed)
+        self.assertLess(false_rate, self.ERROR_RATE * 2)
+
+    def test_width(self):
+        '''Counters may be given a different width'''
+        self.bloom.delete()
+        bloom = pyreBloom.pyreCountingBloom(
+            self.KEY, self.CAPACITY, self.ERROR_RATE, width=8)
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        bloom.extend(tests)
+        self.assertEqual(tests, bloom.contains(tests))
+        # Everyone else sees the recorded width
+        self.assertEqual(pyreBloom.pyreCountingBloom(self.KEY).width, 8)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreCountingBloom,
+            'pyreCountingTestingWidth', self.CAPACITY, self.ERROR_RATE,
+            width=1)
+
+    def test_freeze(self):
+        '''A frozen filter holds the same items as the counting one'''
+        included = sample_strings(20, 5000)
+        excluded = sample_strings(20, 5000)
+        self.bloom.extend(included)
+        self.bloom.remove(included[:1000])
+        frozen = self.bloom.freeze(self.FROZEN)
+        self.assertEqual(frozen.bits, self.bloom.counters)
+        self.assertEqual(frozen.hashes, self.bloom.hashes)
+        for sample in (included, excluded):
+            self.assertEqual(
+                self.bloom.contains(sample), frozen.contains(sample))
+        self.assertRaises(pyreBloomException, self.bloom.freeze, self.KEY)
+
+    def test_freeze_replaces(self):
+        '''Freezing over another filter leaves none of its keys behind'''
+        included = sample_strings(20, 1000)
+        old = pyreBloom.pyreBloom(self.FROZEN, self.CAPACITY * 10,
+            self.ERROR_RATE, layout='partitioned')
+        old.extend(sample_strings(20, 1000))
+        self.bloom.extend(included)
+        frozen = self.bloom.freeze(self.FROZEN)
+        self.assertEqual(sorted(Redis().keys(self.FROZEN + '*')),
+            sorted(frozen.keys() + [self.FROZEN + '.meta']))
+        self.assertEqual(frozen.contains(included), included)
+        # Only as many bytes as there are bits are written
+        self.assertEqual(Redis().strlen(frozen.keys()[-1]),
+            (self.bloom.counters + 7) // 8)
+        # Anything other than a bloom filter isn't overwritten
+        other = pyreBloom.pyreCountingBloom('pyreCountingTestingOther',
+            self.CAPACITY, self.ERROR_RATE)
+        self.assertRaises(pyreBloomException, self.bloom.freeze,
+            'pyreCountingTestingOther')
+        other.delete()
+
+    def test_error(self):
+        '''Errors are reported, and don't disturb the commands that follow'''
+        samples = sample_strings(20, 5000)
+        self.bloom.delete()
+        Redis().hmset(self.KEY + '.0', {'hello': 5})
+        self.assertRaises(pyreBloomException, self.bloom.extend, samples)
+        self.assertRaises(pyreBloomException, self.bloom.contains, samples)
+        Redis().delete(self.KEY + '.0')
+        # A few of them may be false positives, and so not counted as new
+        self.assertGreater(self.bloom.extend(samples), len(samples) * 0.99)
+        self.assertEqual(self.bloom.contains(samples), samples)
+
+    def test_wrong_type(self):
+        '''A counting filter can't be opened as an ordinary one, and vice
+        versa'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+        pyreBloom.pyreBloom(self.FROZEN, 100, 0.1)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreCountingBloom,
+            self.FROZEN, self.CAPACITY, self.ERROR_RATE)
+
+
+if __name__ == '__main__':
+    unittest.main()
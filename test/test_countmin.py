@@ -0,0 +1,109 @@
+#! /usr/bin/env python
+
+'''Tests for count-min sketches'''
+
+import random
+import string
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    ERROR_RATE = 0.001
+    KEY = 'pyreCountMinTesting'
+    OTHER = 'pyreCountMinTestingOther'
+
+    def setUp(self):
+        self.sketch = pyreBloom.pyreCountMin(self.KEY, self.ERROR_RATE)
+
+    def tearDown(self):
+        self.sketch.delete()
+        Redis().delete(self.OTHER + '.meta')
+        pyreBloom.pyreBloom(self.OTHER, 1, 0.1).delete()
+
+
+class CountMinTest(BaseTest):
+    def test_count(self):
+        '''Make sure we can count items in a basic way'''
+        self.assertEqual(self.sketch.add('hello'), 1)
+        self.assertEqual(self.sketch.increment('hello', 4), 5)
+        self.assertEqual(self.sketch.extend(['hello', 'how']), [6, 1])
+        self.assertEqual(self.sketch.count('hello'), 6)
+        self.assertEqual(self.sketch.count(['hello', 'how', 'are']), [6, 1, 0])
+        self.assertEqual(self.sketch.count([]), [])
+
+    def test_shape(self):
+        '''The shape follows from the error and confidence'''
+        self.assertEqual(self.sketch.columns, 2719)
+        self.assertEqual(self.sketch.rows, 7)
+        self.assertEqual(self.sketch.width, 32)
+        self.assertEqual(self.sketch.bits, 2719 * 7 * 32)
+
+    def test_accuracy(self):
+        '''Estimates are never too low, and rarely too high by much'''
+        samples = sample_strings(20, 2000)
+        counts = dict((sample, random.randint(1, 20)) for sample in samples)
+        for sample, count in counts.items():
+            self.sketch.increment(sample, count)
+        total = sum(counts.values())
+        estimates = self.sketch.count(samples)
+        over = [estimate - counts[sample]
+            for sample, estimate in zip(samples, estimates)]
+        self.assertGreaterEqual(min(over), 0)
+        self.assertLess(
+            len([o for o in over if o > total * self.ERROR_RATE]),
+            len(samples) * (1 - self.sketch.confidence) * 2 + 1)
+
+    def test_saturate(self):
+        '''Counters saturate rather than wrap'''
+        sketch = pyreBloom.pyreCountMin(self.OTHER, self.ERROR_RATE, width=4)
+        self.assertEqual(sketch.increment('hello', 20), 15)
+        self.assertEqual(sketch.increment('hello', -20), 0)
+        sketch.delete()
+
+    def test_open(self):
+        '''Opening a sketch uses its recorded shape'''
+        self.sketch.increment(['hello', 'how'])
+        sketch = pyreBloom.pyreCountMin(self.KEY, 0.1)
+        self.assertEqual(sketch.columns, self.sketch.columns)
+        self.assertEqual(sketch.count(['hello', 'how']), [1, 1])
+        self.assertEqual(pyreBloom.pyreCountMin(self.KEY).rows, 7)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreCountMin,
+            self.OTHER)
+
+    def test_invalid(self):
+        '''An invalid shape is refused, and not recorded'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreCountMin,
+            self.OTHER, 0.01, width=64)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreCountMin,
+            self.OTHER, 0.01, confidence=1)
+        self.assertFalse(Redis().exists(self.OTHER + '.meta'))
+
+    def test_error(self):
+        '''Errors are reported, and don't disturb the commands that follow'''
+        samples = sample_strings(20, 100)
+        Redis().hset(self.KEY + '.0', 'hello', 5)
+        self.assertRaises(pyreBloomException, self.sketch.extend, samples)
+        self.assertRaises(pyreBloomException, self.sketch.count, samples)
+        Redis().delete(self.KEY + '.0')
+        self.assertEqual(self.sketch.extend(['hello']), [1])
+
+    def test_wrong_type(self):
+        '''A sketch can't be opened as a filter, and vice versa'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, 100, 0.1)
+        pyreBloom.pyreBloom(self.OTHER, 100, 0.1)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreCountMin,
+            self.OTHER, self.ERROR_RATE)
+
+
+if __name__ == '__main__':
+    unittest.main()
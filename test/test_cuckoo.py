@@ -0,0 +1,133 @@
+#! /usr/bin/env python
+
+'''Tests for cuckoo filters'''
+
+import random
+import string
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    CAPACITY = 10000
+    ERROR_RATE = 0.001
+    KEY = 'pyreCuckooTesting'
+
+    def setUp(self):
+        self.bloom = pyreBloom.pyreCuckoo(
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+
+    def tearDown(self):
+        self.bloom.delete()
+
+
+class CuckooTest(BaseTest):
+    def test_add(self):
+        '''Make sure we can add, check existing in a basic way'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.assertEqual(self.bloom.extend(tests), len(tests))
+        self.assertEqual(self.bloom.extend(tests), 0)
+        for test in tests:
+            self.assertTrue(test in self.bloom)
+        self.assertEqual(tests, self.bloom.contains(tests))
+
+    def test_remove(self):
+        '''Items that are removed are no longer in the filter'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.bloom.extend(tests)
+        self.assertEqual(self.bloom.remove('hello'), 1)
+        self.assertEqual(self.bloom.remove('hello'), 0)
+        self.assertFalse('hello' in self.bloom)
+        self.assertEqual(self.bloom.remove(['how', 'are']), 2)
+        self.assertEqual(['you', 'today'], self.bloom.contains(tests))
+
+    def test_duplicates(self):
+        '''Every copy of an item is stored, and has to be removed'''
+        self.assertEqual(self.bloom.add('hello'), 1)
+        self.assertEqual(self.bloom.add('hello'), 0)
+        self.assertEqual(self.bloom.remove('hello'), 1)
+        self.assertTrue('hello' in self.bloom)
+        self.assertEqual(self.bloom.remove('hello'), 1)
+        self.assertFalse('hello' in self.bloom)
+
+    def test_copies(self):
+        '''An item's two buckets hold only so many copies of it'''
+        self.assertEqual(self.bloom.extend(['hello'] * 8), 1)
+        self.assertRaises(pyreBloomException, self.bloom.add, 'hello')
+        self.assertEqual(self.bloom.remove(['hello'] * 8), 8)
+        self.assertFalse('hello' in self.bloom)
+
+    def test_accuracy(self):
+        '''Fill the filter to capacity, and make sure we meet our accuracy
+        expectations'''
+        included = sample_strings(20, self.CAPACITY)
+        excluded = sample_strings(20, 10000)
+        self.bloom.extend(included)
+        self.assertEqual(len(included), len(self.bloom.contains(included)))
+
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, self.ERROR_RATE * 2)
+
+    def test_size(self):
+        '''At low error rates, it's smaller than a bloom filter'''
+        bloom = pyreBloom.pyreBloom(
+            'pyreCuckooTestingBloom', self.CAPACITY, self.ERROR_RATE)
+        self.assertLess(self.bloom.bits, bloom.bits)
+
+    def test_full(self):
+        '''Adding to a full filter is an error, and leaves it intact'''
+        self.bloom.delete()
+        bloom = pyreBloom.pyreCuckoo(self.KEY, 100, self.ERROR_RATE)
+        self.assertRaises(pyreBloomException, bloom.extend,
+            sample_strings(20, 200))
+        bloom.delete()
+
+        added = []
+        for sample in sample_strings(20, 200):
+            try:
+                bloom.add(sample)
+                added.append(sample)
+            except pyreBloomException:
+                pass
+        self.assertGreaterEqual(len(added), 100)
+        self.assertEqual(added, bloom.contains(added))
+
+    def test_script_flush(self):
+        '''If redis forgets our scripts, only one batch is lost'''
+        Redis().script_flush()
+        self.assertRaises(pyreBloomException, self.bloom.add, 'hello')
+        self.assertEqual(self.bloom.add('hello'), 1)
+        self.assertTrue('hello' in self.bloom)
+
+    def test_two_instances(self):
+        '''A second client sees the same filter'''
+        other = pyreBloom.pyreCuckoo(self.KEY)
+        self.assertEqual(other.buckets, self.bloom.buckets)
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.bloom.extend(tests)
+        self.assertEqual(tests, other.contains(tests))
+
+    def test_wrong_type(self):
+        '''A cuckoo filter can't be opened as an ordinary one, and vice
+        versa'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+        bloom = pyreBloom.pyreBloom('pyreCuckooTestingBloom', 100, 0.1)
+        bloom.add('hello')
+        try:
+            self.assertRaises(pyreBloomException, pyreBloom.pyreCuckoo,
+                'pyreCuckooTestingBloom', self.CAPACITY, self.ERROR_RATE)
+        finally:
+            bloom.delete()
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,122 @@
+#! /usr/bin/env python
+
+'''Tests for packed filters'''
+
+import random
+import string
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    CAPACITY = 1000
+    ERROR_RATE = 0.01
+    KEY = 'pyrePackedTesting'
+    OTHER = 'pyrePackedTestingOther'
+
+    def setUp(self):
+        self.bloom = pyreBloom.pyrePackedBloom(
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+
+    def tearDown(self):
+        self.bloom.delete()
+        Redis().delete(self.OTHER + '.meta', self.OTHER + '.tenants')
+        pyreBloom.pyreBloom(self.OTHER, 1, 0.1).delete()
+
+
+class PackedTest(BaseTest):
+    def test_add(self):
+        '''Make sure we can add, check existing in a basic way'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.assertEqual(self.bloom.extend('moz.com', tests), len(tests))
+        self.assertEqual(self.bloom.extend('moz.com', tests), 0)
+        for test in tests:
+            self.assertTrue(self.bloom.contains('moz.com', test))
+        self.assertEqual(tests, self.bloom.contains('moz.com', tests))
+        self.assertEqual(self.bloom.contains('moz.com', []), [])
+        self.assertFalse(self.bloom.contains('example.com', 'hello'))
+
+    def test_tenants(self):
+        '''Each tenant has a filter of its own'''
+        self.bloom.add('moz.com', 'hello')
+        self.bloom.add('example.com', 'world')
+        self.assertEqual(self.bloom.count(), 2)
+        self.assertEqual(self.bloom.contains('moz.com', ['hello', 'world']),
+            ['hello'])
+        self.assertEqual(self.bloom.contains('example.com',
+            ['hello', 'world']), ['world'])
+        # Another client finds the same tenants
+        other = pyreBloom.pyrePackedBloom(self.KEY)
+        self.assertEqual(other.bits, self.bloom.bits)
+        self.assertEqual(other.contains_pairs([('moz.com', 'hello'),
+            ('moz.com', 'world'), ('other.com', 'hello')]),
+            [('moz.com', 'hello')])
+        self.assertEqual(self.bloom.keys(), [self.KEY + '.0'])
+
+    def test_pairs(self):
+        '''Items for many tenants are added and checked in one batch'''
+        tenants = sample_strings(10, 500)
+        pairs = [(tenant, item) for tenant in tenants
+            for item in sample_strings(20, 10)]
+        random.shuffle(pairs)
+        self.assertEqual(self.bloom.add_pairs(pairs), len(pairs))
+        self.assertEqual(self.bloom.add_pairs(pairs[:100]), 0)
+        self.assertEqual(pairs, self.bloom.contains_pairs(pairs))
+        # Swapping the items between tenants finds hardly any of them
+        swapped = [(tenant, item) for (tenant, ignored), (ignored, item) in
+            zip(pairs, pairs[1:] + pairs[:1])]
+        false_rate = (float(len(self.bloom.contains_pairs(swapped))) /
+            len(swapped))
+        self.assertLess(false_rate, self.ERROR_RATE)
+
+    def test_segments(self):
+        '''Tenants spill over into more shared segments'''
+        bloom = pyreBloom.pyrePackedBloom(self.OTHER, 1000000,
+            self.ERROR_RATE)
+        self.assertEqual(bloom.tenants_per_segment, 14)
+        tenants = ['tenant%i' % i for i in range(30)]
+        bloom.add_pairs([(tenant, tenant) for tenant in tenants])
+        self.assertEqual(len(bloom.keys()), 3)
+        for key in bloom.keys():
+            self.assertTrue(Redis().exists(key))
+        self.assertEqual(bloom.contains_pairs(
+            [(tenant, tenant) for tenant in tenants]),
+            [(tenant, tenant) for tenant in tenants])
+        self.assertEqual(bloom.contains('tenant0', 'tenant1'), False)
+        bloom.delete()
+        for key in ['%s.%i' % (self.OTHER, i) for i in range(3)]:
+            self.assertFalse(Redis().exists(key))
+
+    def test_error(self):
+        '''Errors are reported, and don't disturb the commands that follow'''
+        self.bloom.add('moz.com', 'hello')
+        Redis().delete(self.KEY + '.0')
+        Redis().hset(self.KEY + '.0', 'hello', 5)
+        self.assertRaises(pyreBloomException, self.bloom.extend, 'moz.com',
+            ['a', 'b'])
+        self.assertRaises(pyreBloomException, self.bloom.contains, 'moz.com',
+            ['a', 'b'])
+        Redis().delete(self.KEY + '.0')
+        self.assertEqual(self.bloom.extend('moz.com', ['a', 'b']), 2)
+        self.assertEqual(self.bloom.contains('moz.com', ['a', 'c']), ['a'])
+
+    def test_wrong_type(self):
+        '''A packed filter can't be opened as an ordinary one, and vice
+        versa'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+        pyreBloom.pyreBloom(self.OTHER, 100, 0.1)
+        self.assertRaises(pyreBloomException, pyreBloom.pyrePackedBloom,
+            self.OTHER, self.CAPACITY, self.ERROR_RATE)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,128 @@
+#! /usr/bin/env python
+
+'''Tests for prefix filters'''
+
+import random
+import string
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+def sample_urls(count):
+    '''Return a set of url-like strings with a few components each'''
+    return ['/'.join(sample_strings(8, random.randint(1, 5)))
+        for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    CAPACITY = 10000
+    ERROR_RATE = 0.01
+    KEY = 'pyrePrefixTesting'
+    OTHER = 'pyrePrefixTestingOther'
+
+    def setUp(self):
+        self.bloom = pyreBloom.pyrePrefixBloom(
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+
+    def tearDown(self):
+        self.bloom.delete()
+        Redis().delete(self.OTHER + '.meta')
+        pyreBloom.pyreBloom(self.OTHER, 1, 0.1).delete()
+
+
+class PrefixTest(BaseTest):
+    def test_add(self):
+        '''Make sure we can add, check existing in a basic way'''
+        tests = ['moz.com/blog/post', 'moz.com/about', 'example.com']
+        self.assertEqual(self.bloom.extend(tests), len(tests))
+        self.assertEqual(self.bloom.extend(tests), 0)
+        for test in tests:
+            self.assertTrue(test in self.bloom)
+        self.assertEqual(tests, self.bloom.contains(tests))
+        self.assertEqual(self.bloom.contains([]), [])
+
+    def test_prefixes(self):
+        '''Prefixes of whole components are found, and others aren't'''
+        self.bloom.add('moz.com/blog/post')
+        self.assertEqual(['moz.com', 'moz.com/blog', 'moz.com/blog/'],
+            self.bloom.contains(['moz.com', 'moz.com/blog', 'moz.com/blog/',
+                'moz.co', 'moz.com/bl', 'moz.com/about', 'blog']))
+
+    def test_depth(self):
+        '''The depth is how many leading components have been seen'''
+        self.bloom.add('moz.com/blog/post')
+        self.assertEqual(self.bloom.depth('moz.com/blog/other/page'), 2)
+        self.assertEqual(self.bloom.depth(
+            ['moz.com/blog/post/more', 'example.com/blog', 'moz.com']),
+            [3, 0, 1])
+
+    def test_levels(self):
+        '''Prefixes deeper than the last level still work'''
+        bloom = pyreBloom.pyrePrefixBloom(
+            self.OTHER, self.CAPACITY, self.ERROR_RATE, levels=2)
+        bloom.add('a/b/c/d/e')
+        self.assertEqual(len(bloom.keys()), 2)
+        self.assertEqual(bloom.depth('a/b/c/d/e/f'), 5)
+        self.assertEqual(bloom.depth('a/b/c/x/e'), 3)
+        self.assertFalse('a/b/d' in bloom)
+        bloom.delete()
+
+    def test_separator(self):
+        '''Another separator may be used, and is recorded'''
+        bloom = pyreBloom.pyrePrefixBloom(
+            self.OTHER, self.CAPACITY, self.ERROR_RATE, separator='.')
+        bloom.add('com.moz.www')
+        self.assertTrue('com.moz' in bloom)
+        self.assertFalse('com/moz' in bloom)
+        self.assertEqual(pyreBloom.pyrePrefixBloom(self.OTHER).separator, '.')
+        bloom.delete()
+        self.assertRaises(pyreBloomException, pyreBloom.pyrePrefixBloom,
+            self.OTHER, self.CAPACITY, self.ERROR_RATE, separator='//')
+
+    def test_accuracy(self):
+        '''Items and prefixes meet our accuracy expectations'''
+        included = sample_urls(2000)
+        excluded = sample_urls(2000)
+        self.bloom.extend(included)
+        self.assertEqual(included, self.bloom.contains(included))
+        prefixes = [url.rsplit('/', 1)[0] for url in included]
+        self.assertEqual(prefixes, self.bloom.contains(prefixes))
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, self.ERROR_RATE * 2)
+
+    def test_invalid(self):
+        '''Invalid levels are refused, and not recorded'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyrePrefixBloom,
+            self.OTHER, self.CAPACITY, self.ERROR_RATE, levels=0)
+        self.assertFalse(Redis().exists(self.OTHER + '.meta'))
+
+    def test_error(self):
+        '''Errors are reported, and don't disturb the commands that follow'''
+        Redis().hset(self.KEY + '.l1.0', 'hello', 5)
+        self.assertRaises(pyreBloomException, self.bloom.extend,
+            ['a/b', 'c/d'])
+        self.assertRaises(pyreBloomException, self.bloom.depth,
+            ['a/b', 'c/d'])
+        Redis().delete(self.KEY + '.l1.0')
+        self.assertEqual(self.bloom.depth(['a/b', 'e']), [1, 0])
+
+    def test_wrong_type(self):
+        '''A prefix filter can't be opened as an ordinary one, and vice
+        versa'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+        pyreBloom.pyreBloom(self.OTHER, 100, 0.1)
+        self.assertRaises(pyreBloomException, pyreBloom.pyrePrefixBloom,
+            self.OTHER, self.CAPACITY, self.ERROR_RATE)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,149 @@
+#! /usr/bin/env python
+
+'''Tests for quotient filters'''
+
+import random
+import string
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    CAPACITY = 10000
+    ERROR_RATE = 0.01
+    KEY = 'pyreQuotientTesting'
+    OTHER = 'pyreQuotientTestingOther'
+
+    def setUp(self):
+        self.bloom = pyreBloom.pyreQuotient(
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+
+    def tearDown(self):
+        self.bloom.delete()
+        Redis().delete(self.OTHER + '.meta', self.KEY + '.grow')
+        pyreBloom.pyreBloom(self.OTHER, 1, 0.1).delete()
+
+
+class QuotientTest(BaseTest):
+    def test_add(self):
+        '''Make sure we can add, check existing in a basic way'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.assertEqual(self.bloom.extend(tests), len(tests))
+        self.assertEqual(self.bloom.extend(tests), 0)
+        self.assertEqual(self.bloom.count, len(tests))
+        for test in tests:
+            self.assertTrue(test in self.bloom)
+        self.assertEqual(tests, self.bloom.contains(tests))
+        self.assertEqual(self.bloom.contains([]), [])
+        self.assertFalse('goodbye' in self.bloom)
+
+    def test_shape(self):
+        '''The filter is sized for its capacity, and is described in redis'''
+        self.assertEqual(self.bloom.slots, 16384)
+        self.assertEqual(self.bloom.slot_bytes, 2)
+        self.assertEqual(self.bloom.remainder_bits, 13)
+        other = pyreBloom.pyreQuotient(self.KEY)
+        self.assertEqual(other.capacity, self.CAPACITY)
+        self.assertEqual(other.fingerprint_bits, self.bloom.fingerprint_bits)
+
+    def test_accuracy(self):
+        '''Make sure we meet our accuracy expectations'''
+        included = sample_strings(20, self.CAPACITY)
+        excluded = sample_strings(20, self.CAPACITY)
+        self.bloom.extend(included)
+        self.assertEqual(included, self.bloom.contains(included))
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, self.ERROR_RATE)
+
+    def test_grow(self):
+        '''Growing doubles the slots, keeps every item and the error rate'''
+        included = sample_strings(20, 5000)
+        self.bloom.extend(included)
+        count = self.bloom.count
+        other = pyreBloom.pyreQuotient(self.KEY)
+        self.bloom.grow()
+        self.assertEqual(self.bloom.slots, 32768)
+        self.assertEqual(self.bloom.count, count)
+        self.assertEqual(included, self.bloom.contains(included))
+        # Other clients pick up the new size as they go
+        self.assertEqual(included, other.contains(included))
+        self.assertEqual(other.add('goodbye'), 1)
+        self.assertTrue('goodbye' in self.bloom)
+        self.assertEqual(other.slots, 32768)
+
+    def test_full(self):
+        '''A full filter refuses more items until it grows'''
+        bloom = pyreBloom.pyreQuotient(self.OTHER, 40, self.ERROR_RATE)
+        items = sample_strings(20, 100)
+        self.assertRaises(pyreBloomException, bloom.extend, items)
+        bloom.grow()
+        bloom.grow()
+        bloom.extend(items)
+        self.assertEqual(items, bloom.contains(items))
+        bloom.delete()
+
+    def test_merge(self):
+        '''Merging adds the other filter's items, and grows to fit them'''
+        first = sample_strings(20, 7000)
+        second = sample_strings(20, 7000)
+        other = pyreBloom.pyreQuotient(
+            self.OTHER, self.CAPACITY, self.ERROR_RATE)
+        self.bloom.extend(first)
+        other.extend(second)
+        other.grow()
+        self.bloom.merge(self.OTHER)
+        self.assertEqual(self.bloom.slots, 32768)
+        self.assertEqual(first + second, self.bloom.contains(first + second))
+        count = self.bloom.count
+        self.assertGreater(count, 13990)
+        # Merging again adds nothing new
+        self.bloom.merge(self.OTHER)
+        self.assertEqual(self.bloom.count, count)
+        other.delete()
+
+    def test_merge_mismatch(self):
+        '''Filters with different fingerprints can't be merged'''
+        other = pyreBloom.pyreQuotient(self.OTHER, self.CAPACITY, 0.1)
+        self.assertRaises(pyreBloomException, self.bloom.merge, self.OTHER)
+        other.delete()
+        pyreBloom.pyreBloom(self.OTHER, 100, 0.1)
+        self.assertRaises(pyreBloomException, self.bloom.merge, self.OTHER)
+
+    def test_invalid(self):
+        '''Filters that are too large are refused, and not recorded'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreQuotient,
+            self.OTHER, 2 ** 31, self.ERROR_RATE)
+        self.assertFalse(Redis().exists(self.OTHER + '.meta'))
+        self.assertRaises(pyreBloomException, pyreBloom.pyreQuotient,
+            self.OTHER)
+
+    def test_error(self):
+        '''Errors are reported, and don't disturb the commands that follow'''
+        Redis().hset(self.KEY + '.0', 'hello', 5)
+        self.assertRaises(pyreBloomException, self.bloom.extend, ['a', 'b'])
+        self.assertRaises(pyreBloomException, self.bloom.contains, ['a', 'b'])
+        self.assertRaises(pyreBloomException, self.bloom.grow)
+        Redis().delete(self.KEY + '.0')
+        self.assertEqual(self.bloom.extend(['a', 'b']), 2)
+        self.assertEqual(self.bloom.contains(['a', 'c']), ['a'])
+
+    def test_wrong_type(self):
+        '''A quotient filter can't be opened as an ordinary one, and vice
+        versa'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+        pyreBloom.pyreBloom(self.OTHER, 100, 0.1)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreQuotient,
+            self.OTHER, self.CAPACITY, self.ERROR_RATE)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,136 @@
+#! /usr/bin/env python
+
+'''Tests for rotating filters'''
+
+import random
+import string
+import time
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    CAPACITY = 10000
+    ERROR_RATE = 0.1
+    PERIOD = 86400
+    GENERATIONS = 3
+    KEY = 'pyreRotatingTesting'
+
+    def setUp(self):
+        self.bloom = pyreBloom.pyreRotatingBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, self.PERIOD, self.GENERATIONS)
+        self.redis = Redis()
+
+    def tearDown(self):
+        self.bloom.delete()
+
+
+class RotatingTest(BaseTest):
+    def test_add(self):
+        '''Make sure we can add, check existing in a basic way'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.assertEqual(self.bloom.extend(tests), len(tests))
+        self.assertEqual(self.bloom.extend(tests), 0)
+        for test in tests:
+            self.assertTrue(test in self.bloom)
+        self.assertEqual(tests, self.bloom.contains(tests))
+
+    def test_accuracy(self):
+        '''The false positive rate over all generations stays under error'''
+        included = sample_strings(20, 5000)
+        excluded = sample_strings(20, 5000)
+        self.bloom.extend(included)
+        self.assertEqual(included, self.bloom.contains(included))
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, self.ERROR_RATE)
+
+    def test_generation(self):
+        '''Generations are numbered by redis' clock'''
+        seconds = int(self.redis.time()[0])
+        self.assertEqual(self.bloom.generation, seconds // self.PERIOD)
+        self.bloom.add('hello')
+        key = 'pyreRotatingTesting.g%i.0' % self.bloom.generation
+        self.assertEqual(self.bloom.keys()[0], key)
+        self.assertEqual(len(self.bloom.keys()), self.GENERATIONS)
+
+        # It expires once it's no longer live
+        expiry = (self.bloom.generation + self.GENERATIONS) * self.PERIOD
+        self.assertAlmostEqual(self.redis.ttl(key), expiry - seconds, delta=2)
+
+    def test_open(self):
+        '''The description recorded at creation wins'''
+        bloom = pyreBloom.pyreRotatingBloom(self.KEY)
+        self.assertEqual(bloom.period, self.PERIOD)
+        self.assertEqual(bloom.generations, self.GENERATIONS)
+        self.bloom.add('hello')
+        self.assertTrue('hello' in bloom)
+
+    def test_invalid(self):
+        '''A filter needs a period and at least one generation'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreRotatingBloom,
+            'pyreRotatingTestingInvalid', 100, 0.1, 0)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreRotatingBloom,
+            'pyreRotatingTestingInvalid', 100, 0.1, 60, 0)
+        self.assertFalse(self.redis.exists('pyreRotatingTestingInvalid.meta'))
+
+    def test_wrong_type(self):
+        '''A rotating filter can't share a key with another kind of filter'''
+        bloom = pyreBloom.pyreBloom('pyreRotatingTestingBloom', 100, 0.01)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreRotatingBloom,
+            'pyreRotatingTestingBloom', 100, 0.01)
+        bloom.delete()
+
+    def test_script_flush(self):
+        '''Checks recover after redis forgets our script'''
+        self.bloom.add('hello')
+        self.redis.script_flush()
+        self.assertRaises(pyreBloomException, self.bloom.contains, 'hello')
+        self.assertTrue('hello' in self.bloom)
+
+
+class RotationTest(BaseTest):
+    '''Make sure old generations are forgotten'''
+    PERIOD = 1
+    GENERATIONS = 2
+
+    def wait(self):
+        '''Wait for the start of the next generation'''
+        time.sleep(1 - (self.redis.time()[1] / 1e6) + 0.05)
+
+    def test_rotation(self):
+        '''Items are forgotten once their generation ages out'''
+        self.wait()
+        self.bloom.add('hello')
+        first = self.bloom.generation
+        self.wait()
+        self.bloom.add('how')
+        self.assertEqual(self.bloom.generation, first + 1)
+        self.assertEqual(['hello', 'how'], self.bloom.contains(['hello', 'how']))
+
+        # Now 'hello' has aged out, and its generation has been unlinked
+        self.wait()
+        self.bloom.add('are')
+        self.assertEqual(['how', 'are'],
+            self.bloom.contains(['hello', 'how', 'are']))
+        self.assertFalse(self.redis.exists('pyreRotatingTesting.g%i.0' % first))
+
+    def test_bounded(self):
+        '''There are never more than `generations` generations in redis'''
+        for i in range(4):
+            self.wait()
+            self.bloom.add('hello')
+            self.assertLessEqual(
+                len(self.redis.keys('pyreRotatingTesting.g*')),
+                self.GENERATIONS)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,93 @@
+#! /usr/bin/env python
+
+'''Tests for scalable bloom filters'''
+
+import random
+import string
+import unittest
+import pyreBloom
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    CAPACITY = 1000
+    ERROR_RATE = 0.01
+    KEY = 'pyreScalableTesting'
+
+    def setUp(self):
+        self.bloom = pyreBloom.pyreScalableBloom(
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+
+    def tearDown(self):
+        self.bloom.delete()
+
+
+class ScalableTest(BaseTest):
+    def test_add(self):
+        '''Make sure we can add, check existing in a basic way'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.assertEqual(self.bloom.extend(tests), len(tests))
+        for test in tests:
+            self.assertTrue(test in self.bloom)
+        self.assertEqual(tests, self.bloom.contains(tests))
+        self.assertEqual(self.bloom.filters, 1)
+
+    def test_growth(self):
+        '''Filling past capacity starts new, larger filters'''
+        included = sample_strings(20, 10 * self.CAPACITY)
+        excluded = sample_strings(20, 5000)
+        for start in range(0, len(included), 500):
+            self.bloom.extend(included[start:start + 500])
+        # Capacities of 1000, 2000, 4000 and 8000 hold 10000 items
+        self.assertEqual(self.bloom.filters, 4)
+        self.assertEqual(len(included), len(self.bloom.contains(included)))
+
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, self.ERROR_RATE * 2)
+
+    def test_large_batch(self):
+        '''A batch bigger than the newest filter is spread across new ones'''
+        included = sample_strings(20, 10 * self.CAPACITY)
+        excluded = sample_strings(20, 5000)
+        self.bloom.extend(included)
+        self.assertEqual(self.bloom.filters, 4)
+        self.assertEqual(len(included), len(self.bloom.contains(included)))
+
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, self.ERROR_RATE * 2)
+
+    def test_two_instances(self):
+        '''A second client sees filters started by the first'''
+        other = pyreBloom.pyreScalableBloom(self.KEY)
+        self.assertEqual(other.capacity, self.CAPACITY)
+        included = sample_strings(20, 3 * self.CAPACITY)
+        for start in range(0, len(included), 500):
+            self.bloom.extend(included[start:start + 500])
+        self.assertEqual(other.filters, 1)
+        self.assertEqual(len(included), len(other.contains(included)))
+        self.assertEqual(other.filters, self.bloom.filters)
+
+    def test_delete(self):
+        '''Deleting removes every filter in the chain'''
+        included = sample_strings(20, 3 * self.CAPACITY)
+        for start in range(0, len(included), 500):
+            self.bloom.extend(included[start:start + 500])
+        self.bloom.delete()
+        self.assertEqual(self.bloom.filters, 1)
+        self.assertEqual(len(self.bloom.contains(included)), 0)
+
+    def test_wrong_type(self):
+        '''A scalable filter can't be opened as an ordinary one'''
+        self.bloom.add('hello')
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+
+
+if __name__ == '__main__':
+    unittest.main()
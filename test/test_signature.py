@@ -0,0 +1,106 @@
+#! /usr/bin/env python
+
+'''Tests for bit-sliced signature indexes'''
+
+import random
+import string
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    CAPACITY = 1000
+    ERROR_RATE = 0.01
+    KEY = 'pyreSignatureTesting'
+    OTHER = 'pyreSignatureTestingOther'
+
+    def setUp(self):
+        self.index = pyreBloom.pyreSignatureIndex(
+            self.KEY, self.CAPACITY, self.ERROR_RATE, slots=100)
+
+    def tearDown(self):
+        self.index.delete()
+        Redis().delete(self.OTHER + '.meta')
+        pyreBloom.pyreBloom(self.OTHER, 1, 0.1).delete()
+
+
+class SignatureTest(BaseTest):
+    def test_add(self):
+        '''Make sure we can add, check existing in a basic way'''
+        self.assertEqual(self.index.add('moz.com', ['hello', 'how']), 2)
+        self.assertEqual(self.index.add('moz.com', 'hello'), 0)
+        self.assertEqual(self.index.add('example.com', ['how', 'are']), 2)
+        self.assertEqual(self.index.contains('hello'), ['moz.com'])
+        self.assertEqual(sorted(self.index.contains('how')),
+            ['example.com', 'moz.com'])
+        self.assertEqual(self.index.contains(['are', 'you']),
+            [['example.com'], []])
+        self.assertEqual(self.index.contains([]), [])
+
+    def test_slots(self):
+        '''Slots are rounded up to whole words'''
+        self.assertEqual(self.index.slots, 128)
+        self.assertEqual(self.index.bits % 128, 0)
+
+    def test_accuracy(self):
+        '''Each member's filter meets our accuracy expectations'''
+        members = dict(('member%i' % i, sample_strings(20, 200))
+            for i in range(20))
+        for member, items in members.items():
+            self.index.extend(member, items)
+        for member, items in members.items():
+            found = self.index.contains(items)
+            self.assertTrue(all(member in names for names in found))
+            # Only rarely does another member claim to have the item
+            others = sum(len(names) - 1 for names in found)
+            self.assertLess(others, len(items) * 19 * self.ERROR_RATE * 2)
+
+    def test_open(self):
+        '''Another client sees the same members'''
+        self.index.add('moz.com', 'hello')
+        index = pyreBloom.pyreSignatureIndex(self.KEY)
+        self.assertEqual(index.slots, 128)
+        self.assertEqual(index.contains('hello'), ['moz.com'])
+        index.add('example.com', 'hello')
+        self.assertEqual(sorted(self.index.contains('hello')),
+            ['example.com', 'moz.com'])
+
+    def test_full(self):
+        '''There can't be more members than slots'''
+        for i in range(128):
+            self.index.add('member%i' % i, 'hello')
+        self.assertRaises(pyreBloomException, self.index.add, 'more', 'hello')
+        self.assertEqual(len(self.index.contains('hello')), 128)
+
+    def test_error(self):
+        '''Errors are reported, and don't disturb the commands that follow'''
+        self.index.add('moz.com', 'hello')
+        Redis().delete(self.KEY + '.0')
+        Redis().hset(self.KEY + '.0', 'hello', 5)
+        self.assertRaises(pyreBloomException, self.index.add, 'moz.com',
+            ['hello', 'how'])
+        self.assertRaises(pyreBloomException, self.index.contains,
+            ['hello', 'how'])
+        Redis().delete(self.KEY + '.0')
+        self.assertEqual(self.index.add('moz.com', ['hello']), 1)
+        self.assertEqual(self.index.contains(['hello']), [['moz.com']])
+
+    def test_wrong_type(self):
+        '''An index can't be opened as a filter, and vice versa'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+        pyreBloom.pyreBloom(self.OTHER, 100, 0.1)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreSignatureIndex,
+            self.OTHER, self.CAPACITY, self.ERROR_RATE)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,101 @@
+#! /usr/bin/env python
+
+'''Tests for stable bloom filters'''
+
+import random
+import string
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    CAPACITY = 10000
+    ERROR_RATE = 0.01
+    KEY = 'pyreStableTesting'
+    OTHER = 'pyreStableTestingOther'
+
+    def setUp(self):
+        self.bloom = pyreBloom.pyreStableBloom(
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+
+    def tearDown(self):
+        self.bloom.delete()
+        Redis().delete(self.OTHER + '.meta')
+        pyreBloom.pyreBloom(self.OTHER, 1, 0.1).delete()
+
+
+class StableTest(BaseTest):
+    def test_add(self):
+        '''Make sure we can add, check existing in a basic way'''
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        self.assertEqual(self.bloom.extend(tests), len(tests))
+        self.assertEqual(self.bloom.extend(tests), 0)
+        for test in tests:
+            self.assertTrue(test in self.bloom)
+        self.assertEqual(tests, self.bloom.contains(tests))
+        self.assertEqual(self.bloom.contains([]), [])
+        self.assertEqual(self.bloom.width, 3)
+        self.assertEqual(self.bloom.bits, self.bloom.cells * 3)
+
+    def test_stream(self):
+        '''However many items are added, the false positive rate stays put and
+        the most recent items are still there'''
+        for i in range(6):
+            samples = sample_strings(20, 5000)
+            self.bloom.extend(samples)
+        excluded = sample_strings(20, 5000)
+        false_rate = float(len(self.bloom.contains(excluded))) / len(excluded)
+        self.assertLess(false_rate, self.ERROR_RATE * 2)
+        recent = samples[-100:]
+        self.assertEqual(recent, self.bloom.contains(recent))
+
+    def test_forgets(self):
+        '''Items added long ago are forgotten'''
+        old = sample_strings(20, 1000)
+        self.bloom.extend(old)
+        for i in range(10):
+            self.bloom.extend(sample_strings(20, 5000))
+        self.assertLess(len(self.bloom.contains(old)), len(old) / 2)
+
+    def test_decrements(self):
+        '''The number of decrements is recorded, and used by everyone'''
+        self.assertGreater(self.bloom.decrements, 0)
+        other = pyreBloom.pyreStableBloom(self.KEY, self.CAPACITY, 0.1)
+        self.assertEqual(other.decrements, self.bloom.decrements)
+        self.assertEqual(other.error, self.ERROR_RATE)
+        self.assertEqual(
+            pyreBloom.pyreStableBloom(self.KEY).capacity, self.CAPACITY)
+
+    def test_width(self):
+        '''Cells may be given a different width, within reason'''
+        bloom = pyreBloom.pyreStableBloom(
+            self.OTHER, self.CAPACITY, self.ERROR_RATE, width=8)
+        tests = ['hello', 'how', 'are', 'you', 'today']
+        bloom.extend(tests)
+        self.assertEqual(tests, bloom.contains(tests))
+        self.assertEqual(pyreBloom.pyreStableBloom(self.OTHER).width, 8)
+        bloom.delete()
+        self.assertRaises(pyreBloomException, pyreBloom.pyreStableBloom,
+            self.OTHER, self.CAPACITY, self.ERROR_RATE, width=17)
+        self.assertFalse(Redis().exists(self.OTHER + '.meta'))
+
+    def test_wrong_type(self):
+        '''A stable filter can't be opened as an ordinary one, and vice
+        versa'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreBloom,
+            self.KEY, self.CAPACITY, self.ERROR_RATE)
+        pyreBloom.pyreBloom(self.OTHER, 100, 0.1)
+        self.assertRaises(pyreBloomException, pyreBloom.pyreStableBloom,
+            self.OTHER, self.CAPACITY, self.ERROR_RATE)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,131 @@
+#! /usr/bin/env python
+
+'''Tests for syncing filters to a replica'''
+
+import random
+import string
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    '''The replica is just another database on the same redis'''
+    CAPACITY = 100000
+    ERROR_RATE = 0.01
+    KEY = 'pyreSyncTesting'
+    PAGE_BYTES = 4096
+
+    def setUp(self):
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE)
+        self.sync = pyreBloom.pyreSync(replica_db=1,
+            page_bytes=self.PAGE_BYTES)
+        self.keys = self.bloom.keys() + [self.KEY + '.meta']
+        self.redis = Redis()
+        self.replica = Redis(db=1)
+
+    def tearDown(self):
+        for db in (0, 1):
+            pyreBloom.pyreBloom(self.KEY, 1, 0.1, db=db).delete()
+
+    def assertSynced(self):
+        for key in self.keys:
+            self.assertEqual(self.redis.dump(key), self.replica.dump(key))
+
+
+class SyncTest(BaseTest):
+    def test_sync(self):
+        '''A replica can be opened, and has everything the source has'''
+        included = sample_strings(20, 1000)
+        self.bloom.extend(included)
+        self.assertGreater(self.sync.sync(self.keys), 0)
+        self.assertSynced()
+        replica = pyreBloom.open(self.KEY, db=1)
+        self.assertEqual(replica.bits, self.bloom.bits)
+        self.assertEqual(replica.contains(included), included)
+
+    def test_unchanged(self):
+        '''Nothing is sent when nothing has changed'''
+        self.bloom.extend(sample_strings(20, 1000))
+        self.sync.sync(self.keys)
+        sent = self.sync.pages_sent
+        self.assertEqual(self.sync.sync(self.keys), 0)
+        self.assertEqual(self.sync.pages_sent, sent)
+        pages = (self.bloom.bits // 8 + self.PAGE_BYTES - 1) // self.PAGE_BYTES
+        self.assertEqual(self.sync.pages_checked, 2 * pages)
+
+    def test_incremental(self):
+        '''Only the pages that changed are sent'''
+        self.bloom.extend(sample_strings(20, 1000))
+        self.sync.sync(self.keys)
+        self.bloom.add('hello')
+        self.assertLessEqual(self.sync.sync(self.keys), self.bloom.hashes)
+        self.assertSynced()
+        self.assertTrue('hello' in pyreBloom.open(self.KEY, db=1))
+
+    def test_zero_pages(self):
+        '''Pages with no bits set aren't sent'''
+        self.bloom.extend(['hello', 'world'])
+        # Every bit is in a page of its own, plus the metadata
+        self.assertLessEqual(self.sync.sync(self.keys),
+            2 * self.bloom.hashes + 1)
+        self.assertLessEqual(self.sync.bytes_sent,
+            (2 * self.bloom.hashes + 1) * self.PAGE_BYTES)
+        self.assertSynced()
+
+    def test_drift(self):
+        '''A replica that's been changed on its own is put right'''
+        self.bloom.extend(sample_strings(20, 1000))
+        self.sync.sync(self.keys)
+        self.replica.setrange(self.KEY + '.0', 100, 'garbage')
+        self.assertEqual(self.sync.sync(self.keys), 1)
+        self.assertSynced()
+        self.replica.append(self.KEY + '.0', 'garbage')
+        self.sync.sync(self.keys)
+        self.assertSynced()
+
+    def test_delete(self):
+        '''Keys missing from the source are deleted from the replica'''
+        self.bloom.extend(sample_strings(20, 1000))
+        self.sync.sync(self.keys)
+        self.bloom.delete()
+        self.assertEqual(self.sync.sync(self.keys), 0)
+        for key in self.keys:
+            self.assertFalse(self.replica.exists(key))
+
+    def test_sparse(self):
+        '''Keys that aren't strings are copied whole'''
+        self.bloom.delete()
+        self.bloom = pyreBloom.pyreBloom(self.KEY, self.CAPACITY,
+            self.ERROR_RATE, layout='sparse')
+        self.keys = self.bloom.keys() + [self.KEY + '.meta']
+        self.bloom.extend(['hello', 'world'])
+        self.assertEqual(self.sync.sync(self.keys), 2)
+        self.assertSynced()
+        self.assertEqual(self.sync.sync(self.keys), 0)
+        self.assertEqual(pyreBloom.open(self.KEY, db=1).contains(
+            ['hello', 'world', 'other']), ['hello', 'world'])
+
+    def test_single_key(self):
+        '''A single key can be synced on its own'''
+        self.bloom.add('hello')
+        self.assertGreater(self.sync.sync(self.KEY + '.0'), 0)
+        self.assertEqual(self.redis.get(self.KEY + '.0'),
+            self.replica.get(self.KEY + '.0'))
+
+    def test_page_bytes(self):
+        '''Pages must have something in them'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreSync,
+            page_bytes=0)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,142 @@
+#! /usr/bin/env python
+
+'''Tests for xor filters'''
+
+import os
+import random
+import string
+import tempfile
+import unittest
+import pyreBloom
+from redis import Redis
+from pyreBloom import pyreBloomException
+
+
+def sample_strings(length, count):
+    '''Return a set of sample strings'''
+    return [''.join(
+        random.sample(string.lowercase, length)) for i in range(count)]
+
+
+class BaseTest(unittest.TestCase):
+    CAPACITY = 10000
+    ERROR_RATE = 0.001
+    KEY = 'pyreXorTesting'
+
+    def setUp(self):
+        self.included = sample_strings(20, self.CAPACITY)
+        self.excluded = sample_strings(20, 10000)
+        self.bloom = pyreBloom.pyreXor(
+            self.KEY, self.included, self.ERROR_RATE)
+        self.path = tempfile.mktemp()
+
+    def tearDown(self):
+        self.bloom.delete()
+        if os.path.exists(self.path):
+            os.remove(self.path)
+
+    def assertAccurate(self, bloom, rate):
+        '''Every item is found, and few others are'''
+        self.assertEqual(self.included, bloom.contains(self.included))
+        false_rate = float(
+            len(bloom.contains(self.excluded))) / len(self.excluded)
+        self.assertLess(false_rate, rate)
+
+
+class XorTest(BaseTest):
+    def test_redis(self):
+        '''A filter stored in redis has all of its items'''
+        self.assertEqual(self.bloom.size, self.CAPACITY)
+        self.assertEqual(self.bloom.fingerprint_bits, 16)
+        self.assertTrue(self.included[0] in self.bloom)
+        self.assertAccurate(self.bloom, self.ERROR_RATE)
+
+    def test_open(self):
+        '''A filter in redis can be opened knowing only its key'''
+        bloom = pyreBloom.pyreXor(self.KEY)
+        self.assertEqual(bloom.size, self.bloom.size)
+        self.assertEqual(bloom.bits, self.bloom.bits)
+        self.assertEqual(bloom.keys(), ['pyreXorTesting.0'])
+        self.assertAccurate(bloom, self.ERROR_RATE)
+
+    def test_file(self):
+        '''A filter saved to a file can be loaded and checked locally'''
+        bloom = pyreBloom.pyreXor(items=self.included, path=self.path,
+            hash_family='xxh3')
+        self.assertEqual(bloom.keys(), [])
+        self.assertAccurate(bloom, self.ERROR_RATE)
+        loaded = pyreBloom.pyreXor(path=self.path)
+        self.assertEqual(loaded.hash_family, 'xxh3')
+        self.assertAccurate(loaded, self.ERROR_RATE)
+
+    def test_agreement(self):
+        '''Checks in redis and in memory give the same answers'''
+        self.bloom.save(self.path)
+        local = pyreBloom.pyreXor(path=self.path)
+        self.assertEqual(self.bloom.contains(self.excluded),
+            local.contains(self.excluded))
+
+    def test_size(self):
+        '''It takes fewer bits than a bloom filter with the same error'''
+        bloom = pyreBloom.pyreBloom(
+            'pyreXorTestingBloom', self.CAPACITY, self.bloom.error)
+        self.assertLess(self.bloom.bits, bloom.bits)
+        bloom.delete()
+
+    def test_error_rates(self):
+        '''Coarser error rates take smaller fingerprints'''
+        bloom = pyreBloom.pyreXor(items=self.included, error=0.01,
+            path=self.path)
+        self.assertEqual(bloom.fingerprint_bits, 8)
+        self.assertAccurate(bloom, 0.01)
+
+    def test_duplicates(self):
+        '''The same item may be given more than once'''
+        bloom = pyreBloom.pyreXor(items=self.included * 2, path=self.path)
+        self.assertEqual(bloom.size, self.CAPACITY)
+        self.assertAccurate(bloom, self.ERROR_RATE)
+
+    def test_threads(self):
+        '''The filter doesn't depend on how many threads built it'''
+        one = pyreBloom.pyreXor(items=self.included, threads=1, path=self.path)
+        many = pyreBloom.pyreXor(items=self.included, threads=4,
+            path=self.path)
+        self.assertEqual(one.contains(self.excluded),
+            many.contains(self.excluded))
+
+    def test_many_threads(self):
+        '''Asking for more threads than can be started still hashes every
+        item, on the calling thread if need be'''
+        included = ['%i' % i for i in range(1000000)]
+        bloom = pyreBloom.pyreXor(items=included, threads=1000000,
+            path=self.path)
+        self.assertEqual(included, bloom.contains(included))
+
+    def test_replace(self):
+        '''Storing at the same key again replaces the filter'''
+        bloom = pyreBloom.pyreXor(self.KEY, ['hello', 'how', 'are'])
+        self.assertEqual(['hello', 'how', 'are'],
+            bloom.contains(['hello', 'how', 'are', 'you']))
+        self.assertEqual(bloom.size, 3)
+        self.assertEqual(pyreBloom.pyreXor(self.KEY).size, 3)
+
+    def test_missing(self):
+        '''Opening a filter that was never stored is an error'''
+        self.assertRaises(pyreBloomException, pyreBloom.pyreXor,
+            'pyreXorTestingMissing')
+        self.assertRaises(pyreBloomException, pyreBloom.pyreXor,
+            path=self.path)
+
+    def test_wrong_type(self):
+        '''An xor filter can't replace another kind of filter'''
+        bloom = pyreBloom.pyreBloom('pyreXorTestingBloom', 100, 0.01)
+        bloom.add('hello')
+        self.assertRaises(pyreBloomException, pyreBloom.pyreXor,
+            'pyreXorTestingBloom', ['hello'])
+        self.assertRaises(pyreBloomException, pyreBloom.pyreXor,
+            'pyreXorTestingBloom')
+        bloom.delete()
+
+
+if __name__ == '__main__':
+    unittest.main()